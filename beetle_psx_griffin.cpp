@@ -3,11 +3,14 @@
 #include "mednafen/psx/timer.cpp"
 #include "mednafen/psx/frontio.cpp"
 #include "mednafen/psx/cpu.cpp"
+#include "mednafen/psx/cpu_jit.cpp"
 #include "mednafen/psx/gte.cpp"
 #include "mednafen/psx/dis.cpp"
 #include "mednafen/psx/cdc.cpp"
 #include "mednafen/psx/spu.cpp"
 #include "mednafen/psx/gpu.cpp"
+#include "mednafen/psx/gpu_thread.cpp"
+#include "mednafen/psx/gpu_texcache.cpp"
 #include "mednafen/psx/mdec.cpp"
 #include "mednafen/psx/input/gamepad.cpp"
 #include "mednafen/psx/input/dualanalog.cpp"
@@ -23,6 +26,8 @@
 #include "mednafen/settings.cpp"
 #include "mednafen/general.cpp"
 #include "mednafen/FileStream.cpp"
+#include "mednafen/MappedFileStream.cpp"
+#include "mednafen/PreloadStream.cpp"
 #include "mednafen/MemoryStream.cpp"
 #include "mednafen/Stream.cpp"
 #include "mednafen/state.cpp"
@@ -38,6 +43,8 @@
 #endif
 
 #include "mednafen/mempatcher.cpp"
+#include "mednafen/rewind.cpp"
+#include "mednafen/sound/PolyphaseResampler.cpp"
 #include "mednafen/video/Deinterlacer.cpp"
 #include "mednafen/video/surface.cpp"
 
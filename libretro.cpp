@@ -8,6 +8,7 @@
 #ifdef NEED_DEINTERLACER
 #include "mednafen/video/Deinterlacer.h"
 #endif
+#include "mednafen/sound/PolyphaseResampler.h"
 #include "libretro.h"
 #include <rthreads/rthreads.h>
 #include <retro_stat.h>
@@ -38,7 +39,25 @@ static unsigned image_offset = 0;
 static int psx_skipbios;
 
 bool psx_cpu_overclock;
+int psx_cpu_jit;
 bool psx_gte_subpixel_precision;
+static bool psx_gpu_render_thread;
+static bool psx_spu_block_render;
+static bool psx_mdec_decode_thread;
+static unsigned psx_gpu_raster_threads;
+static unsigned run_ahead_frames;
+static StateMem run_ahead_state;	// Kept between frames so it's only allocated once.
+static uint32_t rewind_buffer_size;	// From the core options, 0 when disabled or no buttons are set.
+static uint32_t rewind_buffer_size_cur;	// What the rewind code was last set up with.
+static uint32_t rewind_button_mask;	// RetroPad buttons on port 1 held together to rewind, 0 for none.
+static size_t serialize_size;		// Worked out once per game, resolution and set of input devices, 0 when unknown.
+static uint64 serialize_size_mc_dirty;	// Memory card write count serialize_size was worked out at.
+static uint32_t audio_output_rate = 44100;	// From the core option; 44100 is the SPU's own rate.
+static uint32_t audio_output_rate_cur;	// What the resampler was last set up with.
+static uint32_t audio_resamp_quality_cur;
+static PolyphaseResampler *resampler;	// NULL when not resampling.
+static int16_t (*resampled_sound_buf)[2];
+static uint32_t resampled_sound_buf_size;
 static bool is_pal;
 enum dither_mode psx_gpu_dither_mode;
 
@@ -207,6 +226,7 @@ static MultiAccessSizeMem<512 * 1024, uint32, false> *BIOSROM = NULL;
 static MultiAccessSizeMem<65536, uint32, false> *PIOMem = NULL;
 
 MultiAccessSizeMem<2048 * 1024, uint32, false> MainRAM;
+uint8 MainRAMDirty[(2048 * 1024) >> REWIND_PAGE_SHIFT];	// For the rewind code.
 
 static uint32_t TextMem_Start;
 static std::vector<uint8> TextMem;
@@ -256,104 +276,141 @@ void PSX_SetDMACycleSteal(unsigned stealage)
 
 static int32_t Running;	// Set to -1 when not desiring exit, and 0 when we are.
 
-struct event_list_entry
+//
+// There are only a handful of event types, so they live in flat arrays indexed by type, with
+// the earliest one cached; PSX_SetEventNT() only has to rescan when that event is pushed back,
+// which is a few compares over a single cache line.
+//
+// Events due at the same timestamp are dispatched in the same order the old sorted-list scheduler
+// used: an event moved earlier goes after the events already due at its new time, and an event
+// moved later goes before them.  "event_order" breaks ties to get that; it's renumbered in
+// RebaseTS() so it can't overflow.
+//
+static int32_t event_time[PSX_EVENT__COUNT];
+static int32_t event_order[PSX_EVENT__COUNT];
+static int32_t event_order_first, event_order_last;
+static unsigned event_next;		// Type of the earliest event.
+static int32_t event_next_ts;		// == event_time[event_next]
+
+// Per-event-type statistics, logged when the game is closed.
+static struct
 {
- uint32_t which;
- int32_t event_time;
- event_list_entry *prev;
- event_list_entry *next;
-};
+ uint64_t calls;		// Times the handler ran the subsystem's Update().
+ uint64_t reschedules;	// PSX_SetEventNT() calls, including those from within the subsystems.
+ uint64_t idle;		// Calls after which the subsystem had nothing left to schedule.
+ uint64_t distance;	// Sum of how far ahead the other calls rescheduled the event, in CPU cycles.
+} event_stats[PSX_EVENT__COUNT];
+
+static INLINE bool EventBefore(const unsigned a, const unsigned b)
+{
+   return event_time[a] < event_time[b] || (event_time[a] == event_time[b] && event_order[a] < event_order[b]);
+}
 
-static event_list_entry events[PSX_EVENT__COUNT];
+static INLINE void EventFindNext(void)
+{
+   unsigned i, next = PSX_EVENT__SYNFIRST + 1;
+
+   for(i = next + 1; i < PSX_EVENT__SYNLAST; i++)
+   {
+      if(EventBefore(i, next))
+         next = i;
+   }
+
+   event_next = next;
+   event_next_ts = event_time[next];
+}
 
 static void EventReset(void)
 {
    unsigned i;
-   for(i = 0; i < PSX_EVENT__COUNT; i++)
+   for(i = PSX_EVENT__SYNFIRST + 1; i < PSX_EVENT__SYNLAST; i++)
    {
-      events[i].which = i;
+      event_time[i] = PSX_EVENT_MAXTS;
+      event_order[i] = i;
+   }
 
-      if(i == PSX_EVENT__SYNFIRST)
-         events[i].event_time = 0;
-      else if(i == PSX_EVENT__SYNLAST)
-         events[i].event_time = 0x7FFFFFFF;
-      else
-         events[i].event_time = PSX_EVENT_MAXTS;
+   event_order_first = PSX_EVENT__SYNFIRST + 1;
+   event_order_last = PSX_EVENT__SYNLAST - 1;
 
-      events[i].prev = (i > 0) ? &events[i - 1] : NULL;
-      events[i].next = (i < (PSX_EVENT__COUNT - 1)) ? &events[i + 1] : NULL;
-   }
+   EventFindNext();
 }
 
-//static void RemoveEvent(event_list_entry *e)
-//{
-// e->prev->next = e->next;
-// e->next->prev = e->prev;
-//}
-
-static void RebaseTS(const int32_t timestamp)
+static void EventLogStats(void)
 {
    unsigned i;
-   for(i = 0; i < PSX_EVENT__COUNT; i++)
+   static const char *const names[PSX_EVENT__COUNT] = { NULL, "GPU", "CDC", "TIMER", "DMA", "FIO", NULL };
+
+   for(i = PSX_EVENT__SYNFIRST + 1; i < PSX_EVENT__SYNLAST; i++)
    {
-      if(i == PSX_EVENT__SYNFIRST || i == PSX_EVENT__SYNLAST)
+      if(!event_stats[i].calls)
          continue;
 
-      assert(events[i].event_time > timestamp);
-      events[i].event_time -= timestamp;
+      const uint64_t scheduled = event_stats[i].calls - event_stats[i].idle;
+
+      log_cb(RETRO_LOG_INFO, "[Mednafen]: Event %-5s: %llu calls (%llu idle), %llu reschedules, %llu cycles average distance.\n",
+            names[i], (unsigned long long)event_stats[i].calls, (unsigned long long)event_stats[i].idle,
+            (unsigned long long)event_stats[i].reschedules,
+            (unsigned long long)(scheduled ? event_stats[i].distance / scheduled : 0));
    }
 
-   CPU->SetEventNT(events[PSX_EVENT__SYNFIRST].next->event_time);
+   memset(event_stats, 0, sizeof(event_stats));
 }
 
-void PSX_SetEventNT(const int type, const int32_t next_timestamp)
+static void RebaseTS(const int32_t timestamp)
 {
-   event_list_entry *e = &events[type];
+   unsigned i, j;
+   int32_t rank[PSX_EVENT__COUNT] = { 0 };
+   for(i = PSX_EVENT__SYNFIRST + 1; i < PSX_EVENT__SYNLAST; i++)
+   {
+      assert(event_time[i] > timestamp);
+      event_time[i] -= timestamp;
+   }
 
-   if(next_timestamp < e->event_time)
+   // Renumber the tie-breakers, keeping their relative order.
+   for(i = PSX_EVENT__SYNFIRST + 1; i < PSX_EVENT__SYNLAST; i++)
    {
-      event_list_entry *fe = e;
+      rank[i] = PSX_EVENT__SYNFIRST + 1;
 
-      do
-      {
-         fe = fe->prev;
-      }while(next_timestamp < fe->event_time);
+      for(j = PSX_EVENT__SYNFIRST + 1; j < PSX_EVENT__SYNLAST; j++)
+         rank[i] += (event_order[j] < event_order[i]);
+   }
 
-      // Remove this event from the list, temporarily of course.
-      e->prev->next = e->next;
-      e->next->prev = e->prev;
+   memcpy(event_order, rank, sizeof(event_order));
 
-      // Insert into the list, just after "fe".
-      e->prev = fe;
-      e->next = fe->next;
-      fe->next->prev = e;
-      fe->next = e;
+   event_order_first = PSX_EVENT__SYNFIRST + 1;
+   event_order_last = PSX_EVENT__SYNLAST - 1;
 
-      e->event_time = next_timestamp;
-   }
-   else if(next_timestamp > e->event_time)
-   {
-      event_list_entry *fe = e;
+   EventFindNext();
 
-      do
-      {
-         fe = fe->next;
-      } while(next_timestamp > fe->event_time);
+   CPU->SetEventNT(event_next_ts);
+}
 
-      // Remove this event from the list, temporarily of course
-      e->prev->next = e->next;
-      e->next->prev = e->prev;
+void PSX_SetEventNT(const int type, const int32_t next_timestamp)
+{
+   event_stats[type].reschedules++;
 
-      // Insert into the list, just BEFORE "fe".
-      e->prev = fe->prev;
-      e->next = fe;
-      fe->prev->next = e;
-      fe->prev = e;
+   if(next_timestamp < event_time[type])
+   {
+      event_time[type] = next_timestamp;
+      event_order[type] = ++event_order_last;
 
-      e->event_time = next_timestamp;
+      if(type == (int)event_next || EventBefore(type, event_next))
+      {
+         event_next = type;
+         event_next_ts = next_timestamp;
+      }
    }
+   else if(next_timestamp > event_time[type])
+   {
+      event_time[type] = next_timestamp;
+      event_order[type] = --event_order_first;
 
-   CPU->SetEventNT(events[PSX_EVENT__SYNFIRST].next->event_time & Running);
+      // Any other event was already due after the earliest one.
+      if(type == (int)event_next)
+         EventFindNext();
+   }
+
+   CPU->SetEventNT(event_next_ts & Running);
 }
 
 // Called from debug.cpp too.
@@ -361,6 +418,7 @@ void ForceEventUpdates(const int32_t timestamp)
 {
    PSX_SetEventNT(PSX_EVENT_GPU, GPU->Update(timestamp));
    PSX_SetEventNT(PSX_EVENT_CDC, CDC->Update(timestamp));
+   SPU->RenderDeferred();
 
    PSX_SetEventNT(PSX_EVENT_TIMER, TIMER_Update(timestamp));
 
@@ -368,43 +426,48 @@ void ForceEventUpdates(const int32_t timestamp)
 
    PSX_SetEventNT(PSX_EVENT_FIO, FIO->Update(timestamp));
 
-   CPU->SetEventNT(events[PSX_EVENT__SYNFIRST].next->event_time);
+   CPU->SetEventNT(event_next_ts);
 }
 
 bool MDFN_FASTCALL PSX_EventHandler(const int32_t timestamp)
 {
-   event_list_entry *e = events[PSX_EVENT__SYNFIRST].next;
-
-   while(timestamp >= e->event_time)	// If Running = 0, PSX_EventHandler() may be called even if there isn't an event per-se, so while() instead of do { ... } while
+   while(timestamp >= event_next_ts)	// If Running = 0, PSX_EventHandler() may be called even if there isn't an event per-se, so while() instead of do { ... } while
    {
+      const unsigned which = event_next;
+      const int32_t event_ts = event_next_ts;
       int32_t nt;
-      event_list_entry *prev = e->prev;
 
-      switch(e->which)
+      switch(which)
       {
          default:
             abort();
          case PSX_EVENT_GPU:
-            nt = GPU->Update(e->event_time);
+            nt = GPU->Update(event_ts);
             break;
          case PSX_EVENT_CDC:
-            nt = CDC->Update(e->event_time);
+            nt = CDC->Update(event_ts);
             break;
          case PSX_EVENT_TIMER:
-            nt = TIMER_Update(e->event_time);
+            nt = TIMER_Update(event_ts);
             break;
          case PSX_EVENT_DMA:
-            nt = DMA_Update(e->event_time);
+            nt = DMA_Update(event_ts);
             break;
          case PSX_EVENT_FIO:
-            nt = FIO->Update(e->event_time);
+            nt = FIO->Update(event_ts);
             break;
       }
 
-      PSX_SetEventNT(e->which, nt);
+      event_stats[which].calls++;
 
-      // Order of events can change due to calling PSX_SetEventNT(), this prev business ensures we don't miss an event due to reordering.
-      e = prev->next;
+      // An idle subsystem parks its event at PSX_EVENT_MAXTS, which would swamp the average.
+      if(nt == PSX_EVENT_MAXTS)
+         event_stats[which].idle++;
+      else
+         event_stats[which].distance += nt - event_ts;
+
+      // Order of events can change due to calling PSX_SetEventNT(), so the next one is looked up again.
+      PSX_SetEventNT(which, nt);
    }
 
    return(Running);
@@ -452,6 +515,9 @@ template<typename T, bool IsWrite, bool Access24> static INLINE void MemRW(int32
             timestamp += 3;
       }
 
+      if(IsWrite)
+         MainRAMDirty[(A & 0x1FFFFF) >> REWIND_PAGE_SHIFT] = 1;
+
       if(Access24)
       {
          if(IsWrite)
@@ -483,7 +549,7 @@ template<typename T, bool IsWrite, bool Access24> static INLINE void MemRW(int32
       return;
    }
 
-   if(timestamp >= events[PSX_EVENT__SYNFIRST].next->event_time)
+   if(timestamp >= event_next_ts)
       PSX_EventHandler(timestamp);
 
    if(A >= 0x1F801000 && A <= 0x1F802FFF)
@@ -502,7 +568,7 @@ template<typename T, bool IsWrite, bool Access24> static INLINE void MemRW(int32
             {
                //timestamp += 15;
 
-               //if(timestamp >= events[PSX_EVENT__SYNFIRST].next->event_time)
+               //if(timestamp >= event_next_ts)
                // PSX_EventHandler(timestamp);
 
                SPU->Write(timestamp, A | 0, V);
@@ -512,7 +578,7 @@ template<typename T, bool IsWrite, bool Access24> static INLINE void MemRW(int32
             {
                timestamp += 36;
 
-               if(timestamp >= events[PSX_EVENT__SYNFIRST].next->event_time)
+               if(timestamp >= event_next_ts)
                   PSX_EventHandler(timestamp);
 
                V = SPU->Read(timestamp, A) | (SPU->Read(timestamp, A | 2) << 16);
@@ -524,7 +590,7 @@ template<typename T, bool IsWrite, bool Access24> static INLINE void MemRW(int32
             {
                //timestamp += 8;
 
-               //if(timestamp >= events[PSX_EVENT__SYNFIRST].next->event_time)
+               //if(timestamp >= event_next_ts)
                // PSX_EventHandler(timestamp);
 
                SPU->Write(timestamp, A & ~1, V);
@@ -533,7 +599,7 @@ template<typename T, bool IsWrite, bool Access24> static INLINE void MemRW(int32
             {
                timestamp += 16; // Just a guess, need to test.
 
-               if(timestamp >= events[PSX_EVENT__SYNFIRST].next->event_time)
+               if(timestamp >= event_next_ts)
                   PSX_EventHandler(timestamp);
 
                V = SPU->Read(timestamp, A & ~1);
@@ -954,6 +1020,7 @@ static void PSX_Power(void)
    PSX_PRNG.lcgo = 0xDEADBEEFCAFEBABEULL;
 
    memset(MainRAM.data32, 0, 2048 * 1024);
+   MDFN_RewindDirtyAll();
 
    for(i = 0; i < 9; i++)
       SysControl.Regs[i] = 0;
@@ -982,6 +1049,8 @@ template<typename T, bool Access24> static INLINE void MemPoke(pscpu_timestamp_t
 {
    if(A < 0x00800000)
    {
+      MainRAMDirty[(A & 0x1FFFFF) >> REWIND_PAGE_SHIFT] = 1;
+
       if(Access24)
          MainRAM.WriteU24(A & 0x1FFFFF, V);
       else
@@ -1368,6 +1437,10 @@ static void InitCommon(std::vector<CDIF *> *CDInterfaces, const bool EmulateMemc
    }
 
    GPU->EnableSubpixelVertexCache(psx_gte_subpixel_precision);
+   GPU->SetRasterThreads(rsx_intf_is_type() == RSX_SOFTWARE ? psx_gpu_raster_threads : 0);
+   GPU->SetRenderThread(psx_gpu_render_thread && rsx_intf_is_type() == RSX_SOFTWARE);
+   SPU->SetBlockRender(psx_spu_block_render);
+   MDEC_SetDecodeThread(psx_mdec_decode_thread);
 
    CD_TrayOpen        = true;
    CD_SelectedDisc    = -1;
@@ -1653,6 +1726,12 @@ static void Cleanup(void)
 {
    TextMem.resize(0);
 
+   MDFN_RewindKill();
+   rewind_buffer_size_cur = 0;
+
+   free(run_ahead_state.data);
+   memset(&run_ahead_state, 0, sizeof(run_ahead_state));
+
 
    if(CDC)
       delete CDC;
@@ -1674,6 +1753,7 @@ static void Cleanup(void)
       delete FIO;
    FIO = NULL;
 
+   MDEC_SetDecodeThread(false);
    DMA_Kill();
 
    if(BIOSROM)
@@ -1718,12 +1798,16 @@ static void CloseGame(void)
       }
    }
 
+   EventLogStats();
+
    Cleanup();
 }
 
 static void SetInput(int port, const char *type, void *ptr)
 {
    FIO->SetInput(port, type, ptr);
+   // The new device's state is a different size.
+   serialize_size = 0;
 }
 
 static int StateAction(StateMem *sm, int load, int data_only)
@@ -1739,7 +1823,7 @@ static int StateAction(StateMem *sm, int load, int data_only)
    {
       SFVAR(CD_TrayOpen),
       SFVAR(CD_SelectedDisc),
-      SFARRAY(MainRAM.data8, 1024 * 2048),
+      { MainRAM.data8, 1024 * 2048, MDFNSTATE_REWIND_TRACKED, "MainRAM.data8" },
       SFARRAY32(SysControl.Regs, 9),
       SFVAR(PSX_PRNG.lcgo),
       SFVAR(PSX_PRNG.x),
@@ -1750,6 +1834,10 @@ static int StateAction(StateMem *sm, int load, int data_only)
    };
 
 
+   // The SPU samples still due read the CDC's CD audio, so run them before its state is saved.
+   if(!load)
+      SPU->RenderDeferred();
+
    int ret = MDFNSS_StateAction(sm, load, data_only, StateRegs, "MAIN");
 
    // Call SetDisc() BEFORE we load CDC state, since SetDisc() has emulation side effects.  We might want to clean this up in the future.
@@ -1780,6 +1868,10 @@ static int StateAction(StateMem *sm, int load, int data_only)
 
    if(load)
    {
+      // Unless the rewind code is the one loading it, anything may have changed.
+      if(!sm->skip_rewind_tracked)
+         MDFN_RewindDirtyAll();
+
       ForceEventUpdates(0); // FIXME to work with debugger step mode.
    }
 
@@ -2490,7 +2582,15 @@ static void check_variables(bool startup)
    {
       bool cdimage_cache = true;
       if (strcmp(var.value, "enabled") == 0)
+      {
          cdimage_cache = true;
+         setting_cd_image_preload = 0;
+      }
+      else if (strcmp(var.value, "background") == 0)
+      {
+         cdimage_cache = true;
+         setting_cd_image_preload = 1;
+      }
       else if (strcmp(var.value, "disabled") == 0)
          cdimage_cache = false;
       if (cdimage_cache != old_cdimagecache)
@@ -2499,6 +2599,16 @@ static void check_variables(bool startup)
       }
    }
 
+   var.key = "beetle_psx_pbp_cache_size";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      setting_cd_pbp_cache_size = atoi(var.value) << 20;
+
+   var.key = "beetle_psx_cd_audio_cache_size";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      setting_cd_audio_cache_size = atoi(var.value) << 20;
+
    var.key = "beetle_psx_cpu_overclock";
    
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -2510,6 +2620,20 @@ static void check_variables(bool startup)
    }
    else
       psx_cpu_overclock = false;
+
+   var.key = "beetle_psx_cpu_dynarec";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "enabled") == 0)
+         psx_cpu_jit = PS_CPU_JIT_ENABLED;
+      else if (strcmp(var.value, "lockstep") == 0)
+         psx_cpu_jit = PS_CPU_JIT_LOCKSTEP;
+      else if (strcmp(var.value, "disabled") == 0)
+         psx_cpu_jit = PS_CPU_JIT_DISABLED;
+   }
+   else
+      psx_cpu_jit = PS_CPU_JIT_DISABLED;
    
    var.key = "beetle_psx_skipbios";
 
@@ -2595,6 +2719,54 @@ static void check_variables(bool startup)
    else
       psx_gte_subpixel_precision = false;
 
+   var.key = "beetle_psx_gpu_thread";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "enabled") == 0)
+         psx_gpu_render_thread = true;
+      else if (strcmp(var.value, "disabled") == 0)
+         psx_gpu_render_thread = false;
+   }
+   else
+      psx_gpu_render_thread = false;
+
+   var.key = "beetle_psx_spu_block_render";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "enabled") == 0)
+         psx_spu_block_render = true;
+      else if (strcmp(var.value, "disabled") == 0)
+         psx_spu_block_render = false;
+   }
+   else
+      psx_spu_block_render = true;
+
+   var.key = "beetle_psx_mdec_thread";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "enabled") == 0)
+         psx_mdec_decode_thread = true;
+      else if (strcmp(var.value, "disabled") == 0)
+         psx_mdec_decode_thread = false;
+   }
+   else
+      psx_mdec_decode_thread = false;
+
+   var.key = "beetle_psx_gpu_raster_threads";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         psx_gpu_raster_threads = 0;
+      else
+         psx_gpu_raster_threads = atoi(var.value);
+   }
+   else
+      psx_gpu_raster_threads = 0;
+
    var.key = "beetle_psx_analog_toggle";
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -2613,6 +2785,9 @@ static void check_variables(bool startup)
       }
    }
 
+   const bool old_multitap_port_1 = setting_psx_multitap_port_1;
+   const bool old_multitap_port_2 = setting_psx_multitap_port_2;
+
    var.key = "beetle_psx_enable_multitap_port1";
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -2661,6 +2836,10 @@ static void check_variables(bool startup)
       setting_last_scanline_pal = atoi(var.value);
    }
 
+   if (setting_psx_multitap_port_1 != old_multitap_port_1 ||
+         setting_psx_multitap_port_2 != old_multitap_port_2)
+      serialize_size = 0;
+
    if(setting_psx_multitap_port_1)
    {
       if(setting_psx_multitap_port_2)
@@ -2733,6 +2912,78 @@ static void check_variables(bool startup)
    else
       allow_frame_duping = false;
 
+   var.key = "beetle_psx_run_ahead";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         run_ahead_frames = 0;
+      else
+         run_ahead_frames = atoi(var.value);
+   }
+   else
+      run_ahead_frames = 0;
+
+   // The hardware renderers keep their own copy of VRAM, which loading a state doesn't roll back.
+   if (run_ahead_frames && rsx_intf_is_type() != RSX_SOFTWARE)
+   {
+      log_cb(RETRO_LOG_WARN, "Run-ahead needs the software renderer, disabling it.\n");
+      run_ahead_frames = 0;
+   }
+
+   var.key = "beetle_psx_rewind";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "disabled") == 0)
+         rewind_buffer_size = 0;
+      else
+         rewind_buffer_size = atoi(var.value) << 20;
+   }
+   else
+      rewind_buffer_size = 0;
+
+   var.key = "beetle_psx_rewind_button";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "select+l2") == 0)
+         rewind_button_mask = (1 << RETRO_DEVICE_ID_JOYPAD_SELECT) | (1 << RETRO_DEVICE_ID_JOYPAD_L2);
+      else if (strcmp(var.value, "select+r2") == 0)
+         rewind_button_mask = (1 << RETRO_DEVICE_ID_JOYPAD_SELECT) | (1 << RETRO_DEVICE_ID_JOYPAD_R2);
+      else if (strcmp(var.value, "l3+r3") == 0)
+         rewind_button_mask = (1 << RETRO_DEVICE_ID_JOYPAD_L3) | (1 << RETRO_DEVICE_ID_JOYPAD_R3);
+      else
+         rewind_button_mask = 0;
+   }
+   else
+      rewind_button_mask = 0;
+
+   // Without a way to rewind there's no point recording every frame.
+   if (!rewind_button_mask)
+      rewind_buffer_size = 0;
+
+   var.key = "beetle_psx_audio_output_rate";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      audio_output_rate = atoi(var.value);
+   else
+      audio_output_rate = 44100;
+
+   var.key = "beetle_psx_audio_resampler_quality";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (strcmp(var.value, "low") == 0)
+         setting_spu_resamp_quality = 0;
+      else if (strcmp(var.value, "medium") == 0)
+         setting_spu_resamp_quality = 4;
+      else if (strcmp(var.value, "high") == 0)
+         setting_spu_resamp_quality = 10;
+   }
+   else
+      setting_spu_resamp_quality = 4;
+
    var.key = "beetle_psx_display_internal_framerate";
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -2938,7 +3189,7 @@ static MDFNGI *MDFNI_LoadGame(const char *force_module, const char *name)
    MDFNFILE *GameFile;
 
 #ifdef NEED_CD
-	if(strlen(name) > 4 && (!strcasecmp(name + strlen(name) - 4, ".cue") || !strcasecmp(name + strlen(name) - 4, ".ccd") || !strcasecmp(name + strlen(name) - 4, ".toc") || !strcasecmp(name + strlen(name) - 4, ".m3u") || !strcasecmp(name + strlen(name) - 4, ".pbp")))
+	if(strlen(name) > 4 && (!strcasecmp(name + strlen(name) - 4, ".cue") || !strcasecmp(name + strlen(name) - 4, ".ccd") || !strcasecmp(name + strlen(name) - 4, ".toc") || !strcasecmp(name + strlen(name) - 4, ".m3u") || !strcasecmp(name + strlen(name) - 4, ".pbp") || !strcasecmp(name + strlen(name) - 4, ".chd")))
 	 return(MDFNI_LoadCD(force_module, name));
 #endif
 
@@ -2990,12 +3241,53 @@ union
 
 static uint16_t input_buf[MAX_PLAYERS] = {0};
 
+// Starts the rewind history over, with the current GPU's VRAM.
+static void setup_rewind(void)
+{
+   MDFN_RewindInit(rewind_buffer_size);
+   rewind_buffer_size_cur = rewind_buffer_size;
+
+   if (!MDFN_RewindEnabled())
+      return;
+
+   MDFN_RewindAddRegion(MainRAM.data8, 2048 * 1024, MainRAMDirty);
+   GPU->RewindAddRegions();
+   SPU->RewindAddRegions();
+}
+
+static void close_resampler(void)
+{
+   delete resampler;
+   resampler = NULL;
+   delete[] resampled_sound_buf;
+   resampled_sound_buf = NULL;
+   resampled_sound_buf_size = 0;
+}
+
+// Sets up converting the SPU's output from 44.1KHz to audio_output_rate, if that's another rate.
+static void setup_resampler(void)
+{
+   close_resampler();
+
+   audio_output_rate_cur = audio_output_rate;
+   audio_resamp_quality_cur = MDFN_GetSettingUI("psx.spu.resamp_quality");
+
+   if (audio_output_rate == 44100)
+      return;
+
+   resampler = new PolyphaseResampler(44100, audio_output_rate, audio_resamp_quality_cur);
+   resampled_sound_buf_size = resampler->MaxOutput(sizeof(IntermediateBuffer) / sizeof(IntermediateBuffer[0]));
+   resampled_sound_buf = new int16_t[resampled_sound_buf_size][2];
+}
+
 bool retro_load_game(const struct retro_game_info *info)
 {
    char tocbasepath[4096];
    if (failed_init)
       return false;
 
+   serialize_size = 0;
+
    struct retro_input_descriptor desc[] = {
       { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT,  "D-Pad Left" },
       { 0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP,    "D-Pad Up" },
@@ -3208,6 +3500,8 @@ bool retro_load_game(const struct retro_game_info *info)
    is_pal = (CalcDiscSCEx() == REGION_EU);
 
    alloc_surface();
+   setup_rewind();
+   setup_resampler();
 
 #ifdef NEED_DEINTERLACER
 	PrevInterlaced = false;
@@ -3254,6 +3548,8 @@ void retro_unload_game(void)
    CDInterfaces.clear();
 #endif
 
+   close_resampler();
+
    retro_cd_base_directory[0] = '\0';
    retro_cd_path[0]           = '\0';
    retro_cd_base_name[0]      = '\0';
@@ -3365,6 +3661,72 @@ static void update_input(void)
 static uint64_t video_frames, audio_frames;
 #define SOUND_CHANNELS 2
 
+static int16_t RunAheadSoundBuf[4096][2];
+
+// Takes the frame's sound from IntermediateBuffer, silenced if "silence", and returns where the
+// frontend gets it from: resampled to the output rate straight into resampled_sound_buf, else
+// IntermediateBuffer itself, or a copy of it in "keep" if that's about to be used again.
+static const int16_t *take_sound(int32_t *count, bool silence, int16_t (*keep)[2])
+{
+   if (silence)
+      memset(IntermediateBuffer, 0, *count * sizeof(IntermediateBuffer[0]));
+
+   if (resampler)
+   {
+      *count = resampler->Resample(IntermediateBuffer, *count, resampled_sound_buf, resampled_sound_buf_size);
+      return &resampled_sound_buf[0][0];
+   }
+
+   if (keep)
+   {
+      memcpy(keep, IntermediateBuffer, *count * sizeof(IntermediateBuffer[0]));
+      return &keep[0][0];
+   }
+
+   return &IntermediateBuffer[0][0];
+}
+
+// Runs the emulation for one frame.
+void Emulate(EmulateSpecStruct *espec)
+{
+   int32_t timestamp = 0;
+
+   MDFNGameInfo->mouse_sensitivity = MDFN_GetSettingF("psx.input.mouse_sensitivity");
+
+   MDFNMP_ApplyPeriodicCheats();
+
+
+   espec->MasterCycles = 0;
+   espec->SoundBufSize = 0;
+
+   FIO->UpdateInput();
+   GPU->StartFrame(espec);
+
+   Running = -1;
+   timestamp = CPU->Run(timestamp);
+
+   assert(timestamp);
+
+   ForceEventUpdates(timestamp);
+   if(GPU->GetScanlineNum() < 100)
+      PSX_DBG(PSX_DBG_ERROR, "[BUUUUUUUG] Frame timing end glitch; scanline=%u, st=%u\n", GPU->GetScanlineNum(), timestamp);
+
+   //printf("scanline=%u, st=%u\n", GPU->GetScanlineNum(), timestamp);
+
+   espec->SoundBufSize = IntermediateBufferPos;
+   IntermediateBufferPos = 0;
+
+   CDC->ResetTS();
+   TIMER_ResetTS();
+   DMA_ResetTS();
+   GPU->ResetTS();
+   FIO->ResetTS();
+
+   RebaseTS(timestamp);
+
+   espec->MasterCycles = timestamp;
+}
+
 void retro_run(void)
 {
    bool updated = false;
@@ -3373,6 +3735,9 @@ void retro_run(void)
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
    {
+      // Settings below are read by the render thread, restart it afterwards.
+      GPU->SetRenderThread(false);
+
       check_variables(false);
       struct retro_system_av_info new_av_info;
       retro_get_system_av_info(&new_av_info);
@@ -3392,6 +3757,8 @@ void retro_run(void)
 		  PS_GPU::Destroy(GPU);
 		  GPU = new_gpu;
 		  alloc_surface();
+		  serialize_size = 0;
+		  setup_rewind();
 		}
 	      else
 		{
@@ -3412,6 +3779,27 @@ void retro_run(void)
         }
 
       GPU->EnableSubpixelVertexCache(psx_gte_subpixel_precision);
+      GPU->SetRasterThreads(rsx_intf_is_type() == RSX_SOFTWARE ? psx_gpu_raster_threads : 0);
+      GPU->SetRenderThread(psx_gpu_render_thread && rsx_intf_is_type() == RSX_SOFTWARE);
+      SPU->SetBlockRender(psx_spu_block_render);
+      MDEC_SetDecodeThread(psx_mdec_decode_thread);
+
+      if (rewind_buffer_size != rewind_buffer_size_cur)
+         setup_rewind();
+
+      if (audio_output_rate != audio_output_rate_cur)
+      {
+         struct retro_system_av_info new_av_info;
+         retro_get_system_av_info(&new_av_info);
+
+         // Keep the old rate if the frontend can't take the new one now.
+         if (environ_cb(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &new_av_info))
+            setup_resampler();
+         else
+            audio_output_rate = audio_output_rate_cur;
+      }
+      else if (MDFN_GetSettingUI("psx.spu.resamp_quality") != audio_resamp_quality_cur)
+         setup_resampler();
    }
 
    if (display_internal_framerate)
@@ -3467,44 +3855,80 @@ void retro_run(void)
    spec.SoundFormatChanged = false;
 
    EmulateSpecStruct *espec = (EmulateSpecStruct*)&spec;
-   /* start of Emulate */
-   int32_t timestamp = 0;
-
-   espec->skip = false;
-   MDFNGameInfo->mouse_sensitivity = MDFN_GetSettingF("psx.input.mouse_sensitivity");
-
-   MDFNMP_ApplyPeriodicCheats();
-
-
-   espec->MasterCycles = 0;
-   espec->SoundBufSize = 0;
-
-   FIO->UpdateInput();
-   GPU->StartFrame(espec);
-
-   Running = -1;
-   timestamp = CPU->Run(timestamp);
+   int32_t timestamp;
+   const int16_t *sound_buf;
+   int32_t sound_buf_size;
+
+   // While the rewind buttons are held, go back a recorded frame and
+   // emulate it again for the picture, then drop it at the next one.
+   // Only the software renderer keeps VRAM where the rewind code can
+   // see it.
+   const bool can_rewind = MDFN_RewindEnabled() && rsx_intf_is_type() == RSX_SOFTWARE;
+   bool rewinding = can_rewind && rewind_button_mask;
+
+   for (unsigned id = 0; rewinding && id < 16; id++)
+   {
+      if ((rewind_button_mask & (1 << id)) && !input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, id))
+         rewinding = false;
+   }
 
-   assert(timestamp);
+   if (rewinding)
+   {
+      if (GPU->render_thread)
+         GPU->SyncRenderThread();
 
-   ForceEventUpdates(timestamp);
-   if(GPU->GetScanlineNum() < 100)
-      PSX_DBG(PSX_DBG_ERROR, "[BUUUUUUUG] Frame timing end glitch; scanline=%u, st=%u\n", GPU->GetScanlineNum(), timestamp);
+      MDFN_RewindPop();
+   }
 
-   //printf("scanline=%u, st=%u\n", GPU->GetScanlineNum(), timestamp);
+   if (run_ahead_frames && rsx_intf_is_type() == RSX_SOFTWARE)
+   {
+      // Emulate the frame for real and keep its sound, then look
+      // run_ahead_frames into the future with the same input for the
+      // picture, and go back.  Only the last of those frames is
+      // shown, unless a light gun needs to see every one.
+      const bool skip = !FIO->RequireNoFrameskip();
+      unsigned i;
+
+      espec->skip = skip;
+      Emulate(espec);
+
+      timestamp = espec->MasterCycles;
+      sound_buf_size = espec->SoundBufSize;
+      sound_buf = take_sound(&sound_buf_size, rewinding, RunAheadSoundBuf);
+
+      run_ahead_state.loc = 0;
+      run_ahead_state.len = 0;
+      if (!MDFNSS_SaveSM(&run_ahead_state, 0, 1, NULL, NULL, NULL))
+         log_cb(RETRO_LOG_ERROR, "Run-ahead snapshot failed.\n");
+      else
+      {
+         for (i = 0; i < run_ahead_frames; i++)
+         {
+            espec->skip = skip && (i + 1) < run_ahead_frames;
+            Emulate(espec);
+         }
 
-   espec->SoundBufSize = IntermediateBufferPos;
-   IntermediateBufferPos = 0;
+         run_ahead_state.loc = 0;
+         MDFNSS_LoadSM(&run_ahead_state, 0, 1);
+      }
+   }
+   else
+   {
+      espec->skip = false;
+      Emulate(espec);
 
-   CDC->ResetTS();
-   TIMER_ResetTS();
-   DMA_ResetTS();
-   GPU->ResetTS();
-   FIO->ResetTS();
+      timestamp = espec->MasterCycles;
+      sound_buf_size = espec->SoundBufSize;
+      sound_buf = take_sound(&sound_buf_size, rewinding, NULL);
+   }
 
-   RebaseTS(timestamp);
+   if (can_rewind && !rewinding)
+   {
+      if (GPU->render_thread)
+         GPU->SyncRenderThread();
 
-   espec->MasterCycles = timestamp;
+      MDFN_RewindPush();
+   }
 
    // Save memcards if dirty.
    for(int i = 0; i < players; i++)
@@ -3527,6 +3951,9 @@ void retro_run(void)
 
             log_cb(RETRO_LOG_INFO, "Saving memcard %d...\n", i);
 
+            // Saving clears the dirty count retro_serialize_size() goes by.
+            serialize_size = 0;
+
             if (i == 0 && !use_mednafen_memcard0_method)
             {
                FIO->SaveMemcard(i);
@@ -3643,15 +4070,13 @@ void retro_run(void)
          fb = pix;
    }
 
-   int16_t *interbuf = (int16_t*)&IntermediateBuffer;
-
    rsx_intf_finalize_frame(fb, width, height,
          MEDNAFEN_CORE_GEOMETRY_MAX_W << (2 + upscale_shift));
 
    video_frames++;
-   audio_frames += spec.SoundBufSize;
+   audio_frames += sound_buf_size;
 
-   audio_batch_cb(interbuf, spec.SoundBufSize);
+   audio_batch_cb(sound_buf, sound_buf_size);
 
    if (GPU->display_change_count != 0) {
      // For simplicity I assume that the game is using double
@@ -3677,6 +4102,7 @@ void retro_get_system_info(struct retro_system_info *info)
 void retro_get_system_av_info(struct retro_system_av_info *info)
 {
    rsx_intf_get_system_av_info(info);
+   info->timing.sample_rate = audio_output_rate;
 }
 
 void retro_deinit(void)
@@ -3687,7 +4113,7 @@ void retro_deinit(void)
    log_cb(RETRO_LOG_INFO, "[%s]: Samples / Frame: %.5f\n",
          MEDNAFEN_CORE_NAME, (double)audio_frames / video_frames);
    log_cb(RETRO_LOG_INFO, "[%s]: Estimated FPS: %.5f\n",
-         MEDNAFEN_CORE_NAME, (double)video_frames * 44100 / audio_frames);
+         MEDNAFEN_CORE_NAME, (double)video_frames * audio_output_rate / audio_frames);
 }
 
 unsigned retro_get_region(void)
@@ -3752,8 +4178,13 @@ void retro_set_environment(retro_environment_t cb)
 
    static const struct retro_variable vars[] = {
       { "beetle_psx_renderer", "Renderer (restart); " FIRST_RENDERER EXT_RENDERER },
-      { "beetle_psx_cdimagecache", "CD Image Cache (restart); disabled|enabled" },
+      { "beetle_psx_cdimagecache", "CD Image Cache (restart); disabled|enabled|background" },
+      { "beetle_psx_pbp_cache_size", "PBP block cache (restart); 8MB|16MB|32MB|64MB|128MB" },
+      { "beetle_psx_cd_audio_cache_size", "CD audio decode cache (restart); 8MB|16MB|32MB|64MB|disabled" },
       { "beetle_psx_cpu_overclock", "CPU Overclock; disabled|enabled" },
+#ifdef PS_CPU_JIT
+      { "beetle_psx_cpu_dynarec", "CPU Dynarec; disabled|enabled|lockstep" },
+#endif
       { "beetle_psx_skipbios", "Skip BIOS; disabled|enabled" },
       { "beetle_psx_widescreen_hack", "Widescreen mode hack; disabled|enabled" },
       { "beetle_psx_internal_resolution", "Internal GPU resolution; 1x(native)|2x|4x|8x" },
@@ -3763,6 +4194,10 @@ void retro_set_environment(retro_environment_t cb)
       { "beetle_psx_wireframe", "Wireframe mode; disabled|enabled" },
       { "beetle_psx_dither_mode", "Dithering pattern; 1x(native)|internal resolution|disabled" },
       { "beetle_psx_gte_subpixel", "GTE pixel accuracy; 1x(native)|subpixel" },
+      { "beetle_psx_gpu_thread", "Software renderer thread; disabled|enabled" },
+      { "beetle_psx_gpu_raster_threads", "Software rasterizer threads; disabled|2|4|8|16" },
+      { "beetle_psx_spu_block_render", "SPU block rendering; enabled|disabled" },
+      { "beetle_psx_mdec_thread", "MDEC decoding thread; disabled|enabled" },
       { "beetle_psx_use_mednafen_memcard0_method", "Memcard 0 method; libretro|mednafen" },
       { "beetle_psx_shared_memory_cards", "Shared memcards (restart); disabled|enabled" },
       { "beetle_psx_initial_scanline", "Initial scanline; 0|1|2|3|4|5|6|7|8|9|10|10|11|12|13|14|15|16|17|18|19|20|21|22|23|24|25|26|27|28|29|30|31|32|33|34|35|36|37|38|39|40" },
@@ -3773,6 +4208,11 @@ void retro_set_environment(retro_environment_t cb)
       { "beetle_psx_enable_multitap_port1", "Port 1: Multitap enable; disabled|enabled" },
       { "beetle_psx_enable_multitap_port2", "Port 2: Multitap enable; disabled|enabled" },
       { "beetle_psx_frame_duping_enable", "Frame duping (speedup); disabled|enabled" },
+      { "beetle_psx_run_ahead", "Run-ahead frames (software renderer only, reduces input lag); disabled|1|2|3|4" },
+      { "beetle_psx_rewind", "Rewind buffer (software renderer only); disabled|16MB|32MB|64MB|128MB|256MB" },
+      { "beetle_psx_rewind_button", "Rewind buttons (hold, player 1); disabled|select+l2|select+r2|l3+r3" },
+      { "beetle_psx_audio_output_rate", "Audio output rate; 44100|48000|96000|32000|22050" },
+      { "beetle_psx_audio_resampler_quality", "Audio resampler quality; medium|low|high" },
       { "beetle_psx_display_internal_framerate", "Display internal FPS; disabled|enabled" },
       { "beetle_psx_image_offset", "Offset Cropped Image; disabled|1 px|2 px|3 px|4 px|-4 px|-3 px|-2 px|-1 px" },
       { NULL, NULL },
@@ -3829,42 +4269,68 @@ void retro_set_video_refresh(retro_video_refresh_t cb)
    rsx_intf_set_video_refresh(cb);
 }
 
-static size_t serialize_size;
+// Memory card contents only go into the state once the card has been written
+// to, and every write bumps the card's dirty count.
+static uint64 MemcardDirtyCount(void)
+{
+   uint64 count = 0;
+
+   if (!FIO)
+      return 0;
+
+   for (unsigned i = 0; i < 8; i++)
+   {
+      InputDevice *mc = FIO->GetMemcardDevice(i);
+
+      if (mc)
+         count += mc->GetNVDirtyCount();
+   }
+
+   return count;
+}
 
 size_t retro_serialize_size(void)
 {
    StateMem st;
+   uint64 mc_dirty = MemcardDirtyCount();
+
+   if (serialize_size && serialize_size_mc_dirty == mc_dirty)
+      return serialize_size;
+
+   // Nothing is stored, this only counts how much room the state takes.
    memset(&st, 0, sizeof(st));
+   st.fixed = true;
 
-   if (!MDFNSS_SaveSM(&st, 0, 0, NULL, NULL, NULL))
-   {
-      return 0;
-   }
+   MDFNSS_SaveSM(&st, 0, 0, NULL, NULL, NULL);
 
-   free(st.data);
+   serialize_size_mc_dirty = mc_dirty;
    return serialize_size = st.len;
 }
 
 bool retro_serialize(void *data, size_t size)
 {
-   /* it seems that mednafen can realloc pointers sent to it?
-      since we don't know the disposition of void* data (is it safe to realloc?) we have to manage a new buffer here */
    StateMem st;
    memset(&st, 0, sizeof(st));
-   st.data     = (uint8_t*)malloc(size);
+   st.data     = (uint8_t*)data;
    st.malloced = size;
+   st.fixed    = true;
 
    bool ret = MDFNSS_SaveSM(&st, 0, 0, NULL, NULL, NULL);
 
-   /* there are still some errors with the save states, the size seems to change on some games for now just log when this happens */
-   if (st.len != size)
-      log_cb(RETRO_LOG_WARN, "warning, save state size has changed\n");
+   if (st.len > size)
+   {
+      // The state grew, e.g. once a memory card is first written to, the
+      // frontend has to ask for the size again.
+      log_cb(RETRO_LOG_WARN, "Save state needs %u bytes, only %u available.\n", st.len, (unsigned)size);
+      serialize_size = 0;
+      return false;
+   }
 
-   memcpy(data,st.data,size);
-   free(st.data);
-return ret;
+   memset((uint8_t*)data + st.len, 0, size - st.len);
 
+   return ret;
 }
+
 bool retro_unserialize(const void *data, size_t size)
 {
    StateMem st;
@@ -0,0 +1,197 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mednafen.h"
+#include "Stream.h"
+#include "FileStream.h"
+#include "MappedFileStream.h"
+
+#include <string.h>
+#include <algorithm>
+#include <memmap.h>
+
+#if defined(HAVE_MMAN) && !defined(_WIN32)
+#define MAPPED_FILE_STREAM_SUPPORTED
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+enum
+{
+   // How far ahead of sequential reads to have the OS read the file.
+   MAPPED_READAHEAD = 1024 * 1024
+};
+
+MappedFileStream::MappedFileStream(const char *path) : data(NULL), data_size(0), position(0), advised_start(0), advised_end(0)
+{
+#ifdef MAPPED_FILE_STREAM_SUPPORTED
+   struct stat stat_buf;
+   int fd = open(path, O_RDONLY);
+
+   if(fd == -1)
+   {
+      ErrnoHolder ene(errno);
+
+      throw(MDFN_Error(ene.Errno(), "Error opening file:\n%s\n%s", path, ene.StrError()));
+   }
+
+   if(fstat(fd, &stat_buf) == -1 || stat_buf.st_size <= 0 || (uint64_t)stat_buf.st_size > SIZE_MAX)
+   {
+      ::close(fd);
+      throw(MDFN_Error(0, "Can't map file:\n%s", path));
+   }
+
+   data_size = stat_buf.st_size;
+   data = (uint8_t *)mmap(NULL, (size_t)data_size, PROT_READ, MAP_SHARED, fd, 0);
+
+   // The mapping keeps the file open.
+   ::close(fd);
+
+   if(data == MAP_FAILED)
+   {
+      ErrnoHolder ene(errno);
+
+      data = NULL;
+      throw(MDFN_Error(ene.Errno(), "Error mapping file:\n%s\n%s", path, ene.StrError()));
+   }
+#else
+   throw(MDFN_Error(0, "Can't map file:\n%s", path));
+#endif
+}
+
+MappedFileStream::~MappedFileStream()
+{
+   close();
+}
+
+uint64_t MappedFileStream::attributes(void)
+{
+   return(ATTRIBUTE_READABLE | ATTRIBUTE_SEEKABLE);
+}
+
+uint8_t *MappedFileStream::map(void)
+{
+   return(data);
+}
+
+// Hints that the data from offset on is about to be read, a window at a time.
+void MappedFileStream::advise(uint64_t offset)
+{
+#if defined(MAPPED_FILE_STREAM_SUPPORTED) && defined(MADV_WILLNEED)
+   static long page_size = 0;
+   uint64_t start, end;
+
+   if(offset >= advised_start && offset + (MAPPED_READAHEAD / 2) <= advised_end)
+      return;
+
+   if(!page_size)
+      page_size = sysconf(_SC_PAGESIZE);
+
+   // Only the part that wasn't hinted already, when reading on sequentially.
+   start = (offset >= advised_start && offset < advised_end) ? advised_end : offset;
+   start &= ~(uint64_t)(page_size - 1);
+   end = std::min<uint64_t>(offset + MAPPED_READAHEAD, data_size);
+
+   if(end > start)
+      madvise(data + start, (size_t)(end - start), MADV_WILLNEED);
+
+   advised_start = offset;
+   advised_end = end;
+#endif
+}
+
+uint64_t MappedFileStream::read(void *buf, uint64_t count, bool error_on_eos)
+{
+   if(position >= data_size)
+      return 0;
+
+   if(count > data_size - position)
+      count = data_size - position;
+
+   advise(position);
+
+   memcpy(buf, data + position, (size_t)count);
+   position += count;
+
+   return count;
+}
+
+void MappedFileStream::write(const void *buf, uint64_t count)
+{
+   throw(MDFN_Error(ErrnoHolder(EBADF)));
+}
+
+void MappedFileStream::seek(int64_t offset, int whence)
+{
+   int64_t new_position;
+
+   switch(whence)
+   {
+      case SEEK_CUR:
+         new_position = position + offset;
+         break;
+
+      case SEEK_END:
+         new_position = data_size + offset;
+         break;
+
+      case SEEK_SET:
+      default:
+         new_position = offset;
+         break;
+   }
+
+   if(new_position < 0)
+      throw(MDFN_Error(ErrnoHolder(EINVAL)));
+
+   position = new_position;
+}
+
+int64_t MappedFileStream::tell(void)
+{
+   return position;
+}
+
+int64_t MappedFileStream::size(void)
+{
+   return data_size;
+}
+
+void MappedFileStream::close(void)
+{
+#ifdef MAPPED_FILE_STREAM_SUPPORTED
+   if(data)
+      munmap(data, (size_t)data_size);
+#endif
+   data = NULL;
+   data_size = 0;
+   position = 0;
+}
+
+Stream *MDFN_OpenMappedFileStream(const char *path)
+{
+   try
+   {
+      return new MappedFileStream(path);
+   }
+   catch(std::exception &e)
+   {
+      return new FileStream(path, MODE_READ);
+   }
+}
@@ -0,0 +1,62 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MDFN_MAPPEDFILESTREAM_H
+#define __MDFN_MAPPEDFILESTREAM_H
+
+#include "Stream.h"
+
+// Read-only file stream over a memory mapping of the whole file, so that
+// reads are a copy out of the page cache(shared with anything else that
+// has the file open) instead of a system call each.  Sequential reads
+// ask the OS to bring in the data ahead of them.
+//
+// The constructor throws if the file can't be mapped, including on
+// platforms without mmap(), in which case use a FileStream instead.
+class MappedFileStream : public Stream
+{
+   public:
+      MappedFileStream(const char *path);
+      virtual ~MappedFileStream();
+
+      virtual uint64_t attributes(void);
+
+      virtual uint8_t *map(void);
+
+      virtual uint64_t read(void *data, uint64_t count, bool error_on_eos = true);
+      virtual void write(const void *data, uint64_t count);
+      virtual void seek(int64_t offset, int whence);
+      virtual int64_t tell(void);
+      virtual int64_t size(void);
+      virtual void close(void);
+
+   private:
+      void advise(uint64_t offset);
+
+      uint8_t *data;
+      uint64_t data_size;
+      uint64_t position;
+
+      // Range last hinted as about to be read.
+      uint64_t advised_start;
+      uint64_t advised_end;
+};
+
+// Maps the file if possible, otherwise opens it as a FileStream.
+Stream *MDFN_OpenMappedFileStream(const char *path);
+
+#endif
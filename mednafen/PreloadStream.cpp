@@ -0,0 +1,282 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mednafen.h"
+#include "Stream.h"
+#include "FileStream.h"
+#include "PreloadStream.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "../libretro.h"
+
+extern retro_log_printf_t log_cb;
+
+enum
+{
+   PRELOAD_CHUNK_SHIFT = 18,	// 256KiB, about 110 sectors.
+   PRELOAD_CHUNK_SIZE = 1 << PRELOAD_CHUNK_SHIFT,
+
+   PRELOAD_NO_CHUNK = ~0U
+};
+
+PreloadStream::PreloadStream(const char *path) : path(path), file(NULL), data(NULL), data_size(0), position(0),
+   chunk_loaded(NULL), chunk_count(0), chunks_left(0), wanted_chunk(PRELOAD_NO_CHUNK), stop(false), failed(false),
+   complete(false), waited_chunks(0), lock(NULL), cond(NULL), thread(NULL)
+{
+   file = new FileStream(path, MODE_READ);
+
+   try
+   {
+      data_size = file->size();
+
+      if(data_size > SIZE_MAX || (data_size >> PRELOAD_CHUNK_SHIFT) >= PRELOAD_NO_CHUNK)
+         throw MDFN_Error(0, "File too large to load into memory:\n%s", path);
+
+      chunk_count = (data_size + PRELOAD_CHUNK_SIZE - 1) >> PRELOAD_CHUNK_SHIFT;
+      chunks_left = chunk_count;
+
+      if(!(data = (uint8_t *)malloc(std::max<size_t>((size_t)data_size, 1))))
+         throw MDFN_Error(ErrnoHolder(errno));
+
+      if(!(chunk_loaded = (uint8_t *)calloc(std::max<uint32_t>(chunk_count, 1), 1)))
+         throw MDFN_Error(ErrnoHolder(errno));
+   }
+   catch(...)
+   {
+      free(chunk_loaded);
+      free(data);
+      delete file;
+      throw;
+   }
+
+   lock = slock_new();
+   cond = scond_new();
+   thread = sthread_create(LoadThread, this);
+}
+
+PreloadStream::~PreloadStream()
+{
+   close();
+}
+
+void PreloadStream::LoadThread(void *arg)
+{
+   ((PreloadStream *)arg)->Load();
+}
+
+void PreloadStream::Load(void)
+{
+   uint32_t next_chunk = 0;
+
+   slock_lock(lock);
+
+   while(!stop && chunks_left)
+   {
+      uint32_t chunk = (wanted_chunk != PRELOAD_NO_CHUNK) ? wanted_chunk : next_chunk;
+
+      // On from there to the first one not loaded yet, around to the start of the file if
+      // the rest is.
+      while(chunk_loaded[chunk])
+         chunk = (chunk + 1) % chunk_count;
+
+      slock_unlock(lock);
+
+      const uint64_t offset = (uint64_t)chunk << PRELOAD_CHUNK_SHIFT;
+      const uint64_t count = std::min<uint64_t>(PRELOAD_CHUNK_SIZE, data_size - offset);
+      std::string error;
+
+      try
+      {
+         file->seek(offset, SEEK_SET);
+
+         // FileStream doesn't throw on a short read, the file may have shrunk since it was opened.
+         if(file->read(data + offset, count) != count)
+            error = "Unexpected end of file.";
+      }
+      catch(std::exception &e)
+      {
+         error = e.what();
+      }
+
+      slock_lock(lock);
+
+      if(!error.empty())
+      {
+         failed = true;
+         error_message = error;
+         scond_broadcast(cond);
+         break;
+      }
+
+      chunk_loaded[chunk] = 1;
+      chunks_left--;
+
+      if(wanted_chunk == chunk)
+         wanted_chunk = PRELOAD_NO_CHUNK;
+
+      next_chunk = (chunk + 1) % chunk_count;
+
+      scond_broadcast(cond);
+   }
+
+   slock_unlock(lock);
+
+   file->close();
+}
+
+void PreloadStream::WaitForRange(uint64_t start, uint64_t end)
+{
+   const uint32_t first_chunk = start >> PRELOAD_CHUNK_SHIFT;
+   const uint32_t last_chunk = (end - 1) >> PRELOAD_CHUNK_SHIFT;
+
+   slock_lock(lock);
+
+   for(uint32_t chunk = first_chunk; chunk <= last_chunk; chunk++)
+   {
+      if(chunk_loaded[chunk])
+         continue;
+
+      waited_chunks++;
+
+      while(!chunk_loaded[chunk] && !failed)
+      {
+         wanted_chunk = chunk;
+         scond_wait(cond, lock);
+      }
+
+      if(failed)
+      {
+         const std::string error = error_message;
+
+         slock_unlock(lock);
+         throw MDFN_Error(0, "Error loading file:\n%s\n%s", path.c_str(), error.c_str());
+      }
+   }
+
+   complete = !chunks_left;
+
+   slock_unlock(lock);
+}
+
+uint64_t PreloadStream::attributes(void)
+{
+   return(ATTRIBUTE_READABLE | ATTRIBUTE_SEEKABLE);
+}
+
+uint64_t PreloadStream::read(void *buf, uint64_t count, bool error_on_eos)
+{
+   if(position >= data_size)
+      return 0;
+
+   if(count > data_size - position)
+      count = data_size - position;
+
+   if(!count)
+      return 0;
+
+   if(!complete)
+      WaitForRange(position, position + count);
+
+   memcpy(buf, data + position, (size_t)count);
+   position += count;
+
+   return count;
+}
+
+void PreloadStream::write(const void *buf, uint64_t count)
+{
+   throw(MDFN_Error(ErrnoHolder(EBADF)));
+}
+
+void PreloadStream::seek(int64_t offset, int whence)
+{
+   int64_t new_position;
+
+   switch(whence)
+   {
+      case SEEK_CUR:
+         new_position = position + offset;
+         break;
+
+      case SEEK_END:
+         new_position = data_size + offset;
+         break;
+
+      case SEEK_SET:
+      default:
+         new_position = offset;
+         break;
+   }
+
+   if(new_position < 0)
+      throw(MDFN_Error(ErrnoHolder(EINVAL)));
+
+   position = new_position;
+}
+
+int64_t PreloadStream::tell(void)
+{
+   return position;
+}
+
+int64_t PreloadStream::size(void)
+{
+   return data_size;
+}
+
+void PreloadStream::close(void)
+{
+   if(thread)
+   {
+      slock_lock(lock);
+      stop = true;
+      slock_unlock(lock);
+
+      sthread_join(thread);
+      thread = NULL;
+
+      log_cb(RETRO_LOG_INFO, "[Mednafen]: Preloaded %u of %u chunks of \"%s\", %u needed before they were loaded.\n",
+            chunk_count - chunks_left, chunk_count, path.c_str(), waited_chunks);
+   }
+
+   if(cond)
+   {
+      scond_free(cond);
+      cond = NULL;
+   }
+
+   if(lock)
+   {
+      slock_free(lock);
+      lock = NULL;
+   }
+
+   if(file)
+   {
+      delete file;
+      file = NULL;
+   }
+
+   free(chunk_loaded);
+   chunk_loaded = NULL;
+   free(data);
+   data = NULL;
+   data_size = 0;
+   position = 0;
+}
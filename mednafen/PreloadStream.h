@@ -0,0 +1,78 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MDFN_PRELOADSTREAM_H
+#define __MDFN_PRELOADSTREAM_H
+
+#include <string>
+
+#include <rthreads/rthreads.h>
+
+#include "Stream.h"
+
+class FileStream;
+
+// Read-only stream over a copy of the whole file in memory, like a MemoryStream
+// of a FileStream, except that the constructor returns right away and the copy
+// is filled in by a thread, from the start of the file on.  A read of a part
+// that isn't loaded yet waits for it, the thread loading that part next and
+// then carrying on from there.
+class PreloadStream : public Stream
+{
+   public:
+      PreloadStream(const char *path);
+      virtual ~PreloadStream();
+
+      virtual uint64_t attributes(void);
+
+      virtual uint64_t read(void *data, uint64_t count, bool error_on_eos = true);
+      virtual void write(const void *data, uint64_t count);
+      virtual void seek(int64_t offset, int whence);
+      virtual int64_t tell(void);
+      virtual int64_t size(void);
+      virtual void close(void);
+
+   private:
+      static void LoadThread(void *arg);
+      void Load(void);
+      void WaitForRange(uint64_t start, uint64_t end);
+
+      std::string path;
+      FileStream *file;	// Only used by the thread.
+
+      uint8_t *data;
+      uint64_t data_size;
+      uint64_t position;
+
+      // Protected by lock.
+      uint8_t *chunk_loaded;
+      uint32_t chunk_count;
+      uint32_t chunks_left;
+      uint32_t wanted_chunk;	// Needed by a read, load it next.
+      bool stop;
+      bool failed;
+      std::string error_message;
+
+      bool complete;	// Everything loaded; only used by readers, so reads don't need the lock anymore.
+      uint32_t waited_chunks;
+
+      slock_t *lock;
+      scond_t *cond;
+      sthread_t *thread;
+};
+
+#endif
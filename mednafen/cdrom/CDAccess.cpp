@@ -24,11 +24,16 @@
 #endif
 
 #include "../mednafen.h"
+#include "../FileStream.h"
+#include "../MemoryStream.h"
+#include "../MappedFileStream.h"
+#include "../PreloadStream.h"
 
 #include "CDAccess.h"
 #include "CDAccess_Image.h"
 #include "CDAccess_CCD.h"
 #include "CDAccess_PBP.h"
+#include "CDAccess_CHD.h"
 
 CDAccess::CDAccess()
 {
@@ -48,8 +53,21 @@ CDAccess *cdaccess_open_image(const char *path, bool image_memcache)
   ret = new CDAccess_CCD(path, image_memcache);
  else if(strlen(path) >= 4 && !strcasecmp(path + strlen(path) - 4, ".pbp"))
   ret = new CDAccess_PBP(path, image_memcache);
+ else if(strlen(path) >= 4 && !strcasecmp(path + strlen(path) - 4, ".chd"))
+  ret = new CDAccess_CHD(path, image_memcache);
  else
   ret = new CDAccess_Image(path, image_memcache);
 
  return ret;
 }
+
+Stream *cdaccess_open_stream(const char *path, bool image_memcache)
+{
+ if(!image_memcache)
+  return MDFN_OpenMappedFileStream(path);
+
+ if(MDFN_GetSettingB("cdrom.image_preload"))
+  return new PreloadStream(path);
+
+ return new MemoryStream(new FileStream(path, MODE_READ));
+}
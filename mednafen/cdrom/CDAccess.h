@@ -7,6 +7,8 @@
 #include "CDUtility.h"
 #include "misc.h"
 
+class Stream;
+
 class CDAccess
 {
  public:
@@ -27,4 +29,8 @@ class CDAccess
 
 CDAccess *cdaccess_open_image(const char *path, bool image_memcache);
 
+// Opens a file of a disc image: mapped, or copied into memory when image_memcache is set,
+// in the background if the "cdrom.image_preload" setting is.
+Stream *cdaccess_open_stream(const char *path, bool image_memcache);
+
 #endif
@@ -240,12 +240,8 @@ void CDAccess_CCD::Load(const char *path, bool image_memcache)
    /* Open image stream. */
    {
       std::string image_path = MDFN_EvalFIP(dir_path, file_base + std::string(".") + std::string(img_extsd), true);
-      FileStream *str        = new FileStream(image_path.c_str(), MODE_READ);
 
-      if(image_memcache)
-         img_stream = new MemoryStream(str);
-      else
-         img_stream = str;
+      img_stream = cdaccess_open_stream(image_path.c_str(), image_memcache);
 
       int64 ss = img_stream->size();
 
@@ -0,0 +1,1847 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+	Only what chdman createcd produces is handled: version 5 files with CD track metadata,
+	hunks a whole number of 2448 byte frames(2352 bytes of sector data followed by 96 of
+	subcode), and each track padded to a multiple of 4 frames.
+
+	The codecs chdman createcd uses by default("cdlz", "cdzl" and "cdfl") are supported, as are
+	"lzma" and "zlib" for whole hunks.  Images with hunks compressed any other way(e.g. "cdzs")
+	are refused when opened; chdman can recompress them with "-c cdlz,cdzl,cdfl".
+*/
+
+#include <retro_stat.h>
+
+#include "../mednafen.h"
+
+#include <sys/types.h>
+
+#include <string.h>
+#include <errno.h>
+
+#include "../general.h"
+#include "../FileStream.h"
+
+#include "CDAccess.h"
+#include "CDAccess_CHD.h"
+#include "CDUtility.h"
+
+#include "../../libretro.h"
+
+#include "zlib.h"
+
+extern retro_log_printf_t log_cb;
+
+enum
+{
+   CDRF_SUBM_NONE = 0,
+   CDRF_SUBM_RW = 1,
+   CDRF_SUBM_RW_RAW = 2
+};
+
+// Disk-image(rip) track/sector formats
+enum
+{
+   DI_FORMAT_AUDIO       = 0x00,
+   DI_FORMAT_MODE1       = 0x01,
+   DI_FORMAT_MODE1_RAW   = 0x02,
+   DI_FORMAT_MODE2       = 0x03,
+   DI_FORMAT_MODE2_FORM1 = 0x04,
+   DI_FORMAT_MODE2_FORM2 = 0x05,
+   DI_FORMAT_MODE2_RAW   = 0x06,
+   _DI_FORMAT_COUNT
+};
+
+static const struct
+{
+   const char *name;
+   uint32_t format;
+} CHD_TrackTypes[] =
+{
+   { "AUDIO",          DI_FORMAT_AUDIO },
+   { "MODE1",          DI_FORMAT_MODE1 },
+   { "MODE1/2048",     DI_FORMAT_MODE1 },
+   { "MODE1_RAW",      DI_FORMAT_MODE1_RAW },
+   { "MODE1/2352",     DI_FORMAT_MODE1_RAW },
+   { "MODE2",          DI_FORMAT_MODE2 },
+   { "MODE2/2336",     DI_FORMAT_MODE2 },
+   { "MODE2_FORM_MIX", DI_FORMAT_MODE2 },
+   { "MODE2_FORM1",    DI_FORMAT_MODE2_FORM1 },
+   { "MODE2/2048",     DI_FORMAT_MODE2_FORM1 },
+   { "MODE2_FORM2",    DI_FORMAT_MODE2_FORM2 },
+   { "MODE2/2324",     DI_FORMAT_MODE2_FORM2 },
+   { "MODE2_RAW",      DI_FORMAT_MODE2_RAW },
+   { "MODE2/2352",     DI_FORMAT_MODE2_RAW },
+};
+
+#define CHD_MAKE_TAG(a, b, c, d)	(((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+enum
+{
+   CHD_V5_HEADER_SIZE = 124,
+
+   CHD_CODEC_ZLIB = CHD_MAKE_TAG('z', 'l', 'i', 'b'),
+   CHD_CODEC_LZMA = CHD_MAKE_TAG('l', 'z', 'm', 'a'),
+   CHD_CODEC_CDZL = CHD_MAKE_TAG('c', 'd', 'z', 'l'),
+   CHD_CODEC_CDLZ = CHD_MAKE_TAG('c', 'd', 'l', 'z'),
+   CHD_CODEC_CDFL = CHD_MAKE_TAG('c', 'd', 'f', 'l'),
+
+   CHD_META_TRACK = CHD_MAKE_TAG('C', 'H', 'T', 'R'),
+   CHD_META_TRACK2 = CHD_MAKE_TAG('C', 'H', 'T', '2'),
+   CHD_META_GDROM = CHD_MAKE_TAG('C', 'H', 'G', 'D'),
+
+   CHD_FRAME_SIZE = 2352 + 96,
+   CHD_TRACK_PADDING = 4
+};
+
+// Hunk types in the map.
+enum
+{
+   CHD_HUNK_CODEC_0 = 0,	// Through 3, compressed with compressors[type].
+   CHD_HUNK_NONE = 4,
+   CHD_HUNK_SELF = 5,	// Same as the hunk numbered "offset".
+   CHD_HUNK_PARENT = 6,
+
+   // Only in the compressed map.
+   CHD_HUNK_RLE_SMALL = 7,
+   CHD_HUNK_RLE_LARGE = 8,
+   CHD_HUNK_SELF_0 = 9,
+   CHD_HUNK_SELF_1 = 10,
+   CHD_HUNK_PARENT_SELF = 11,
+   CHD_HUNK_PARENT_0 = 12,
+   CHD_HUNK_PARENT_1 = 13
+};
+
+static const uint8_t CHD_SyncHeader[12] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+
+static uint16_t CHD_CRC16Table[256];
+
+static void CHD_InitCRC16(void)
+{
+   for(unsigned i = 0; i < 256; i++)
+   {
+      uint16_t crc = i << 8;
+
+      for(unsigned b = 0; b < 8; b++)
+         crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+
+      CHD_CRC16Table[i] = crc;
+   }
+}
+
+static uint16_t CHD_CRC16(const uint8_t *data, uint32_t len)
+{
+   uint16_t crc = 0xFFFF;
+
+   while(len--)
+      crc = (crc << 8) ^ CHD_CRC16Table[(crc >> 8) ^ *data++];
+
+   return crc;
+}
+
+static INLINE uint64_t CHD_GetBE(const uint8_t *p, unsigned bytes)
+{
+   uint64_t ret = 0;
+
+   while(bytes--)
+      ret = (ret << 8) | *p++;
+
+   return ret;
+}
+
+static INLINE void CHD_PutBE(uint8_t *p, uint64_t v, unsigned bytes)
+{
+   while(bytes--)
+   {
+      p[bytes] = (uint8_t)v;
+      v >>= 8;
+   }
+}
+
+// MSB-first bit reader for the compressed hunk map; reads past the end give zeros.
+struct CHD_BitReader
+{
+   const uint8_t *data;
+   uint32_t len;
+   uint32_t pos;
+
+   uint32_t Peek(unsigned bits) const
+   {
+      uint32_t ret = 0;
+
+      for(unsigned i = 0; i < bits; i++)
+      {
+         const uint32_t bp = pos + i;
+         const uint8_t byte = ((bp >> 3) < len) ? data[bp >> 3] : 0;
+
+         ret = (ret << 1) | ((byte >> (7 - (bp & 7))) & 1);
+      }
+
+      return ret;
+   }
+
+   uint32_t Read(unsigned bits)
+   {
+      const uint32_t ret = Peek(bits);
+
+      pos += bits;
+
+      return ret;
+   }
+
+   bool Overflowed(void) const
+   {
+      return pos > len * 8;
+   }
+};
+
+// The Huffman code the hunk types of the compressed map are coded with: 16 symbols, codes up
+// to 8 bits, and the code lengths stored run-length encoded in front of the data.
+class CHD_MapHuffman
+{
+   public:
+
+      bool ImportTree(CHD_BitReader *br)
+      {
+         uint8_t numbits[NUM_CODES];
+         uint32_t bithisto[33];
+         uint32_t curstart = 0;
+         unsigned node = 0;
+
+         while(node < NUM_CODES)
+         {
+            uint32_t nb = br->Read(4);
+
+            if(nb != 1)
+               numbits[node++] = nb;
+            else
+            {
+               nb = br->Read(4);
+
+               if(nb == 1)
+                  numbits[node++] = nb;
+               else
+               {
+                  uint32_t repcount = br->Read(4) + 3;
+
+                  if(node + repcount > NUM_CODES)
+                     return false;
+
+                  while(repcount--)
+                     numbits[node++] = nb;
+               }
+            }
+         }
+
+         // Canonical codes, the longest ones first.
+         memset(bithisto, 0, sizeof(bithisto));
+
+         for(node = 0; node < NUM_CODES; node++)
+         {
+            if(numbits[node] > MAX_BITS)
+               return false;
+
+            bithisto[numbits[node]]++;
+         }
+
+         for(int codelen = 32; codelen > 0; codelen--)
+         {
+            const uint32_t nextstart = (curstart + bithisto[codelen]) >> 1;
+
+            if(codelen != 1 && nextstart * 2 != (curstart + bithisto[codelen]))
+               return false;
+
+            bithisto[codelen] = curstart;
+            curstart = nextstart;
+         }
+
+         memset(lookup, 0, sizeof(lookup));
+
+         for(node = 0; node < NUM_CODES; node++)
+         {
+            if(numbits[node])
+            {
+               const uint32_t code = bithisto[numbits[node]]++;
+               const unsigned shift = MAX_BITS - numbits[node];
+
+               for(uint32_t i = code << shift; i < ((code + 1) << shift); i++)
+                  lookup[i] = (node << 4) | numbits[node];
+            }
+         }
+
+         return true;
+      }
+
+      unsigned Decode(CHD_BitReader *br) const
+      {
+         const uint16_t l = lookup[br->Peek(MAX_BITS)];
+
+         br->pos += l & 0xF;
+
+         return l >> 4;
+      }
+
+   private:
+      enum { NUM_CODES = 16, MAX_BITS = 8 };
+
+      uint16_t lookup[1 << MAX_BITS];
+};
+
+// Raw LZMA as the "lzma" and "cdlz" codecs store it: no header, no end marker, and always the
+// properties chdman's encoder uses(lc=3, lp=0, pb=2).  A hunk is decoded in one go, so the
+// output buffer doubles as the dictionary.
+class CHD_LZMADecoder
+{
+   public:
+
+      bool Decode(const uint8_t *src, uint32_t src_len, uint8_t *dest, uint32_t dest_len);
+
+   private:
+      enum
+      {
+         LC = 3,
+         LP = 0,
+         PB = 2,
+
+         NUM_STATES = 12,
+         NUM_POS_STATES = 1 << PB,
+         NUM_LEN_TO_POS_STATES = 4,
+         END_POS_MODEL_INDEX = 14,
+         NUM_FULL_DISTANCES = 1 << (END_POS_MODEL_INDEX >> 1),
+         NUM_ALIGN_BITS = 4,
+         MATCH_MIN_LEN = 2
+      };
+
+      struct LenProbs
+      {
+         uint16_t choice;
+         uint16_t choice2;
+         uint16_t low[NUM_POS_STATES][1 << 3];
+         uint16_t mid[NUM_POS_STATES][1 << 3];
+         uint16_t high[1 << 8];
+      };
+
+      // Kept together so they can all be reset at once.
+      struct
+      {
+         uint16_t literal[0x300 << (LC + LP)];
+         uint16_t is_match[NUM_STATES][NUM_POS_STATES];
+         uint16_t is_rep[NUM_STATES];
+         uint16_t is_rep_g0[NUM_STATES];
+         uint16_t is_rep_g1[NUM_STATES];
+         uint16_t is_rep_g2[NUM_STATES];
+         uint16_t is_rep0_long[NUM_STATES][NUM_POS_STATES];
+         uint16_t pos_slot[NUM_LEN_TO_POS_STATES][1 << 6];
+         uint16_t pos_special[1 + NUM_FULL_DISTANCES - END_POS_MODEL_INDEX];
+         uint16_t align[1 << NUM_ALIGN_BITS];
+         LenProbs len;
+         LenProbs rep_len;
+      } probs;
+
+      const uint8_t *in;
+      const uint8_t *in_end;
+      uint32_t range;
+      uint32_t code;
+      bool overrun;
+
+      INLINE void Normalize(void)
+      {
+         if(range < (1U << 24))
+         {
+            range <<= 8;
+            code <<= 8;
+
+            if(in < in_end)
+               code |= *in++;
+            else
+               overrun = true;
+         }
+      }
+
+      INLINE unsigned DecodeBit(uint16_t *prob)
+      {
+         const uint32_t bound = (range >> 11) * *prob;
+         unsigned ret;
+
+         if(code < bound)
+         {
+            *prob += ((1 << 11) - *prob) >> 5;
+            range = bound;
+            ret = 0;
+         }
+         else
+         {
+            *prob -= *prob >> 5;
+            code -= bound;
+            range -= bound;
+            ret = 1;
+         }
+
+         Normalize();
+
+         return ret;
+      }
+
+      uint32_t DecodeDirectBits(unsigned bits)
+      {
+         uint32_t ret = 0;
+
+         while(bits--)
+         {
+            range >>= 1;
+            code -= range;
+
+            const uint32_t mask = 0 - (code >> 31);
+
+            code += range & mask;
+            Normalize();
+            ret = (ret << 1) + (mask + 1);
+         }
+
+         return ret;
+      }
+
+      uint32_t DecodeTree(uint16_t *p, unsigned bits)
+      {
+         uint32_t m = 1;
+
+         for(unsigned i = 0; i < bits; i++)
+            m = (m << 1) + DecodeBit(&p[m]);
+
+         return m - (1 << bits);
+      }
+
+      uint32_t DecodeReverseTree(uint16_t *p, unsigned bits)
+      {
+         uint32_t m = 1;
+         uint32_t ret = 0;
+
+         for(unsigned i = 0; i < bits; i++)
+         {
+            const unsigned bit = DecodeBit(&p[m]);
+
+            m = (m << 1) + bit;
+            ret |= bit << i;
+         }
+
+         return ret;
+      }
+
+      uint32_t DecodeLen(LenProbs *lp, unsigned pos_state)
+      {
+         if(!DecodeBit(&lp->choice))
+            return DecodeTree(lp->low[pos_state], 3);
+
+         if(!DecodeBit(&lp->choice2))
+            return 8 + DecodeTree(lp->mid[pos_state], 3);
+
+         return 16 + DecodeTree(lp->high, 8);
+      }
+};
+
+bool CHD_LZMADecoder::Decode(const uint8_t *src, uint32_t src_len, uint8_t *dest, uint32_t dest_len)
+{
+   uint16_t *p = (uint16_t *)&probs;
+   uint32_t rep0 = 0, rep1 = 0, rep2 = 0, rep3 = 0;
+   unsigned state = 0;
+   uint32_t pos = 0;
+
+   for(size_t i = 0; i < sizeof(probs) / sizeof(uint16_t); i++)
+      p[i] = 1 << 10;
+
+   if(src_len < 5 || src[0] != 0)
+      return false;
+
+   in = src + 5;
+   in_end = src + src_len;
+   range = 0xFFFFFFFF;
+   code = CHD_GetBE(src + 1, 4);
+   overrun = false;
+
+   while(pos < dest_len)
+   {
+      const unsigned pos_state = pos & (NUM_POS_STATES - 1);
+      uint32_t len;
+
+      if(!DecodeBit(&probs.is_match[state][pos_state]))
+      {
+         const unsigned prev = pos ? dest[pos - 1] : 0;
+         uint16_t *lp = &probs.literal[0x300 * (((pos & ((1 << LP) - 1)) << LC) + (prev >> (8 - LC)))];
+         unsigned symbol = 1;
+
+         // After a match the literal is coded relative to the byte the match would have continued with.
+         if(state >= 7)
+         {
+            unsigned match_byte = dest[pos - rep0 - 1];
+
+            do
+            {
+               const unsigned match_bit = (match_byte >> 7) & 1;
+               const unsigned bit = DecodeBit(&lp[((1 + match_bit) << 8) + symbol]);
+
+               match_byte <<= 1;
+               symbol = (symbol << 1) | bit;
+
+               if(bit != match_bit)
+                  break;
+            } while(symbol < 0x100);
+         }
+
+         while(symbol < 0x100)
+            symbol = (symbol << 1) | DecodeBit(&lp[symbol]);
+
+         dest[pos++] = symbol - 0x100;
+         state = (state < 4) ? 0 : ((state < 10) ? (state - 3) : (state - 6));
+         continue;
+      }
+
+      if(DecodeBit(&probs.is_rep[state]))
+      {
+         if(!pos)
+            return false;
+
+         if(!DecodeBit(&probs.is_rep_g0[state]))
+         {
+            if(!DecodeBit(&probs.is_rep0_long[state][pos_state]))
+            {
+               // A single byte from the last distance.
+               state = (state < 7) ? 9 : 11;
+               dest[pos] = dest[pos - rep0 - 1];
+               pos++;
+               continue;
+            }
+         }
+         else
+         {
+            uint32_t dist;
+
+            if(!DecodeBit(&probs.is_rep_g1[state]))
+               dist = rep1;
+            else
+            {
+               if(!DecodeBit(&probs.is_rep_g2[state]))
+                  dist = rep2;
+               else
+               {
+                  dist = rep3;
+                  rep3 = rep2;
+               }
+               rep2 = rep1;
+            }
+            rep1 = rep0;
+            rep0 = dist;
+         }
+
+         len = DecodeLen(&probs.rep_len, pos_state);
+         state = (state < 7) ? 8 : 11;
+      }
+      else
+      {
+         unsigned pos_slot;
+
+         rep3 = rep2;
+         rep2 = rep1;
+         rep1 = rep0;
+
+         len = DecodeLen(&probs.len, pos_state);
+         state = (state < 7) ? 7 : 10;
+
+         pos_slot = DecodeTree(probs.pos_slot[(len < NUM_LEN_TO_POS_STATES) ? len : (NUM_LEN_TO_POS_STATES - 1)], 6);
+
+         if(pos_slot < 4)
+            rep0 = pos_slot;
+         else
+         {
+            const unsigned direct_bits = (pos_slot >> 1) - 1;
+
+            rep0 = (2 | (pos_slot & 1)) << direct_bits;
+
+            if(pos_slot < END_POS_MODEL_INDEX)
+               rep0 += DecodeReverseTree(probs.pos_special + rep0 - pos_slot, direct_bits);
+            else
+            {
+               rep0 += DecodeDirectBits(direct_bits - NUM_ALIGN_BITS) << NUM_ALIGN_BITS;
+               rep0 += DecodeReverseTree(probs.align, NUM_ALIGN_BITS);
+            }
+         }
+
+         // Also catches an end marker, which chdman doesn't write.
+         if(rep0 >= pos)
+            return false;
+      }
+
+      len += MATCH_MIN_LEN;
+
+      if(len > (dest_len - pos))
+         return false;
+
+      for(; len; len--, pos++)
+         dest[pos] = dest[pos - rep0 - 1];
+   }
+
+   return !overrun;
+}
+
+// MSB-first bit reader for FLAC frames, reads past the end give zeros.
+struct CHD_FLACBitReader
+{
+   const uint8_t *data;
+   uint32_t len;
+   uint32_t pos;
+
+   INLINE uint32_t Peek32(void) const
+   {
+      const uint32_t bp = pos >> 3;
+      uint64_t w = 0;
+
+      if((bp + 5) <= len)
+         w = CHD_GetBE(data + bp, 5);
+      else
+      {
+         for(uint32_t i = bp; i < bp + 5; i++)
+            w = (w << 8) | ((i < len) ? data[i] : 0);
+      }
+
+      return (uint32_t)(w >> (8 - (pos & 7)));
+   }
+
+   INLINE uint32_t Read(unsigned bits)
+   {
+      const uint32_t ret = bits ? (Peek32() >> (32 - bits)) : 0;
+
+      pos += bits;
+
+      return ret;
+   }
+
+   INLINE int32_t ReadSigned(unsigned bits)
+   {
+      if(!bits)
+         return 0;
+
+      return (int32_t)(Read(bits) << (32 - bits)) >> (32 - bits);
+   }
+
+   // The number of 0 bits before the next 1 bit.
+   INLINE uint32_t ReadUnary(void)
+   {
+      uint32_t ret = 0;
+
+      for(;;)
+      {
+         const uint32_t w = Peek32();
+
+         if(w)
+         {
+            const unsigned zeros = MDFN_lzcount32(w);
+
+            pos += zeros + 1;
+
+            return ret + zeros;
+         }
+
+         pos += 32;
+         ret += 32;
+
+         if(Overflowed())
+            return ret;
+      }
+   }
+
+   INLINE int32_t ReadRice(unsigned param)
+   {
+      const uint32_t v = (ReadUnary() << param) | Read(param);
+
+      return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+   }
+
+   bool Overflowed(void) const
+   {
+      return pos > len * 8;
+   }
+};
+
+// The FLAC frames of a "cdfl" hunk, which code the sector data as 16-bit stereo with the samples
+// stored big-endian.  chdman leaves out the stream header, so all that's known comes from the
+// frames; the CRCs in them aren't checked, the hunk's own CRC covers the data.
+class CHD_FLACDecoder
+{
+   public:
+
+      // Returns how many bytes of src the frames took up, 0 if they're corrupt.
+      uint32_t Decode(const uint8_t *src, uint32_t src_len, uint8_t *dest, uint32_t samples);
+
+   private:
+      enum
+      {
+         CHAN_INDEPENDENT_2 = 1,
+         CHAN_LEFT_SIDE = 8,
+         CHAN_RIGHT_SIDE = 9,
+         CHAN_MID_SIDE = 10
+      };
+
+      std::vector<int32_t> block;
+
+      bool DecodeSubframe(CHD_FLACBitReader *br, int32_t *out, uint32_t blocksize, unsigned bps);
+      bool DecodeResidual(CHD_FLACBitReader *br, int32_t *out, uint32_t blocksize, unsigned order);
+};
+
+bool CHD_FLACDecoder::DecodeResidual(CHD_FLACBitReader *br, int32_t *out, uint32_t blocksize, unsigned order)
+{
+   const unsigned method = br->Read(2);
+   const unsigned param_bits = method ? 5 : 4;
+   const unsigned escape = (1 << param_bits) - 1;
+   const unsigned partition_order = br->Read(4);
+   const uint32_t partition_size = blocksize >> partition_order;
+   uint32_t i = order;
+
+   if(method > 1 || (partition_size << partition_order) != blocksize || partition_size < order)
+      return false;
+
+   for(uint32_t p = 0; p < (1U << partition_order); p++)
+   {
+      const uint32_t end = (p + 1) * partition_size;
+      const unsigned param = br->Read(param_bits);
+
+      if(param == escape)
+      {
+         const unsigned bits = br->Read(5);
+
+         for(; i < end; i++)
+            out[i] = br->ReadSigned(bits);
+      }
+      else
+      {
+         for(; i < end; i++)
+            out[i] = br->ReadRice(param);
+      }
+
+      if(br->Overflowed())
+         return false;
+   }
+
+   return true;
+}
+
+bool CHD_FLACDecoder::DecodeSubframe(CHD_FLACBitReader *br, int32_t *out, uint32_t blocksize, unsigned bps)
+{
+   unsigned type, wasted = 0;
+
+   if(br->Read(1))
+      return false;
+
+   type = br->Read(6);
+
+   if(br->Read(1))
+   {
+      wasted = br->ReadUnary() + 1;
+
+      if(wasted >= bps)
+         return false;
+
+      bps -= wasted;
+   }
+
+   if(type == 0)
+   {
+      const int32_t v = br->ReadSigned(bps);
+
+      for(uint32_t i = 0; i < blocksize; i++)
+         out[i] = v;
+   }
+   else if(type == 1)
+   {
+      for(uint32_t i = 0; i < blocksize; i++)
+         out[i] = br->ReadSigned(bps);
+   }
+   else if((type >= 8 && type <= 12) || type >= 32)
+   {
+      // The fixed predictors are just LPC with set coefficients.
+      static const int32_t fixed_coefs[5][4] =
+      {
+         { 0 },
+         { 1 },
+         { 2, -1 },
+         { 3, -3, 1 },
+         { 4, -6, 4, -1 }
+      };
+      const unsigned order = (type >= 32) ? (type - 31) : (type - 8);
+      int32_t coefs[32];
+      int shift = 0;
+
+      if(order > blocksize)
+         return false;
+
+      for(unsigned i = 0; i < order; i++)
+         out[i] = br->ReadSigned(bps);
+
+      if(type >= 32)
+      {
+         const unsigned precision = br->Read(4) + 1;
+
+         shift = br->ReadSigned(5);
+
+         if(precision == 16 || shift < 0)
+            return false;
+
+         for(unsigned i = 0; i < order; i++)
+            coefs[i] = br->ReadSigned(precision);
+      }
+      else
+         memcpy(coefs, fixed_coefs[order], sizeof(fixed_coefs[order]));
+
+      if(!DecodeResidual(br, out, blocksize, order))
+         return false;
+
+      for(uint32_t i = order; i < blocksize; i++)
+      {
+         int64_t sum = 0;
+
+         for(unsigned j = 0; j < order; j++)
+            sum += (int64_t)coefs[j] * out[i - j - 1];
+
+         out[i] = (int32_t)(out[i] + (sum >> shift));
+      }
+   }
+   else
+      return false;
+
+   if(wasted)
+   {
+      for(uint32_t i = 0; i < blocksize; i++)
+         out[i] = (int32_t)((uint32_t)out[i] << wasted);
+   }
+
+   return true;
+}
+
+uint32_t CHD_FLACDecoder::Decode(const uint8_t *src, uint32_t src_len, uint8_t *dest, uint32_t samples)
+{
+   CHD_FLACBitReader br;
+   uint32_t done = 0;
+
+   br.data = src;
+   br.len = src_len;
+   br.pos = 0;
+
+   while(done < samples)
+   {
+      uint32_t blocksize, first;
+      unsigned blocksize_code, rate_code, chan, sample_size_code;
+      int32_t *c0, *c1;
+
+      // Sync code, then a reserved 0 bit.
+      if(br.Read(15) != 0x7FFC)
+         return 0;
+
+      br.Read(1);	// Blocking strategy.
+      blocksize_code = br.Read(4);
+      rate_code = br.Read(4);
+      chan = br.Read(4);
+      sample_size_code = br.Read(3);
+
+      if(br.Read(1) || blocksize_code == 0 || rate_code == 15)
+         return 0;
+
+      if((sample_size_code != 0 && sample_size_code != 4) || (chan != CHAN_INDEPENDENT_2 && (chan < CHAN_LEFT_SIDE || chan > CHAN_MID_SIDE)))
+         return 0;
+
+      // Frame or sample number, UTF-8 style.
+      first = br.Read(8);
+
+      if(first & 0x80)
+      {
+         unsigned extra = MDFN_lzcount32(~(first << 24)) - 1;
+
+         if(extra == 0 || extra > 6)
+            return 0;
+
+         while(extra--)
+         {
+            if((br.Read(8) & 0xC0) != 0x80)
+               return 0;
+         }
+      }
+
+      if(blocksize_code == 1)
+         blocksize = 192;
+      else if(blocksize_code <= 5)
+         blocksize = 576 << (blocksize_code - 2);
+      else if(blocksize_code == 6)
+         blocksize = br.Read(8) + 1;
+      else if(blocksize_code == 7)
+         blocksize = br.Read(16) + 1;
+      else
+         blocksize = 256 << (blocksize_code - 8);
+
+      if(rate_code == 12)
+         br.Read(8);
+      else if(rate_code == 13 || rate_code == 14)
+         br.Read(16);
+
+      br.Read(8);	// CRC-8
+
+      if(blocksize > (samples - done))
+         return 0;
+
+      if(block.size() < blocksize * 2)
+         block.resize(blocksize * 2);
+
+      c0 = &block[0];
+      c1 = &block[blocksize];
+
+      // The side channel needs a bit more.
+      if(!DecodeSubframe(&br, c0, blocksize, 16 + (chan == CHAN_RIGHT_SIDE)) ||
+         !DecodeSubframe(&br, c1, blocksize, 16 + (chan == CHAN_LEFT_SIDE || chan == CHAN_MID_SIDE)))
+         return 0;
+
+      for(uint32_t i = 0; i < blocksize; i++)
+      {
+         int64_t l = c0[i];
+         int64_t r = c1[i];
+
+         if(chan == CHAN_LEFT_SIDE)
+            r = l - r;
+         else if(chan == CHAN_RIGHT_SIDE)
+            l += r;
+         else if(chan == CHAN_MID_SIDE)
+         {
+            const int64_t mid = (l * 2) | (r & 1);
+
+            l = (mid + r) >> 1;
+            r = (mid - r) >> 1;
+         }
+
+         CHD_PutBE(dest + 0, (uint16_t)l, 2);
+         CHD_PutBE(dest + 2, (uint16_t)r, 2);
+         dest += 4;
+      }
+
+      // Padded to a byte, then the CRC-16.
+      br.pos = ((br.pos + 7) & ~7) + 16;
+
+      if(br.Overflowed())
+         return 0;
+
+      done += blocksize;
+   }
+
+   return br.pos >> 3;
+}
+
+void CDAccess_CHD::ReadHunkMap(uint64_t map_offset, uint32_t unit_bytes)
+{
+   const int64 file_size = fp->size();
+
+   hunk_map.resize(hunk_count);
+
+   if(!compressors[0])
+   {
+      // Uncompressed file, the map is just the hunk numbers in the file, 0 for a hunk of zeros.
+      std::vector<uint8_t> raw(hunk_count * 4);
+
+      fp->seek(map_offset, SEEK_SET);
+      fp->read(&raw[0], raw.size());
+
+      for(uint32_t hunk = 0; hunk < hunk_count; hunk++)
+      {
+         HunkMapEntry *e = &hunk_map[hunk];
+
+         e->type = CHD_HUNK_NONE;
+         e->length = hunk_bytes;
+         e->offset = CHD_GetBE(&raw[hunk * 4], 4) * hunk_bytes;
+         e->crc = 0;
+      }
+
+      map_has_crc = false;
+   }
+   else
+   {
+      uint8_t header[16];
+      std::vector<uint8_t> compressed;
+      std::vector<uint8_t> raw(hunk_count * 12);
+      CHD_BitReader br;
+      CHD_MapHuffman huff;
+      uint64_t cur_offset, last_self = 0, last_parent = 0;
+      unsigned length_bits, self_bits, parent_bits;
+      uint32_t repcount = 0;
+      uint8_t last_type = 0;
+
+      fp->seek(map_offset, SEEK_SET);
+      fp->read(header, sizeof(header));
+
+      compressed.resize(CHD_GetBE(header + 0, 4) + 1);
+      cur_offset = CHD_GetBE(header + 4, 6);
+      length_bits = header[12];
+      self_bits = header[13];
+      parent_bits = header[14];
+
+      fp->read(&compressed[0], compressed.size() - 1);
+
+      br.data = &compressed[0];
+      br.len = compressed.size() - 1;
+      br.pos = 0;
+
+      if(!huff.ImportTree(&br))
+         throw(MDFN_Error(0, _("CHD hunk map is corrupt.")));
+
+      // First the hunk types, with runs of the same type coded as repeats...
+      for(uint32_t hunk = 0; hunk < hunk_count; hunk++)
+      {
+         if(repcount > 0)
+         {
+            raw[hunk * 12] = last_type;
+            repcount--;
+            continue;
+         }
+
+         const unsigned type = huff.Decode(&br);
+
+         if(type == CHD_HUNK_RLE_SMALL)
+         {
+            raw[hunk * 12] = last_type;
+            repcount = 2 + huff.Decode(&br);
+         }
+         else if(type == CHD_HUNK_RLE_LARGE)
+         {
+            raw[hunk * 12] = last_type;
+            repcount = 2 + 16 + (huff.Decode(&br) << 4);
+            repcount += huff.Decode(&br);
+         }
+         else
+            raw[hunk * 12] = last_type = type;
+      }
+
+      // ...then what each type needs, in the uncompressed map's layout so the CRC can be checked.
+      for(uint32_t hunk = 0; hunk < hunk_count; hunk++)
+      {
+         uint8_t *rm = &raw[hunk * 12];
+         uint64_t offset = cur_offset;
+         uint32_t length = 0;
+         uint16_t crc = 0;
+
+         switch(rm[0])
+         {
+            case CHD_HUNK_CODEC_0 + 0:
+            case CHD_HUNK_CODEC_0 + 1:
+            case CHD_HUNK_CODEC_0 + 2:
+            case CHD_HUNK_CODEC_0 + 3:
+               length = br.Read(length_bits);
+               cur_offset += length;
+               crc = br.Read(16);
+               break;
+
+            case CHD_HUNK_NONE:
+               length = hunk_bytes;
+               cur_offset += length;
+               crc = br.Read(16);
+               break;
+
+            case CHD_HUNK_SELF:
+               last_self = offset = br.Read(self_bits);
+               break;
+
+            case CHD_HUNK_PARENT:
+               last_parent = offset = br.Read(parent_bits);
+               break;
+
+            case CHD_HUNK_SELF_1:
+               last_self++;
+               // Fall through.
+            case CHD_HUNK_SELF_0:
+               rm[0] = CHD_HUNK_SELF;
+               offset = last_self;
+               break;
+
+            case CHD_HUNK_PARENT_SELF:
+               rm[0] = CHD_HUNK_PARENT;
+               last_parent = offset = ((uint64_t)hunk * hunk_bytes) / unit_bytes;
+               break;
+
+            case CHD_HUNK_PARENT_1:
+               last_parent += hunk_bytes / unit_bytes;
+               // Fall through.
+            case CHD_HUNK_PARENT_0:
+               rm[0] = CHD_HUNK_PARENT;
+               offset = last_parent;
+               break;
+
+            default:
+               throw(MDFN_Error(0, _("CHD hunk map is corrupt.")));
+         }
+
+         CHD_PutBE(rm + 1, length, 3);
+         CHD_PutBE(rm + 4, offset, 6);
+         CHD_PutBE(rm + 10, crc, 2);
+      }
+
+      if(br.Overflowed() || CHD_CRC16(&raw[0], raw.size()) != CHD_GetBE(header + 10, 2))
+         throw(MDFN_Error(0, _("CHD hunk map is corrupt.")));
+
+      for(uint32_t hunk = 0; hunk < hunk_count; hunk++)
+      {
+         const uint8_t *rm = &raw[hunk * 12];
+         HunkMapEntry *e = &hunk_map[hunk];
+
+         e->type = rm[0];
+         e->length = CHD_GetBE(rm + 1, 3);
+         e->offset = CHD_GetBE(rm + 4, 6);
+         e->crc = CHD_GetBE(rm + 10, 2);
+      }
+
+      map_has_crc = true;
+   }
+
+   // Check every hunk once here, so that reading one can trust the map.
+   for(uint32_t hunk = 0; hunk < hunk_count; hunk++)
+   {
+      const HunkMapEntry *e = &hunk_map[hunk];
+
+      switch(e->type)
+      {
+         case CHD_HUNK_CODEC_0 + 0:
+         case CHD_HUNK_CODEC_0 + 1:
+         case CHD_HUNK_CODEC_0 + 2:
+         case CHD_HUNK_CODEC_0 + 3:
+            {
+               const uint32_t codec = compressors[e->type - CHD_HUNK_CODEC_0];
+
+               if(codec != CHD_CODEC_ZLIB && codec != CHD_CODEC_LZMA && codec != CHD_CODEC_CDZL && codec != CHD_CODEC_CDLZ && codec != CHD_CODEC_CDFL)
+               {
+                  throw(MDFN_Error(0, _("CHD codec \"%c%c%c%c\" is not supported."), (char)(codec >> 24), (char)(codec >> 16), (char)(codec >> 8), (char)codec));
+               }
+
+               if(e->length > hunk_bytes * 2 || (e->offset + e->length) > (uint64_t)file_size)
+                  throw(MDFN_Error(0, _("CHD hunk %u is out of bounds."), hunk));
+            }
+            break;
+
+         case CHD_HUNK_NONE:
+            if((e->offset + hunk_bytes) > (uint64_t)file_size)
+               throw(MDFN_Error(0, _("CHD hunk %u is out of bounds."), hunk));
+            break;
+
+         case CHD_HUNK_SELF:
+            // Always an earlier hunk, so following them ends.
+            if(e->offset >= hunk)
+               throw(MDFN_Error(0, _("CHD hunk map is corrupt.")));
+            break;
+
+         case CHD_HUNK_PARENT:
+            throw(MDFN_Error(0, _("CHD files with a parent are not supported.")));
+      }
+   }
+}
+
+void CDAccess_CHD::ReadTrackMetadata(uint64_t meta_offset)
+{
+   struct
+   {
+      bool present;
+      uint32_t format;
+      unsigned subchannel_mode;
+      int32_t frames;
+      int32_t pregap;
+      bool pregap_in_file;
+      int32_t postgap;
+   } meta[100];
+   unsigned entries = 0;
+   int32 RunningLBA = 0;
+   long FileOffset = 0;
+
+   memset(meta, 0, sizeof(meta));
+
+   disc_type = DISC_TYPE_CDDA_OR_M1;
+   FirstTrack = 99;
+   LastTrack = 0;
+
+   while(meta_offset)
+   {
+      uint8_t header[16];
+      char text[256];
+      char type[32], subtype[32], pgtype[32], pgsub[32];
+      int track = 0, frames = 0, pregap = 0, postgap = 0;
+      uint32_t tag, length;
+
+      if(++entries > 1000)
+         throw(MDFN_Error(0, _("CHD metadata is corrupt.")));
+
+      fp->seek(meta_offset, SEEK_SET);
+      fp->read(header, sizeof(header));
+
+      tag = CHD_GetBE(header + 0, 4);
+      length = CHD_GetBE(header + 5, 3);
+      meta_offset = CHD_GetBE(header + 8, 8);
+
+      if(tag == CHD_META_GDROM)
+         throw(MDFN_Error(0, _("GD-ROM CHD images are not supported.")));
+
+      if(tag != CHD_META_TRACK && tag != CHD_META_TRACK2)
+         continue;
+
+      if(length >= sizeof(text))
+         throw(MDFN_Error(0, _("CHD metadata is corrupt.")));
+
+      fp->read(text, length);
+      text[length] = 0;
+
+      strcpy(pgtype, "");
+      strcpy(pgsub, "");
+
+      if(tag == CHD_META_TRACK2)
+      {
+         if(sscanf(text, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d PREGAP:%d PGTYPE:%31s PGSUB:%31s POSTGAP:%d", &track, type, subtype, &frames, &pregap, pgtype, pgsub, &postgap) != 8)
+            throw(MDFN_Error(0, _("CHD track metadata is corrupt: %s"), text));
+      }
+      else if(sscanf(text, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d", &track, type, subtype, &frames) != 4)
+         throw(MDFN_Error(0, _("CHD track metadata is corrupt: %s"), text));
+
+      if(track < 1 || track > 99 || frames < 0 || pregap < 0 || postgap < 0 || meta[track].present)
+         throw(MDFN_Error(0, _("CHD track metadata is corrupt: %s"), text));
+
+      meta[track].present = true;
+      meta[track].frames = frames;
+      meta[track].pregap = pregap;
+      meta[track].pregap_in_file = (pgtype[0] == 'V');
+      meta[track].postgap = postgap;
+
+      unsigned i;
+      for(i = 0; i < sizeof(CHD_TrackTypes) / sizeof(CHD_TrackTypes[0]); i++)
+      {
+         if(!strcmp(type, CHD_TrackTypes[i].name))
+            break;
+      }
+
+      if(i == sizeof(CHD_TrackTypes) / sizeof(CHD_TrackTypes[0]))
+         throw(MDFN_Error(0, _("Unsupported CHD track type: %s"), type));
+
+      meta[track].format = CHD_TrackTypes[i].format;
+
+      if(!strcmp(subtype, "RW"))
+         meta[track].subchannel_mode = CDRF_SUBM_RW;
+      else if(!strcmp(subtype, "RW_RAW"))
+         meta[track].subchannel_mode = CDRF_SUBM_RW_RAW;
+      else
+         meta[track].subchannel_mode = CDRF_SUBM_NONE;
+
+      if(track < FirstTrack)
+         FirstTrack = track;
+      if(track > LastTrack)
+         LastTrack = track;
+   }
+
+   if(!LastTrack)
+      throw(MDFN_Error(0, _("No tracks found!\n")));
+
+   NumTracks = 1 + LastTrack - FirstTrack;
+
+   // Same layout as a CUE sheet with one file per track; a pregap that's in the file is like
+   // one given with INDEX 00.  FileOffset is the frame in the CHD of the track's first sector.
+   for(int x = FirstTrack; x < (FirstTrack + NumTracks); x++)
+   {
+      CDRFILE_TRACK_INFO *ct = &Tracks[x];
+
+      if(!meta[x].present)
+         throw(MDFN_Error(0, _("CHD track %d is missing."), x));
+
+      ct->DIFormat = meta[x].format;
+      ct->SubchannelMode = meta[x].subchannel_mode;
+
+      if(ct->DIFormat == DI_FORMAT_AUDIO)
+         ct->subq_control &= ~SUBQ_CTRLF_DATA;
+      else
+         ct->subq_control |= SUBQ_CTRLF_DATA;
+
+      switch(ct->DIFormat)
+      {
+         default: break;
+
+         case DI_FORMAT_MODE2:
+         case DI_FORMAT_MODE2_FORM1:
+         case DI_FORMAT_MODE2_FORM2:
+         case DI_FORMAT_MODE2_RAW:
+                  disc_type = DISC_TYPE_CD_XA;
+                  break;
+      }
+
+      ct->pregap = meta[x].pregap_in_file ? 0 : meta[x].pregap;
+      ct->pregap_dv = meta[x].pregap_in_file ? meta[x].pregap : 0;
+      ct->postgap = meta[x].postgap;
+
+      if(ct->pregap_dv > meta[x].frames)
+         throw(MDFN_Error(0, _("CHD track %d is shorter than its pregap."), x));
+
+      RunningLBA += ct->pregap;
+      RunningLBA += ct->pregap_dv;
+
+      ct->LBA = RunningLBA;
+      ct->index[0] = -1;
+      ct->index[1] = 0;
+      ct->FileOffset = FileOffset + ct->pregap_dv;
+      ct->sectors = meta[x].frames - ct->pregap_dv;
+
+      RunningLBA += ct->sectors;
+      RunningLBA += ct->postgap;
+
+      FileOffset += (meta[x].frames + CHD_TRACK_PADDING - 1) / CHD_TRACK_PADDING * CHD_TRACK_PADDING;
+   }
+
+   if((uint64_t)FileOffset > (uint64_t)hunk_count * frames_per_hunk)
+      throw(MDFN_Error(0, _("CHD tracks are longer than the image.")));
+
+   total_sectors = RunningLBA;
+}
+
+int CDAccess_CHD::LoadSBI(const char* sbi_path)
+{
+   /* Loading SBI file */
+   uint8 header[4];
+   uint8 ed[4 + 10];
+   uint8 tmpq[12];
+   FileStream sbis(sbi_path, MODE_READ);
+
+   sbis.read(header, 4);
+
+   if(memcmp(header, "SBI\0", 4))
+      return -1;
+
+   while(sbis.read(ed, sizeof(ed), false) == sizeof(ed))
+   {
+      /* Bad BCD MSF offset in SBI file. */
+      if(!BCD_is_valid(ed[0]) || !BCD_is_valid(ed[1]) || !BCD_is_valid(ed[2]))
+         return -1;
+
+      /* Unrecognized boogly oogly in SBI file */
+      if(ed[3] != 0x01)
+         return -1;
+
+      memcpy(tmpq, &ed[4], 10);
+
+      subq_generate_checksum(tmpq);
+      tmpq[10] ^= 0xFF;
+      tmpq[11] ^= 0xFF;
+
+      uint32 aba = AMSF_to_ABA(BCD_to_U8(ed[0]), BCD_to_U8(ed[1]), BCD_to_U8(ed[2]));
+
+      memcpy(SubQReplaceMap[aba].data, tmpq, 12);
+   }
+
+   return 0;
+}
+
+void CDAccess_CHD::ImageOpen(const char *path, bool image_memcache)
+{
+   uint8_t header[CHD_V5_HEADER_SIZE];
+   std::string base_dir, file_base, file_ext;
+   char sbi_ext[4] = { 's', 'b', 'i', 0 };
+   uint64_t logical_bytes, map_offset, meta_offset;
+   uint32_t unit_bytes;
+
+   MDFN_GetFilePathComponents(path, &base_dir, &file_base, &file_ext);
+
+   fp = cdaccess_open_stream(path, image_memcache);
+
+   if(fp->read(header, sizeof(header), false) != sizeof(header) || memcmp(header, "MComprHD", 8))
+      throw(MDFN_Error(0, _("Invalid CHD header: %s"), path));
+
+   if(CHD_GetBE(header + 12, 4) != 5 || CHD_GetBE(header + 8, 4) != CHD_V5_HEADER_SIZE)
+      throw(MDFN_Error(0, _("Only version 5 CHD files are supported: %s"), path));
+
+   for(int i = 0; i < 4; i++)
+      compressors[i] = CHD_GetBE(header + 16 + i * 4, 4);
+
+   logical_bytes = CHD_GetBE(header + 32, 8);
+   map_offset = CHD_GetBE(header + 40, 8);
+   meta_offset = CHD_GetBE(header + 48, 8);
+   hunk_bytes = CHD_GetBE(header + 56, 4);
+   unit_bytes = CHD_GetBE(header + 60, 4);
+
+   if(!hunk_bytes || (hunk_bytes % CHD_FRAME_SIZE) || unit_bytes != CHD_FRAME_SIZE)
+      throw(MDFN_Error(0, _("Not a CD CHD image: %s"), path));
+
+   if(((logical_bytes + hunk_bytes - 1) / hunk_bytes) > 0x10000000)
+      throw(MDFN_Error(0, _("Invalid CHD header: %s"), path));
+
+   hunk_count = (logical_bytes + hunk_bytes - 1) / hunk_bytes;
+   frames_per_hunk = hunk_bytes / CHD_FRAME_SIZE;
+
+   ReadHunkMap(map_offset, unit_bytes);
+   ReadTrackMetadata(meta_offset);
+
+   compressed_buf = (uint8_t *)malloc(hunk_bytes * 2);
+   codec_buf = (uint8_t *)malloc(hunk_bytes);
+
+   if(!compressed_buf || !codec_buf)
+      throw(MDFN_Error(0, _("Unable to allocate memory")));
+
+   for(int i = 0; i < 4; i++)
+   {
+      if((compressors[i] == CHD_CODEC_LZMA || compressors[i] == CHD_CODEC_CDLZ) && !lzma_decoder)
+         lzma_decoder = new CHD_LZMADecoder();
+
+      if(compressors[i] == CHD_CODEC_CDFL && !flac_decoder)
+         flac_decoder = new CHD_FLACDecoder();
+   }
+
+   for(int i = 0; i < HUNK_CACHE_SIZE; i++)
+   {
+      hunk_cache[i].data = (uint8_t *)malloc(hunk_bytes);
+
+      if(!hunk_cache[i].data)
+         throw(MDFN_Error(0, _("Unable to allocate memory")));
+   }
+
+   //
+   // Load SBI file, if present
+   //
+   if(file_ext.length() == 4 && file_ext[0] == '.')
+   {
+      for(int i = 0; i < 3; i++)
+      {
+         if(file_ext[1 + i] >= 'A' && file_ext[1 + i] <= 'Z')
+            sbi_ext[i] += 'A' - 'a';
+      }
+   }
+
+   std::string sbi_path = MDFN_EvalFIP(base_dir, file_base + std::string(".") + std::string(sbi_ext), true);
+
+   if(path_is_valid(sbi_path.c_str()))
+      LoadSBI(sbi_path.c_str());
+}
+
+void CDAccess_CHD::Cleanup(void)
+{
+   for(int i = 0; i < HUNK_CACHE_SIZE; i++)
+   {
+      free(hunk_cache[i].data);
+      hunk_cache[i].data = NULL;
+   }
+
+   free(compressed_buf);
+   compressed_buf = NULL;
+   free(codec_buf);
+   codec_buf = NULL;
+
+   delete lzma_decoder;
+   lzma_decoder = NULL;
+   delete flac_decoder;
+   flac_decoder = NULL;
+
+   if(inflate_stream != NULL)
+   {
+      if(inflate_stream->zalloc != NULL)
+         inflateEnd(inflate_stream);
+      free(inflate_stream);
+      inflate_stream = NULL;
+   }
+
+   if(fp != NULL)
+   {
+      delete fp;
+      fp = NULL;
+   }
+}
+
+CDAccess_CHD::CDAccess_CHD(const char *path, bool image_memcache) : fp(NULL), hunk_bytes(0), hunk_count(0), frames_per_hunk(0), map_has_crc(false),
+   hunk_cache_clock(0), compressed_buf(NULL), codec_buf(NULL), inflate_stream(NULL), lzma_decoder(NULL), flac_decoder(NULL), NumTracks(0), FirstTrack(0), LastTrack(0), total_sectors(0)
+{
+   memset(Tracks, 0, sizeof(Tracks));
+
+   for(int i = 0; i < HUNK_CACHE_SIZE; i++)
+   {
+      hunk_cache[i].hunk = ~0U;
+      hunk_cache[i].last_used = 0;
+      hunk_cache[i].data = NULL;
+   }
+
+   CHD_InitCRC16();
+
+   try
+   {
+      inflate_stream = (z_stream *)calloc(1, sizeof(z_stream));
+      if(inflate_stream == NULL)
+         throw(MDFN_Error(0, _("Unable to allocate memory")));
+
+      ImageOpen(path, image_memcache);
+   }
+   catch(...)
+   {
+      Cleanup();
+      throw;
+   }
+}
+
+CDAccess_CHD::~CDAccess_CHD()
+{
+   Cleanup();
+}
+
+void CDAccess_CHD::Inflate(const uint8_t *src, uint32_t src_len, uint8_t *dest, uint32_t dest_len)
+{
+   z_stream *z = inflate_stream;
+   int ret;
+
+   if(z->zalloc == NULL)
+      ret = inflateInit2(z, -MAX_WBITS);
+   else
+      ret = inflateReset(z);
+
+   if(ret != Z_OK)
+      throw(MDFN_Error(0, _("CHD inflate initialization failed: %d"), ret));
+
+   z->next_in = (Bytef *)src;
+   z->avail_in = src_len;
+   z->next_out = (Bytef *)dest;
+   z->avail_out = dest_len;
+
+   ret = inflate(z, Z_FINISH);
+
+   if((ret != Z_STREAM_END && ret != Z_OK && ret != Z_BUF_ERROR) || z->total_out != dest_len)
+      throw(MDFN_Error(0, _("CHD hunk decompression failed: %d"), ret));
+}
+
+void CDAccess_CHD::DecompressLZMA(const uint8_t *src, uint32_t src_len, uint8_t *dest, uint32_t dest_len)
+{
+   if(!lzma_decoder->Decode(src, src_len, dest, dest_len))
+      throw(MDFN_Error(0, _("CHD hunk is corrupt.")));
+}
+
+// The sector data and the subcode of the frames are compressed separately, the subcode always
+// with deflate.  "cdzl" and "cdlz" leave out the ECC of sectors that had correct ECC, to be
+// recalculated; "cdfl" codes the sector data as FLAC audio, leaving nothing out.
+void CDAccess_CHD::DecompressCD(uint32_t codec, const uint8_t *src, uint32_t src_len, uint8_t *dest)
+{
+   const uint32_t frames = frames_per_hunk;
+   uint32_t ecc_bytes = 0;
+   uint32_t subcode_offset;
+
+   if(codec == CHD_CODEC_CDFL)
+   {
+      subcode_offset = flac_decoder->Decode(src, src_len, codec_buf, frames * 2352 / 4);
+
+      if(!subcode_offset)
+         throw(MDFN_Error(0, _("CHD hunk is corrupt.")));
+   }
+   else
+   {
+      const uint32_t complen_bytes = (hunk_bytes < 65536) ? 2 : 3;
+      uint32_t header_bytes, complen_base;
+
+      ecc_bytes = (frames + 7) / 8;
+      header_bytes = ecc_bytes + complen_bytes;
+
+      if(src_len < header_bytes)
+         throw(MDFN_Error(0, _("CHD hunk is corrupt.")));
+
+      complen_base = CHD_GetBE(src + ecc_bytes, complen_bytes);
+
+      if(complen_base > (src_len - header_bytes))
+         throw(MDFN_Error(0, _("CHD hunk is corrupt.")));
+
+      if(codec == CHD_CODEC_CDLZ)
+         DecompressLZMA(src + header_bytes, complen_base, codec_buf, frames * 2352);
+      else
+         Inflate(src + header_bytes, complen_base, codec_buf, frames * 2352);
+
+      subcode_offset = header_bytes + complen_base;
+   }
+
+   Inflate(src + subcode_offset, src_len - subcode_offset, codec_buf + frames * 2352, frames * 96);
+
+   for(uint32_t f = 0; f < frames; f++)
+   {
+      uint8_t *frame = dest + f * CHD_FRAME_SIZE;
+
+      memcpy(frame, codec_buf + f * 2352, 2352);
+      memcpy(frame + 2352, codec_buf + frames * 2352 + f * 96, 96);
+
+      if(ecc_bytes && (src[f >> 3] & (1 << (f & 7))))
+      {
+         memcpy(frame, CHD_SyncHeader, sizeof(CHD_SyncHeader));
+         encode_sector_ecc(frame);
+      }
+   }
+}
+
+void CDAccess_CHD::DecompressHunk(uint32_t hunk, uint8_t *dest)
+{
+   const HunkMapEntry *e = &hunk_map[hunk];
+
+   // Checked when opening to always refer to an earlier hunk.
+   while(e->type == CHD_HUNK_SELF)
+   {
+      hunk = e->offset;
+      e = &hunk_map[hunk];
+   }
+
+   if(e->type == CHD_HUNK_NONE)
+   {
+      if(!map_has_crc && !e->offset)
+      {
+         memset(dest, 0, hunk_bytes);
+         return;
+      }
+
+      fp->seek(e->offset, SEEK_SET);
+      fp->read(dest, hunk_bytes);
+   }
+   else
+   {
+      fp->seek(e->offset, SEEK_SET);
+      fp->read(compressed_buf, e->length);
+
+      const uint32_t codec = compressors[e->type - CHD_HUNK_CODEC_0];
+
+      if(codec == CHD_CODEC_ZLIB)
+         Inflate(compressed_buf, e->length, dest, hunk_bytes);
+      else if(codec == CHD_CODEC_LZMA)
+         DecompressLZMA(compressed_buf, e->length, dest, hunk_bytes);
+      else
+         DecompressCD(codec, compressed_buf, e->length, dest);
+   }
+
+   if(map_has_crc && CHD_CRC16(dest, hunk_bytes) != e->crc)
+      throw(MDFN_Error(0, _("CHD hunk %u is corrupt."), hunk));
+}
+
+const uint8_t *CDAccess_CHD::ReadHunk(uint32_t hunk)
+{
+   HunkCacheEntry *victim = &hunk_cache[0];
+
+   hunk_cache_clock++;
+
+   for(int i = 0; i < HUNK_CACHE_SIZE; i++)
+   {
+      if(hunk_cache[i].hunk == hunk)
+      {
+         hunk_cache[i].last_used = hunk_cache_clock;
+         return hunk_cache[i].data;
+      }
+
+      if(hunk_cache[i].last_used < victim->last_used)
+         victim = &hunk_cache[i];
+   }
+
+   // Not valid until decompressed without error.
+   victim->hunk = ~0U;
+   victim->last_used = 0;
+
+   DecompressHunk(hunk, victim->data);
+
+   victim->hunk = hunk;
+   victim->last_used = hunk_cache_clock;
+
+   return victim->data;
+}
+
+void CDAccess_CHD::Read_Raw_Sector(uint8 *buf, int32 lba)
+{
+   int32_t track;
+   uint8_t SimuQ[0xC];
+   bool TrackFound = FALSE;
+
+   memset(buf + 2352, 0, 96);
+
+   MakeSubPQ(lba, buf + 2352);
+
+   subq_deinterleave(buf + 2352, SimuQ);
+
+   for(track = FirstTrack; track < (FirstTrack + NumTracks); track++)
+   {
+      CDRFILE_TRACK_INFO *ct = &Tracks[track];
+
+      if(lba >= (ct->LBA - ct->pregap_dv - ct->pregap) && lba < (ct->LBA + ct->sectors + ct->postgap))
+      {
+         TrackFound = TRUE;
+
+         // Handle pregap and postgap reading
+         if(lba < (ct->LBA - ct->pregap_dv) || lba >= (ct->LBA + ct->sectors))
+            memset(buf, 0, 2352);	// Null sector data, per spec
+         else
+         {
+            const uint32_t frame = ct->FileOffset + (lba - ct->LBA);
+            const uint8_t *fd = ReadHunk(frame / frames_per_hunk) + (frame % frames_per_hunk) * CHD_FRAME_SIZE;
+
+            switch(ct->DIFormat)
+            {
+               case DI_FORMAT_AUDIO:
+                  // Stored big-endian.
+                  for(int i = 0; i < 2352; i += 2)
+                  {
+                     buf[i + 0] = fd[i + 1];
+                     buf[i + 1] = fd[i + 0];
+                  }
+                  break;
+
+               case DI_FORMAT_MODE1:
+                  memcpy(buf + 12 + 3 + 1, fd, 2048);
+                  encode_mode1_sector(lba + 150, buf);
+                  break;
+
+               case DI_FORMAT_MODE1_RAW:
+               case DI_FORMAT_MODE2_RAW:
+                  memcpy(buf, fd, 2352);
+                  break;
+
+               case DI_FORMAT_MODE2:
+                  memcpy(buf + 16, fd, 2336);
+                  encode_mode2_sector(lba + 150, buf);
+                  break;
+
+               case DI_FORMAT_MODE2_FORM1:
+                  memcpy(buf + 24, fd, 2048);
+                  break;
+
+               case DI_FORMAT_MODE2_FORM2:
+                  memcpy(buf + 24, fd, 2324);
+                  break;
+            }
+
+            if(ct->SubchannelMode == CDRF_SUBM_RW_RAW)
+               memcpy(buf + 2352, fd + 2352, 96);
+            else if(ct->SubchannelMode == CDRF_SUBM_RW)
+               subpw_interleave(fd + 2352, buf + 2352);
+         }
+         break;
+      }
+   }
+
+   if(!TrackFound)
+      throw(MDFN_Error(0, _("Could not find track for sector %u!"), lba));
+}
+
+// Note: this function makes use of the current contents(as in |=) in SubPWBuf.
+void CDAccess_CHD::MakeSubPQ(int32 lba, uint8 *SubPWBuf)
+{
+   unsigned i;
+   uint8_t buf[0xC], adr, control;
+   int32_t track;
+   uint32_t lba_relative;
+   uint32_t ma, sa, fa;
+   uint32_t m, s, f;
+   uint8_t pause_or = 0x00;
+   bool track_found = FALSE;
+
+   for(track = FirstTrack; track < (FirstTrack + NumTracks); track++)
+   {
+      if(lba >= (Tracks[track].LBA - Tracks[track].pregap_dv - Tracks[track].pregap) && lba < (Tracks[track].LBA + Tracks[track].sectors + Tracks[track].postgap))
+      {
+         track_found = TRUE;
+         break;
+      }
+   }
+
+   if(!track_found)
+   {
+      printf("MakeSubPQ error for sector %u!", lba);
+      track = FirstTrack;
+   }
+
+   lba_relative = abs((int32)lba - Tracks[track].LBA);
+
+   f            = (lba_relative % 75);
+   s            = ((lba_relative / 75) % 60);
+   m            = (lba_relative / 75 / 60);
+
+   fa           = (lba + 150) % 75;
+   sa           = ((lba + 150) / 75) % 60;
+   ma           = ((lba + 150) / 75 / 60);
+
+   adr          = 0x1; // Q channel data encodes position
+   control      = Tracks[track].subq_control;
+
+   // Handle pause(D7 of interleaved subchannel byte) bit, should be set to 1 when in pregap or postgap.
+   if((lba < Tracks[track].LBA) || (lba >= Tracks[track].LBA + Tracks[track].sectors))
+      pause_or = 0x80;
+
+   // Handle pregap between audio->data track
+   {
+      int32_t pg_offset = (int32)lba - Tracks[track].LBA;
+
+      // If we're more than 2 seconds(150 sectors) from the real "start" of the track/INDEX 01, and the track is a data track,
+      // and the preceding track is an audio track, encode it as audio(by taking the SubQ control field from the preceding track).
+      if(pg_offset < -150)
+      {
+         if((Tracks[track].subq_control & SUBQ_CTRLF_DATA) && (FirstTrack < track) && !(Tracks[track - 1].subq_control & SUBQ_CTRLF_DATA))
+            control = Tracks[track - 1].subq_control;
+      }
+   }
+
+   memset(buf, 0, 0xC);
+   buf[0] = (adr << 0) | (control << 4);
+   buf[1] = U8_to_BCD(track);
+
+   if(lba < Tracks[track].LBA) // Index is 00 in pregap
+      buf[2] = U8_to_BCD(0x00);
+   else
+      buf[2] = U8_to_BCD(0x01);
+
+   /* Track relative MSF address */
+   buf[3] = U8_to_BCD(m);
+   buf[4] = U8_to_BCD(s);
+   buf[5] = U8_to_BCD(f);
+   buf[6] = 0;
+   /* Absolute MSF address */
+   buf[7] = U8_to_BCD(ma);
+   buf[8] = U8_to_BCD(sa);
+   buf[9] = U8_to_BCD(fa);
+
+   subq_generate_checksum(buf);
+
+   if(!SubQReplaceMap.empty())
+   {
+      std::map<uint32, cpp11_array_doodad>::const_iterator it = SubQReplaceMap.find(LBA_to_ABA(lba));
+
+      if(it != SubQReplaceMap.end())
+         memcpy(buf, it->second.data, 12);
+   }
+
+   for (i = 0; i < 96; i++)
+      SubPWBuf[i] |= (((buf[i >> 3] >> (7 - (i & 0x7))) & 1) ? 0x40 : 0x00) | pause_or;
+}
+
+void CDAccess_CHD::Read_TOC(TOC *toc)
+{
+   unsigned i;
+
+   TOC_Clear(toc);
+
+   toc->first_track = FirstTrack;
+   toc->last_track = FirstTrack + NumTracks - 1;
+   toc->disc_type = disc_type;
+
+   for(i = toc->first_track; i <= toc->last_track; i++)
+   {
+      toc->tracks[i].lba = Tracks[i].LBA;
+      toc->tracks[i].adr = ADR_CURPOS;
+      toc->tracks[i].control = Tracks[i].subq_control;
+   }
+
+   toc->tracks[100].lba = total_sectors;
+   toc->tracks[100].adr = ADR_CURPOS;
+   toc->tracks[100].control = toc->tracks[toc->last_track].control & 0x4;
+
+   // Convenience leadout track duplication.
+   if(toc->last_track < 99)
+      toc->tracks[toc->last_track + 1] = toc->tracks[100];
+}
+
+void CDAccess_CHD::Eject(bool eject_status)
+{
+
+}
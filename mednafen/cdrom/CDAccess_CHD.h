@@ -0,0 +1,98 @@
+#ifndef __MDFN_CDACCESS_CHD_H
+#define __MDFN_CDACCESS_CHD_H
+
+#include <map>
+#include <vector>
+#include "CDAccess_Image.h"
+
+class Stream;
+struct z_stream_s;
+class CHD_LZMADecoder;
+class CHD_FLACDecoder;
+
+// CHD(MAME "compressed hunks of data") version 5 CD images, as made by chdman createcd.
+// Hunks compressed with the zlib, LZMA and FLAC based codecs("zlib", "lzma", "cdzl", "cdlz"
+// and "cdfl") are supported, along with uncompressed hunks and hunks duplicating others; images
+// using any other codec, or with a parent, are refused when opened.
+class CDAccess_CHD : public CDAccess
+{
+   public:
+
+      CDAccess_CHD(const char *path, bool image_memcache);
+      virtual ~CDAccess_CHD();
+
+      virtual void Read_Raw_Sector(uint8_t *buf, int32_t lba);
+
+      virtual void Read_TOC(TOC *toc);
+
+      virtual void Eject(bool eject_status);
+
+   private:
+      Stream *fp;
+
+      uint32_t compressors[4];
+      uint32_t hunk_bytes;
+      uint32_t hunk_count;
+      uint32_t frames_per_hunk;
+      bool map_has_crc;
+
+      struct HunkMapEntry
+      {
+         uint8_t type;
+         uint32_t length;
+         uint64_t offset;
+         uint16_t crc;
+      };
+      std::vector<HunkMapEntry> hunk_map;
+
+      // Decompressed hunks, the least recently used one making room for a new one.  Reads are
+      // ahead of the emulation when they come from the CD read thread, so a hunk is usually
+      // decompressed well before its first sector is needed.
+      enum { HUNK_CACHE_SIZE = 32 };
+
+      struct HunkCacheEntry
+      {
+         uint32_t hunk;
+         uint64_t last_used;
+         uint8_t *data;
+      };
+      HunkCacheEntry hunk_cache[HUNK_CACHE_SIZE];
+      uint64_t hunk_cache_clock;
+
+      uint8_t *compressed_buf;
+      uint8_t *codec_buf;	// Sector data and subcode of a CD codec hunk, before being interleaved.
+      struct z_stream_s *inflate_stream;
+      CHD_LZMADecoder *lzma_decoder;	// Only when one of the compressors needs it.
+      CHD_FLACDecoder *flac_decoder;
+
+      int32_t NumTracks;
+      int32_t FirstTrack;
+      int32_t LastTrack;
+      int32_t total_sectors;
+      uint8_t disc_type;
+      CDRFILE_TRACK_INFO Tracks[100]; // Track #0(HMM?) through 99
+
+      struct cpp11_array_doodad
+      {
+         uint8 data[12];
+      };
+
+      std::map<uint32, cpp11_array_doodad> SubQReplaceMap;
+
+      void ImageOpen(const char *path, bool image_memcache);
+      void ReadHunkMap(uint64_t map_offset, uint32_t unit_bytes);
+      void ReadTrackMetadata(uint64_t meta_offset);
+      int LoadSBI(const char* sbi_path);
+      void Cleanup(void);
+
+      // MakeSubPQ will OR the simulated P and Q subchannel data into SubPWBuf.
+      void MakeSubPQ(int32_t lba, uint8_t *SubPWBuf);
+
+      const uint8_t *ReadHunk(uint32_t hunk);
+      void DecompressHunk(uint32_t hunk, uint8_t *dest);
+      void DecompressCD(uint32_t codec, const uint8_t *src, uint32_t src_len, uint8_t *dest);
+      void DecompressLZMA(const uint8_t *src, uint32_t src_len, uint8_t *dest, uint32_t dest_len);
+      void Inflate(const uint8_t *src, uint32_t src_len, uint8_t *dest, uint32_t dest_len);
+};
+
+#endif
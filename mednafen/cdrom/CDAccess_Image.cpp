@@ -219,10 +219,7 @@ void CDAccess_Image::ParseTOCFileLineInfo(CDRFILE_TRACK_INFO *track, const int t
 
       efn = MDFN_EvalFIP(base_dir, filename);
 
-      if(image_memcache)
-         track->fp = new MemoryStream(new FileStream(efn.c_str(), MODE_READ));
-      else
-         track->fp = new FileStream(efn.c_str(), MODE_READ);
+      track->fp = cdaccess_open_stream(efn.c_str(), image_memcache);
 
       toc_streamcache[filename] = track->fp;
    }
@@ -588,12 +585,9 @@ void CDAccess_Image::ImageOpen(const char *path, bool image_memcache)
             }
 
             std::string efn = MDFN_EvalFIP(base_dir, args[0]);
-            TmpTrack.fp = new FileStream(efn.c_str(), MODE_READ);
+            TmpTrack.fp = cdaccess_open_stream(efn.c_str(), image_memcache);
             TmpTrack.FirstFileInstance = 1;
 
-            if(image_memcache)
-               TmpTrack.fp = new MemoryStream(TmpTrack.fp);
-
             if(!strcasecmp(args[1].c_str(), "BINARY"))
             {
                //TmpTrack.Format = TRACK_FORMAT_DATA;
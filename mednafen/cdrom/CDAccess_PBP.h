@@ -2,9 +2,13 @@
 #define __MDFN_CDACCESS_PBP_H
 
 #include <map>
+#include <deque>
 #include "CDAccess_Image.h"
 
+#include <rthreads/rthreads.h>
+
 class Stream;
+struct z_stream_s;
 
 class CDAccess_PBP : public CDAccess
 {
@@ -37,14 +41,62 @@ class CDAccess_PBP : public CDAccess
       uint32_t pbp_file_offsets[PBP_NUM_FILES];
 
       ////////////////
-      uint8_t buff_raw[16][2352];
       uint8_t buff_compressed[2352 * 16];
-      uint32_t *index_table;
-      uint32_t index_len;
-      uint32_t current_block;
-      uint32_t sector_in_blk;
+      struct z_stream_s *inflate_stream;
+      uint32_t *index_table;     // File offset of each block, and of the end of the last one.
+      uint32_t index_len;        // Number of blocks.
       ////////////////
 
+      // Decompressed(and, for official images, fixed up) blocks, the least recently used
+      // ones making room for new ones.  Worker threads decompress the blocks following the
+      // one being read before they're asked for.
+      enum
+      {
+         BLOCK_QUEUED,
+         BLOCK_BUSY,
+         BLOCK_READY,
+         BLOCK_FAILED
+      };
+
+      enum
+      {
+         DECODE_THREADS = 2,
+         PREFETCH_BLOCKS = 4
+      };
+
+      struct BlockCacheEntry
+      {
+         int state;
+         uint64_t last_used;
+         uint8_t data[16][2352];
+      };
+
+      std::map<uint32_t, BlockCacheEntry *> block_cache;
+      std::deque<uint32_t> decode_queue;
+      uint32_t block_cache_max;
+      uint64_t block_cache_clock;
+
+      slock_t *block_cache_lock;
+      scond_t *block_ready_cond;   // Signalled when a worker finishes a block.
+      scond_t *decode_cond;        // Signalled when blocks are queued, or the workers should quit.
+      slock_t *fp_lock;
+      sthread_t *decode_threads[DECODE_THREADS];
+      bool decode_threads_quit;
+
+      // Statistics, logged on close.
+      uint32_t cache_hits;
+      uint32_t cache_misses;
+      uint32_t cache_waits;        // Read while a worker was still decompressing the block.
+
+      void StartDecodeThreads(void);
+      void StopDecodeThreads(void);
+      void FlushBlockCache(void);
+      BlockCacheEntry *AllocBlockCacheEntry(uint32_t block);
+      bool DecodeBlock(uint32_t block, uint8_t (*out)[2352], uint8_t *compressed, struct z_stream_s *z);
+
+      void DecodeThread(void);
+      static void DecodeThreadStart(void *arg);
+
       int32_t NumTracks;
       int32_t FirstTrack;
       int32_t LastTrack;
@@ -55,7 +107,6 @@ class CDAccess_PBP : public CDAccess
       uint32_t discs_start_offset[5];
       uint32_t psisoimg_offset;
 
-      uint16_t fixed_sectors;
       bool is_official;    // TODO: find more consistent ways to check for used compression algorithm, compressed (and/or encrypted?) audio tracks and messed up sectors
 
       void ImageOpen(const char *path, bool image_memcache);
@@ -70,7 +121,7 @@ class CDAccess_PBP : public CDAccess
       std::map<uint32, cpp11_array_doodad> SubQReplaceMap;
       void MakeSubPQ(int32 lba, uint8 *SubPWBuf);
 
-      int decompress2(void *out, uint32_t *out_size, void *in, uint32_t in_size);
+      int decompress2(struct z_stream_s *z, void *out, uint32_t *out_size, void *in, uint32_t in_size);
 
       int decode_range(unsigned int *range, unsigned int *code, unsigned char **src);
       int decode_bit(unsigned int *range, unsigned int *code, int *index, unsigned char **src, unsigned char *c);
@@ -91,6 +91,7 @@ void CDUtility_Init(void)
    if(!CDUtility_Inited)
    {
       Init_LEC_Correct();
+      EDCCrc32_Init();
 
       InitScrambleTable();
       lec_tables_init();
@@ -134,6 +135,13 @@ void encode_mode2_form2_sector(uint32_t aba, uint8_t *sector_data)
    lec_encode_mode2_form2_sector(aba, sector_data);
 }
 
+void encode_sector_ecc(uint8_t *sector_data)
+{
+   CDUtility_Init();
+
+   lec_encode_ecc(sector_data);
+}
+
 bool edc_check(const uint8_t *sector_data, bool xa)
 {
    CDUtility_Init();
@@ -174,6 +174,7 @@ void encode_mode1_sector(uint32_t aba, uint8_t *sector_data);	// 2048 bytes of u
 void encode_mode2_sector(uint32_t aba, uint8_t *sector_data);	// 2336 bytes of user data at offset 16 
 void encode_mode2_form1_sector(uint32_t aba, uint8_t *sector_data);	// 2048+8 bytes of user data at offset 16
 void encode_mode2_form2_sector(uint32_t aba, uint8_t *sector_data);	// 2324+8 bytes of user data at offset 16
+void encode_sector_ecc(uint8_t *sector_data);	// Recalculates the P and Q parity over the header and data in place.
 
 
 // out_buf must be able to contain 2352+96 bytes.
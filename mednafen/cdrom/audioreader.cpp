@@ -30,9 +30,19 @@
 #include <errno.h>
 #include <time.h>
 
+#include <vector>
+#include <algorithm>
+
+#include <rthreads/rthreads.h>
+
 #include "../general.h"
 #include "../mednafen-endian.h"
 
+#include "../../libretro.h"
+
+extern retro_log_printf_t log_cb;
+extern struct retro_perf_callback perf_cb;
+
 AudioReader::AudioReader() : LastReadPos(0)
 {
 
@@ -165,7 +175,302 @@ int64_t OggVorbisReader::FrameCount(void)
    return(ov_pcm_total(&ovfile, -1));
 }
 
+// Keeps decoded PCM of another reader's track, in blocks of a second, up to a memory budget.
+// A thread decodes from where the track is being played on, ahead of it, so playing it
+// doesn't decode on the emulation thread; a read of a block that isn't there yet has that
+// block decoded next, seeking the decoder there if need be, and waits for it.  Blocks
+// behind playback are dropped least recently used first to make room.
+class CachedAudioReader : public AudioReader
+{
+   public:
+      CachedAudioReader(AudioReader *source, uint64_t budget);
+      ~CachedAudioReader();
+
+      int64_t Read_(int16_t *buffer, int64_t frames);
+      bool Seek_(int64_t frame_offset);
+      int64_t FrameCount(void);
+
+   private:
+      struct Block
+      {
+         int16_t *pcm;		// NULL if not decoded.
+         uint32_t frames;
+         uint64_t last_used;
+      };
+
+      static void DecodeThread(void *arg);
+      void Decode(void);
+      uint32_t NextBlock(void);
+      bool MakeRoom(uint32_t keep);
+
+      AudioReader *source;	// Only used by the thread.
+      int64_t frame_count;
+      int64_t position;
+
+      // Protected by lock.
+      std::vector<Block> blocks;
+      uint32_t blocks_cached;
+      uint32_t blocks_max;
+      uint32_t play_block;	// Last block read; decode ahead from there.
+      uint32_t wanted_block;	// Needed by a read, decode it next.
+      uint64_t use_counter;
+      bool stop;
+
+      // Stats, for the log when the track is closed.
+      uint32_t blocks_decoded;
+      uint32_t seeks;
+      uint32_t waited_blocks;
+      uint64_t decode_time;
+
+      slock_t *lock;
+      scond_t *cond;
+      sthread_t *thread;
+};
+
+enum
+{
+   AUDIO_CACHE_BLOCK_FRAMES = 588 * 75,	// One second, 75 sectors.
+   AUDIO_CACHE_BLOCK_SIZE = AUDIO_CACHE_BLOCK_FRAMES * 2 * sizeof(int16_t),
+   AUDIO_CACHE_AHEAD = 8,			// Blocks decoded ahead of playback.
+
+   AUDIO_CACHE_NO_BLOCK = ~0U
+};
+
+CachedAudioReader::CachedAudioReader(AudioReader *source, uint64_t budget) : source(source), position(0),
+   blocks_cached(0), play_block(AUDIO_CACHE_NO_BLOCK), wanted_block(AUDIO_CACHE_NO_BLOCK), use_counter(0), stop(false),
+   blocks_decoded(0), seeks(0), waited_blocks(0), decode_time(0), lock(NULL), cond(NULL), thread(NULL)
+{
+   Block empty = { NULL, 0, 0 };
+
+   frame_count = std::max<int64_t>(source->FrameCount(), 0);
+   blocks.resize((frame_count + AUDIO_CACHE_BLOCK_FRAMES - 1) / AUDIO_CACHE_BLOCK_FRAMES, empty);
+
+   // Room for at least the blocks ahead of playback, the one being played and the one a
+   // read might need besides.
+   blocks_max = std::max<uint64_t>(budget / AUDIO_CACHE_BLOCK_SIZE, AUDIO_CACHE_AHEAD + 2);
+
+   lock = slock_new();
+   cond = scond_new();
+}
+
+CachedAudioReader::~CachedAudioReader()
+{
+   if(thread)
+   {
+      slock_lock(lock);
+      stop = true;
+      scond_broadcast(cond);
+      slock_unlock(lock);
+
+      sthread_join(thread);
+
+      log_cb(RETRO_LOG_INFO, "[CDIF] Audio track of %u seconds: %u ms decoding %u seconds of it, %u seeks, %u waits for decoding.\n",
+            (unsigned)blocks.size(), (unsigned)(decode_time / 1000), blocks_decoded, seeks, waited_blocks);
+   }
+
+   for(size_t i = 0; i < blocks.size(); i++)
+      free(blocks[i].pcm);
+
+   scond_free(cond);
+   slock_free(lock);
+
+   delete source;
+}
+
+void CachedAudioReader::DecodeThread(void *arg)
+{
+   ((CachedAudioReader *)arg)->Decode();
+}
+
+// The block to decode next, or AUDIO_CACHE_NO_BLOCK if there is nothing to do.
+uint32_t CachedAudioReader::NextBlock(void)
+{
+   if(wanted_block != AUDIO_CACHE_NO_BLOCK && !blocks[wanted_block].pcm)
+      return wanted_block;
+
+   if(play_block == AUDIO_CACHE_NO_BLOCK)
+      return AUDIO_CACHE_NO_BLOCK;
+
+   const uint32_t end = std::min<uint32_t>(play_block + 1 + AUDIO_CACHE_AHEAD, blocks.size());
+
+   for(uint32_t block = play_block; block < end; block++)
+   {
+      if(!blocks[block].pcm)
+         return block;
+   }
+
+   return AUDIO_CACHE_NO_BLOCK;
+}
+
+// Frees the least recently used block outside of what's being played and decoded ahead,
+// if the cache is full.  Returns false if there is nothing to free.
+bool CachedAudioReader::MakeRoom(uint32_t keep)
+{
+   if(blocks_cached < blocks_max)
+      return true;
+
+   uint32_t victim = AUDIO_CACHE_NO_BLOCK;
+
+   for(uint32_t block = 0; block < blocks.size(); block++)
+   {
+      if(!blocks[block].pcm || block == keep)
+         continue;
+
+      if(play_block != AUDIO_CACHE_NO_BLOCK && block >= play_block && block <= play_block + AUDIO_CACHE_AHEAD)
+         continue;
+
+      if(victim == AUDIO_CACHE_NO_BLOCK || blocks[block].last_used < blocks[victim].last_used)
+         victim = block;
+   }
+
+   if(victim == AUDIO_CACHE_NO_BLOCK)
+      return false;
+
+   free(blocks[victim].pcm);
+   blocks[victim].pcm = NULL;
+   blocks_cached--;
+
+   return true;
+}
+
+void CachedAudioReader::Decode(void)
+{
+   int64_t source_position = 0;
+
+   slock_lock(lock);
+
+   while(!stop)
+   {
+      const uint32_t block = NextBlock();
+
+      if(block == AUDIO_CACHE_NO_BLOCK || !MakeRoom(block))
+      {
+         scond_wait(cond, lock);
+         continue;
+      }
+
+      slock_unlock(lock);
+
+      const int64_t start = (int64_t)block * AUDIO_CACHE_BLOCK_FRAMES;
+      const int64_t count = std::min<int64_t>(AUDIO_CACHE_BLOCK_FRAMES, frame_count - start);
+      int16_t *pcm = (int16_t *)malloc(AUDIO_CACHE_BLOCK_SIZE);
+      int64_t decoded = 0;
+      retro_time_t t = 0;
+
+      if(perf_cb.get_time_usec)
+         t = perf_cb.get_time_usec();
+
+      if(pcm)
+         decoded = source->Read(start, pcm, count);
+
+      if(perf_cb.get_time_usec)
+         t = perf_cb.get_time_usec() - t;
+
+      slock_lock(lock);
+
+      if(!pcm)
+      {
+         // Out of memory; let the reads find it out for themselves.
+         stop = true;
+         scond_broadcast(cond);
+         break;
+      }
+
+      if(source_position != start)
+         seeks++;
+      source_position = start + decoded;
+
+      blocks[block].pcm = pcm;
+      blocks[block].frames = decoded;
+      blocks[block].last_used = use_counter;
+      blocks_cached++;
+      blocks_decoded++;
+      decode_time += t;
+
+      // Once it's been evicted again, it's no more wanted than any other block.
+      if(wanted_block == block)
+         wanted_block = AUDIO_CACHE_NO_BLOCK;
+
+      scond_broadcast(cond);
+   }
+
+   slock_unlock(lock);
+}
+
+int64_t CachedAudioReader::Read_(int16_t *buffer, int64_t frames)
+{
+   int64_t done = 0;
+
+   if(!thread)
+      thread = sthread_create(DecodeThread, this);
+
+   slock_lock(lock);
+
+   while(done < frames && position < frame_count)
+   {
+      const uint32_t block = position / AUDIO_CACHE_BLOCK_FRAMES;
+      const uint32_t offset = position % AUDIO_CACHE_BLOCK_FRAMES;
+      Block *b = &blocks[block];
+
+      if(play_block != block)
+      {
+         play_block = block;
+         scond_broadcast(cond);
+      }
+
+      if(!b->pcm)
+      {
+         waited_blocks++;
+
+         while(!b->pcm && !stop)
+         {
+            wanted_block = block;
+            scond_broadcast(cond);
+            scond_wait(cond, lock);
+         }
+
+         if(wanted_block == block)
+            wanted_block = AUDIO_CACHE_NO_BLOCK;
+
+         if(!b->pcm)
+            break;
+      }
+
+      if(offset >= b->frames)
+         break;
+
+      const int64_t count = std::min<int64_t>(frames - done, b->frames - offset);
+
+      memcpy(buffer + done * 2, b->pcm + offset * 2, count * 2 * sizeof(int16_t));
+      b->last_used = ++use_counter;
+
+      done += count;
+      position += count;
+   }
+
+   slock_unlock(lock);
+
+   return done;
+}
+
+bool CachedAudioReader::Seek_(int64_t frame_offset)
+{
+   position = frame_offset;
+   return(true);
+}
+
+int64_t CachedAudioReader::FrameCount(void)
+{
+   return frame_count;
+}
+
 AudioReader *AR_Open(Stream *fp)
 {
-   return new OggVorbisReader(fp);
+   AudioReader *reader = new OggVorbisReader(fp);
+   const uint64_t cache_size = MDFN_GetSettingUI("cdrom.audio_cache_size");
+
+   if(cache_size)
+      reader = new CachedAudioReader(reader, cache_size);
+
+   return reader;
 }
@@ -30,6 +30,32 @@
 #include "../../libretro.h"
 
 extern retro_log_printf_t log_cb;
+extern struct retro_perf_callback perf_cb;
+
+// Ordering for the sector buffers, which are filled by the read thread and looked up by the
+// emulation thread without taking a lock.
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define SB_LOAD_ACQUIRE(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define SB_STORE_RELEASE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define SB_FENCE_ACQUIRE()	__atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define SB_FENCE_RELEASE()	__atomic_thread_fence(__ATOMIC_RELEASE)
+#define SB_FENCE_FULL()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#elif defined(__GNUC__)
+#define SB_LOAD_ACQUIRE(p)	({ __typeof__(*(p)) sb_tmp = *(volatile __typeof__(*(p)) *)(p); __sync_synchronize(); sb_tmp; })
+#define SB_STORE_RELEASE(p, v)	do { __sync_synchronize(); *(volatile __typeof__(*(p)) *)(p) = (v); } while(0)
+#define SB_FENCE_ACQUIRE()	__sync_synchronize()
+#define SB_FENCE_RELEASE()	__sync_synchronize()
+#define SB_FENCE_FULL()		__sync_synchronize()
+#elif defined(_MSC_VER)
+#include <windows.h>
+#define SB_LOAD_ACQUIRE(p)	(MemoryBarrier(), *(volatile long *)(p))
+#define SB_STORE_RELEASE(p, v)	do { MemoryBarrier(); *(volatile long *)(p) = (v); } while(0)
+#define SB_FENCE_ACQUIRE()	MemoryBarrier()
+#define SB_FENCE_RELEASE()	MemoryBarrier()
+#define SB_FENCE_FULL()		MemoryBarrier()
+#else
+#error "No memory barriers for this compiler."
+#endif
 
 enum
 {
@@ -79,7 +105,7 @@ class CDIF_Queue
 
 typedef struct
 {
-   bool valid;
+   uint32 seq;		// Odd while being written, 0 if never written.
    bool error;
    uint32 lba;
    uint8 data[2352 + 96];
@@ -116,22 +142,50 @@ class CDIF_MT : public CDIF
       CDIF_Queue EmuThreadQueue;
 
 
-      enum { SBSize = 256 };
+      // The read thread writes sectors into the ring without a lock, each guarded by its own
+      // sequence count so that a lookup can tell when it raced with the sector being replaced.
+      // The emulation thread only takes SBMutex to wait when the sector isn't there yet.
+      enum { SBSize = 256, SBIndexSize = 1024 };
       CDIF_Sector_Buffer SectorBuffers[SBSize];
 
-      uint32 SBWritePos;
+      // Slot + 1 of the last sector written with each LBA modulo SBIndexSize, 0 if none.
+      uint32 SBIndex[SBIndexSize];
+
+      uint32 SBWritePos;	// Read-thread-only.
+      uint32 SBWaiting;		// Set while the emulation thread waits on SBCond.
 
       slock_t *SBMutex;
       scond_t *SBCond;
 
+      bool SB_Lookup(uint8 *buf, uint32 lba, bool *error_condition);
+      bool SB_TryCopy(uint32 slot, uint8 *buf, uint32 lba, bool *error_condition);
+
       //
       // Read-thread-only:
       //
       void RT_EjectDisc(bool eject_status, bool skip_actual_eject = false);
-
-      uint32 ra_lba;
-      int ra_count;
+      void RT_ResetReadAhead(void);
+      void RT_ClearSectorBuffers(void);
+      void RT_WriteSectorBuffer(uint32 lba, const uint8 *data, bool error_condition);
+
+      // Read-ahead window, in sectors.  It grows while reads are sequential(XA/STR streaming), and
+      // after a seek starts over at the average length of the last sequential runs, so that file
+      // table lookups and the like don't have lots of sectors read after them for nothing.
+      enum { RA_MIN = 2, RA_MAX = 48 };
+
+      uint32 ra_lba;		// Next sector to read ahead.
+      int ra_count;		// How many more to read.
+      int ra_window;
+      uint32 run_start;	// First sector of the current sequential run.
+      int run_len_avg;
       uint32 last_read_lba;
+
+      // Statistics, logged when the disc is closed.
+      uint32 rt_seeks;
+      uint32 rt_sectors_read;
+      uint32 reads;
+      uint32 stalls;		// Reads that had to wait for the read thread.
+      uint32 stall_hist[4];	// < 1ms, < 4ms, < 16ms, >= 16ms(if the frontend has a timer).
 };
 
 /* TODO: prohibit copy constructor */
@@ -262,14 +316,59 @@ void CDIF_MT::RT_EjectDisc(bool eject_status, bool skip_actual_eject)
             throw(MDFN_Error(0, _("TOC first(%d)/last(%d) track numbers bad."), disc_toc.first_track, disc_toc.last_track));
       }
 
-      SBWritePos = 0;
-      ra_lba = 0;
-      ra_count = 0;
-      last_read_lba = ~0U;
-      memset(SectorBuffers, 0, SBSize * sizeof(CDIF_Sector_Buffer));
+      RT_ResetReadAhead();
+      RT_ClearSectorBuffers();
+   }
+}
+
+// Only while the emulation thread is waiting on the thread for something else than a sector.
+void CDIF_MT::RT_ClearSectorBuffers(void)
+{
+   SBWritePos = 0;
+   memset(SectorBuffers, 0, sizeof(SectorBuffers));
+   memset(SBIndex, 0, sizeof(SBIndex));
+   SB_FENCE_FULL();
+}
+
+void CDIF_MT::RT_WriteSectorBuffer(uint32 lba, const uint8 *data, bool error_condition)
+{
+   CDIF_Sector_Buffer *sb = &SectorBuffers[SBWritePos];
+   const uint32 seq = sb->seq;
+
+   SB_STORE_RELEASE(&sb->seq, seq + 1);
+   SB_FENCE_RELEASE();
+
+   sb->lba = lba;
+   sb->error = error_condition;
+   memcpy(sb->data, data, 2352 + 96);
+
+   SB_STORE_RELEASE(&sb->seq, seq + 2);
+   SB_STORE_RELEASE(&SBIndex[lba & (SBIndexSize - 1)], SBWritePos + 1);
+
+   SBWritePos = (SBWritePos + 1) % SBSize;
+
+   // Pairs with the fence in ReadRawSector(), so that either the wait there sees the sector or
+   // this sees the wait.
+   SB_FENCE_FULL();
+
+   if(SB_LOAD_ACQUIRE(&SBWaiting))
+   {
+      slock_lock((slock_t*)SBMutex);
+      scond_signal((scond_t*)SBCond);
+      slock_unlock((slock_t*)SBMutex);
    }
 }
 
+void CDIF_MT::RT_ResetReadAhead(void)
+{
+   ra_lba = 0;
+   ra_count = 0;
+   ra_window = RA_MIN;
+   run_start = 0;
+   run_len_avg = RA_MIN;
+   last_read_lba = ~0U;
+}
+
 struct RTS_Args
 {
    CDIF_MT *cdif_ptr;
@@ -287,10 +386,8 @@ int CDIF_MT::ReadThreadStart()
    bool Running = TRUE;
 
    DiscEjected = true;
-   SBWritePos = 0;
-   ra_lba = 0;
-   ra_count = 0;
-   last_read_lba = ~0U;
+   RT_ResetReadAhead();
+   RT_ClearSectorBuffers();
 
    try
    {
@@ -332,29 +429,34 @@ int CDIF_MT::ReadThreadStart()
 
             case CDIF_MSG_READ_SECTOR:
                {
-                  static const int       max_ra = 16;
-                  static const int   initial_ra = 1;
-                  static const int speedmult_ra = 2;
-                  uint32_t              new_lba = msg.args[0];
+                  const uint32 new_lba = msg.args[0];
+                  const bool hint = msg.args[1];
+                  uint32 target;
 
-                  assert((unsigned int)max_ra < (SBSize / 4));
+                  assert((unsigned int)RA_MAX < (SBSize / 4));
 
-                  if(last_read_lba != ~0U && new_lba == (last_read_lba + 1))
+                  // Anything from the start of the run up to what's been read ahead is part of it,
+                  // re-reads and skipping ahead a little included, as long as it's recent enough to
+                  // still be in the sector buffers.
+                  if(last_read_lba == ~0U || new_lba < run_start || new_lba > ra_lba || (ra_lba - new_lba) >= (SBSize / 2))
                   {
-                     int how_far_ahead = ra_lba - new_lba;
+                     if(last_read_lba != ~0U && last_read_lba >= run_start && last_read_lba < ra_lba)
+                        run_len_avg = (run_len_avg * 3 + (last_read_lba - run_start + 1) + 2) / 4;
 
-                     if(how_far_ahead <= max_ra)
-                        ra_count = MIN(speedmult_ra, 1 + max_ra - how_far_ahead);
-                     else
-                        ra_count++;
-                  }
-                  else if(new_lba != last_read_lba)
-                  {
+                     run_start = new_lba;
                      ra_lba = new_lba;
-                     ra_count = initial_ra;
+                     ra_window = std::min<int>(std::max<int>(run_len_avg, RA_MIN), RA_MAX);
+                     rt_seeks++;
                   }
+                  else if(new_lba == last_read_lba + 1 && ra_window < RA_MAX)
+                     ra_window++;
+
+                  // A hint is where the next read will be(the target of a seek), but doesn't count
+                  // as one itself.
+                  last_read_lba = hint ? new_lba - 1 : new_lba;
 
-                  last_read_lba = new_lba;
+                  target = new_lba + ra_window;
+                  ra_count = (target > ra_lba) ? (target - ra_lba) : 0;
                }
                break;
          }
@@ -383,27 +485,22 @@ int CDIF_MT::ReadThreadStart()
             error_condition = true;
          }
 
-         slock_lock((slock_t*)SBMutex);
-
-         SectorBuffers[SBWritePos].lba = ra_lba;
-         memcpy(SectorBuffers[SBWritePos].data, tmpbuf, 2352 + 96);
-         SectorBuffers[SBWritePos].valid = TRUE;
-         SectorBuffers[SBWritePos].error = error_condition;
-         SBWritePos = (SBWritePos + 1) % SBSize;
-
-         scond_signal((scond_t*)SBCond);
-         slock_unlock((slock_t*)SBMutex);
+         RT_WriteSectorBuffer(ra_lba, tmpbuf, error_condition);
 
          ra_lba++;
          ra_count--;
+         rt_sectors_read++;
       }
    }
 
    return(1);
 }
 
-CDIF_MT::CDIF_MT(CDAccess *cda) : disc_cdaccess(cda), CDReadThread(NULL), SBMutex(NULL), SBCond(NULL)
+CDIF_MT::CDIF_MT(CDAccess *cda) : disc_cdaccess(cda), CDReadThread(NULL), SBWritePos(0), SBWaiting(0), SBMutex(NULL), SBCond(NULL),
+   rt_seeks(0), rt_sectors_read(0), reads(0), stalls(0)
 {
+   memset(stall_hist, 0, sizeof(stall_hist));
+
    try
    {
       CDIF_Message msg;
@@ -466,12 +563,24 @@ CDIF_MT::~CDIF_MT()
    if(!thread_deaded_failed)
       sthread_join((sthread_t*)CDReadThread);
 
+   if(reads)
+   {
+      log_cb(RETRO_LOG_INFO, "[CDIF] %u sector reads, %u stalled(%u < 1ms, %u < 4ms, %u < 16ms, %u longer), %u seeks, %u sectors read ahead.\n",
+            reads, stalls, stall_hist[0], stall_hist[1], stall_hist[2], stall_hist[3], rt_seeks, rt_sectors_read);
+   }
+
    if(SBMutex)
    {
       slock_free((slock_t*)SBMutex);
       SBMutex = NULL;
    }
 
+   if(SBCond)
+   {
+      scond_free((scond_t*)SBCond);
+      SBCond = NULL;
+   }
+
    if(disc_cdaccess)
    {
       delete disc_cdaccess;
@@ -492,10 +601,45 @@ bool CDIF::ValidateRawSector(uint8 *buf)
    return(true);
 }
 
+// Copies out the sector in the slot if it's the one wanted and wasn't replaced while copying.
+bool CDIF_MT::SB_TryCopy(uint32 slot, uint8 *buf, uint32 lba, bool *error_condition)
+{
+   const CDIF_Sector_Buffer *sb = &SectorBuffers[slot];
+   const uint32 seq = SB_LOAD_ACQUIRE(&sb->seq);
+
+   if(!seq || (seq & 1) || sb->lba != lba)
+      return(false);
+
+   *error_condition = sb->error;
+   memcpy(buf, sb->data, 2352 + 96);
+
+   SB_FENCE_ACQUIRE();
+
+   return(SB_LOAD_ACQUIRE(&sb->seq) == seq);
+}
+
+bool CDIF_MT::SB_Lookup(uint8 *buf, uint32 lba, bool *error_condition)
+{
+   const uint32 indexed = SB_LOAD_ACQUIRE(&SBIndex[lba & (SBIndexSize - 1)]);
+
+   if(indexed && SB_TryCopy(indexed - 1, buf, lba, error_condition))
+      return(true);
+
+   // Another sector with the same index entry may have been read since.
+   for(uint32 i = 0; i < SBSize; i++)
+   {
+      if(SB_TryCopy(i, buf, lba, error_condition))
+         return(true);
+   }
+
+   return(false);
+}
+
 bool CDIF_MT::ReadRawSector(uint8 *buf, uint32 lba)
 {
-   bool found = FALSE;
    bool error_condition = false;
+   bool stalled = false;
+   retro_time_t stall_start = 0;
 
    if(UnrecoverableError)
    {
@@ -513,26 +657,35 @@ bool CDIF_MT::ReadRawSector(uint8 *buf, uint32 lba)
 
    ReadThreadQueue.Write(CDIF_Message(CDIF_MSG_READ_SECTOR, lba));
 
-   slock_lock((slock_t*)SBMutex);
+   reads++;
 
-   do
+   if(!SB_Lookup(buf, lba, &error_condition))
    {
-      int i;
-      for(i = 0; i < SBSize; i++)
-      {
-         if(SectorBuffers[i].valid && SectorBuffers[i].lba == lba)
-         {
-            error_condition = SectorBuffers[i].error;
-            memcpy(buf, SectorBuffers[i].data, 2352 + 96);
-            found = TRUE;
-         }
-      }
+      stalled = true;
+      stalls++;
+
+      if(perf_cb.get_time_usec)
+         stall_start = perf_cb.get_time_usec();
+
+      slock_lock((slock_t*)SBMutex);
 
-      if(!found)
+      SB_STORE_RELEASE(&SBWaiting, 1);
+      SB_FENCE_FULL();
+
+      while(!SB_Lookup(buf, lba, &error_condition))
          scond_wait((scond_t*)SBCond, (slock_t*)SBMutex);
-   } while(!found);
 
-   slock_unlock((slock_t*)SBMutex);
+      SB_STORE_RELEASE(&SBWaiting, 0);
+
+      slock_unlock((slock_t*)SBMutex);
+   }
+
+   if(stalled && perf_cb.get_time_usec)
+   {
+      const retro_time_t t = perf_cb.get_time_usec() - stall_start;
+
+      stall_hist[(t < 1000) ? 0 : (t < 4000) ? 1 : (t < 16000) ? 2 : 3]++;
+   }
 
    return(!error_condition);
 }
@@ -565,10 +718,10 @@ bool CDIF_MT::ReadRawSectorPWOnly(uint8 *buf, uint32 lba, bool hint_fullread)
 
 void CDIF_MT::HintReadSector(uint32 lba)
 {
-   if(UnrecoverableError)
+   if(UnrecoverableError || lba >= disc_toc.tracks[100].lba)
       return;
 
-   ReadThreadQueue.Write(CDIF_Message(CDIF_MSG_READ_SECTOR, lba));
+   ReadThreadQueue.Write(CDIF_Message(CDIF_MSG_READ_SECTOR, lba, 1));
 }
 
 int CDIF::ReadSector(uint8* pBuf, uint32 lba, uint32 nSectors)
@@ -890,7 +1043,8 @@ CDIF *CDIF_Open(const char *path, const bool is_device, bool image_memcache)
 {
    CDAccess *cda = cdaccess_open_image(path, image_memcache);
 
-   if(!image_memcache)
+   // The read thread hides waiting for the parts of a preloaded image that aren't loaded yet.
+   if(!image_memcache || MDFN_GetSettingB("cdrom.image_preload"))
       return new CDIF_MT(cda);
    return new CDIF_ST(cda); 
 }
@@ -115,6 +115,37 @@ unsigned long  edctable[256] =
  0x71C0FC00L, 0xE151FD01L, 0xE0E1FE01L, 0x7070FF00L
 };
 
+/*
+ * Tables for processing 8 bytes at a time("slicing-by-8"):
+ * edctable8[k][b] is the CRC of byte b followed by k zero bytes.
+ */
+
+static uint32_t edctable8[8][256];
+static int edctable8_inited = 0;
+
+void EDCCrc32_Init(void)
+{
+   int i, k;
+
+   if(edctable8_inited)
+      return;
+
+   for(i = 0; i < 256; i++)
+      edctable8[0][i] = edctable[i];
+
+   for(k = 1; k < 8; k++)
+   {
+      for(i = 0; i < 256; i++)
+      {
+         const uint32_t prev = edctable8[k - 1][i];
+
+         edctable8[k][i] = edctable8[0][prev & 0xFF] ^ (prev >> 8);
+      }
+   }
+
+   edctable8_inited = 1;
+}
+
 /*
  * CDROM EDC calculation
  */
@@ -123,8 +154,24 @@ uint32_t EDCCrc32(const unsigned char *data, int len)
 {
    uint32_t crc = 0;
 
+   if(!edctable8_inited)
+      EDCCrc32_Init();
+
+   while(len >= 8)
+   {
+      crc ^= data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+
+      crc = edctable8[7][crc & 0xFF] ^ edctable8[6][(crc >> 8) & 0xFF] ^
+            edctable8[5][(crc >> 16) & 0xFF] ^ edctable8[4][crc >> 24] ^
+            edctable8[3][data[4]] ^ edctable8[2][data[5]] ^
+            edctable8[1][data[6]] ^ edctable8[0][data[7]];
+
+      data += 8;
+      len -= 8;
+   }
+
    while(len--)
-      crc = edctable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+      crc = edctable8[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
 
    return crc;
 }
@@ -7,6 +7,9 @@
 extern "C" {
 #endif
 
+/* Sets up the tables EDCCrc32() uses; done on its first use otherwise. */
+void EDCCrc32_Init(void);
+
 uint32_t EDCCrc32(const unsigned char*, int);
 
 #ifdef __cplusplus
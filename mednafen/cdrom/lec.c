@@ -20,13 +20,13 @@
 #include <assert.h>
 #include <sys/types.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "lec.h"
+#include "edc_crc32.h"
 
 #define GF8_PRIM_POLY 0x11d /* x^8 + x^4 + x^3 + x^2 + 1 */
 
-#define EDC_POLY 0x8001801b /* (x^16 + x^15 + x^2 + 1) (x^16 + x^2 + x + 1) */
-
 #define LEC_HEADER_OFFSET 12
 #define LEC_DATA_OFFSET 16
 #define LEC_MODE1_DATA_LEN 2048
@@ -39,70 +39,32 @@
 #define LEC_MODE2_FORM2_DATA_LEN (2324+8)
 #define LEC_MODE2_FORM2_EDC_OFFSET 2348
 
-static uint8_t GF8_LOG[256];
-static uint8_t GF8_ILOG[256];
-
-uint16_t cf8_table[43][256];
-uint32_t crc_table[256];
-uint8_t scramble_table[2340];
+#define LEC_P_ROWS 24
+#define LEC_P_ROW_LEN (2 * 43)
+#define LEC_Q_ROWS 26
+#define LEC_Q_VECTOR_LEN 43
 
-/* Addition in the GF(8) domain: just the XOR of the values.
+/* GF8_DIV3[x ^ (x * a)] = x, dividing by a + 1 where a is the primitive
+ * element(2).
  */
-#define gf8_add(a,  b) (a) ^ (b)
-
-/* Division in the GF(8) domain: Like multiplication but logarithms a
- * subtracted.
- */
-static uint8_t gf8_div(uint8_t a, uint8_t b)
-{
-  int16_t sum;
-
-  assert(b != 0);
-
-  if (a == 0)
-    return 0;
-
-  sum = GF8_LOG[a] - GF8_LOG[b];
-
-  if (sum < 0)
-    sum += 255;
-
-  return GF8_ILOG[sum];
-}
+static uint8_t GF8_DIV3[256];
 
+uint8_t scramble_table[2340];
 
-/* Reverses the bits in 'd'. 'bits' defines the bit width of 'd'.
+/* Calculates the EDC of given data with given lengths.
  */
-static uint32_t mirror_bits(uint32_t d, int bits)
+static uint32_t calc_edc(uint8_t *data, int len)
 {
-  int i;
-  uint32_t r = 0;
-
-  for (i = 0; i < bits; i++)
-  {
-    r <<= 1;
-
-    if ((d & 0x1) != 0)
-      r |= 0x1;
-
-    d >>= 1;
-  }
-
-  return r;
+  return EDCCrc32(data, len);
 }
 
-
-/* Calculates the CRC of given data with given lengths based on the
- * table lookup algorithm.
+/* Multiplication by a in the GF(8) domain of each of the 8 bytes of 'x'.
  */
-static uint32_t calc_edc(uint8_t *data, int len)
+static uint64_t gf8_mul2x8(uint64_t x)
 {
-  uint32_t crc = 0;
-
-  while (len--)
-    crc = crc_table[(int)(crc ^ *data++) & 0xff] ^ (crc >> 8);
+   const uint64_t carry = (x >> 7) & 0x0101010101010101ULL;
 
-  return crc;
+   return ((x & 0x7F7F7F7F7F7F7F7FULL) << 1) ^ (carry * (GF8_PRIM_POLY & 0xFF));
 }
 
 /* Build the scramble table as defined in the yellow book. The bytes
@@ -134,139 +96,26 @@ static void scramble_table_init(void)
    }
 }
 
-/* Build the CRC lookup table for EDC_POLY poly. The CRC is 32 bit wide
- * and reversed (i.e. the bit stream is divided by the EDC_POLY with the
- * LSB first order).
- */
-static void crc_table_init(void)
+static void gf8_div3_table_init(void)
 {
-   uint32_t i, j;
-   uint32_t r;
-
-   for (i = 0; i < 256; i++)
-   {
-      r = mirror_bits(i, 8);
-
-      r <<= 24;
-
-      for (j = 0; j < 8; j++)
-      {
-         r <<= 1;
-         if ((r & 0x80000000) != 0)
-            r ^= EDC_POLY;
-      }
-
-      r = mirror_bits(r, 32);
-
-      crc_table[i] = r;
-   }
-}
-
-/* Creates the logarithm and inverse logarithm table that is required
- * for performing multiplication in the GF(8) domain.
- */
-static void gf8_create_log_tables(void)
-{
-   uint8_t log;
    uint16_t b;
 
    for (b = 0; b <= 255; b++)
    {
-      GF8_LOG[b] = 0;
-      GF8_ILOG[b] = 0;
-   }
-
-   b = 1;
-
-   for (log = 0; log < 255; log++)
-   {
-      GF8_LOG[(uint8_t)b] = log;
-      GF8_ILOG[log] = (uint8_t)b;
-
-      b <<= 1;
-
-      if ((b & 0x100) != 0) 
-         b ^= GF8_PRIM_POLY;
-   }
-}
-
-static void cf8_table_init(void)
-{
-   int i, j;
-   uint16_t c;
-   uint8_t GF8_COEFFS_HELP[2][45]; 
-   uint8_t GF8_Q_COEFFS[2][45];
-
-   gf8_create_log_tables();
-
-   /* build matrix H:
-    *  1    1   ...  1   1
-    * a^44 a^43 ... a^1 a^0
-    *
-    * 
-    */
-
-   for (j = 0; j < 45; j++)
-   {
-      GF8_COEFFS_HELP[0][j] = 1;               /* e0 */
-      GF8_COEFFS_HELP[1][j] = GF8_ILOG[44-j];  /* e1 */
-   }
-
-
-   /* resolve equation system for parity byte 0 and 1 */
-
-   /* e1' = e1 + e0 */
-   for (j = 0; j < 45; j++)
-      GF8_Q_COEFFS[1][j] = gf8_add(GF8_COEFFS_HELP[1][j],
-            GF8_COEFFS_HELP[0][j]);
-
-   /* e1'' = e1' / (a^1 + 1) */
-   for (j = 0; j < 45; j++)
-      GF8_Q_COEFFS[1][j] = gf8_div(GF8_Q_COEFFS[1][j], GF8_Q_COEFFS[1][43]);
+      uint16_t b2 = b << 1;
 
-   /* e0' = e0 + e1 / a^1 */
-   for (j = 0; j < 45; j++)
-      GF8_Q_COEFFS[0][j] = gf8_add(GF8_COEFFS_HELP[0][j],
-            gf8_div(GF8_COEFFS_HELP[1][j],
-               GF8_ILOG[1]));
+      if ((b2 & 0x100) != 0)
+         b2 ^= GF8_PRIM_POLY;
 
-   /* e0'' = e0' / (1 + 1 / a^1) */
-   for (j = 0; j < 45; j++)
-      GF8_Q_COEFFS[0][j] = gf8_div(GF8_Q_COEFFS[0][j], GF8_Q_COEFFS[0][44]);
-
-   /* 
-    * Compute the products of 0..255 with all of the Q coefficients in
-    * advance. When building the scalar product between the data vectors
-    * and the P/Q vectors the individual products can be looked up in
-    * this table
-    *
-    * The P parity coefficients are just a subset of the Q coefficients so
-    * that we do not need to create a separate table for them. 
-    */
-
-   for (j = 0; j < 43; j++)
-   {
-
-      cf8_table[j][0] = 0;
-
-      for (i = 1; i < 256; i++)
-      {
-         c = GF8_LOG[i] + GF8_LOG[GF8_Q_COEFFS[0][j]];
-         if (c >= 255) c -= 255;
-         cf8_table[j][i] = GF8_ILOG[c];
-
-         c = GF8_LOG[i] + GF8_LOG[GF8_Q_COEFFS[1][j]];
-         if (c >= 255) c -= 255;
-         cf8_table[j][i] |= GF8_ILOG[c]<<8;
-      }
+      GF8_DIV3[b ^ b2] = (uint8_t)b;
    }
 }
 
 void lec_tables_init(void)
 {
    scramble_table_init();
-   crc_table_init();
-   cf8_table_init();
+   EDCCrc32_Init();
+   gf8_div3_table_init();
 }
 
 /* Calc EDC for a MODE 1 sector
@@ -335,102 +184,109 @@ static void set_sector_header(uint8_t mode, uint32_t adr, uint8_t *sector)
   sector[LEC_HEADER_OFFSET + 3] = mode;
 }
 
+/* Both parities are two check bytes of a Reed-Solomon code over vectors of
+ * bytes, the bytes at the same position of a pair being in different
+ * vectors.  With 'x' the primitive element, for the vector d[0] ... d[n-1]
+ *   A = d[0] * x^n + d[1] * x^(n-1) + ... + d[n-1] * x
+ *   B = d[0] + d[1] + ... + d[n-1]
+ * the check bytes are p0 = (A * x + B) / (x + 1) and p1 = p0 + B.  The sums
+ * are built up a vector element at a time(Horner's method for A), for 8
+ * vectors at once in a 64 bit word.
+ */
+static void calc_parity_finish(const uint64_t *a, const uint64_t *b, int len,
+                               uint8_t *p0, uint8_t *p1)
+{
+   uint8_t ab[8 * 11], bb[8 * 11];
+   int i;
+
+   for (i = 0; i < (len + 7) / 8; i++)
+   {
+      const uint64_t t = gf8_mul2x8(a[i]) ^ b[i];
+
+      memcpy(ab + i * 8, &t, 8);
+      memcpy(bb + i * 8, &b[i], 8);
+   }
+
+   for (i = 0; i < len; i++)
+   {
+      p0[i] = GF8_DIV3[ab[i]];
+      p1[i] = p0[i] ^ bb[i];
+   }
+}
+
 /* Calculate the P parities for the sector.
- * The 43 P vectors of length 24 are combined with the GF8_P_COEFFS.
+ * The 86 P vectors(columns) of length 24 are the bytes at the same offset
+ * in each of the 24 rows of 86 bytes from the header on.
  */
 static void calc_P_parity(uint8_t *sector)
 {
+   uint64_t a[11], b[11];
+   const uint8_t *row = sector + LEC_HEADER_OFFSET;
    int i, j;
-   uint16_t p01_msb, p01_lsb;
-   uint8_t *p_lsb_start;
-   uint8_t *p_lsb;
-   uint8_t *p0, *p1;
-   uint8_t d0,d1;
-
-   p_lsb_start = sector + LEC_HEADER_OFFSET;
 
-   p1 = sector + LEC_MODE1_P_PARITY_OFFSET;
-   p0 = sector + LEC_MODE1_P_PARITY_OFFSET + 2 * 43;
+   memset(a, 0, sizeof(a));
+   memset(b, 0, sizeof(b));
 
-   for (i = 0; i <= 42; i++)
+   for (j = 0; j < LEC_P_ROWS; j++)
    {
-      p_lsb = p_lsb_start;
+      uint64_t d[11];
 
-      p01_lsb = p01_msb = 0;
+      /* 88 bytes, the 2 past the row are ignored */
+      memcpy(d, row, sizeof(d));
 
-      for (j = 19; j <= 42; j++)
+      for (i = 0; i < 11; i++)
       {
-         d0 = *p_lsb;
-         d1 = *(p_lsb+1);
-
-         p01_lsb ^= cf8_table[j][d0];
-         p01_msb ^= cf8_table[j][d1];
-
-         p_lsb += 2 * 43;
+         a[i] = gf8_mul2x8(a[i] ^ d[i]);
+         b[i] ^= d[i];
       }
 
-      *p0 = p01_lsb;
-      *(p0 + 1) = p01_msb;
-
-      *p1 = p01_lsb>>8;
-      *(p1 + 1) = p01_msb>>8;
-
-      p0 += 2;
-      p1 += 2;
-
-      p_lsb_start += 2;
+      row += LEC_P_ROW_LEN;
    }
+
+   calc_parity_finish(a, b, LEC_P_ROW_LEN,
+                      sector + LEC_MODE1_P_PARITY_OFFSET,
+                      sector + LEC_MODE1_P_PARITY_OFFSET + LEC_P_ROW_LEN);
 }
 
 /* Calculate the Q parities for the sector.
- * The 26 Q vectors of length 43 are combined with the GF8_Q_COEFFS.
+ * Taken as 26 rows of 43 byte pairs from the header on(P parity included),
+ * element j of Q vector i is the pair in column j of row (i + j) % 26.
  */
 static void calc_Q_parity(uint8_t *sector)
 {
+   uint64_t a[7], b[7];
+   const uint8_t *data = sector + LEC_HEADER_OFFSET;
    int i, j;
-   uint16_t q01_lsb, q01_msb;
-   uint8_t *q_lsb_start;
-   uint8_t *q_lsb;
-   uint8_t *q0, *q1, *q_start;
-   uint8_t d0,d1;
-
-   q_lsb_start = sector + LEC_HEADER_OFFSET;
 
-   q_start = sector + LEC_MODE1_Q_PARITY_OFFSET;
-   q1 = sector + LEC_MODE1_Q_PARITY_OFFSET;
-   q0 = sector + LEC_MODE1_Q_PARITY_OFFSET + 2 * 26;
+   memset(a, 0, sizeof(a));
+   memset(b, 0, sizeof(b));
 
-   for (i = 0; i <= 25; i++)
+   for (j = 0; j < LEC_Q_VECTOR_LEN; j++)
    {
-      q_lsb = q_lsb_start;
+      uint64_t d[7];
+      uint8_t *db = (uint8_t *)d;
+      int row = j % LEC_Q_ROWS;
 
-      q01_lsb = q01_msb = 0;
-
-      for (j = 0; j <= 42; j++)
+      for (i = 0; i < LEC_Q_ROWS; i++)
       {
-         d0 = *q_lsb;
-         d1 = *(q_lsb+1);
-
-         q01_lsb ^= cf8_table[j][d0];
-         q01_msb ^= cf8_table[j][d1];
-
-         q_lsb += 2 * 44;
+         memcpy(db + i * 2, data + (row * LEC_Q_VECTOR_LEN + j) * 2, 2);
 
-         if (q_lsb >= q_start)
-            q_lsb -= 2 * 1118;
+         if (++row == LEC_Q_ROWS)
+            row = 0;
       }
 
-      *q0 = q01_lsb;
-      *(q0 + 1) = q01_msb;
+      db[52] = db[53] = db[54] = db[55] = 0;
 
-      *q1 = q01_lsb>>8;
-      *(q1 + 1) = q01_msb>>8;
-
-      q0 += 2;
-      q1 += 2;
-
-      q_lsb_start += 2 * 43;
+      for (i = 0; i < 7; i++)
+      {
+         a[i] = gf8_mul2x8(a[i] ^ d[i]);
+         b[i] ^= d[i];
+      }
    }
+
+   calc_parity_finish(a, b, 2 * LEC_Q_ROWS,
+                      sector + LEC_MODE1_Q_PARITY_OFFSET,
+                      sector + LEC_MODE1_Q_PARITY_OFFSET + 2 * LEC_Q_ROWS);
 }
 
 /* Encodes a MODE 0 sector.
@@ -476,6 +332,16 @@ void lec_encode_mode1_sector(uint32_t adr, uint8_t *sector)
    calc_Q_parity(sector);
 }
 
+/* Recalculates the P and Q parities of a sector, over the header and
+ * data as they are(so with the header cleared first for MODE 2 FORM 1).
+ * 'sector' must be 2352 byte wide
+ */
+void lec_encode_ecc(uint8_t *sector)
+{
+   calc_P_parity(sector);
+   calc_Q_parity(sector);
+}
+
 /* Encodes a MODE 2 sector.
  * 'adr' is the current physical sector address
  * 'sector' must be 2352 byte wide containing 2336 bytes user data at
@@ -26,6 +26,7 @@
 #include "general.h"
 #include "md5.h"
 #include "mempatcher.h"
+#include "rewind.h"
 
 #ifdef _WIN32
 #include <compat/msvc.h>
@@ -399,6 +400,7 @@ void MDFNMP_ApplyPeriodicCheats(void)
                      tmpval >>= x * 8;
 
                   RAMPtrs[page][(chit->addr + x) % PageSize] = tmpval;
+                  MDFN_RewindMarkPtr(&RAMPtrs[page][(chit->addr + x) % PageSize]);
                }
             }
       }
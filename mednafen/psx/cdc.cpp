@@ -1106,6 +1106,9 @@ int32_t PS_CDC::Update(const int32_t timestamp)
 
          if(PSRCounter <= 0) 
          {
+            // The SPU mustn't see the CD audio from here on before it's due.
+            SPU->RenderDeferred();
+
             switch (DriveStatus)
             {
                case DS_RESETTING:
@@ -1199,6 +1202,8 @@ int32_t PS_CDC::Update(const int32_t timestamp)
          {
             int32 next_time = 0;
 
+            SPU->RenderDeferred();
+
             if(PendingCommandPhase >= 2)	// Command phase 2+
             {
                BeginResults();
@@ -1312,6 +1317,7 @@ void PS_CDC::Write(const int32_t timestamp, uint32 A, uint8 V)
       const unsigned reg_index = ((RegSelector & 0x3) * 3) + (A - 1);
 
       Update(timestamp);
+      SPU->RenderDeferred();
       //PSX_WARNING("[CDC] Write to register 0x%02x: 0x%02x @ %d --- 0x%02x 0x%02x\n", reg_index, V, timestamp, DMABuffer.CanRead(), IRQBuffer);
 
       switch(reg_index)
@@ -1563,6 +1569,10 @@ int32 PS_CDC::Command_Setloc(const int arg_count, const uint8 *args)
    CommandLoc = f + 75 * s + 75 * 60 * m - 150;
    CommandLoc_Dirty = true;
 
+   // Have the disc reader start on the seek target while the game gets around to seeking.
+   if(Cur_CDIF && CommandLoc >= 0)
+      Cur_CDIF->HintReadSector(CommandLoc);
+
    WriteResult(MakeStatus());
    WriteIRQ(CDCIRQ_ACKNOWLEDGE);
 
@@ -1623,6 +1633,9 @@ void PS_CDC::PreSeekHack(uint32 target)
    CurSector = target;	// If removing/changing this, take into account how it will affect ReadN/ReadS/Play/etc command calls that interrupt a seek.
    SeekRetryCounter = 128;
 
+   // Seeks that didn't come from a Setloc(e.g. Play with a track number) haven't been hinted yet.
+   Cur_CDIF->HintReadSector(target);
+
    // If removing this SubQ reading bit, think about how it will interact with a Read command of data(or audio :b) sectors when Mode bit0 is 1.
    do
    {
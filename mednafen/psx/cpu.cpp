@@ -20,6 +20,7 @@
 
 
 extern bool psx_cpu_overclock;
+extern int psx_cpu_jit;
 
 /* TODO
 	Make sure load delays are correct.
@@ -51,6 +52,15 @@ PS_CPU::PS_CPU()
    CPUHook = NULL;
    ADDBT = NULL;
 
+#ifdef PS_CPU_JIT
+   JIT = NULL;
+   JIT_Exit = 0;
+   JIT_FlushPending = 0;
+   JIT_LockstepBus = 0;
+   JIT_Retired = 0;
+   memset(JIT_CodePages, 0, sizeof(JIT_CodePages));
+#endif
+
    GTE_Init();
 
    for(i = 0; i < 24; i++)
@@ -69,8 +79,9 @@ PS_CPU::PS_CPU()
 
 PS_CPU::~PS_CPU()
 {
-
-
+#ifdef PS_CPU_JIT
+   JIT_Free();
+#endif
 }
 
 void PS_CPU::SetFastMap(void *region_mem, uint32_t region_address, uint32_t region_size)
@@ -83,6 +94,48 @@ void PS_CPU::SetFastMap(void *region_mem, uint32_t region_address, uint32_t regi
       FastMap[A >> FAST_MAP_SHIFT] = ((uint8_t *)region_mem - region_address);
 }
 
+void PS_CPU::DecodeInstr(DecodedInstr *d, uint32_t instr)
+{
+   uint32_t opf = instr & 0x3F;
+
+   if(instr & (0x3F << 26))
+      opf = 0x40 | (instr >> 26);
+
+   d->instr = instr;
+   d->opf = opf;
+   d->rs = (instr >> 21) & 0x1F;
+   d->rt = (instr >> 16) & 0x1F;
+   d->rd = (instr >> 11) & 0x1F;
+   d->shamt = (instr >> 6) & 0x1F;
+
+   switch(opf)
+   {
+      // J, JAL
+      case 0x42:
+      case 0x43:
+         d->immediate = instr & ((1 << 26) - 1);
+         break;
+
+      // ANDI, ORI, XORI, LUI
+      case 0x4C:
+      case 0x4D:
+      case 0x4E:
+      case 0x4F:
+         d->immediate = instr & 0xFFFF;
+         break;
+
+      default:
+         d->immediate = (int32)(int16)(instr & 0xFFFF);
+         break;
+   }
+}
+
+void PS_CPU::RedecodeICache(void)
+{
+   for(unsigned i = 0; i < 1024; i++)
+      DecodeInstr(&ICacheDecoded[i], ICache[i].Data);
+}
+
 INLINE void PS_CPU::RecalcIPCache(void)
 {
    IPCache = 0;
@@ -147,6 +200,11 @@ void PS_CPU::Power(void)
       ICache[i].TV = 0x2 | ((BIU & 0x800) ? 0x0 : 0x1);
       ICache[i].Data = 0;
    }
+   RedecodeICache();
+
+#ifdef PS_CPU_JIT
+   JIT_FlushPending = 1;
+#endif
 
    GTE_Power();
 }
@@ -187,13 +245,26 @@ int PS_CPU::StateAction(StateMem *sm, int load, int data_only)
 
       SFEND
    };
+#ifdef PS_CPU_JIT
+   const uint32_t old_BIU = BIU;
+   const uint32_t old_SR = CP0.SR;
+#endif
    int ret = MDFNSS_StateAction(sm, load, data_only, StateRegs, "CPU");
 
    ret &= GTE_StateAction(sm, load, data_only);
 
    if(load)
    {
+      RedecodeICache();
+
+#ifdef PS_CPU_JIT
+      // Compiled blocks check their instruction words as they run, so only the settings baked into them at compile
+      // time(see SetBIU() and the SR write) call for a full flush; run-ahead loads a state every frame.
+      if(((BIU ^ old_BIU) & 0x800) || ((CP0.SR ^ old_SR) & 0x10000))
+         JIT_FlushPending = 1;
 
+      JIT_CheckCodePages();
+#endif
    }
 
    return(ret);
@@ -221,6 +292,11 @@ void PS_CPU::SetBIU(uint32_t val)
    {
       unsigned i;
 
+#ifdef PS_CPU_JIT
+      // Compiled blocks bake in whether they're fetching through the I-cache.
+      JIT_FlushPending = 1;
+#endif
+
       if(BIU & 0x800)	// ICache enabled
       {
          for(i = 0; i < 1024; i++)
@@ -306,6 +382,11 @@ INLINE T PS_CPU::ReadMemory(int32_t &timestamp, uint32_t address, bool DS24, boo
 
    int32_t lts = timestamp;
 
+#ifdef PS_CPU_JIT
+   if(MDFN_UNLIKELY(JIT_LockstepBus))
+      ret = JIT_LockstepAccess(lts, address, 0, DS24 ? 3 : sizeof(T), false);
+   else
+#endif
    if(sizeof(T) == 1)
       ret = PSX_MemRead8(lts, address);
    else if(sizeof(T) == 2)
@@ -358,6 +439,14 @@ INLINE void PS_CPU::WriteMemory(int32_t &timestamp, uint32_t address, uint32_t v
       //WriteAbsorb |= (3U << (WriteAbsorbCount * 8));
       //WriteAbsorbCount++;
 
+#ifdef PS_CPU_JIT
+      if(address < 0x00800000 && JIT_CodePages[(address & 0x1FFFFF) >> 12])
+         JIT_InvalidatePage(address);
+
+      if(MDFN_UNLIKELY(JIT_LockstepBus))
+         JIT_LockstepAccess(timestamp, address, value, DS24 ? 3 : sizeof(T), true);
+      else
+#endif
       if(sizeof(T) == 1)
          PSX_MemWrite8(timestamp, address, value);
       else if(sizeof(T) == 2)
@@ -388,6 +477,7 @@ INLINE void PS_CPU::WriteMemory(int32_t &timestamp, uint32_t address, uint32_t v
          else if(!(BIU & 0x1))
          {
             ICache[(address & 0xFFC) >> 2].Data = value << ((address & 0x3) * 8);
+            DecodeInstr(&ICacheDecoded[(address & 0xFFC) >> 2], ICache[(address & 0xFFC) >> 2].Data);
          }
       }
 
@@ -448,6 +538,53 @@ uint32_t PS_CPU::Exception(uint32_t code, uint32_t PC, const uint32 NP, const ui
    return(handler);
 }
 
+// Refills the I-cache line containing PC, from PC to the end of the line.
+INLINE void PS_CPU::ICacheFill(int32_t &timestamp, uint32_t PC)
+{
+   __ICache *ICI = &ICache[((PC & 0xFF0) >> 2)];
+   DecodedInstr *DI = &ICacheDecoded[((PC & 0xFF0) >> 2)];
+   const uint32_t *FMP = (uint32_t *)&FastMap[(PC &~ 0xF) >> FAST_MAP_SHIFT][PC &~ 0xF];
+
+   // | 0x2 to simulate (in)validity bits.
+   ICI[0x00].TV = (PC &~ 0xF) | 0x00 | 0x2;
+   ICI[0x01].TV = (PC &~ 0xF) | 0x04 | 0x2;
+   ICI[0x02].TV = (PC &~ 0xF) | 0x08 | 0x2;
+   ICI[0x03].TV = (PC &~ 0xF) | 0x0C | 0x2;
+
+   // When overclock is enabled, remove code cache fetch latency
+   if (!psx_cpu_overclock)
+      timestamp += 3;
+
+   switch(PC & 0xC)
+   {
+      case 0x0:
+         if (!psx_cpu_overclock)
+            timestamp++;
+         ICI[0x00].TV &= ~0x2;
+         ICI[0x00].Data = LoadU32_LE(&FMP[0]);
+         DecodeInstr(&DI[0x00], ICI[0x00].Data);
+      case 0x4:
+         if (!psx_cpu_overclock)
+            timestamp++;
+         ICI[0x01].TV &= ~0x2;
+         ICI[0x01].Data = LoadU32_LE(&FMP[1]);
+         DecodeInstr(&DI[0x01], ICI[0x01].Data);
+      case 0x8:
+         if (!psx_cpu_overclock)
+            timestamp++;
+         ICI[0x02].TV &= ~0x2;
+         ICI[0x02].Data = LoadU32_LE(&FMP[2]);
+         DecodeInstr(&DI[0x02], ICI[0x02].Data);
+      case 0xC:
+         if (!psx_cpu_overclock)
+            timestamp++;
+         ICI[0x03].TV &= ~0x2;
+         ICI[0x03].Data = LoadU32_LE(&FMP[3]);
+         DecodeInstr(&DI[0x03], ICI[0x03].Data);
+         break;
+   }
+}
+
 #define BACKING_TO_ACTIVE			\
 	PC = BACKED_PC;				\
 	new_PC = BACKED_new_PC;			\
@@ -467,31 +604,37 @@ uint32_t PS_CPU::Exception(uint32_t code, uint32_t PC, const uint32 NP, const ui
 #define GPR_RES(n) { unsigned tn = (n); ReadAbsorb[tn] = 0; }
 #define GPR_DEPRES_END ReadAbsorb[0] = back; }
 
-template<bool DebugMode>
+// With SingleStep, exactly one instruction is executed and gte_ts_done/muldiv_ts_done are
+// left as absolute timestamps; the caller(RunJIT()) is responsible for the event loop.
+template<bool DebugMode, bool SingleStep>
 int32_t PS_CPU::RunReal(int32_t timestamp_in)
 {
-   register int32_t timestamp = timestamp_in;
+   int32_t timestamp = timestamp_in;
 
-   register uint32_t PC;
-   register uint32_t new_PC;
-   register uint32_t new_PC_mask;
-   register uint32_t LDWhich;
-   register uint32_t LDValue;
+   uint32_t PC;
+   uint32_t new_PC;
+   uint32_t new_PC_mask;
+   uint32_t LDWhich;
+   uint32_t LDValue;
 
    //printf("%d %d\n", gte_ts_done, muldiv_ts_done);
 
-   gte_ts_done += timestamp;
-   muldiv_ts_done += timestamp;
+   if(!SingleStep)
+   {
+      gte_ts_done += timestamp;
+      muldiv_ts_done += timestamp;
+   }
 
    BACKING_TO_ACTIVE;
 
    do
    {
       //printf("Running: %d %d\n", timestamp, next_event_ts);
-      while(MDFN_LIKELY(timestamp < next_event_ts))
+      while(MDFN_LIKELY(SingleStep || timestamp < next_event_ts))
       {
          uint32_t instr;
          uint32_t opf;
+         const DecodedInstr *dec;
 
          // Zero must be zero...until the Master Plan is enacted.
          GPR[0] = 0;
@@ -526,7 +669,7 @@ int32_t PS_CPU::RunReal(int32_t timestamp_in)
             goto OpDone;
          }
 
-         instr = ICache[(PC & 0xFFC) >> 2].Data;
+         dec = &ICacheDecoded[(PC & 0xFFC) >> 2];
 
          if(ICache[(PC & 0xFFC) >> 2].TV != PC)
          {
@@ -539,7 +682,8 @@ int32_t PS_CPU::RunReal(int32_t timestamp_in)
             // FIXME: Handle executing out of scratchpad.
             if(PC >= 0xA0000000 || !(BIU & 0x800))
             {
-               instr = LoadU32_LE((uint32_t *)&FastMap[PC >> FAST_MAP_SHIFT][PC]);
+               DecodeInstr(&DecodeScratch, LoadU32_LE((uint32_t *)&FastMap[PC >> FAST_MAP_SHIFT][PC]));
+               dec = &DecodeScratch;
 
                if (!psx_cpu_overclock)
                {
@@ -551,59 +695,17 @@ int32_t PS_CPU::RunReal(int32_t timestamp_in)
                }
             }
             else
-            {
-               __ICache *ICI = &ICache[((PC & 0xFF0) >> 2)];
-               const uint32_t *FMP = (uint32_t *)&FastMap[(PC &~ 0xF) >> FAST_MAP_SHIFT][PC &~ 0xF];
-
-               // | 0x2 to simulate (in)validity bits.
-               ICI[0x00].TV = (PC &~ 0xF) | 0x00 | 0x2;
-               ICI[0x01].TV = (PC &~ 0xF) | 0x04 | 0x2;
-               ICI[0x02].TV = (PC &~ 0xF) | 0x08 | 0x2;
-               ICI[0x03].TV = (PC &~ 0xF) | 0x0C | 0x2;
-
-               // When overclock is enabled, remove code cache fetch latency
-               if (!psx_cpu_overclock)
-                  timestamp += 3;
-
-               switch(PC & 0xC)
-               {
-                  case 0x0:
-                     if (!psx_cpu_overclock)
-                        timestamp++;
-                     ICI[0x00].TV &= ~0x2;
-                     ICI[0x00].Data = LoadU32_LE(&FMP[0]);
-                  case 0x4:
-                     if (!psx_cpu_overclock)
-                        timestamp++;
-                     ICI[0x01].TV &= ~0x2;
-                     ICI[0x01].Data = LoadU32_LE(&FMP[1]);
-                  case 0x8:
-                     if (!psx_cpu_overclock)
-                        timestamp++;
-                     ICI[0x02].TV &= ~0x2;
-                     ICI[0x02].Data = LoadU32_LE(&FMP[2]);
-                  case 0xC:
-                     if (!psx_cpu_overclock)
-                        timestamp++;
-                     ICI[0x03].TV &= ~0x2;
-                     ICI[0x03].Data = LoadU32_LE(&FMP[3]);
-                     break;
-               }
-               instr = ICache[(PC & 0xFFC) >> 2].Data;
-            }
+               ICacheFill(timestamp, PC);
          }
 
+         instr = dec->instr;
+
          //printf("PC=%08x, SP=%08x - op=0x%02x - funct=0x%02x - instr=0x%08x\n", PC, GPR[29], instr >> 26, instr & 0x3F, instr);
          //for(int i = 0; i < 32; i++)
          // printf("%02x : %08x\n", i, GPR[i]);
          //printf("\n");
 
-         opf = instr & 0x3F;
-
-         if(instr & (0x3F << 26))
-            opf = 0x40 | (instr >> 26);
-
-         opf |= IPCache;
+         opf = dec->opf | IPCache;
 
 #if 0
          {
@@ -643,10 +745,11 @@ int32_t PS_CPU::RunReal(int32_t timestamp_in)
 	}
 
 
-   #define ITYPE uint32 rs MDFN_NOWARN_UNUSED = (instr >> 21) & 0x1F; uint32 rt MDFN_NOWARN_UNUSED = (instr >> 16) & 0x1F; uint32 immediate = (int32)(int16)(instr & 0xFFFF); /*printf(" rs=%02x(%08x), rt=%02x(%08x), immediate=(%08x) ", rs, GPR[rs], rt, GPR[rt], immediate);*/
-   #define ITYPE_ZE uint32 rs MDFN_NOWARN_UNUSED = (instr >> 21) & 0x1F; uint32 rt MDFN_NOWARN_UNUSED = (instr >> 16) & 0x1F; uint32 immediate = instr & 0xFFFF; /*printf(" rs=%02x(%08x), rt=%02x(%08x), immediate=(%08x) ", rs, GPR[rs], rt, GPR[rt], immediate);*/
-   #define JTYPE uint32 target = instr & ((1 << 26) - 1); /*printf(" target=(%08x) ", target);*/
-   #define RTYPE uint32 rs MDFN_NOWARN_UNUSED = (instr >> 21) & 0x1F; uint32 rt MDFN_NOWARN_UNUSED = (instr >> 16) & 0x1F; uint32 rd MDFN_NOWARN_UNUSED = (instr >> 11) & 0x1F; uint32 shamt MDFN_NOWARN_UNUSED = (instr >> 6) & 0x1F; /*printf(" rs=%02x(%08x), rt=%02x(%08x), rd=%02x(%08x) ", rs, GPR[rs], rt, GPR[rt], rd, GPR[rd]);*/
+   // Fields come pre-extracted(see ICacheDecoded); immediates are already sign- or zero-extended as appropriate(see DecodeInstr()).
+   #define ITYPE uint32 rs MDFN_NOWARN_UNUSED = dec->rs; uint32 rt MDFN_NOWARN_UNUSED = dec->rt; uint32 immediate = dec->immediate; /*printf(" rs=%02x(%08x), rt=%02x(%08x), immediate=(%08x) ", rs, GPR[rs], rt, GPR[rt], immediate);*/
+   #define ITYPE_ZE ITYPE
+   #define JTYPE uint32 target = dec->immediate; /*printf(" target=(%08x) ", target);*/
+   #define RTYPE uint32 rs MDFN_NOWARN_UNUSED = dec->rs; uint32 rt MDFN_NOWARN_UNUSED = dec->rt; uint32 rd MDFN_NOWARN_UNUSED = dec->rd; uint32 shamt MDFN_NOWARN_UNUSED = dec->shamt; /*printf(" rs=%02x(%08x), rt=%02x(%08x), rd=%02x(%08x) ", rs, GPR[rs], rt, GPR[rt], rd, GPR[rd]);*/
 
 #if !defined(__GNUC__) || defined(NO_COMPUTED_GOTO)
    /* (uint8) cast for cheaper alternative to generated branch+compare bounds check instructions, but still more
@@ -1040,7 +1143,12 @@ int32_t PS_CPU::RunReal(int32_t timestamp_in)
 
                case CP0REG_SR:
                   if((CP0.SR ^ val) & 0x10000)
+                  {
                      PSX_DBG(PSX_DBG_SPARSE, "[CPU] IsC %u->%u\n", (bool)(CP0.SR & (1U << 16)), (bool)(val & (1U << 16)));
+#ifdef PS_CPU_JIT
+                     JIT_FlushPending = 1;
+#endif
+                  }
 
                   CP0.SR = val & ~( (0x3 << 26) | (0x3 << 23) | (0x3 << 6));
                   RecalcIPCache();
@@ -2285,6 +2393,8 @@ OpDone: ;
 SkipNPCStuff:	;
 
                //printf("\n");
+         if(SingleStep)
+            goto SingleStepDone;
       }
    } while(MDFN_LIKELY(PSX_EventHandler(timestamp)));
 
@@ -2294,18 +2404,240 @@ SkipNPCStuff:	;
    if(muldiv_ts_done > 0)
       muldiv_ts_done -= timestamp;
 
+SingleStepDone:
    ACTIVE_TO_BACKING;
 
    return(timestamp);
 }
 
+#ifdef PS_CPU_JIT
+//
+// Recompiler runtime support; the compiler itself lives in cpu_jit.cpp.
+//
+// Generated code keeps all architectural state in the object(BACKED_*), and only ever enters a
+// block at an instruction boundary outside of a branch delay slot.  Anything a block can't handle
+// (pending interrupts, address errors, stale code) makes it bail out with JIT_Exit set, so that
+// the instruction can be run through the interpreter instead.
+//
+
+int32_t PS_CPU::RunJIT(int32_t timestamp_in)
+{
+   int32_t timestamp = timestamp_in;
+
+   gte_ts_done += timestamp;
+   muldiv_ts_done += timestamp;
+
+   do
+   {
+      while(MDFN_LIKELY(timestamp < next_event_ts))
+      {
+         JITBlock *block = NULL;
+
+         if(psx_cpu_jit != PS_CPU_JIT_DISABLED && !IPCache && BACKED_new_PC == 4 && BACKED_new_PC_mask == ~0U)
+            block = JIT_GetBlock(BACKED_PC);
+
+         if(block)
+         {
+            JIT_Exit = PS_CPU_JIT_EXIT_NORMAL;
+
+            if(psx_cpu_jit == PS_CPU_JIT_LOCKSTEP)
+               timestamp = JIT_RunLockstep(block, timestamp);
+            else
+               timestamp = block->code(this, timestamp);
+
+            if(JIT_Exit == PS_CPU_JIT_EXIT_NORMAL)
+               continue;
+
+            if(JIT_Exit == PS_CPU_JIT_EXIT_STALE)
+               JIT_InvalidateBlock(block);
+         }
+
+         timestamp = RunReal<false, true>(timestamp);
+      }
+   } while(MDFN_LIKELY(PSX_EventHandler(timestamp)));
+
+   if(gte_ts_done > 0)
+      gte_ts_done -= timestamp;
+
+   if(muldiv_ts_done > 0)
+      muldiv_ts_done -= timestamp;
+
+   return(timestamp);
+}
+
+// Runs the block, then replays the same number of instructions through the interpreter from
+// the same starting state(feeding it the bus accesses the block made), and compares the results.
+int32_t PS_CPU::JIT_RunLockstep(JITBlock *block, int32_t timestamp)
+{
+   JITSnapshot *pre  = JIT_LockstepSnapshot(0);
+   JITSnapshot *jit  = JIT_LockstepSnapshot(1);
+   JITSnapshot *intr = JIT_LockstepSnapshot(2);
+   uint8_t exit_code;
+   uint32_t retired;
+   uint32_t i;
+
+   JIT_SaveSnapshot(pre, timestamp);
+
+   JIT_LockstepBegin(false);
+   JIT_Retired = 0;
+   timestamp = block->code(this, timestamp);
+   exit_code = JIT_Exit;
+   retired = JIT_Retired;
+   JIT_SaveSnapshot(jit, timestamp);
+
+   timestamp = JIT_LoadSnapshot(pre);
+   JIT_LockstepBegin(true);
+   for(i = 0; i < retired; i++)
+      timestamp = RunReal<false, true>(timestamp);
+   JIT_LockstepBus = 0;
+   JIT_SaveSnapshot(intr, timestamp);
+
+   if(!JIT_CompareSnapshots(jit, intr, block->PC))
+      psx_cpu_jit = PS_CPU_JIT_DISABLED;
+
+   // The rest of the system saw the block's bus accesses, so its state is the one to keep.
+   timestamp = JIT_LoadSnapshot(jit);
+   JIT_Exit = exit_code;
+
+   return(timestamp);
+}
+
+int32_t PS_CPU::JIT_Step(PS_CPU *cpu, int32_t timestamp, uint32_t PC, uint32_t unused)
+{
+   cpu->BACKED_PC = PC;
+
+   return cpu->RunReal<false, true>(timestamp);
+}
+
+int32_t PS_CPU::JIT_ICacheRefill(PS_CPU *cpu, int32_t timestamp, uint32_t PC, uint32_t unused)
+{
+   cpu->ReadAbsorb[cpu->ReadAbsorbWhich] = 0;
+   cpu->ReadAbsorbWhich = 0;
+
+   cpu->ICacheFill(timestamp, PC);
+
+   return(timestamp);
+}
+
+// MFHI/MFLO interlock; only called when timestamp < muldiv_ts_done.
+int32_t PS_CPU::JIT_MulDivStall(PS_CPU *cpu, int32_t timestamp, uint32_t unused0, uint32_t unused1)
+{
+   if(timestamp == cpu->muldiv_ts_done - 1)
+      cpu->muldiv_ts_done--;
+   else
+   {
+      do
+      {
+         if(cpu->ReadAbsorb[cpu->ReadAbsorbWhich])
+            cpu->ReadAbsorb[cpu->ReadAbsorbWhich]--;
+         timestamp++;
+      } while(timestamp < cpu->muldiv_ts_done);
+   }
+
+   return(timestamp);
+}
+
+int32_t PS_CPU::JIT_MulDiv(PS_CPU *cpu, int32_t timestamp, uint32_t instr, uint32_t unused)
+{
+   const uint32_t rs_val = cpu->GPR[(instr >> 21) & 0x1F];
+   const uint32_t rt_val = cpu->GPR[(instr >> 16) & 0x1F];
+   uint64 result;
+
+   switch(instr & 0x3F)
+   {
+      case 0x18:	// MULT
+         result = (int64)(int32)rs_val * (int32)rt_val;
+         cpu->muldiv_ts_done = timestamp + cpu->MULT_Tab24[MDFN_lzcount32((rs_val ^ ((int32)rs_val >> 31)) | 0x400)];
+         cpu->LO = result;
+         cpu->HI = result >> 32;
+         break;
+
+      case 0x19:	// MULTU
+         result = (uint64)rs_val * rt_val;
+         cpu->muldiv_ts_done = timestamp + cpu->MULT_Tab24[MDFN_lzcount32(rs_val | 0x400)];
+         cpu->LO = result;
+         cpu->HI = result >> 32;
+         break;
+
+      case 0x1A:	// DIV
+         if(!rt_val)
+         {
+            if(rs_val & 0x80000000)
+               cpu->LO = 1;
+            else
+               cpu->LO = 0xFFFFFFFF;
+
+            cpu->HI = rs_val;
+         }
+         else if(rs_val == 0x80000000 && rt_val == 0xFFFFFFFF)
+         {
+            cpu->LO = 0x80000000;
+            cpu->HI = 0;
+         }
+         else
+         {
+            cpu->LO = (int32)rs_val / (int32)rt_val;
+            cpu->HI = (int32)rs_val % (int32)rt_val;
+         }
+         cpu->muldiv_ts_done = timestamp + 37;
+         break;
+
+      case 0x1B:	// DIVU
+         if(!rt_val)
+         {
+            cpu->LO = 0xFFFFFFFF;
+            cpu->HI = rs_val;
+         }
+         else
+         {
+            cpu->LO = rs_val / rt_val;
+            cpu->HI = rs_val % rt_val;
+         }
+         cpu->muldiv_ts_done = timestamp + 37;
+         break;
+   }
+
+   return(timestamp);
+}
+
+template<typename T>
+int32_t PS_CPU::JIT_Load(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t rt)
+{
+   cpu->BACKED_LDWhich = rt;
+   cpu->BACKED_LDValue = (int32)cpu->ReadMemory<T>(timestamp, address);
+
+   return(timestamp);
+}
+
+template<typename T>
+int32_t PS_CPU::JIT_Store(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t value)
+{
+   cpu->WriteMemory<T>(timestamp, address, value);
+
+   return(timestamp);
+}
+
+template int32_t PS_CPU::JIT_Load<int8>(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t rt);
+template int32_t PS_CPU::JIT_Load<uint8>(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t rt);
+template int32_t PS_CPU::JIT_Load<int16>(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t rt);
+template int32_t PS_CPU::JIT_Load<uint16>(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t rt);
+template int32_t PS_CPU::JIT_Load<uint32>(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t rt);
+template int32_t PS_CPU::JIT_Store<uint8>(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t value);
+template int32_t PS_CPU::JIT_Store<uint16>(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t value);
+template int32_t PS_CPU::JIT_Store<uint32>(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t value);
+#endif
+
 int32_t PS_CPU::Run(int32_t timestamp_in)
 {
 #ifdef HAVE_DEBUG
    if(CPUHook || ADDBT)
-      return(RunReal<true>(timestamp_in));
+      return(RunReal<true, false>(timestamp_in));
+#endif
+#ifdef PS_CPU_JIT
+   if(psx_cpu_jit != PS_CPU_JIT_DISABLED)
+      return(RunJIT(timestamp_in));
 #endif
-   return(RunReal<false>(timestamp_in));
+   return(RunReal<false, false>(timestamp_in));
 }
 
 void PS_CPU::SetCPUHook(void (*cpuh)(const int32_t timestamp, uint32_t pc), void (*addbt)(uint32_t from, uint32_t to, bool exception))
@@ -2429,15 +2761,12 @@ void PS_CPU::PokeMem32(uint32 A, uint32 V)
 // FIXME: should we breakpoint on an illegal address?  And with LWC2/SWC2 if CP2 isn't enabled?
 void PS_CPU::CheckBreakpoints(void (*callback)(bool write, uint32_t address, unsigned int len), uint32_t instr)
 {
-   uint32 opf;
+   DecodedInstr d;
+   const DecodedInstr *dec = &d;
 
-   opf = instr & 0x3F;
+   DecodeInstr(&d, instr);
 
-   if(instr & (0x3F << 26))
-      opf = 0x40 | (instr >> 26);
-
-
-   switch(opf)
+   switch(dec->opf)
    {
       default:
          break;
@@ -8,6 +8,20 @@
 #define FAST_MAP_SHIFT        16
 #define FAST_MAP_PSIZE        (1 << FAST_MAP_SHIFT)
 
+// Dynamic recompiler(see cpu_jit.cpp), x86-64 hosts only.
+#if defined(__x86_64__) || defined(_M_X64)
+#define PS_CPU_JIT 1
+#endif
+
+#define PS_CPU_JIT_DISABLED   0
+#define PS_CPU_JIT_ENABLED    1
+#define PS_CPU_JIT_LOCKSTEP   2   /* Verify every block against the interpreter */
+
+/* Why a compiled block returned */
+#define PS_CPU_JIT_EXIT_NORMAL   0   /* Carry on at BACKED_PC */
+#define PS_CPU_JIT_EXIT_STEP     1   /* Interpret the instruction at BACKED_PC first */
+#define PS_CPU_JIT_EXIT_STALE    2   /* Code changed since the block was compiled */
+
 #define CP0REG_BPC            3   /* PC breakpoint address */
 #define CP0REG_BDA            5   /* Data load/store breakpoint address */
 #define CP0REG_TAR            6   /* Target address */
@@ -139,6 +153,26 @@ class PS_CPU
          };
       } CP0;
 
+      // Every ICache word, pre-decoded.  Kept up to date wherever ICache[].Data changes(fills, isolated-cache writes,
+      // power-on and state loads), so an instruction that hits in the ICache is neither fetched nor decoded again;
+      // whatever happens to the memory behind it doesn't matter until the line is refilled.
+      struct DecodedInstr
+      {
+         uint32_t instr;
+         uint32_t immediate;	// Sign-/zero-extended as the opcode requires, or the J/JAL target.
+         uint8_t opf;		// Index into RunReal()'s opcode table, minus the interrupt bit.
+         uint8_t rs;
+         uint8_t rt;
+         uint8_t rd;
+         uint8_t shamt;
+      };
+
+      DecodedInstr ICacheDecoded[1024];
+      DecodedInstr DecodeScratch;	// For instructions fetched with the ICache bypassed.
+
+      static void DecodeInstr(DecodedInstr *d, uint32_t instr);
+      void RedecodeICache(void);
+
       uint8_t ReadAbsorb[0x20 + 1];
       uint8_t ReadAbsorbWhich;
       uint8_t ReadFudge;
@@ -153,13 +187,60 @@ class PS_CPU
 
       uint32_t Exception(uint32_t code, uint32_t PC, const uint32_t NP, const uint32_t NPM, const uint32_t instr) MDFN_WARN_UNUSED_RESULT;
 
-      template<bool DebugMode> int32_t RunReal(int32_t timestamp_in);
+      template<bool DebugMode, bool SingleStep> int32_t RunReal(int32_t timestamp_in);
+      void ICacheFill(int32_t &timestamp, uint32_t PC);
 
       template<typename T> T PeekMemory(uint32_t address) MDFN_COLD;
       template<typename T> void PokeMemory(uint32 address, T value) MDFN_COLD;
       template<typename T> T ReadMemory(int32_t &timestamp, uint32_t address, bool DS24 = false, bool LWC_timing = false);
       template<typename T> void WriteMemory(int32_t &timestamp, uint32_t address, uint32_t value, bool DS24 = false);
 
+#ifdef PS_CPU_JIT
+      // Everything referenced by generated code must live in PS_CPU itself, since
+      // blocks address CPU state relative to the object pointer.
+      struct JITState;
+      struct JITSnapshot;
+
+      struct JITBlock
+      {
+         uint32_t PC;
+         uint32_t count;	// 0 if nothing at PC could be compiled.
+         uint32_t instr;	// First instruction word, to notice when an empty block's code changes.
+         int32_t (*code)(PS_CPU *cpu, int32_t timestamp);
+      };
+
+      JITState *JIT;
+      uint8_t JIT_Exit;
+      uint8_t JIT_FlushPending;
+      uint8_t JIT_LockstepBus;	// 0 = off, 1 = record bus accesses, 2 = replay them
+      uint32_t JIT_Retired;
+      uint8_t JIT_CodePages[2048 * 1024 / 4096];	// Main RAM pages holding compiled code
+
+      int32_t RunJIT(int32_t timestamp_in);
+      JITBlock *JIT_GetBlock(uint32_t PC);
+      void JIT_Compile(JITBlock *block, uint32_t PC);
+      void JIT_InvalidateBlock(JITBlock *block);
+      void JIT_InvalidatePage(uint32_t address);
+      void JIT_CheckCodePages(void);
+      void JIT_FlushAll(void);
+      void JIT_Free(void);
+      int32_t JIT_RunLockstep(JITBlock *block, int32_t timestamp);
+      JITSnapshot *JIT_LockstepSnapshot(unsigned which);
+      void JIT_SaveSnapshot(JITSnapshot *s, int32_t timestamp);
+      int32_t JIT_LoadSnapshot(const JITSnapshot *s);
+      bool JIT_CompareSnapshots(const JITSnapshot *jit, const JITSnapshot *interp, uint32_t PC);
+      void JIT_LockstepBegin(bool replay);
+      uint32_t JIT_LockstepAccess(int32_t &timestamp, uint32_t address, uint32_t value, unsigned size, bool write);
+
+      // Called from generated code; these mirror the corresponding paths in RunReal().
+      static int32_t JIT_Step(PS_CPU *cpu, int32_t timestamp, uint32_t PC, uint32_t unused);
+      static int32_t JIT_ICacheRefill(PS_CPU *cpu, int32_t timestamp, uint32_t PC, uint32_t unused);
+      static int32_t JIT_MulDivStall(PS_CPU *cpu, int32_t timestamp, uint32_t unused0, uint32_t unused1);
+      static int32_t JIT_MulDiv(PS_CPU *cpu, int32_t timestamp, uint32_t instr, uint32_t unused);
+      template<typename T> static int32_t JIT_Load(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t rt);
+      template<typename T> static int32_t JIT_Store(PS_CPU *cpu, int32_t timestamp, uint32_t address, uint32_t value);
+#endif
+
       // Mednafen debugger stuff follows:
    public:
       void SetCPUHook(void (*cpuh)(const int32_t timestamp, uint32_t pc), void (*addbt)(uint32_t from, uint32_t to, bool exception));
@@ -0,0 +1,1521 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ x86-64 dynamic recompiler for the R3000A.
+
+ Blocks are straight-line runs of up to JIT_MAX_BLOCK_INSNS instructions, ending at the first branch(plus its delay slot),
+ at a 4KiB page boundary, or at anything that always raises an exception.  Generated code operates directly on the PS_CPU
+ object(pointer kept in rbx, timestamp in r12d), and reproduces the interpreter's load delay and ReadAbsorb timing
+ behavior instruction for instruction, so that it can bail out to RunReal() at any instruction boundary.
+
+ Instructions that are rare or awkward(LWL/LWR/SWL/SWR, COP0, and the GTE) are executed by calling back into the
+ interpreter for a single instruction.  Each instruction re-checks its own opcode against memory(or the I-cache)
+ before executing, so stale code is detected even when RAM is modified behind our back(e.g. by DMA).
+*/
+
+#include "psx.h"
+#include "cpu.h"
+#include "../../libretro.h"
+
+#ifdef PS_CPU_JIT
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+extern retro_log_printf_t log_cb;
+extern bool psx_cpu_overclock;
+extern int psx_cpu_jit;
+
+#define JIT_CODE_SIZE         (16 * 1024 * 1024)
+#define JIT_CODE_SLACK        (64 * 1024)		// Enough for the largest possible block.
+#define JIT_MAX_BLOCKS        65536
+#define JIT_MAX_BLOCK_INSNS   64
+#define JIT_MAX_EXITS         (JIT_MAX_BLOCK_INSNS * 8)
+#define JIT_LOCKSTEP_LOG      256
+
+// Block map; main RAM(mirrors folded together) followed by BIOS, one entry per word.
+#define JIT_MAP_RAM_SIZE      (0x200000 >> 2)
+#define JIT_MAP_SIZE          (JIT_MAP_RAM_SIZE + (0x80000 >> 2))
+
+enum
+{
+   JIT_EAX = 0,
+   JIT_ECX = 1,
+   JIT_EDX = 2,
+   JIT_EBX = 3,
+   JIT_ESI = 6,
+   JIT_EDI = 7,
+   JIT_R8  = 8,
+   JIT_R9  = 9,
+   JIT_R12 = 12,
+
+   JIT_IMM = 0xFF	// Helper call argument is an immediate
+};
+
+enum
+{
+   JIT_CC_O  = 0x0,
+   JIT_CC_B  = 0x2,
+   JIT_CC_E  = 0x4,
+   JIT_CC_NE = 0x5,
+   JIT_CC_L  = 0xC,
+   JIT_CC_GE = 0xD,
+   JIT_CC_LE = 0xE,
+   JIT_CC_G  = 0xF,
+
+   JIT_CC_ALWAYS = -1
+};
+
+enum
+{
+   JIT_INSN_NATIVE = 0,
+   JIT_INSN_BRANCH,
+   JIT_INSN_STEP,	// Run through the interpreter
+   JIT_INSN_END		// Can't be part of a block
+};
+
+struct jit_insn
+{
+   uint32 pc;
+   uint32 instr;
+   const uint32 *host;
+   bool cached;
+   unsigned kind;
+};
+
+struct jit_exit_fixup
+{
+   uint8 *patch;
+   uint32 pc;
+   uint8 code;
+   bool store_pc;
+};
+
+struct jit_compiler
+{
+   uint8 *p;
+
+   // Offsets of PS_CPU members from the object pointer.
+   int32 GPR, LO, HI;
+   int32 PC, new_PC, new_PC_mask;
+   int32 IPCache;
+   int32 LDWhich, LDValue, LDAbsorb;
+   int32 next_event_ts, muldiv_ts_done;
+   int32 ICache;
+   int32 ReadAbsorb, ReadAbsorbWhich, ReadFudge;
+   int32 Exit, FlushPending, Retired;
+
+   uintptr_t fn_step, fn_icache_refill, fn_muldiv_stall, fn_muldiv;
+   uintptr_t fn_load[0x08];
+   uintptr_t fn_store[0x08];
+
+   jit_exit_fixup exits[JIT_MAX_EXITS];
+   unsigned exit_count;
+
+   uint32 ldwhich;	// LDWhich at this point in the block, or ~0U if not known at compile time.
+   bool check_ipcache;	// IPCache may have changed since the last check.
+   bool check_flush;	// JIT_FlushPending may have been set since the last check.
+   bool overclock;
+   bool lockstep;
+};
+
+struct jit_bus_access
+{
+   uint8 write;
+   uint8 size;
+   uint32 address;
+   uint32 value;
+   int32 ts_delta;
+
+   // CPU state the rest of the system may have changed during the access.
+   int32 next_event_ts;
+   uint32 cause;
+   uint32 ipcache;
+   bool halted;
+   uint32 biu;
+};
+
+struct PS_CPU::JITSnapshot
+{
+   int32 timestamp;
+   uint32 GPR[32];
+   uint32 LO;
+   uint32 HI;
+   uint32 PC;
+   uint32 new_PC;
+   uint32 new_PC_mask;
+   uint32 IPCache;
+   bool Halted;
+   uint32 LDWhich;
+   uint32 LDValue;
+   uint32 LDAbsorb;
+   int32 next_event_ts;
+   int32 gte_ts_done;
+   int32 muldiv_ts_done;
+   uint32 BIU;
+   uint32 ICache_Bulk[2048];
+   uint32 CP0[32];
+   uint8 ReadAbsorb[0x20];
+   uint8 ReadAbsorbWhich;
+   uint8 ReadFudge;
+   uint8 ScratchRAM[1024];
+};
+
+struct PS_CPU::JITState
+{
+   uint8 *code;
+   uint32 code_used;
+
+   JITBlock blocks[JIT_MAX_BLOCKS];
+   uint32 block_count;
+   JITBlock *map[JIT_MAP_SIZE];
+
+   // Main RAM as it was when each page in JIT_CodePages was first compiled from.
+   uint32 code_pages[JIT_MAP_RAM_SIZE];
+
+   // Settings the current set of blocks was compiled with.
+   bool overclock;
+   bool lockstep;
+
+   jit_compiler compiler;
+
+   JITSnapshot snapshots[3];
+   jit_bus_access log[JIT_LOCKSTEP_LOG];
+   unsigned log_count;
+   unsigned log_pos;
+   bool log_error;
+};
+
+//
+// Code emission
+//
+static INLINE void jit_emit8(jit_compiler *c, uint8 v)
+{
+   *c->p++ = v;
+}
+
+static INLINE void jit_emit32(jit_compiler *c, uint32 v)
+{
+   memcpy(c->p, &v, 4);
+   c->p += 4;
+}
+
+static INLINE void jit_emit64(jit_compiler *c, uint64 v)
+{
+   memcpy(c->p, &v, 8);
+   c->p += 8;
+}
+
+// opcode reg, [rbx + disp], or [rbx + rax * scale + disp] if scale is non-zero.
+static void jit_mem(jit_compiler *c, unsigned opcode, unsigned reg, int32 disp, unsigned scale = 0)
+{
+   if(reg & 8)
+      jit_emit8(c, 0x44);
+
+   if(opcode & 0xFF00)
+      jit_emit8(c, opcode >> 8);
+   jit_emit8(c, opcode);
+
+   if(scale)
+   {
+      jit_emit8(c, 0x84 | ((reg & 7) << 3));
+      jit_emit8(c, ((scale == 4) ? 0x80 : 0x00) | (JIT_EAX << 3) | JIT_EBX);
+   }
+   else
+      jit_emit8(c, 0x83 | ((reg & 7) << 3));
+
+   jit_emit32(c, disp);
+}
+
+// opcode reg, rm(register-direct)
+static void jit_reg(jit_compiler *c, unsigned opcode, unsigned reg, unsigned rm, bool wide = false)
+{
+   const uint8 rex = (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+
+   if(rex)
+      jit_emit8(c, 0x40 | rex);
+
+   if(opcode & 0xFF00)
+      jit_emit8(c, opcode >> 8);
+   jit_emit8(c, opcode);
+
+   jit_emit8(c, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static INLINE void jit_load32(jit_compiler *c, unsigned reg, int32 disp)
+{
+   jit_mem(c, 0x8B, reg, disp);
+}
+
+static INLINE void jit_store32(jit_compiler *c, int32 disp, unsigned reg)
+{
+   jit_mem(c, 0x89, reg, disp);
+}
+
+static INLINE void jit_store32_imm(jit_compiler *c, int32 disp, uint32 imm)
+{
+   jit_mem(c, 0xC7, 0, disp);
+   jit_emit32(c, imm);
+}
+
+static INLINE void jit_store8_imm(jit_compiler *c, int32 disp, uint8 imm)
+{
+   jit_mem(c, 0xC6, 0, disp);
+   jit_emit8(c, imm);
+}
+
+static INLINE void jit_cmp32_imm(jit_compiler *c, int32 disp, uint32 imm)
+{
+   jit_mem(c, 0x81, 7, disp);
+   jit_emit32(c, imm);
+}
+
+static INLINE void jit_alu_imm(jit_compiler *c, unsigned ext, unsigned reg, uint32 imm)
+{
+   jit_reg(c, 0x81, ext, reg);
+   jit_emit32(c, imm);
+}
+
+static INLINE void jit_mov_imm(jit_compiler *c, unsigned reg, uint32 imm)
+{
+   if(reg & 8)
+      jit_emit8(c, 0x41);
+   jit_emit8(c, 0xB8 + (reg & 7));
+   jit_emit32(c, imm);
+}
+
+static INLINE void jit_mov_reg(jit_compiler *c, unsigned dst, unsigned src)
+{
+   jit_reg(c, 0x89, src, dst);
+}
+
+static void jit_prologue(jit_compiler *c)
+{
+#ifdef _WIN32
+   const unsigned arg0 = JIT_ECX, arg1 = JIT_EDX;
+#else
+   const unsigned arg0 = JIT_EDI, arg1 = JIT_ESI;
+#endif
+
+   jit_emit8(c, 0x53);			// push rbx
+   jit_emit8(c, 0x41);			// push r12
+   jit_emit8(c, 0x54);
+   jit_emit8(c, 0x48);			// sub rsp, 40(shadow space, and keeps the stack 16-byte aligned)
+   jit_emit8(c, 0x83);
+   jit_emit8(c, 0xEC);
+   jit_emit8(c, 0x28);
+   jit_reg(c, 0x89, arg0, JIT_EBX, true);	// mov rbx, arg0
+   jit_mov_reg(c, JIT_R12, arg1);	// mov r12d, arg1
+}
+
+static void jit_epilogue(jit_compiler *c)
+{
+   jit_mov_reg(c, JIT_EAX, JIT_R12);	// mov eax, r12d
+   jit_emit8(c, 0x48);			// add rsp, 40
+   jit_emit8(c, 0x83);
+   jit_emit8(c, 0xC4);
+   jit_emit8(c, 0x28);
+   jit_emit8(c, 0x41);			// pop r12
+   jit_emit8(c, 0x5C);
+   jit_emit8(c, 0x5B);			// pop rbx
+   jit_emit8(c, 0xC3);			// ret
+}
+
+// Conditional(or unconditional, with JIT_CC_ALWAYS) jump to an exit stub.
+static void jit_exit(jit_compiler *c, int cc, uint32 pc, uint8 code, bool store_pc = true)
+{
+   jit_exit_fixup *x = &c->exits[c->exit_count++];
+
+   assert(c->exit_count <= JIT_MAX_EXITS);
+
+   if(cc == JIT_CC_ALWAYS)
+      jit_emit8(c, 0xE9);
+   else
+   {
+      jit_emit8(c, 0x0F);
+      jit_emit8(c, 0x80 | cc);
+   }
+
+   x->patch = c->p;
+   x->pc = pc;
+   x->code = code;
+   x->store_pc = store_pc;
+
+   jit_emit32(c, 0);
+}
+
+// Short forward jump within the block; resolved with jit_bind8().
+static uint8 *jit_jump8(jit_compiler *c, int cc)
+{
+   jit_emit8(c, (cc == JIT_CC_ALWAYS) ? 0xEB : (0x70 | cc));
+   jit_emit8(c, 0);
+
+   return(c->p - 1);
+}
+
+static void jit_bind8(jit_compiler *c, uint8 *patch)
+{
+   const ptrdiff_t rel = c->p - (patch + 1);
+
+   assert(rel < 0x80);
+   *patch = rel;
+}
+
+// Calls int32 fn(PS_CPU *cpu, int32 timestamp, uint32 a, uint32 b), and takes the returned timestamp.
+// a and b come from eax/edx, or are immediates(JIT_IMM).
+static void jit_call(jit_compiler *c, uintptr_t fn, unsigned a_reg, uint32 a_imm, unsigned b_reg, uint32 b_imm)
+{
+#ifdef _WIN32
+   const unsigned arg0 = JIT_ECX, arg1 = JIT_EDX, arg2 = JIT_R8, arg3 = JIT_R9;
+#else
+   const unsigned arg0 = JIT_EDI, arg1 = JIT_ESI, arg2 = JIT_EDX, arg3 = JIT_ECX;
+#endif
+
+   // Ordered so that no source register is overwritten before it's used.
+   if(b_reg == JIT_IMM)
+      jit_mov_imm(c, arg3, b_imm);
+   else
+      jit_mov_reg(c, arg3, b_reg);
+
+   if(a_reg == JIT_IMM)
+      jit_mov_imm(c, arg2, a_imm);
+   else if(a_reg != arg2)
+      jit_mov_reg(c, arg2, a_reg);
+
+   jit_mov_reg(c, arg1, JIT_R12);
+   jit_reg(c, 0x89, JIT_EBX, arg0, true);	// mov arg0, rbx
+
+   jit_emit8(c, 0x48);				// mov rax, fn
+   jit_emit8(c, 0xB8);
+   jit_emit64(c, fn);
+   jit_emit8(c, 0xFF);				// call rax
+   jit_emit8(c, 0xD0);
+
+   jit_mov_reg(c, JIT_R12, JIT_EAX);
+}
+
+//
+// Interpreter behavior, emitted.
+//
+static INLINE int32 jit_gpr(jit_compiler *c, unsigned n)
+{
+   return(c->GPR + n * 4);
+}
+
+// GPR_DEP()/GPR_RES(); ReadAbsorb[0] is preserved by GPR_DEPRES_END.
+static void jit_gpr_depres(jit_compiler *c, unsigned n)
+{
+   if(n)
+      jit_store8_imm(c, c->ReadAbsorb + n, 0);
+}
+
+// DO_LDS(); only uses eax and ecx.
+static void jit_do_lds(jit_compiler *c)
+{
+   if(c->ldwhich == ~0U)
+   {
+      jit_load32(c, JIT_EAX, c->LDWhich);
+      jit_load32(c, JIT_ECX, c->LDValue);
+      jit_mem(c, 0x89, JIT_ECX, c->GPR, 4);		// mov [GPR + LDWhich * 4], ecx
+      jit_load32(c, JIT_ECX, c->LDAbsorb);
+      jit_mem(c, 0x88, JIT_ECX, c->ReadAbsorb, 1);	// mov [ReadAbsorb + LDWhich], cl
+      jit_mem(c, 0x88, JIT_EAX, c->ReadFudge);		// mov [ReadFudge], al
+      jit_alu_imm(c, 4, JIT_EAX, 0x1F);			// and eax, 0x1F
+      jit_mem(c, 0x08, JIT_EAX, c->ReadAbsorbWhich);	// or [ReadAbsorbWhich], al
+      jit_store32_imm(c, c->LDWhich, 0x20);
+   }
+   else
+   {
+      const uint32 w = c->ldwhich;
+
+      // GPR[0x20] and ReadAbsorb[0x20] are never read.
+      if(w != 0x20)
+      {
+         jit_load32(c, JIT_EAX, c->LDValue);
+         jit_store32(c, jit_gpr(c, w), JIT_EAX);
+         jit_load32(c, JIT_EAX, c->LDAbsorb);
+         jit_mem(c, 0x88, JIT_EAX, c->ReadAbsorb + w);
+      }
+
+      jit_store8_imm(c, c->ReadFudge, w);
+
+      if(w & 0x1F)
+      {
+         jit_mem(c, 0x80, 1, c->ReadAbsorbWhich);	// or byte [ReadAbsorbWhich], w
+         jit_emit8(c, w & 0x1F);
+      }
+
+      if(w != 0x20)
+         jit_store32_imm(c, c->LDWhich, 0x20);
+   }
+
+   c->ldwhich = 0x20;
+}
+
+// ReadAbsorb[ReadAbsorbWhich] ? ReadAbsorb[ReadAbsorbWhich]-- : timestamp++
+static void jit_absorb_tick(jit_compiler *c)
+{
+   uint8 *no_absorb, *done;
+
+   jit_mem(c, 0x0FB6, JIT_EAX, c->ReadAbsorbWhich);	// movzx eax, byte [ReadAbsorbWhich]
+   jit_mem(c, 0x80, 7, c->ReadAbsorb, 1);		// cmp byte [ReadAbsorb + rax], 0
+   jit_emit8(c, 0);
+   no_absorb = jit_jump8(c, JIT_CC_E);
+   jit_mem(c, 0xFE, 1, c->ReadAbsorb, 1);		// dec byte [ReadAbsorb + rax]
+   done = jit_jump8(c, JIT_CC_ALWAYS);
+   jit_bind8(c, no_absorb);
+   jit_alu_imm(c, 0, JIT_R12, 1);
+   jit_bind8(c, done);
+}
+
+// Instruction fetch: the timing side effects of RunReal()'s fetch, plus a check that the opcode is still what was compiled.
+static void jit_fetch(jit_compiler *c, const jit_insn *insn)
+{
+   const int32 tv = c->ICache + ((insn->pc & 0xFFC) >> 2) * 8;
+
+   if(!insn->cached)
+   {
+      // Can't happen outside of weird I-cache tag test mode games, but the interpreter would use the cached word.
+      jit_cmp32_imm(c, tv, insn->pc);
+      jit_exit(c, JIT_CC_E, insn->pc, PS_CPU_JIT_EXIT_STEP);
+
+      jit_emit8(c, 0x48);			// mov rax, host
+      jit_emit8(c, 0xB8);
+      jit_emit64(c, (uintptr_t)insn->host);
+      jit_emit8(c, 0x81);			// cmp dword [rax], instr
+      jit_emit8(c, 0x38);
+      jit_emit32(c, insn->instr);
+      jit_exit(c, JIT_CC_NE, insn->pc, PS_CPU_JIT_EXIT_STALE);
+
+      jit_mem(c, 0x0FB6, JIT_EAX, c->ReadAbsorbWhich);
+      jit_mem(c, 0xC6, 0, c->ReadAbsorb, 1);	// mov byte [ReadAbsorb + rax], 0
+      jit_emit8(c, 0);
+      jit_store8_imm(c, c->ReadAbsorbWhich, 0);
+
+      if(!c->overclock)
+         jit_alu_imm(c, 0, JIT_R12, 4);
+   }
+   else
+   {
+      uint8 *hit, *done;
+
+      jit_cmp32_imm(c, tv, insn->pc);
+      hit = jit_jump8(c, JIT_CC_E);
+
+      jit_emit8(c, 0x48);			// mov rax, host
+      jit_emit8(c, 0xB8);
+      jit_emit64(c, (uintptr_t)insn->host);
+      jit_emit8(c, 0x81);			// cmp dword [rax], instr
+      jit_emit8(c, 0x38);
+      jit_emit32(c, insn->instr);
+      jit_exit(c, JIT_CC_NE, insn->pc, PS_CPU_JIT_EXIT_STALE);
+      jit_call(c, c->fn_icache_refill, JIT_IMM, insn->pc, JIT_IMM, 0);
+      done = jit_jump8(c, JIT_CC_ALWAYS);
+
+      jit_bind8(c, hit);
+      jit_cmp32_imm(c, tv + 4, insn->instr);
+      jit_exit(c, JIT_CC_NE, insn->pc, PS_CPU_JIT_EXIT_STALE);
+      jit_bind8(c, done);
+   }
+}
+
+static unsigned jit_classify(uint32 instr, bool lockstep)
+{
+   if(!(instr >> 26))
+   {
+      switch(instr & 0x3F)
+      {
+         case 0x00: case 0x02: case 0x03: case 0x04: case 0x06: case 0x07:	// Shifts
+         case 0x10: case 0x11: case 0x12: case 0x13:				// MFHI, MTHI, MFLO, MTLO
+         case 0x18: case 0x19: case 0x1A: case 0x1B:				// MULT, MULTU, DIV, DIVU
+         case 0x20: case 0x21: case 0x22: case 0x23:				// ADD, ADDU, SUB, SUBU
+         case 0x24: case 0x25: case 0x26: case 0x27:				// AND, OR, XOR, NOR
+         case 0x2A: case 0x2B:							// SLT, SLTU
+            return JIT_INSN_NATIVE;
+
+         case 0x08: case 0x09:							// JR, JALR
+            return JIT_INSN_BRANCH;
+      }
+
+      return JIT_INSN_END;	// SYSCALL, BREAK, illegal
+   }
+
+   switch(instr >> 26)
+   {
+      case 0x01: case 0x02: case 0x03:			// BCOND, J, JAL
+      case 0x04: case 0x05: case 0x06: case 0x07:	// BEQ, BNE, BLEZ, BGTZ
+         return JIT_INSN_BRANCH;
+
+      case 0x08: case 0x09: case 0x0A: case 0x0B:	// ADDI, ADDIU, SLTI, SLTIU
+      case 0x0C: case 0x0D: case 0x0E: case 0x0F:	// ANDI, ORI, XORI, LUI
+      case 0x20: case 0x21: case 0x23:			// LB, LH, LW
+      case 0x24: case 0x25:				// LBU, LHU
+      case 0x28: case 0x29: case 0x2B:			// SB, SH, SW
+         return JIT_INSN_NATIVE;
+
+      case 0x10:					// COP0
+      case 0x22: case 0x26:				// LWL, LWR
+      case 0x2A: case 0x2E:				// SWL, SWR
+         return JIT_INSN_STEP;
+
+      case 0x12:					// COP2
+      case 0x32: case 0x3A:				// LWC2, SWC2
+         // GTE state isn't part of the lockstep snapshots, so leave these to the interpreter outright.
+         return lockstep ? JIT_INSN_END : JIT_INSN_STEP;
+   }
+
+   return JIT_INSN_END;
+}
+
+static void jit_decode(jit_insn *insn, uint32 pc, uint8 *const *fast_map, const uint32 *icache, uint32 biu, bool lockstep)
+{
+   const uint32 *ici = &icache[((pc & 0xFFC) >> 2) * 2];
+
+   insn->pc = pc;
+   insn->host = (const uint32 *)&fast_map[pc >> FAST_MAP_SHIFT][pc];
+   insn->cached = !(pc >= 0xA0000000 || !(biu & 0x800));
+   insn->instr = (insn->cached && ici[0] == pc) ? ici[1] : LoadU32_LE(insn->host);
+   insn->kind = jit_classify(insn->instr, lockstep);
+}
+
+// Emits the ALU operation for the R-type ALU instructions, with the result in edx.
+static void jit_rtype_alu(jit_compiler *c, unsigned funct, unsigned rs, unsigned rt, unsigned shamt)
+{
+   switch(funct)
+   {
+      case 0x00:	// SLL
+      case 0x02:	// SRL
+      case 0x03:	// SRA
+         jit_load32(c, JIT_EDX, jit_gpr(c, rt));
+         if(shamt)
+         {
+            jit_reg(c, 0xC1, (funct == 0x00) ? 4 : ((funct == 0x02) ? 5 : 7), JIT_EDX);
+            jit_emit8(c, shamt);
+         }
+         break;
+
+      case 0x04:	// SLLV
+      case 0x06:	// SRLV
+      case 0x07:	// SRAV
+         jit_load32(c, JIT_ECX, jit_gpr(c, rs));
+         jit_load32(c, JIT_EDX, jit_gpr(c, rt));
+         jit_reg(c, 0xD3, (funct == 0x04) ? 4 : ((funct == 0x06) ? 5 : 7), JIT_EDX);
+         break;
+
+      case 0x20:	// ADD
+      case 0x21:	// ADDU
+         jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+         jit_mem(c, 0x03, JIT_EDX, jit_gpr(c, rt));
+         break;
+
+      case 0x22:	// SUB
+      case 0x23:	// SUBU
+         jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+         jit_mem(c, 0x2B, JIT_EDX, jit_gpr(c, rt));
+         break;
+
+      case 0x24:	// AND
+         jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+         jit_mem(c, 0x23, JIT_EDX, jit_gpr(c, rt));
+         break;
+
+      case 0x25:	// OR
+         jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+         jit_mem(c, 0x0B, JIT_EDX, jit_gpr(c, rt));
+         break;
+
+      case 0x26:	// XOR
+         jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+         jit_mem(c, 0x33, JIT_EDX, jit_gpr(c, rt));
+         break;
+
+      case 0x27:	// NOR
+         jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+         jit_mem(c, 0x0B, JIT_EDX, jit_gpr(c, rt));
+         jit_reg(c, 0xF7, 2, JIT_EDX);
+         break;
+
+      case 0x2A:	// SLT
+      case 0x2B:	// SLTU
+         jit_load32(c, JIT_EAX, jit_gpr(c, rs));
+         jit_mem(c, 0x3B, JIT_EAX, jit_gpr(c, rt));
+         jit_reg(c, 0x0F90 | ((funct == 0x2A) ? JIT_CC_L : JIT_CC_B), 0, JIT_EDX);
+         jit_reg(c, 0x0FB6, JIT_EDX, JIT_EDX);
+         break;
+   }
+}
+
+// Stores the branch target into BACKED_new_PC/BACKED_new_PC_mask if dl is non-zero(or unconditionally).
+static void jit_branch_target(jit_compiler *c, bool conditional, uint32 offset, uint32 mask)
+{
+   uint8 *not_taken = NULL;
+
+   if(conditional)
+   {
+      jit_reg(c, 0x84, JIT_EDX, JIT_EDX);	// test dl, dl
+      not_taken = jit_jump8(c, JIT_CC_E);
+   }
+
+   jit_store32_imm(c, c->new_PC, offset);
+   jit_store32_imm(c, c->new_PC_mask, mask & ~3);
+
+   if(conditional)
+      jit_bind8(c, not_taken);
+}
+
+// Everything but the checks and fetch; mirrors the corresponding op_* handler in RunReal().
+static void jit_body(jit_compiler *c, const jit_insn *insn)
+{
+   const uint32 pc = insn->pc;
+   const uint32 instr = insn->instr;
+   const unsigned rs = (instr >> 21) & 0x1F;
+   const unsigned rt = (instr >> 16) & 0x1F;
+   const unsigned rd = (instr >> 11) & 0x1F;
+   const unsigned shamt = (instr >> 6) & 0x1F;
+   const uint32 immediate = (int32)(int16)(instr & 0xFFFF);
+   const uint32 immediate_ze = instr & 0xFFFF;
+
+   if(!(instr >> 26))
+   {
+      const unsigned funct = instr & 0x3F;
+
+      switch(funct)
+      {
+         case 0x00: case 0x02: case 0x03:
+            jit_gpr_depres(c, rt);
+            jit_gpr_depres(c, rd);
+            jit_rtype_alu(c, funct, rs, rt, shamt);
+            jit_do_lds(c);
+            jit_store32(c, jit_gpr(c, rd), JIT_EDX);
+            break;
+
+         case 0x04: case 0x06: case 0x07:
+         case 0x20: case 0x21: case 0x22: case 0x23:
+         case 0x24: case 0x25: case 0x26: case 0x27:
+         case 0x2A: case 0x2B:
+            jit_gpr_depres(c, rs);
+            jit_gpr_depres(c, rt);
+            jit_gpr_depres(c, rd);
+            jit_rtype_alu(c, funct, rs, rt, shamt);
+            jit_do_lds(c);
+            jit_store32(c, jit_gpr(c, rd), JIT_EDX);	// ADD/SUB overflow was checked up front.
+            break;
+
+         case 0x08:	// JR
+         case 0x09:	// JALR
+            jit_gpr_depres(c, rs);
+            jit_gpr_depres(c, rd);
+            jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+            jit_do_lds(c);
+            if(funct == 0x09)
+               jit_store32_imm(c, jit_gpr(c, rd), pc + 8);
+            jit_store32(c, c->new_PC, JIT_EDX);
+            jit_store32_imm(c, c->new_PC_mask, 0);
+            break;
+
+         case 0x10:	// MFHI
+         case 0x12:	// MFLO
+            {
+               uint8 *no_stall;
+
+               jit_gpr_depres(c, rd);
+               jit_do_lds(c);
+
+               jit_mem(c, 0x3B, JIT_R12, c->muldiv_ts_done);	// cmp r12d, [muldiv_ts_done]
+               no_stall = jit_jump8(c, JIT_CC_GE);
+               jit_call(c, c->fn_muldiv_stall, JIT_IMM, 0, JIT_IMM, 0);
+               jit_bind8(c, no_stall);
+
+               jit_load32(c, JIT_EAX, (funct == 0x10) ? c->HI : c->LO);
+               jit_store32(c, jit_gpr(c, rd), JIT_EAX);
+            }
+            break;
+
+         case 0x11:	// MTHI
+         case 0x13:	// MTLO
+            jit_gpr_depres(c, rs);
+            jit_load32(c, JIT_EAX, jit_gpr(c, rs));
+            jit_store32(c, (funct == 0x11) ? c->HI : c->LO, JIT_EAX);
+            jit_do_lds(c);
+            break;
+
+         case 0x18: case 0x19: case 0x1A: case 0x1B:	// MULT, MULTU, DIV, DIVU
+            jit_gpr_depres(c, rs);
+            jit_gpr_depres(c, rt);
+            jit_call(c, c->fn_muldiv, JIT_IMM, instr, JIT_IMM, 0);
+            jit_do_lds(c);
+            break;
+      }
+
+      return;
+   }
+
+   switch(instr >> 26)
+   {
+      case 0x01:	// BCOND
+         jit_gpr_depres(c, rs);
+         if(rt & 0x10)
+            jit_gpr_depres(c, 31);
+         jit_cmp32_imm(c, jit_gpr(c, rs), 0);
+         jit_reg(c, 0x0F90 | ((rt & 1) ? JIT_CC_GE : JIT_CC_L), 0, JIT_EDX);
+         jit_do_lds(c);
+         if(rt & 0x10)
+            jit_store32_imm(c, jit_gpr(c, 31), pc + 8);
+         jit_branch_target(c, true, immediate << 2, ~0U);
+         break;
+
+      case 0x02:	// J
+      case 0x03:	// JAL
+         if(instr & (1 << 26))
+            jit_gpr_depres(c, 31);
+         jit_do_lds(c);
+         if(instr & (1 << 26))
+            jit_store32_imm(c, jit_gpr(c, 31), pc + 8);
+         jit_branch_target(c, false, (instr & ((1 << 26) - 1)) << 2, 0xF0000000);
+         break;
+
+      case 0x04:	// BEQ
+      case 0x05:	// BNE
+         jit_gpr_depres(c, rs);
+         jit_gpr_depres(c, rt);
+         jit_load32(c, JIT_EAX, jit_gpr(c, rs));
+         jit_mem(c, 0x3B, JIT_EAX, jit_gpr(c, rt));
+         jit_reg(c, 0x0F90 | ((instr & (1 << 26)) ? JIT_CC_NE : JIT_CC_E), 0, JIT_EDX);
+         jit_do_lds(c);
+         jit_branch_target(c, true, immediate << 2, ~0U);
+         break;
+
+      case 0x06:	// BLEZ
+      case 0x07:	// BGTZ
+         jit_gpr_depres(c, rs);
+         jit_cmp32_imm(c, jit_gpr(c, rs), 0);
+         jit_reg(c, 0x0F90 | ((instr & (1 << 26)) ? JIT_CC_G : JIT_CC_LE), 0, JIT_EDX);
+         jit_do_lds(c);
+         jit_branch_target(c, true, immediate << 2, ~0U);
+         break;
+
+      case 0x08:	// ADDI(overflow was checked up front)
+      case 0x09:	// ADDIU
+         jit_gpr_depres(c, rs);
+         jit_gpr_depres(c, rt);
+         jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+         if(immediate)
+            jit_alu_imm(c, 0, JIT_EDX, immediate);
+         jit_do_lds(c);
+         jit_store32(c, jit_gpr(c, rt), JIT_EDX);
+         break;
+
+      case 0x0A:	// SLTI
+      case 0x0B:	// SLTIU
+         jit_gpr_depres(c, rs);
+         jit_gpr_depres(c, rt);
+         jit_load32(c, JIT_EAX, jit_gpr(c, rs));
+         jit_alu_imm(c, 7, JIT_EAX, immediate);
+         jit_reg(c, 0x0F90 | (((instr >> 26) == 0x0A) ? JIT_CC_L : JIT_CC_B), 0, JIT_EDX);
+         jit_reg(c, 0x0FB6, JIT_EDX, JIT_EDX);
+         jit_do_lds(c);
+         jit_store32(c, jit_gpr(c, rt), JIT_EDX);
+         break;
+
+      case 0x0C:	// ANDI
+      case 0x0D:	// ORI
+      case 0x0E:	// XORI
+         jit_gpr_depres(c, rs);
+         jit_gpr_depres(c, rt);
+         jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+         jit_alu_imm(c, ((instr >> 26) == 0x0C) ? 4 : (((instr >> 26) == 0x0D) ? 1 : 6), JIT_EDX, immediate_ze);
+         jit_do_lds(c);
+         jit_store32(c, jit_gpr(c, rt), JIT_EDX);
+         break;
+
+      case 0x0F:	// LUI
+         jit_gpr_depres(c, rt);
+         jit_do_lds(c);
+         jit_store32_imm(c, jit_gpr(c, rt), immediate_ze << 16);
+         break;
+
+      case 0x20: case 0x21: case 0x23:	// LB, LH, LW
+      case 0x24: case 0x25:		// LBU, LHU
+         jit_gpr_depres(c, rs);
+         jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+         if(immediate)
+            jit_alu_imm(c, 0, JIT_EDX, immediate);
+         jit_do_lds(c);
+         jit_call(c, c->fn_load[(instr >> 26) & 0x7], JIT_EDX, 0, JIT_IMM, rt);
+         c->ldwhich = rt;
+         c->check_ipcache = true;
+         break;
+
+      case 0x28: case 0x29: case 0x2B:	// SB, SH, SW
+         jit_gpr_depres(c, rs);
+         jit_gpr_depres(c, rt);
+         jit_load32(c, JIT_EDX, jit_gpr(c, rs));
+         if(immediate)
+            jit_alu_imm(c, 0, JIT_EDX, immediate);
+         jit_load32(c, JIT_EAX, jit_gpr(c, rt));
+         jit_call(c, c->fn_store[(instr >> 26) & 0x7], JIT_EDX, 0, JIT_EAX, 0);
+         jit_do_lds(c);
+         c->check_ipcache = true;
+         c->check_flush = true;
+         break;
+   }
+}
+
+// Address errors and overflow exceptions are left to the interpreter.
+static void jit_exception_check(jit_compiler *c, const jit_insn *insn)
+{
+   const uint32 instr = insn->instr;
+   const unsigned rs = (instr >> 21) & 0x1F;
+   const unsigned rt = (instr >> 16) & 0x1F;
+   const uint32 immediate = (int32)(int16)(instr & 0xFFFF);
+   unsigned align = 0;
+
+   if(!(instr >> 26))
+   {
+      if((instr & 0x3F) == 0x20 || (instr & 0x3F) == 0x22)	// ADD, SUB
+      {
+         jit_load32(c, JIT_EAX, jit_gpr(c, rs));
+         jit_mem(c, ((instr & 0x3F) == 0x20) ? 0x03 : 0x2B, JIT_EAX, jit_gpr(c, rt));
+         jit_exit(c, JIT_CC_O, insn->pc, PS_CPU_JIT_EXIT_STEP);
+      }
+      return;
+   }
+
+   switch(instr >> 26)
+   {
+      case 0x08:	// ADDI
+         jit_load32(c, JIT_EAX, jit_gpr(c, rs));
+         jit_alu_imm(c, 0, JIT_EAX, immediate);
+         jit_exit(c, JIT_CC_O, insn->pc, PS_CPU_JIT_EXIT_STEP);
+         return;
+
+      case 0x21: case 0x25: case 0x29:	// LH, LHU, SH
+         align = 1;
+         break;
+
+      case 0x23: case 0x2B:		// LW, SW
+         align = 3;
+         break;
+
+      default:
+         return;
+   }
+
+   jit_load32(c, JIT_EAX, jit_gpr(c, rs));
+   if(immediate)
+      jit_alu_imm(c, 0, JIT_EAX, immediate);
+   jit_emit8(c, 0xA8);	// test al, align
+   jit_emit8(c, align);
+   jit_exit(c, JIT_CC_NE, insn->pc, PS_CPU_JIT_EXIT_STEP);
+}
+
+static void jit_insn_emit(jit_compiler *c, const jit_insn *insn, bool first, bool in_delay_slot)
+{
+   // The dispatcher has already done these checks for the first instruction.
+   if(!first)
+   {
+      jit_mem(c, 0x3B, JIT_R12, c->next_event_ts);	// cmp r12d, [next_event_ts]
+      jit_exit(c, JIT_CC_GE, insn->pc, PS_CPU_JIT_EXIT_NORMAL);
+   }
+
+   if(c->check_ipcache)
+   {
+      jit_cmp32_imm(c, c->IPCache, 0);
+      jit_exit(c, JIT_CC_NE, insn->pc, PS_CPU_JIT_EXIT_STEP);
+      c->check_ipcache = false;
+   }
+
+   if(c->check_flush)
+   {
+      jit_mem(c, 0x80, 7, c->FlushPending);	// cmp byte [JIT_FlushPending], 0
+      jit_emit8(c, 0);
+      jit_exit(c, JIT_CC_NE, insn->pc, PS_CPU_JIT_EXIT_NORMAL);
+      c->check_flush = false;
+   }
+
+   if(insn->kind == JIT_INSN_STEP)
+   {
+      jit_call(c, c->fn_step, JIT_IMM, insn->pc, JIT_IMM, 0);
+
+      if(c->lockstep)
+         jit_mem(c, 0xFF, 0, c->Retired);	// inc dword [JIT_Retired]
+
+      // The interpreter has already moved on to the next instruction; stop here if that's not
+      // the next one in the block(exception, or the instruction changed into a branch).
+      if(in_delay_slot)
+         jit_exit(c, JIT_CC_ALWAYS, 0, PS_CPU_JIT_EXIT_NORMAL, false);
+      else
+      {
+         jit_cmp32_imm(c, c->new_PC_mask, ~0U);
+         jit_exit(c, JIT_CC_NE, 0, PS_CPU_JIT_EXIT_NORMAL, false);
+         jit_cmp32_imm(c, c->PC, insn->pc + 4);
+         jit_exit(c, JIT_CC_NE, 0, PS_CPU_JIT_EXIT_NORMAL, false);
+      }
+
+      c->ldwhich = ~0U;
+      c->check_ipcache = true;
+      c->check_flush = true;
+      return;
+   }
+
+   jit_store32_imm(c, jit_gpr(c, 0), 0);
+   jit_exception_check(c, insn);
+   jit_fetch(c, insn);
+   jit_absorb_tick(c);
+   jit_body(c, insn);
+
+   if(c->lockstep)
+      jit_mem(c, 0xFF, 0, c->Retired);
+}
+
+// Returns the block map index for PC, or -1 if code at PC isn't compiled.
+static int32 jit_map_index(uint32 PC)
+{
+   const uint32 seg = PC >> 29;
+   uint32 phys;
+
+   // Misaligned PCs are left to the interpreter, which raises the address error.
+   if((PC & 0x3) || (seg != 0 && seg != 4 && seg != 5))
+      return(-1);
+
+   phys = PC & 0x1FFFFFFF;
+
+   if(phys < 0x800000)
+      return((phys & 0x1FFFFF) >> 2);
+
+   if(phys >= 0x1FC00000 && phys < 0x1FC80000)
+      return(JIT_MAP_RAM_SIZE + ((phys & 0x7FFFF) >> 2));
+
+   return(-1);
+}
+
+static uint8 *jit_alloc_code(void)
+{
+#ifdef _WIN32
+   return (uint8 *)VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+   void *ret = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+   if(ret == MAP_FAILED)
+      return(NULL);
+
+   return (uint8 *)ret;
+#endif
+}
+
+static void jit_free_code(uint8 *code)
+{
+#ifdef _WIN32
+   VirtualFree(code, 0, MEM_RELEASE);
+#else
+   munmap(code, JIT_CODE_SIZE);
+#endif
+}
+
+void PS_CPU::JIT_Compile(JITBlock *block, uint32_t PC)
+{
+   jit_compiler *c = &JIT->compiler;
+   uint8 *const start = JIT->code + JIT->code_used;
+   unsigned count = 0;
+   uint32 pc = PC;
+   unsigned i;
+
+#define JIT_OFS(m) ((int32)((uint8 *)&(m) - (uint8 *)this))
+   c->GPR = JIT_OFS(GPR[0]);
+   c->LO = JIT_OFS(LO);
+   c->HI = JIT_OFS(HI);
+   c->PC = JIT_OFS(BACKED_PC);
+   c->new_PC = JIT_OFS(BACKED_new_PC);
+   c->new_PC_mask = JIT_OFS(BACKED_new_PC_mask);
+   c->IPCache = JIT_OFS(IPCache);
+   c->LDWhich = JIT_OFS(BACKED_LDWhich);
+   c->LDValue = JIT_OFS(BACKED_LDValue);
+   c->LDAbsorb = JIT_OFS(LDAbsorb);
+   c->next_event_ts = JIT_OFS(next_event_ts);
+   c->muldiv_ts_done = JIT_OFS(muldiv_ts_done);
+   c->ICache = JIT_OFS(ICache_Bulk[0]);
+   c->ReadAbsorb = JIT_OFS(ReadAbsorb[0]);
+   c->ReadAbsorbWhich = JIT_OFS(ReadAbsorbWhich);
+   c->ReadFudge = JIT_OFS(ReadFudge);
+   c->Exit = JIT_OFS(JIT_Exit);
+   c->FlushPending = JIT_OFS(JIT_FlushPending);
+   c->Retired = JIT_OFS(JIT_Retired);
+#undef JIT_OFS
+
+   c->fn_step = (uintptr_t)&PS_CPU::JIT_Step;
+   c->fn_icache_refill = (uintptr_t)&PS_CPU::JIT_ICacheRefill;
+   c->fn_muldiv_stall = (uintptr_t)&PS_CPU::JIT_MulDivStall;
+   c->fn_muldiv = (uintptr_t)&PS_CPU::JIT_MulDiv;
+   c->fn_load[0x0] = (uintptr_t)&PS_CPU::JIT_Load<int8>;
+   c->fn_load[0x1] = (uintptr_t)&PS_CPU::JIT_Load<int16>;
+   c->fn_load[0x3] = (uintptr_t)&PS_CPU::JIT_Load<uint32>;
+   c->fn_load[0x4] = (uintptr_t)&PS_CPU::JIT_Load<uint8>;
+   c->fn_load[0x5] = (uintptr_t)&PS_CPU::JIT_Load<uint16>;
+   c->fn_store[0x0] = (uintptr_t)&PS_CPU::JIT_Store<uint8>;
+   c->fn_store[0x1] = (uintptr_t)&PS_CPU::JIT_Store<uint16>;
+   c->fn_store[0x3] = (uintptr_t)&PS_CPU::JIT_Store<uint32>;
+
+   c->p = start;
+   c->exit_count = 0;
+   c->ldwhich = ~0U;
+   c->check_ipcache = false;
+   c->check_flush = false;
+   c->overclock = JIT->overclock;
+   c->lockstep = JIT->lockstep;
+
+   jit_prologue(c);
+
+   for(;;)
+   {
+      jit_insn insn, slot;
+
+      if(count >= JIT_MAX_BLOCK_INSNS || (count && !(pc & 0xFFF)))
+      {
+         jit_store32_imm(c, c->PC, pc);
+         jit_epilogue(c);
+         break;
+      }
+
+      jit_decode(&insn, pc, FastMap, ICache_Bulk, BIU, c->lockstep);
+
+      if(!count)
+         block->instr = insn.instr;
+
+      if(insn.kind == JIT_INSN_BRANCH)
+      {
+         jit_decode(&slot, pc + 4, FastMap, ICache_Bulk, BIU, c->lockstep);
+
+         // Branches in delay slots are left to the interpreter.
+         if(slot.kind == JIT_INSN_BRANCH || slot.kind == JIT_INSN_END)
+            insn.kind = JIT_INSN_END;
+      }
+
+      if(insn.kind == JIT_INSN_END)
+      {
+         if(count)
+         {
+            jit_store32_imm(c, c->PC, pc);
+            jit_epilogue(c);
+         }
+         break;
+      }
+
+      jit_insn_emit(c, &insn, !count, false);
+      count++;
+
+      if(insn.kind == JIT_INSN_BRANCH)
+      {
+         jit_insn_emit(c, &slot, false, true);
+         count++;
+
+         if(slot.kind != JIT_INSN_STEP)
+         {
+            // OpDone
+            jit_mov_imm(c, JIT_EAX, slot.pc);
+            jit_mem(c, 0x23, JIT_EAX, c->new_PC_mask);
+            jit_mem(c, 0x03, JIT_EAX, c->new_PC);
+            jit_store32(c, c->PC, JIT_EAX);
+            jit_store32_imm(c, c->new_PC, 4);
+            jit_store32_imm(c, c->new_PC_mask, ~0U);
+            jit_epilogue(c);
+         }
+         pc += 4;
+         break;
+      }
+
+      pc += 4;
+   }
+
+   block->PC = PC;
+   block->count = count;
+   block->code = NULL;
+
+   if(jit_map_index(PC) < JIT_MAP_RAM_SIZE)
+   {
+      const uint32 pages[2] = { (PC & 0x1FFFFF) >> 12, (pc & 0x1FFFFF) >> 12 };
+
+      for(i = 0; i < 2; i++)
+      {
+         if(!JIT_CodePages[pages[i]])
+         {
+            JIT_CodePages[pages[i]] = 1;
+            memcpy(&JIT->code_pages[pages[i] << 10], &MainRAM.data32[pages[i] << 10], 4096);
+         }
+      }
+   }
+
+   if(!count)
+      return;
+
+   for(i = 0; i < c->exit_count; i++)
+   {
+      const jit_exit_fixup *x = &c->exits[i];
+      const int32 rel = c->p - (x->patch + 4);
+
+      memcpy(x->patch, &rel, 4);
+
+      if(x->store_pc)
+         jit_store32_imm(c, c->PC, x->pc);
+
+      if(x->code != PS_CPU_JIT_EXIT_NORMAL)
+         jit_store8_imm(c, c->Exit, x->code);
+
+      jit_epilogue(c);
+   }
+
+   assert((c->p - start) <= JIT_CODE_SLACK);
+
+   block->code = (int32 (*)(PS_CPU *, int32))start;
+   JIT->code_used += c->p - start;
+}
+
+PS_CPU::JITBlock *PS_CPU::JIT_GetBlock(uint32_t PC)
+{
+   JITBlock *block;
+   int32 index;
+
+   if(MDFN_UNLIKELY(!JIT))
+   {
+      JIT = (JITState *)calloc(1, sizeof(JITState));
+
+      if(JIT)
+         JIT->code = jit_alloc_code();
+
+      if(!JIT || !JIT->code)
+      {
+         log_cb(RETRO_LOG_ERROR, "[CPU] Couldn't allocate dynarec code buffer, falling back to the interpreter.\n");
+         if(JIT)
+            free(JIT);
+         JIT = NULL;
+         psx_cpu_jit = PS_CPU_JIT_DISABLED;
+         return(NULL);
+      }
+
+      JIT_FlushPending = 1;
+   }
+
+   if(JIT_FlushPending || JIT->overclock != psx_cpu_overclock || JIT->lockstep != (psx_cpu_jit == PS_CPU_JIT_LOCKSTEP))
+      JIT_FlushAll();
+
+   index = jit_map_index(PC);
+
+   if(index < 0)
+      return(NULL);
+
+   block = JIT->map[index];
+
+   // Nothing runs an empty block, so nothing else would notice if the code at PC changes.
+   if(block && block->PC == PC && !block->count)
+   {
+      jit_insn insn;
+
+      jit_decode(&insn, PC, FastMap, ICache_Bulk, BIU, JIT->lockstep);
+
+      if(insn.instr != block->instr)
+         block = NULL;
+   }
+
+   if(!block || block->PC != PC)
+   {
+      if(JIT->block_count == JIT_MAX_BLOCKS || (JIT->code_used + JIT_CODE_SLACK) > JIT_CODE_SIZE)
+         JIT_FlushAll();
+
+      block = &JIT->blocks[JIT->block_count++];
+      JIT_Compile(block, PC);
+      JIT->map[index] = block;
+   }
+
+   return(block->count ? block : NULL);
+}
+
+void PS_CPU::JIT_InvalidateBlock(JITBlock *block)
+{
+   const int32 index = jit_map_index(block->PC);
+
+   if(index >= 0 && JIT->map[index] == block)
+      JIT->map[index] = NULL;
+}
+
+// Drops the blocks starting in the 4KiB page of main RAM containing address.  Code isn't freed(one of the blocks may
+// be the one currently running), just orphaned until the next flush.
+void PS_CPU::JIT_InvalidatePage(uint32_t address)
+{
+   const uint32 page = (address & 0x1FFFFF) >> 12;
+
+   JIT_CodePages[page] = 0;
+
+   if(JIT)
+      memset(&JIT->map[page << 10], 0, sizeof(JIT->map[0]) << 10);
+}
+
+// After a state load, drops the compiled pages of main RAM whose contents differ from what they were compiled from.
+// Blocks would catch the change themselves when they next ran, this just saves them bailing out one at a time.
+void PS_CPU::JIT_CheckCodePages(void)
+{
+   unsigned page;
+
+   if(!JIT || JIT_FlushPending)
+      return;
+
+   for(page = 0; page < sizeof(JIT_CodePages); page++)
+   {
+      if(JIT_CodePages[page] && memcmp(&JIT->code_pages[page << 10], &MainRAM.data32[page << 10], 4096))
+         JIT_InvalidatePage(page << 12);
+   }
+}
+
+void PS_CPU::JIT_FlushAll(void)
+{
+   JIT_FlushPending = 0;
+   memset(JIT_CodePages, 0, sizeof(JIT_CodePages));
+
+   if(!JIT)
+      return;
+
+   JIT->code_used = 0;
+   JIT->block_count = 0;
+   memset(JIT->map, 0, sizeof(JIT->map));
+
+   JIT->overclock = psx_cpu_overclock;
+   JIT->lockstep = (psx_cpu_jit == PS_CPU_JIT_LOCKSTEP);
+}
+
+void PS_CPU::JIT_Free(void)
+{
+   if(JIT)
+   {
+      jit_free_code(JIT->code);
+      free(JIT);
+      JIT = NULL;
+   }
+
+   memset(JIT_CodePages, 0, sizeof(JIT_CodePages));
+}
+
+//
+// Lockstep verification
+//
+PS_CPU::JITSnapshot *PS_CPU::JIT_LockstepSnapshot(unsigned which)
+{
+   return(&JIT->snapshots[which]);
+}
+
+void PS_CPU::JIT_SaveSnapshot(JITSnapshot *s, int32_t timestamp)
+{
+   s->timestamp = timestamp;
+   memcpy(s->GPR, GPR, sizeof(s->GPR));
+   s->LO = LO;
+   s->HI = HI;
+   s->PC = BACKED_PC;
+   s->new_PC = BACKED_new_PC;
+   s->new_PC_mask = BACKED_new_PC_mask;
+   s->IPCache = IPCache;
+   s->Halted = Halted;
+   s->LDWhich = BACKED_LDWhich;
+   s->LDValue = BACKED_LDValue;
+   s->LDAbsorb = LDAbsorb;
+   s->next_event_ts = next_event_ts;
+   s->gte_ts_done = gte_ts_done;
+   s->muldiv_ts_done = muldiv_ts_done;
+   s->BIU = BIU;
+   memcpy(s->ICache_Bulk, ICache_Bulk, sizeof(s->ICache_Bulk));
+   memcpy(s->CP0, CP0.Regs, sizeof(s->CP0));
+   memcpy(s->ReadAbsorb, ReadAbsorb, sizeof(s->ReadAbsorb));
+   s->ReadAbsorbWhich = ReadAbsorbWhich;
+   s->ReadFudge = ReadFudge;
+   memcpy(s->ScratchRAM, ScratchRAM.data8, sizeof(s->ScratchRAM));
+}
+
+int32_t PS_CPU::JIT_LoadSnapshot(const JITSnapshot *s)
+{
+   memcpy(GPR, s->GPR, sizeof(s->GPR));
+   LO = s->LO;
+   HI = s->HI;
+   BACKED_PC = s->PC;
+   BACKED_new_PC = s->new_PC;
+   BACKED_new_PC_mask = s->new_PC_mask;
+   IPCache = s->IPCache;
+   Halted = s->Halted;
+   BACKED_LDWhich = s->LDWhich;
+   BACKED_LDValue = s->LDValue;
+   LDAbsorb = s->LDAbsorb;
+   next_event_ts = s->next_event_ts;
+   gte_ts_done = s->gte_ts_done;
+   muldiv_ts_done = s->muldiv_ts_done;
+   BIU = s->BIU;
+   memcpy(ICache_Bulk, s->ICache_Bulk, sizeof(s->ICache_Bulk));
+   RedecodeICache();
+   memcpy(CP0.Regs, s->CP0, sizeof(s->CP0));
+   memcpy(ReadAbsorb, s->ReadAbsorb, sizeof(s->ReadAbsorb));
+   ReadAbsorbWhich = s->ReadAbsorbWhich;
+   ReadFudge = s->ReadFudge;
+   memcpy(ScratchRAM.data8, s->ScratchRAM, sizeof(s->ScratchRAM));
+
+   return(s->timestamp);
+}
+
+static bool jit_diverged(uint32 PC, const char *what, int index, uint32 jit_value, uint32 interp_value)
+{
+   char name[32];
+
+   if(index >= 0)
+      snprintf(name, sizeof(name), "%s[%d]", what, index);
+   else
+      snprintf(name, sizeof(name), "%s", what);
+
+   log_cb(RETRO_LOG_ERROR, "[CPU] Dynarec block @0x%08x diverged from the interpreter: %s is 0x%08x, should be 0x%08x; dynarec disabled.\n",
+         PC, name, jit_value, interp_value);
+
+   return(false);
+}
+
+bool PS_CPU::JIT_CompareSnapshots(const JITSnapshot *jit, const JITSnapshot *interp, uint32_t PC)
+{
+   unsigned i;
+
+#define JIT_CMP(field) if(jit->field != interp->field) return jit_diverged(PC, #field, -1, jit->field, interp->field);
+#define JIT_CMP_ARRAY(field, first, count) for(i = first; i < count; i++) { if(jit->field[i] != interp->field[i]) return jit_diverged(PC, #field, i, jit->field[i], interp->field[i]); }
+   if(JIT->log_error || JIT->log_pos != JIT->log_count)
+   {
+      log_cb(RETRO_LOG_ERROR, "[CPU] Dynarec block @0x%08x diverged from the interpreter: bus accesses differ(%u/%u replayed); dynarec disabled.\n",
+            PC, JIT->log_pos, JIT->log_count);
+      return(false);
+   }
+
+   JIT_CMP(PC);
+   JIT_CMP(new_PC);
+   JIT_CMP(new_PC_mask);
+   JIT_CMP(timestamp);
+   JIT_CMP_ARRAY(GPR, 1, 32);
+   JIT_CMP(LO);
+   JIT_CMP(HI);
+   JIT_CMP(LDWhich);
+   JIT_CMP(LDValue);
+   JIT_CMP(LDAbsorb);
+   JIT_CMP(IPCache);
+   JIT_CMP(Halted);
+   JIT_CMP(next_event_ts);
+   JIT_CMP(gte_ts_done);
+   JIT_CMP(muldiv_ts_done);
+   JIT_CMP(BIU);
+   JIT_CMP_ARRAY(CP0, 0, 32);
+   JIT_CMP_ARRAY(ReadAbsorb, 0, 0x20);
+   JIT_CMP(ReadAbsorbWhich);
+   JIT_CMP(ReadFudge);
+   JIT_CMP_ARRAY(ICache_Bulk, 0, 2048);
+   JIT_CMP_ARRAY(ScratchRAM, 0, 1024);
+#undef JIT_CMP_ARRAY
+#undef JIT_CMP
+
+   return(true);
+}
+
+void PS_CPU::JIT_LockstepBegin(bool replay)
+{
+   if(replay)
+   {
+      JIT->log_pos = 0;
+      JIT_LockstepBus = 2;
+   }
+   else
+   {
+      JIT->log_count = 0;
+      JIT->log_error = false;
+      JIT_LockstepBus = 1;
+   }
+}
+
+// Bus accesses(other than to the scratchpad) while in lockstep mode; the block's accesses go to the rest of the
+// system and are recorded, while the interpreter's are checked against and satisfied from the recording.
+uint32_t PS_CPU::JIT_LockstepAccess(int32_t &timestamp, uint32_t address, uint32_t value, unsigned size, bool write)
+{
+   jit_bus_access *a;
+
+   if(JIT_LockstepBus == 1)
+   {
+      const int32 ts_before = timestamp;
+
+      if(write)
+      {
+         switch(size)
+         {
+            case 1: PSX_MemWrite8(timestamp, address, value); break;
+            case 2: PSX_MemWrite16(timestamp, address, value); break;
+            case 3: PSX_MemWrite24(timestamp, address, value); break;
+            case 4: PSX_MemWrite32(timestamp, address, value); break;
+         }
+      }
+      else
+      {
+         switch(size)
+         {
+            case 1: value = PSX_MemRead8(timestamp, address); break;
+            case 2: value = PSX_MemRead16(timestamp, address); break;
+            case 3: value = PSX_MemRead24(timestamp, address) & 0xFFFFFF; break;
+            case 4: value = PSX_MemRead32(timestamp, address); break;
+         }
+      }
+
+      if(JIT->log_count == JIT_LOCKSTEP_LOG)
+      {
+         JIT->log_error = true;
+         return(value);
+      }
+
+      a = &JIT->log[JIT->log_count++];
+      a->write = write;
+      a->size = size;
+      a->address = address;
+      a->value = value;
+      a->ts_delta = timestamp - ts_before;
+      a->next_event_ts = next_event_ts;
+      a->cause = CP0.CAUSE;
+      a->ipcache = IPCache;
+      a->halted = Halted;
+      a->biu = BIU;
+
+      return(value);
+   }
+
+   if(JIT->log_pos == JIT->log_count)
+   {
+      JIT->log_error = true;
+      return(0);
+   }
+
+   a = &JIT->log[JIT->log_pos++];
+
+   if(a->write != write || a->size != size || a->address != address || (write && a->value != value))
+      JIT->log_error = true;
+
+   timestamp += a->ts_delta;
+   next_event_ts = a->next_event_ts;
+   CP0.CAUSE = a->cause;
+   IPCache = a->ipcache;
+   Halted = a->halted;
+
+   if(BIU != a->biu)
+      SetBIU(a->biu);
+
+   return(a->value);
+}
+
+#endif
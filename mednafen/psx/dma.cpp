@@ -434,7 +434,12 @@ static INLINE void RunChannel(int32_t timestamp, int32_t clocks, int ch)
             ChRW(ch, CRModeCache, &vtmp, &voffs);
 
             if(!(CRModeCache & 0x1))
-               MainRAM.WriteU32((DMACH[ch].CurAddr + (voffs << 2)) & 0x1FFFFC, vtmp);
+            {
+               const uint32_t addr = (DMACH[ch].CurAddr + (voffs << 2)) & 0x1FFFFC;
+
+               MainRAM.WriteU32(addr, vtmp);
+               MainRAMDirty[addr >> REWIND_PAGE_SHIFT] = 1;
+            }
          }
 
          if(CRModeCache & 0x2)
@@ -89,7 +89,20 @@ PS_GPU::PS_GPU(bool pal_clock_and_tv, int sls, int sle, uint8_t upscale_shift)
 
    this->upscale_shift = upscale_shift;
    this->dither_upscale_shift = 0;
+   this->vram_dirty = new uint8[256 << (2 * upscale_shift)]();
    this->SubpixelVertexCache = NULL;
+   this->SubpixelVertexQueued = NULL;
+
+   vram = (uint16*)(this + 1);
+
+   render_thread = NULL;
+   timing_only = false;
+   render_copy = false;
+
+   raster_pool = NULL;
+   raster_threads = 0;
+
+   TexPageCacheInit();
 }
 
 PS_GPU::PS_GPU(const PS_GPU &g, uint8 ushift)
@@ -99,10 +112,25 @@ PS_GPU::PS_GPU(const PS_GPU &g, uint8 ushift)
 
    // Be careful not to copy the dynamically allocated vertex cache
    this->SubpixelVertexCache = NULL;
+   this->SubpixelVertexQueued = NULL;
+
+   // ...or the pointer to g's VRAM, or its threads
+   vram = (uint16*)(this + 1);
+
+   render_thread = NULL;
+   timing_only = false;
+   render_copy = false;
+
+   raster_pool = NULL;
+   raster_threads = 0;
+
+   TexPageCacheInit();
 
    // Override the upscaling factor
    upscale_shift = ushift;
 
+   vram_dirty = new uint8[256 << (2 * upscale_shift)]();
+
    //For simplicity we do the transfer at 1x internal resolution.
    for (unsigned y = 0; y < 512; y++)
    {
@@ -120,8 +148,35 @@ PS_GPU::PS_GPU(const PS_GPU &g, uint8 ushift)
    }
 }
 
+// The render thread's copy of g; it draws into g's VRAM, and only what drawing
+// depends on is ever used.
+PS_GPU::PS_GPU(const PS_GPU &g, GPURenderThread *)
+{
+   *this = g;
+
+   render_thread = NULL;
+   timing_only = false;
+   render_copy = true;
+
+   // The GTE writes the cache on the emulation thread, polygons carry their
+   // vertices over.
+   SubpixelVertexCache = NULL;
+   SubpixelVertexQueued = NULL;
+
+   tex_page_cur = NULL;
+   DrawTimeAvail = 0;
+}
+
 PS_GPU::~PS_GPU()
 {
+   if(render_copy)
+      return;
+
+   SetRenderThread(false);
+   SetRasterThreads(0);
+   TexPageCacheFree();
+
+   delete [] vram_dirty;
 }
 
 void PS_GPU::BuildDitherTable()
@@ -149,6 +204,10 @@ void PS_GPU::BuildDitherTable()
 }
 
 void PS_GPU::EnableSubpixelVertexCache(bool enable) {
+  // The render thread's copy of the cache pointer may be about to dangle
+  if (render_thread)
+    SyncRenderThread();
+
   // The cache is useless at 1x
   if (enable && upscale_shift > 0) {
     if (SubpixelVertexCache == NULL) {
@@ -161,6 +220,9 @@ void PS_GPU::EnableSubpixelVertexCache(bool enable) {
       SubpixelVertexCache = NULL;
     }
   }
+
+  if (render_thread)
+    ReloadRenderThread();
 }
 
 void PS_GPU::ResetSubpixelVertexCache() {
@@ -203,9 +265,17 @@ void PS_GPU::Destroy(PS_GPU *gpu) {
   delete [] (char*)gpu;
 }
 
+void PS_GPU::RewindAddRegions(void)
+{
+   MDFN_RewindAddRegion(vram, (1024 << upscale_shift) * (512 << upscale_shift) * sizeof(uint16), vram_dirty);
+}
+
 // Build a new GPU with a different upscale_shift
 PS_GPU *PS_GPU::Rescale(uint8 ushift)
 {
+   if (render_thread)
+      SyncRenderThread();
+
    void *buffer = PS_GPU::Alloc(ushift);
 
    return new (buffer) PS_GPU(*this, ushift);
@@ -320,11 +390,18 @@ void PS_GPU::SoftReset(void) // Control command 0x00
 
    TexDisable = false;
    TexDisableAllowChange = false;
+
+   if(render_thread)
+      ReloadRenderThread();
 }
 
 void PS_GPU::Power(void)
 {
+   if(render_thread)
+      SyncRenderThread();
+
    memset(vram, 0, vram_npixels() * sizeof(*vram));
+   TexPageCacheInvalidateAll();
 
    memset(CLUT_Cache, 0, sizeof(CLUT_Cache));
    CLUT_Cache_VB = ~0U;
@@ -508,6 +585,9 @@ static void G_Command_FBFill(PS_GPU* gpu, const uint32 *cb)
 
       gpu->DrawTimeAvail -= (width >> 3) + 9;
 
+      if(gpu->timing_only)
+         continue;
+
       for(x = 0; x < width; x++)
       {
          const int32 d_x = (x + destX) & 1023;
@@ -539,6 +619,9 @@ static void G_Command_FBCopy(PS_GPU* g, const uint32 *cb)
 
    g->DrawTimeAvail -= (width * height) * 2;
 
+   if(g->timing_only)
+      return;
+
    for(int32 y = 0; y < height; y++)
    {
       for(int32 x = 0; x < width; x += 128)
@@ -602,6 +685,10 @@ static void G_Command_FBRead(PS_GPU* g, const uint32 *cb)
 {
    //assert(g->InCmd == INCMD_NONE);
 
+   // VRAM is about to be read back, let the render thread catch up.
+   if(g->render_thread)
+      g->SyncRenderThread();
+
    g->FBRW_X = (cb[1] >>  0) & 0x3FF;
    g->FBRW_Y = (cb[1] >> 16) & 0x3FF;
 
@@ -822,97 +909,55 @@ CTEntry PS_GPU::Commands[256] =
 };
 
 
-void PS_GPU::ProcessFIFO(void)
+// Writes the two pixels of a GP0 word during an FBWrite transfer.
+void PS_GPU::WriteFBWord(uint32_t InData)
 {
-   uint32_t CB[0x10], InData;
    unsigned i;
-   unsigned command_len;
-   uint32_t cc            = InCmd_CC;
-   const CTEntry *command = &Commands[cc];
-   bool read_fifo         = false;
 
-   if(!BlitterFIFO.CanRead())
-      return;
+   // The whole rectangle was flagged when the command started, but a rewind snapshot may have
+   // been taken since.
+   if(!timing_only)
+      MarkVRAMDirty(FBRW_CurY, 1);
 
-   switch(InCmd)
+   for(i = 0; i < 2; i++)
    {
-      default:
-      case INCMD_NONE:
-         break;
-
-      case INCMD_FBREAD:
-         return;
-
-      case INCMD_FBWRITE:
-         InData = BlitterFIFO.Read();
-
-         for(i = 0; i < 2; i++)
-         {
-            bool fetch = texel_fetch(FBRW_CurX & 1023, FBRW_CurY & 511) & MaskEvalAND;
-
-            if (!fetch)
-               texel_put(FBRW_CurX & 1023, FBRW_CurY & 511, InData | MaskSetOR);
-
-            FBRW_CurX++;
-            if(FBRW_CurX == (FBRW_X + FBRW_W))
-            {
-               FBRW_CurX = FBRW_X;
-               FBRW_CurY++;
-               if(FBRW_CurY == (FBRW_Y + FBRW_H))
-               {
-                  /* Upload complete, send over to RSX */
-                  rsx_intf_load_image(FBRW_X, FBRW_Y,
-                        FBRW_W, FBRW_H,
-                        this->vram);
-                  InCmd = INCMD_NONE;
-                  break;	// Break out of the for() loop.
-               }
-            }
-            InData >>= 16;
-         }
-         return;
-
-      case INCMD_QUAD:
-         if(DrawTimeAvail < 0)
-            return;
-
-         command_len      = 1 + (bool)(cc & 0x4) + (bool)(cc & 0x10);
-         read_fifo = true;
-         break;
-      case INCMD_PLINE:
-         if(DrawTimeAvail < 0)
-            return;
+      if(!timing_only)
+      {
+         bool fetch = texel_fetch(FBRW_CurX & 1023, FBRW_CurY & 511) & MaskEvalAND;
 
-         command_len        = 1 + (bool)(InCmd_CC & 0x10);
+         if (!fetch)
+            texel_put(FBRW_CurX & 1023, FBRW_CurY & 511, InData | MaskSetOR);
+      }
 
-         if((BlitterFIFO.Peek() & 0xF000F000) == 0x50005000)
+      FBRW_CurX++;
+      if(FBRW_CurX == (FBRW_X + FBRW_W))
+      {
+         FBRW_CurX = FBRW_X;
+         FBRW_CurY++;
+         if(FBRW_CurY == (FBRW_Y + FBRW_H))
          {
-            BlitterFIFO.Read();
+            /* Upload complete, send over to RSX */
+            rsx_intf_load_image(FBRW_X, FBRW_Y,
+                  FBRW_W, FBRW_H,
+                  this->vram);
             InCmd = INCMD_NONE;
-            return;
+            break;	// Break out of the for() loop.
          }
 
-         read_fifo = true;
-         break;
-   }
-
-   if (!read_fifo)
-   {
-      cc          = BlitterFIFO.Peek() >> 24;
-      command     = &Commands[cc];
-      command_len = command->len;
-
-      if(DrawTimeAvail < 0 && !command->ss_cmd)
-         return;
+         if(!timing_only)
+            MarkVRAMDirty(FBRW_CurY, 1);
+      }
+      InData >>= 16;
    }
+}
 
-   if(BlitterFIFO.CanRead() < command_len)
-      return;
-
-   for(i = 0; i < command_len; i++)
-      CB[i] = BlitterFIFO.Read();
+// Runs a command whose words have been pulled out of the FIFO;
+// continuation is set for the later parts of quads and polylines.
+void PS_GPU::ExecuteCommand(uint32_t cc, const uint32_t *CB, bool continuation)
+{
+   const CTEntry *command = &Commands[cc];
 
-   if (!read_fifo)
+   if (!continuation)
    {
       if(!command->ss_cmd)
          DrawTimeAvail -= 2;
@@ -927,6 +972,32 @@ void PS_GPU::ProcessFIFO(void)
       }
    }
 
+   // Drop cached texture pages this may draw over, and tell the rewind code.
+   if(!timing_only)
+   {
+      if(cc == 0x02)
+      {
+         TexPageCacheInvalidate(CB[1] & 0x3F0, (CB[1] >> 16) & 0x3FF, ((CB[2] & 0x3FF) + 0xF) & ~0xF, (CB[2] >> 16) & 0x1FF);
+         MarkVRAMDirty((CB[1] >> 16) & 0x3FF, (CB[2] >> 16) & 0x1FF);
+      }
+      else if(cc >= 0x20 && cc <= 0x7F)
+      {
+         if(ClipX1 >= ClipX0 && ClipY1 >= ClipY0)
+         {
+            TexPageCacheInvalidate(ClipX0, ClipY0, ClipX1 - ClipX0 + 1, std::min<int32>(ClipY1 - ClipY0 + 1, 512));
+            MarkVRAMDirty(ClipY0, std::min<int32>(ClipY1 - ClipY0 + 1, 512));
+         }
+      }
+      else if(cc >= 0x80 && cc <= 0xBF)
+      {
+         // FBCopy destination, or FBWrite.
+         const uint32 *dest = (cc <= 0x9F) ? &CB[2] : &CB[1];
+
+         TexPageCacheInvalidate(*dest & 0x3FF, (*dest >> 16) & 0x3FF, ((dest[1] - 1) & 0x3FF) + 1, (((dest[1] >> 16) - 1) & 0x1FF) + 1);
+         MarkVRAMDirty((*dest >> 16) & 0x3FF, (((dest[1] >> 16) - 1) & 0x1FF) + 1);
+      }
+   }
+
    if ((cc >= 0x80) && (cc <= 0x9F))
       G_Command_FBCopy(this, CB);
    else if ((cc >= 0xA0) && (cc <= 0xBF))
@@ -989,6 +1060,86 @@ void PS_GPU::ProcessFIFO(void)
    }
 }
 
+void PS_GPU::ProcessFIFO(void)
+{
+   uint32_t CB[0x10], InData;
+   unsigned i;
+   unsigned command_len;
+   uint32_t cc            = InCmd_CC;
+   const CTEntry *command = &Commands[cc];
+   bool read_fifo         = false;
+
+   if(!BlitterFIFO.CanRead())
+      return;
+
+   switch(InCmd)
+   {
+      default:
+      case INCMD_NONE:
+         break;
+
+      case INCMD_FBREAD:
+         return;
+
+      case INCMD_FBWRITE:
+         {
+            const uint32_t first_line = FBRW_CurY;
+
+            InData = BlitterFIFO.Read();
+            WriteFBWord(InData);
+
+            if(render_thread)
+               QueueRenderFBWrite(InData, first_line & 511, FBRW_CurY & 511);
+         }
+         return;
+
+      case INCMD_QUAD:
+         if(DrawTimeAvail < 0)
+            return;
+
+         command_len      = 1 + (bool)(cc & 0x4) + (bool)(cc & 0x10);
+         read_fifo = true;
+         break;
+      case INCMD_PLINE:
+         if(DrawTimeAvail < 0)
+            return;
+
+         command_len        = 1 + (bool)(InCmd_CC & 0x10);
+
+         if((BlitterFIFO.Peek() & 0xF000F000) == 0x50005000)
+         {
+            BlitterFIFO.Read();
+            InCmd = INCMD_NONE;
+            return;
+         }
+
+         read_fifo = true;
+         break;
+   }
+
+   if (!read_fifo)
+   {
+      cc          = BlitterFIFO.Peek() >> 24;
+      command     = &Commands[cc];
+      command_len = command->len;
+
+      if(DrawTimeAvail < 0 && !command->ss_cmd)
+         return;
+   }
+
+   if(BlitterFIFO.CanRead() < command_len)
+      return;
+
+   for(i = 0; i < command_len; i++)
+      CB[i] = BlitterFIFO.Read();
+
+   // Must see InCmd and the drawing state as they were before the command.
+   if(render_thread)
+      QueueRenderCommand(cc, CB, command_len, read_fifo);
+
+   ExecuteCommand(cc, CB, read_fifo);
+}
+
 INLINE void PS_GPU::WriteCB(uint32_t InData)
 {
    if(BlitterFIFO.CanRead() >= 0x10
@@ -1589,8 +1740,13 @@ int32_t PS_GPU::Update(const int32_t sys_timestamp)
 
                LineWidths[dest_line] = dmw;
 
+               if(render_thread && dx_start < dx_end && !espec->skip)
+                  SyncRenderLine(DisplayFB_CurLineYReadout);
+
                //printf("dx_start base: %d, dmw: %d\n", dx_start, dmw);
 
+               // Nothing of a skipped frame is shown, don't bother converting it.
+               if(!espec->skip)
                {
                   // Convert the necessary variables to the upscaled version
                   uint32_t x;
@@ -1699,11 +1855,23 @@ int PS_GPU::StateAction(StateMem *sm, int load, int data_only)
 
    uint16 *vram_new = NULL;
 
+   if (render_thread)
+      SyncRenderThread();
+
+   uint32 vram_new_size = 1024 * 512;
+
    if (upscale_shift == 0)
    {
       // No upscaling, we can dump the VRAM contents directly
       vram_new = vram;
    }
+   else if (data_only)
+   {
+      // Raw snapshots are only loaded back into this same GPU, keep
+      // the upscaled VRAM as it is
+      vram_new = vram;
+      vram_new_size = (1024 << upscale_shift) * (512 << upscale_shift);
+   }
    else
    {
       // We have increased internal resolution, savestates are always
@@ -1733,7 +1901,7 @@ int PS_GPU::StateAction(StateMem *sm, int load, int data_only)
    {
       // Hardcode entry name to remain backward compatible with the
       // previous fixed internal resolution code
-      SFARRAY16N(vram_new, 1024 * 512, "&GPURAM[0][0]"),
+      { vram_new, (uint32)(vram_new_size * sizeof(uint16)), (uint32)(MDFNSTATE_RLSB16 | (data_only ? MDFNSTATE_REWIND_TRACKED : 0)), "&GPURAM[0][0]" },
 
       SFVAR(DMAControl),
 
@@ -1834,7 +2002,7 @@ int PS_GPU::StateAction(StateMem *sm, int load, int data_only)
 
    int ret = MDFNSS_StateAction(sm, load, data_only, StateRegs, "GPU");
 
-   if (upscale_shift > 0)
+   if (vram_new != vram)
    {
       if (load)
       {
@@ -1855,6 +2023,8 @@ int PS_GPU::StateAction(StateMem *sm, int load, int data_only)
       // Invalidate vertex cache
       ResetSubpixelVertexCache();
 
+      TexPageCacheInvalidateAll();
+
       for(unsigned i = 0; i < 256; i++)
       {
          TexCache[i].Tag = TexCache_Tag[i];
@@ -1871,6 +2041,9 @@ int PS_GPU::StateAction(StateMem *sm, int load, int data_only)
       HorizEnd &= 0xFFF;
 
       IRQ_Assert(IRQ_GPU, IRQPending);
+
+      if (render_thread)
+         ReloadRenderThread();
    }
    rsx_intf_toggle_display(DisplayOff);
    rsx_intf_set_draw_area(this->ClipX0, this->ClipY0,
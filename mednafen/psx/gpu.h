@@ -9,6 +9,7 @@
 #include <cmath>
 #include <math.h>
 #include "FastFIFO.h"
+#include "../rewind.h"
 
 #if defined(HAVE_OPENGL) || defined(HAVE_OPENGLES)
 #include <glsm/glsmsym.h>
@@ -16,7 +17,14 @@
 
 #include "../../rsx/rsx.h"
 
+#if (defined(__ARM_NEON__) || defined(__ARM_NEON)) && !defined(__SSE2__)
+#define GPU_SPAN_NEON
+#endif
+
 class PS_GPU;
+struct GPURenderThread;
+struct GPURasterPool;
+struct TexPageCache;
 
 #define INCMD_NONE     0
 #define INCMD_PLINE    1
@@ -53,6 +61,13 @@ struct tri_vertex
 
 struct i_group;
 struct i_deltas;
+struct tri_rows;
+
+enum
+{
+   GPU_RASTER_THREADS_MAX = 16,
+   RASTER_BAND_MIN_LINES = 32	// At 1x; smaller triangles aren't worth splitting.
+};
 
 struct line_point
 {
@@ -67,6 +82,21 @@ struct line_point
    _b = tmp;                \
 }                           \
 
+// A 4bpp or 8bpp texture page with a CLUT applied(see gpu_texcache.cpp).
+struct TexPageCacheEntry
+{
+   uint32 key;
+   uint32 last_use;
+
+   uint32 mode;
+   uint32 page_x;
+   uint32 page_y;
+   uint32 clut;
+
+   bool line_valid[256];
+   uint16 texels[256][256];	// [v][u], texture window already applied.
+};
+
 struct subpixel_vertex {
   float x;
   float y;
@@ -86,6 +116,7 @@ class PS_GPU
       // custom allocators to allocate the flexible vram
       PS_GPU(bool pal_clock_and_tv, int sls, int sle, uint8 upscale_shift) MDFN_COLD;
       PS_GPU(const PS_GPU &, uint8 upscale_shift) MDFN_COLD;
+      PS_GPU(const PS_GPU &, GPURenderThread *) MDFN_COLD;
      ~PS_GPU() MDFN_COLD;
 
       static void *Alloc(uint8 upscale_shift) MDFN_COLD;
@@ -120,8 +151,13 @@ class PS_GPU
 	}
       }
 
-      INLINE const subpixel_vertex *GetSubpixelVertex(int32 x, int32 y) const
+      INLINE const subpixel_vertex *GetSubpixelVertex(int32 x, int32 y)
       {
+	if (SubpixelVertexQueued) {
+	  // The GTE may have moved on since the polygon was queued
+	  return SubpixelVertexQueued++;
+	}
+
 	if (SubpixelVertexCache == NULL) {
 	  // Cache disabled
 	  return NULL;
@@ -141,11 +177,20 @@ class PS_GPU
       void EnableSubpixelVertexCache(bool enable);
       void ResetSubpixelVertexCache();
 
+      // Software rasterization on a separate thread(see gpu_thread.cpp).
+      void SetRenderThread(bool enable) MDFN_COLD;
+      void SyncRenderThread(void);
+
+      // Threads drawing large triangles in bands(0 or 1 to disable).
+      void SetRasterThreads(unsigned count) MDFN_COLD;
+
       static PS_GPU *Build(bool pal_clock_and_tv, int sls, int sle, uint8 upscale_shift) MDFN_COLD;
       static void Destroy(PS_GPU *gpu) MDFN_COLD;
 
       PS_GPU *Rescale(uint8 upscale_shift) MDFN_COLD;
 
+      void RewindAddRegions(void) MDFN_COLD;
+
       void FillVideoParams(MDFNGI* gi) MDFN_COLD;
 
       void Power(void) MDFN_COLD;
@@ -204,7 +249,36 @@ class PS_GPU
 
       INLINE void PokeRAM(uint32 A, uint16 V)
       {
+         if(render_thread)
+            SyncRenderThread();
+
          texel_put(A & 0x3FF, (A >> 10) & 0x1FF, V);
+         TexPageCacheInvalidate(A & 0x3FF, (A >> 10) & 0x1FF, 1, 1);
+         MarkVRAMDirty((A >> 10) & 0x1FF, 1);
+      }
+
+      // Flags VRAM lines y to y + h - 1(wrapping around) as written to.
+      INLINE void MarkVRAMDirty(uint32 y, uint32 h)
+      {
+         const uint32 line_shift = 11 + 2 * upscale_shift;	// Bytes per line, upscaled both ways.
+
+         y &= 511;
+
+         if(!h)
+            return;
+
+         if(y + h > 512)
+         {
+            const uint32 last = (((y + h - 512) << line_shift) - 1) >> REWIND_PAGE_SHIFT;
+
+            memset(vram_dirty, 1, last + 1);
+            h = 512 - y;
+         }
+
+         const uint32 first = (y << line_shift) >> REWIND_PAGE_SHIFT;
+         const uint32 last = (((y + h) << line_shift) - 1) >> REWIND_PAGE_SHIFT;
+
+         memset(vram_dirty + first, 1, last - first + 1);
       }
 
       // Return a pixel from VRAM, ignoring the internal upscaling
@@ -405,8 +479,45 @@ class PS_GPU
 
       uint8_t DitherLUT[4][4][512];	// Y, X, 8-bit source value(256 extra for saturation)
 
+      // Non-NULL while a render thread does the drawing, in which case this
+      // object only runs the commands for their timing(timing_only is set),
+      // and a copy of it owned by the thread draws into the shared VRAM.
+      GPURenderThread *render_thread;
+      bool timing_only;
+
+      // Set on the render thread's copy, which shares VRAM and everything
+      // else that's allocated with the GPU it was made from.
+      bool render_copy;
+
+      // Set on the render thread's copy while it runs a polygon, to the
+      // subpixel vertices queued along with it.
+      const subpixel_vertex *SubpixelVertexQueued;
+
+      // Shared with the render thread's copy; only one of them draws at a time.
+      GPURasterPool *raster_pool;
+      unsigned raster_threads;
+
+      // Shared with the render thread's copy, which is the only one using it
+      // while it runs.
+      TexPageCache *tex_page_cache;
+      TexPageCacheEntry *tex_page_cur;	// For the primitive being drawn, NULL to read VRAM.
+
    private:
 
+      void QueueRenderCommand(uint32 cc, const uint32 *CB, unsigned len, bool continuation);
+      void QueueRenderFBWrite(uint32 InData, uint32 first_line, uint32 last_line);
+      void SyncRenderLine(uint32 line);
+      void ReloadRenderThread(void) MDFN_COLD;
+      void TexPageCacheInit(void) MDFN_COLD;
+      void TexPageCacheFree(void) MDFN_COLD;
+      TexPageCacheEntry *TexPageCacheLookup(uint32 mode, uint32 clut);
+      void TexPageCacheDecodeLine(TexPageCacheEntry *e, uint32 v);
+      void TexPageCacheFill(TexPageCacheEntry *e);
+      void TexPageCacheInvalidate(uint32 x, uint32 y, uint32 w, uint32 h);
+      void TexPageCacheInvalidateAll(void);
+
+      void RunRasterBands(void (*func)(void *arg, unsigned band), void *arg, unsigned bands);
+
       template<uint32 TexMode_TA>
          void Update_CLUT_Cache(uint16 raw_clut);
 
@@ -431,7 +542,25 @@ class PS_GPU
       uint16 ModTexel(uint16 texel, int32 r, int32 g, int32 b, const int32 dither_x, const int32 dither_y);
 
       template<bool goraud, bool textured, int BlendMode, bool TexMult, uint32 TexMode, bool MaskEval_TA>
-         void DrawSpan(int y, uint32 clut_offset, const int32 x_start, const int32 x_bound, i_group ig, const i_deltas &idl);
+         int32 DrawSpan(int y, uint32 clut_offset, const int32 x_start, const int32 x_bound, i_group ig, const i_deltas &idl);
+
+#if defined(__SSE2__)
+      template<bool goraud, bool textured, int BlendMode, bool TexMult, bool MaskEval_TA>
+         void DrawSpan_SSE2(int y, int32 &x, const int32 x_bound, i_group &ig, const i_deltas &idl);
+#elif defined(GPU_SPAN_NEON)
+      template<bool goraud, bool textured, int BlendMode, bool TexMult, bool MaskEval_TA>
+         void DrawSpan_NEON(int y, int32 &x, const int32 x_bound, i_group &ig, const i_deltas &idl);
+#endif
+
+#if defined(__SSE2__) || defined(GPU_SPAN_NEON)
+      bool SpanInTexPage(int y, int32 x_start, int32 x_bound);
+#endif
+
+      template<bool shaded, bool textured, int BlendMode, bool TexMult, uint32 TexMode_TA, bool MaskEval_TA>
+         int32 DrawTriangleRows(const tri_rows &t, int32 y_first, int32 y_end);
+
+      template<bool shaded, bool textured, int BlendMode, bool TexMult, uint32 TexMode_TA, bool MaskEval_TA>
+         static void DrawTriangleBand(void *arg, unsigned band);
 
       template<bool shaded, bool textured, int BlendMode, bool TexMult, uint32 TexMode_TA, bool MaskEval_TA>
          void DrawTriangle(tri_vertex *vertices, uint32 clut);
@@ -461,6 +590,9 @@ class PS_GPU
       void Command_FBWrite(const uint32 *cb);
       void Command_FBRead(const uint32 *cb);
 
+      void ExecuteCommand(uint32 cc, const uint32 *CB, bool continuation);
+      void WriteFBWord(uint32 InData);
+
       void Command_DrawMode(const uint32 *cb);
       void Command_TexWindow(const uint32 *cb);
       void Command_Clip0(const uint32 *cb);
@@ -481,11 +613,14 @@ class PS_GPU
 
    public:
 
-      // "Flexible" array at the end of the struct. This lets us
-      // having a dynamically sized vram (depending on the internal
-      // upscaling ratio) without having an additional level of
-      // indirection since it'll be allocated right after the struct
-      uint16 vram[0];
+      // Points right after the struct, where Alloc() leaves room for a
+      // dynamically sized vram (depending on the internal upscaling
+      // ratio). The render thread's copy shares it with the original.
+      uint16 *vram;
+
+      // A byte per REWIND_PAGE_SIZE bytes of vram, set for pages drawn to.
+      // Shared with the render thread's copy like vram.
+      uint8 *vram_dirty;
 
 };
 
@@ -112,9 +112,12 @@ INLINE void PS_GPU::Update_CLUT_Cache(uint16 raw_clut)
 
          DrawTimeAvail -= count;
 
-         for(unsigned i = 0; i < count; i++)
+         if(!timing_only)
          {
-            CLUT_Cache[i] = texel_fetch((cxo + i) & 0x3FF, y);
+            for(unsigned i = 0; i < count; i++)
+            {
+               CLUT_Cache[i] = texel_fetch((cxo + i) & 0x3FF, y);
+            }
          }
 
          CLUT_Cache_VB = new_ccvb;
@@ -208,6 +211,15 @@ INLINE uint16_t PS_GPU::GetTexel(const uint32_t clut_offset, int32_t u_arg, int3
 #else
    uint32_t u_ext = TexWindowXLUT[u_arg];
    uint32_t v = TexWindowYLUT[v_arg];
+
+   if(TexMode_TA != 2 && tex_page_cur)
+   {
+      if(MDFN_UNLIKELY(!tex_page_cur->line_valid[v]))
+         TexPageCacheDecodeLine(tex_page_cur, v);
+
+      return tex_page_cur->texels[v][u_ext];
+   }
+
    uint32_t fbtex_x = TexPageX + (u_ext >> (2 - TexMode_TA));
    uint32_t fbtex_y = TexPageY + v;
    uint16_t fbw = texel_fetch(fbtex_x & 1023, fbtex_y);
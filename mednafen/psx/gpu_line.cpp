@@ -121,6 +121,9 @@ void PS_GPU::DrawLine(line_point *points)
 
    DrawTimeAvail -= k * 2;
 
+   if(timing_only)
+      return;
+
    line_points_to_fixed_point_step<goraud>(&points[0], &points[1], k, &step);
    line_point_to_fixed_point_coord<goraud>(&points[0], &step, &cur_point);
 
@@ -1,5 +1,11 @@
 #include <math.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(GPU_SPAN_NEON)
+#include <arm_neon.h>
+#endif
+
 #define COORD_FBS 12
 #define COORD_MF_INT(n) ((n) << COORD_FBS)
 #define COORD_POST_PADDING	12
@@ -130,15 +136,492 @@ static INLINE void AddIDeltas_DY(i_group &ig, const i_deltas &idl, uint32_t coun
    }
 }
 
+#if defined(__SSE2__)
+//
+// SSE2 versions of the per-pixel work in DrawSpan(), for untextured and 15-bit
+// direct textured spans, 8 pixels at a time.  Blending is done with the same
+// integer math as PlotPixelBlend(), in 32-bit lanes, so results are identical.
+//
+
+// Truncates 2x4 32-bit lanes to 8 16-bit lanes.
+static INLINE __m128i PackLow16_SSE2(__m128i lo, __m128i hi)
+{
+   lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+   hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+
+   return _mm_packs_epi32(lo, hi);
+}
+
+// Integer part of 8 interpolant coordinates, saturated to 0-255 like RGB8SAT[].
+template<bool saturate>
+static INLINE __m128i GetCoordInt_SSE2(__m128i lo, __m128i hi)
+{
+   __m128i ret = _mm_packs_epi32(_mm_srai_epi32(lo, COORD_FBS), _mm_srai_epi32(hi, COORD_FBS));
+
+   if(saturate)
+      ret = _mm_min_epi16(_mm_max_epi16(ret, _mm_setzero_si128()), _mm_set1_epi16(0xFF));
+
+   return ret;
+}
+
+// DitherLUT[][][v] for 8 lanes, with the dither matrix offsets in d.
+static INLINE __m128i DitherLookup_SSE2(__m128i v, __m128i d)
+{
+   v = _mm_srai_epi16(_mm_add_epi16(v, d), 3);
+
+   return _mm_min_epi16(_mm_max_epi16(v, _mm_setzero_si128()), _mm_set1_epi16(0x1F));
+}
+
+template<int BlendMode>
+static INLINE __m128i PlotPixelBlend_SSE2(__m128i bg_pix, __m128i fore_pix)
+{
+   const __m128i bit15 = _mm_set1_epi32(0x8000);
+   __m128i sum, carry;
+
+   switch(BlendMode)
+   {
+      case BLEND_MODE_AVERAGE:
+         bg_pix   = _mm_or_si128(bg_pix, bit15);
+         fore_pix = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(fore_pix, bg_pix), _mm_and_si128(_mm_xor_si128(fore_pix, bg_pix), _mm_set1_epi32(0x0421))), 1);
+         break;
+
+      case BLEND_MODE_ADD_FOURTH:
+         fore_pix = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(fore_pix, 2), _mm_set1_epi32(0x1CE7)), bit15);
+         // Fall through
+
+      case BLEND_MODE_ADD:
+         bg_pix   = _mm_andnot_si128(bit15, bg_pix);
+         sum      = _mm_add_epi32(fore_pix, bg_pix);
+         carry    = _mm_and_si128(_mm_sub_epi32(sum, _mm_and_si128(_mm_xor_si128(fore_pix, bg_pix), _mm_set1_epi32(0x8421))), _mm_set1_epi32(0x8420));
+         fore_pix = _mm_or_si128(_mm_sub_epi32(sum, carry), _mm_sub_epi32(carry, _mm_srli_epi32(carry, 5)));
+         break;
+
+      case BLEND_MODE_SUBTRACT:
+         {
+            const __m128i borrow_mask = _mm_set1_epi32(0x108420);
+            __m128i diff, borrow;
+
+            bg_pix   = _mm_or_si128(bg_pix, bit15);
+            fore_pix = _mm_andnot_si128(bit15, fore_pix);
+            diff     = _mm_add_epi32(_mm_sub_epi32(bg_pix, fore_pix), borrow_mask);
+            borrow   = _mm_and_si128(_mm_sub_epi32(diff, _mm_and_si128(_mm_xor_si128(bg_pix, fore_pix), borrow_mask)), borrow_mask);
+            fore_pix = _mm_and_si128(_mm_sub_epi32(diff, borrow), _mm_sub_epi32(borrow, _mm_srli_epi32(borrow, 5)));
+         }
+         break;
+   }
+
+   return fore_pix;
+}
+
+// Draws whole groups of 8 pixels of the span [x, x_bound), leaving x and ig at
+// the first pixel left for the scalar loop.
+template<bool goraud, bool textured, int BlendMode, bool TexMult, bool MaskEval_TA>
+INLINE void PS_GPU::DrawSpan_SSE2(int y, int32_t &x, const int32_t x_bound, i_group &ig, const i_deltas &idl)
+{
+   const int32_t count = (x_bound - x) & ~7;
+   const bool dither = DitherEnabled() && (textured ? TexMult : goraud);
+   const bool modulate = !textured || TexMult;
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i ones = _mm_cmpeq_epi16(zero, zero);
+   const __m128i bit15 = _mm_set1_epi16((int16_t)0x8000);
+   const __m128i mask_set = _mm_set1_epi16((int16_t)MaskSetOR);
+   uint16_t *row = &vram[(y & ((512 << upscale_shift) - 1)) << (10 + upscale_shift)];
+   int16_t dither_row[(4 << 3) + 8];
+   unsigned dither_wrap = 0;
+   __m128i dither_offs = _mm_set1_epi16(dither_table[2][3]);	// What ModTexel() gets without dithering.
+   __m128i r_lo, r_hi, g_lo, g_hi, b_lo, b_hi;
+   __m128i r_step, g_step, b_step;
+
+   if(count <= 0)
+      return;
+
+   if(dither)
+   {
+      const int dy = (y >> dither_upscale_shift) & 3;
+
+      dither_wrap = (4 << dither_upscale_shift) - 1;
+
+      for(unsigned i = 0; i < dither_wrap + 1 + 8; i++)
+         dither_row[i] = dither_table[dy][(i >> dither_upscale_shift) & 3];
+   }
+
+   r_lo = _mm_add_epi32(_mm_set1_epi32(ig.r), _mm_set_epi32(idl.dr_dx * 3, idl.dr_dx * 2, idl.dr_dx, 0));
+   g_lo = _mm_add_epi32(_mm_set1_epi32(ig.g), _mm_set_epi32(idl.dg_dx * 3, idl.dg_dx * 2, idl.dg_dx, 0));
+   b_lo = _mm_add_epi32(_mm_set1_epi32(ig.b), _mm_set_epi32(idl.db_dx * 3, idl.db_dx * 2, idl.db_dx, 0));
+
+   if(!goraud)
+   {
+      r_lo = _mm_set1_epi32(ig.r);
+      g_lo = _mm_set1_epi32(ig.g);
+      b_lo = _mm_set1_epi32(ig.b);
+   }
+
+   r_step = _mm_set1_epi32(goraud ? idl.dr_dx * 4 : 0);
+   g_step = _mm_set1_epi32(goraud ? idl.dg_dx * 4 : 0);
+   b_step = _mm_set1_epi32(goraud ? idl.db_dx * 4 : 0);
+
+   r_hi = _mm_add_epi32(r_lo, r_step);
+   g_hi = _mm_add_epi32(g_lo, g_step);
+   b_hi = _mm_add_epi32(b_lo, b_step);
+
+   for(int32_t i = 0; i < count; i += 8, x += 8)
+   {
+      __m128i fore, bg, write = ones;
+
+      if(dither)
+         dither_offs = _mm_loadu_si128((const __m128i*)&dither_row[x & dither_wrap]);
+
+      if(textured)
+      {
+         uint16_t texels[8];
+
+         for(unsigned j = 0; j < 8; j++)
+         {
+            texels[j] = GetTexel<2>(0, COORD_GET_INT(ig.u), COORD_GET_INT(ig.v));
+            ig.u += idl.du_dx;
+            ig.v += idl.dv_dx;
+         }
+
+         fore = _mm_loadu_si128((const __m128i*)texels);
+
+         // Texel 0 is transparent.
+         write = _mm_andnot_si128(_mm_cmpeq_epi16(fore, zero), ones);
+      }
+
+      if(modulate)
+      {
+         __m128i r = GetCoordInt_SSE2<goraud>(r_lo, r_hi);
+         __m128i g = GetCoordInt_SSE2<goraud>(g_lo, g_hi);
+         __m128i b = GetCoordInt_SSE2<goraud>(b_lo, b_hi);
+
+         if(textured)
+         {
+            // ModTexel()
+            const __m128i five = _mm_set1_epi16(0x1F);
+
+            r = _mm_srli_epi16(_mm_mullo_epi16(_mm_and_si128(fore, five), r), 4);
+            g = _mm_srli_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(fore, 5), five), g), 4);
+            b = _mm_srli_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(fore, 10), five), b), 4);
+
+            r = DitherLookup_SSE2(r, dither_offs);
+            g = DitherLookup_SSE2(g, dither_offs);
+            b = DitherLookup_SSE2(b, dither_offs);
+
+            fore = _mm_or_si128(_mm_and_si128(fore, bit15), _mm_or_si128(r, _mm_or_si128(_mm_slli_epi16(g, 5), _mm_slli_epi16(b, 10))));
+         }
+         else
+         {
+            if(dither)
+            {
+               r = DitherLookup_SSE2(r, dither_offs);
+               g = DitherLookup_SSE2(g, dither_offs);
+               b = DitherLookup_SSE2(b, dither_offs);
+            }
+            else
+            {
+               r = _mm_srli_epi16(r, 3);
+               g = _mm_srli_epi16(g, 3);
+               b = _mm_srli_epi16(b, 3);
+            }
+
+            fore = _mm_or_si128(bit15, _mm_or_si128(r, _mm_or_si128(_mm_slli_epi16(g, 5), _mm_slli_epi16(b, 10))));
+         }
+
+         r_lo = _mm_add_epi32(r_hi, r_step);
+         g_lo = _mm_add_epi32(g_hi, g_step);
+         b_lo = _mm_add_epi32(b_hi, b_step);
+         r_hi = _mm_add_epi32(r_lo, r_step);
+         g_hi = _mm_add_epi32(g_lo, g_step);
+         b_hi = _mm_add_epi32(b_lo, b_step);
+      }
+
+      bg = _mm_loadu_si128((const __m128i*)&row[x]);
+
+      if(BlendMode >= 0)
+      {
+         __m128i blended = PackLow16_SSE2(PlotPixelBlend_SSE2<BlendMode>(_mm_unpacklo_epi16(bg, zero), _mm_unpacklo_epi16(fore, zero)),
+                                          PlotPixelBlend_SSE2<BlendMode>(_mm_unpackhi_epi16(bg, zero), _mm_unpackhi_epi16(fore, zero)));
+
+         if(textured)
+         {
+            // Only texels with the semi-transparency bit set are blended.
+            const __m128i semi = _mm_cmpeq_epi16(_mm_and_si128(fore, bit15), bit15);
+
+            fore = _mm_or_si128(_mm_and_si128(semi, blended), _mm_andnot_si128(semi, fore));
+         }
+         else
+            fore = blended;
+      }
+
+      if(textured)
+         fore = _mm_or_si128(fore, mask_set);
+      else
+         fore = _mm_or_si128(_mm_andnot_si128(bit15, fore), mask_set);
+
+      if(MaskEval_TA)
+         write = _mm_and_si128(write, _mm_cmpeq_epi16(_mm_and_si128(bg, bit15), zero));
+
+      _mm_storeu_si128((__m128i*)&row[x], _mm_or_si128(_mm_and_si128(write, fore), _mm_andnot_si128(write, bg)));
+   }
+
+   if(goraud)
+   {
+      ig.r += idl.dr_dx * count;
+      ig.g += idl.dg_dx * count;
+      ig.b += idl.db_dx * count;
+   }
+}
+#elif defined(GPU_SPAN_NEON)
+//
+// NEON versions of the above, lane for lane.
+//
+
+template<bool saturate>
+static INLINE int16x8_t GetCoordInt_NEON(int32x4_t lo, int32x4_t hi)
+{
+   int16x8_t ret = vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, COORD_FBS)), vqmovn_s32(vshrq_n_s32(hi, COORD_FBS)));
+
+   if(saturate)
+      ret = vminq_s16(vmaxq_s16(ret, vdupq_n_s16(0)), vdupq_n_s16(0xFF));
+
+   return ret;
+}
+
+static INLINE uint16x8_t DitherLookup_NEON(int16x8_t v, int16x8_t d)
+{
+   v = vshrq_n_s16(vaddq_s16(v, d), 3);
+
+   return vreinterpretq_u16_s16(vminq_s16(vmaxq_s16(v, vdupq_n_s16(0)), vdupq_n_s16(0x1F)));
+}
+
+template<int BlendMode>
+static INLINE uint32x4_t PlotPixelBlend_NEON(uint32x4_t bg_pix, uint32x4_t fore_pix)
+{
+   const uint32x4_t bit15 = vdupq_n_u32(0x8000);
+   uint32x4_t sum, carry;
+
+   switch(BlendMode)
+   {
+      case BLEND_MODE_AVERAGE:
+         bg_pix   = vorrq_u32(bg_pix, bit15);
+         fore_pix = vshrq_n_u32(vsubq_u32(vaddq_u32(fore_pix, bg_pix), vandq_u32(veorq_u32(fore_pix, bg_pix), vdupq_n_u32(0x0421))), 1);
+         break;
+
+      case BLEND_MODE_ADD_FOURTH:
+         fore_pix = vorrq_u32(vandq_u32(vshrq_n_u32(fore_pix, 2), vdupq_n_u32(0x1CE7)), bit15);
+         // Fall through
+
+      case BLEND_MODE_ADD:
+         bg_pix   = vbicq_u32(bg_pix, bit15);
+         sum      = vaddq_u32(fore_pix, bg_pix);
+         carry    = vandq_u32(vsubq_u32(sum, vandq_u32(veorq_u32(fore_pix, bg_pix), vdupq_n_u32(0x8421))), vdupq_n_u32(0x8420));
+         fore_pix = vorrq_u32(vsubq_u32(sum, carry), vsubq_u32(carry, vshrq_n_u32(carry, 5)));
+         break;
+
+      case BLEND_MODE_SUBTRACT:
+         {
+            const uint32x4_t borrow_mask = vdupq_n_u32(0x108420);
+            uint32x4_t diff, borrow;
+
+            bg_pix   = vorrq_u32(bg_pix, bit15);
+            fore_pix = vbicq_u32(fore_pix, bit15);
+            diff     = vaddq_u32(vsubq_u32(bg_pix, fore_pix), borrow_mask);
+            borrow   = vandq_u32(vsubq_u32(diff, vandq_u32(veorq_u32(bg_pix, fore_pix), borrow_mask)), borrow_mask);
+            fore_pix = vandq_u32(vsubq_u32(diff, borrow), vsubq_u32(borrow, vshrq_n_u32(borrow, 5)));
+         }
+         break;
+   }
+
+   return fore_pix;
+}
+
+template<bool goraud, bool textured, int BlendMode, bool TexMult, bool MaskEval_TA>
+INLINE void PS_GPU::DrawSpan_NEON(int y, int32_t &x, const int32_t x_bound, i_group &ig, const i_deltas &idl)
+{
+   static const int32_t lane_index[4] = { 0, 1, 2, 3 };
+   const int32_t count = (x_bound - x) & ~7;
+   const bool dither = DitherEnabled() && (textured ? TexMult : goraud);
+   const bool modulate = !textured || TexMult;
+   const uint16x8_t bit15 = vdupq_n_u16(0x8000);
+   const uint16x8_t mask_set = vdupq_n_u16(MaskSetOR);
+   uint16_t *row = &vram[(y & ((512 << upscale_shift) - 1)) << (10 + upscale_shift)];
+   int16_t dither_row[(4 << 3) + 8];
+   unsigned dither_wrap = 0;
+   int16x8_t dither_offs = vdupq_n_s16(dither_table[2][3]);	// What ModTexel() gets without dithering.
+   int32x4_t r_lo, r_hi, g_lo, g_hi, b_lo, b_hi;
+   int32x4_t r_step, g_step, b_step;
+
+   if(count <= 0)
+      return;
+
+   if(dither)
+   {
+      const int dy = (y >> dither_upscale_shift) & 3;
+
+      dither_wrap = (4 << dither_upscale_shift) - 1;
+
+      for(unsigned i = 0; i < dither_wrap + 1 + 8; i++)
+         dither_row[i] = dither_table[dy][(i >> dither_upscale_shift) & 3];
+   }
+
+   r_lo = vdupq_n_s32(ig.r);
+   g_lo = vdupq_n_s32(ig.g);
+   b_lo = vdupq_n_s32(ig.b);
+
+   if(goraud)
+   {
+      const int32x4_t li = vld1q_s32(lane_index);
+
+      r_lo = vaddq_s32(r_lo, vmulq_n_s32(li, idl.dr_dx));
+      g_lo = vaddq_s32(g_lo, vmulq_n_s32(li, idl.dg_dx));
+      b_lo = vaddq_s32(b_lo, vmulq_n_s32(li, idl.db_dx));
+   }
+
+   r_step = vdupq_n_s32(goraud ? idl.dr_dx * 4 : 0);
+   g_step = vdupq_n_s32(goraud ? idl.dg_dx * 4 : 0);
+   b_step = vdupq_n_s32(goraud ? idl.db_dx * 4 : 0);
+
+   r_hi = vaddq_s32(r_lo, r_step);
+   g_hi = vaddq_s32(g_lo, g_step);
+   b_hi = vaddq_s32(b_lo, b_step);
+
+   for(int32_t i = 0; i < count; i += 8, x += 8)
+   {
+      uint16x8_t fore, bg, write = vdupq_n_u16(0xFFFF);
+
+      if(dither)
+         dither_offs = vld1q_s16(&dither_row[x & dither_wrap]);
+
+      if(textured)
+      {
+         uint16_t texels[8];
+
+         for(unsigned j = 0; j < 8; j++)
+         {
+            texels[j] = GetTexel<2>(0, COORD_GET_INT(ig.u), COORD_GET_INT(ig.v));
+            ig.u += idl.du_dx;
+            ig.v += idl.dv_dx;
+         }
+
+         fore = vld1q_u16(texels);
+
+         // Texel 0 is transparent.
+         write = vtstq_u16(fore, fore);
+      }
+
+      if(modulate)
+      {
+         int16x8_t r = GetCoordInt_NEON<goraud>(r_lo, r_hi);
+         int16x8_t g = GetCoordInt_NEON<goraud>(g_lo, g_hi);
+         int16x8_t b = GetCoordInt_NEON<goraud>(b_lo, b_hi);
+         uint16x8_t r5, g5, b5;
+
+         if(textured)
+         {
+            // ModTexel()
+            const uint16x8_t five = vdupq_n_u16(0x1F);
+
+            r = vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vandq_u16(fore, five), vreinterpretq_u16_s16(r)), 4));
+            g = vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vandq_u16(vshrq_n_u16(fore, 5), five), vreinterpretq_u16_s16(g)), 4));
+            b = vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vandq_u16(vshrq_n_u16(fore, 10), five), vreinterpretq_u16_s16(b)), 4));
+
+            r5 = DitherLookup_NEON(r, dither_offs);
+            g5 = DitherLookup_NEON(g, dither_offs);
+            b5 = DitherLookup_NEON(b, dither_offs);
+
+            fore = vorrq_u16(vandq_u16(fore, bit15), vorrq_u16(r5, vorrq_u16(vshlq_n_u16(g5, 5), vshlq_n_u16(b5, 10))));
+         }
+         else
+         {
+            if(dither)
+            {
+               r5 = DitherLookup_NEON(r, dither_offs);
+               g5 = DitherLookup_NEON(g, dither_offs);
+               b5 = DitherLookup_NEON(b, dither_offs);
+            }
+            else
+            {
+               r5 = vshrq_n_u16(vreinterpretq_u16_s16(r), 3);
+               g5 = vshrq_n_u16(vreinterpretq_u16_s16(g), 3);
+               b5 = vshrq_n_u16(vreinterpretq_u16_s16(b), 3);
+            }
+
+            fore = vorrq_u16(bit15, vorrq_u16(r5, vorrq_u16(vshlq_n_u16(g5, 5), vshlq_n_u16(b5, 10))));
+         }
+
+         r_lo = vaddq_s32(r_hi, r_step);
+         g_lo = vaddq_s32(g_hi, g_step);
+         b_lo = vaddq_s32(b_hi, b_step);
+         r_hi = vaddq_s32(r_lo, r_step);
+         g_hi = vaddq_s32(g_lo, g_step);
+         b_hi = vaddq_s32(b_lo, b_step);
+      }
+
+      bg = vld1q_u16(&row[x]);
+
+      if(BlendMode >= 0)
+      {
+         uint16x8_t blended = vcombine_u16(vmovn_u32(PlotPixelBlend_NEON<BlendMode>(vmovl_u16(vget_low_u16(bg)), vmovl_u16(vget_low_u16(fore)))),
+                                           vmovn_u32(PlotPixelBlend_NEON<BlendMode>(vmovl_u16(vget_high_u16(bg)), vmovl_u16(vget_high_u16(fore)))));
+
+         if(textured)
+         {
+            // Only texels with the semi-transparency bit set are blended.
+            fore = vbslq_u16(vtstq_u16(fore, bit15), blended, fore);
+         }
+         else
+            fore = blended;
+      }
+
+      if(textured)
+         fore = vorrq_u16(fore, mask_set);
+      else
+         fore = vorrq_u16(vbicq_u16(fore, bit15), mask_set);
+
+      if(MaskEval_TA)
+         write = vbicq_u16(write, vtstq_u16(bg, bit15));
+
+      vst1q_u16(&row[x], vbslq_u16(write, fore, bg));
+   }
+
+   if(goraud)
+   {
+      ig.r += idl.dr_dx * count;
+      ig.g += idl.dg_dx * count;
+      ig.b += idl.db_dx * count;
+   }
+}
+#endif
+
+#if defined(__SSE2__) || defined(GPU_SPAN_NEON)
+// Whether the span [x_start, x_bound) of line y lies in the 15-bit texture page,
+// so that drawing it might change texels it goes on to sample.  The kernels
+// above fetch 8 texels before drawing any of them, and can't draw such a span.
+INLINE bool PS_GPU::SpanInTexPage(int y, int32_t x_start, int32_t x_bound)
+{
+   const uint32_t line = (y >> upscale_shift) & 511;
+   const uint32_t x = (x_start >> upscale_shift) & 1023;
+   const uint32_t w = ((x_bound - 1) >> upscale_shift) - (x_start >> upscale_shift) + 1;
+
+   if((line - TexPageY) >= 256)
+      return false;
+
+   return ((x - TexPageX) & 1023) < 256 || ((TexPageX - x) & 1023) < w;
+}
+#endif
+
+// Returns the drawing time used, which the caller charges to DrawTimeAvail(spans
+// of one triangle may be drawn by several threads at once).
 template<bool goraud, bool textured, int BlendMode, bool TexMult, uint32_t TexMode_TA, bool MaskEval_TA>
-INLINE void PS_GPU::DrawSpan(int y, uint32_t clut_offset, const int32_t x_start, const int32_t x_bound, i_group ig, const i_deltas &idl)
+INLINE int32_t PS_GPU::DrawSpan(int y, uint32_t clut_offset, const int32_t x_start, const int32_t x_bound, i_group ig, const i_deltas &idl)
 {
    int32_t xs = x_start, xb = x_bound;
    int32 clipx0 = ClipX0 << upscale_shift;
    int32 clipx1 = ClipX1 << upscale_shift;
+   int32_t draw_time = 0;
 
    if(LineSkipTest(this, y >> upscale_shift))
-      return;
+      return 0;
 
    if(xs < xb)	// (xs != xb)
    {
@@ -150,18 +633,21 @@ INLINE void PS_GPU::DrawSpan(int y, uint32_t clut_offset, const int32_t x_start,
 
       if(xs < xb && ((y & (upscale() - 1)) == 0))
       {
-         DrawTimeAvail -= (xb - xs) >> upscale_shift;
+         draw_time += (xb - xs) >> upscale_shift;
 
          if(goraud || textured)
          {
-            DrawTimeAvail -= (xb - xs) >> upscale_shift;
+            draw_time += (xb - xs) >> upscale_shift;
          }
          else if((BlendMode >= 0) || MaskEval_TA)
          {
-            DrawTimeAvail -= (((((xb  >> upscale_shift) + 1) & ~1) - ((xs  >> upscale_shift) & ~1)) >> 1);
+            draw_time += (((((xb  >> upscale_shift) + 1) & ~1) - ((xs  >> upscale_shift) & ~1)) >> 1);
          }
       }
 
+      if(timing_only)
+         return draw_time;
+
       if(textured)
       {
          ig.u += (xs * idl.du_dx) + (y * idl.du_dy);
@@ -175,6 +661,16 @@ INLINE void PS_GPU::DrawSpan(int y, uint32_t clut_offset, const int32_t x_start,
          ig.b += (xs * idl.db_dx) + (y * idl.db_dy);
       }
 
+#if defined(__SSE2__) || defined(GPU_SPAN_NEON)
+      if(!textured || (TexMode_TA == 2 && !SpanInTexPage(y, xs, xb)))
+      {
+#if defined(__SSE2__)
+         DrawSpan_SSE2<goraud, textured, BlendMode, TexMult, MaskEval_TA>(y, xs, xb, ig, idl);
+#else
+         DrawSpan_NEON<goraud, textured, BlendMode, TexMult, MaskEval_TA>(y, xs, xb, ig, idl);
+#endif
+      }
+#endif
 
       for(int32_t x = xs; MDFN_LIKELY(x < xb); x++)
       {
@@ -230,6 +726,103 @@ INLINE void PS_GPU::DrawSpan(int y, uint32_t clut_offset, const int32_t x_start,
          //AddStep<goraud, textured>(perp_coord, perp_step);
       }
    }
+
+   return draw_time;
+}
+
+// Where the rows of a triangle start, after clipping; row y's edges are at
+// the coordinates here plus their step times its distance from y_start(or
+// y_middle, for the lower bound).
+struct tri_rows
+{
+   int64_t base_coord;
+   int64_t base_step;
+
+   int64_t bound_coord_ul;
+   int64_t bound_coord_us;
+
+   int64_t bound_coord_ll;
+   int64_t bound_coord_ls;
+
+   int32_t y_start;
+   int32_t y_middle;
+   int32_t y_bound;
+
+   bool right_facing;
+   uint32_t clut;
+   i_group ig;
+   i_deltas idl;
+};
+
+struct tri_band_job
+{
+   PS_GPU *gpu;
+   const tri_rows *rows;
+   int32_t band_height;
+   int32_t draw_time[GPU_RASTER_THREADS_MAX];
+};
+
+// Draws rows [y_first, y_end) of a triangle, returning the drawing time used.
+template<bool goraud, bool textured, int BlendMode, bool TexMult, uint32_t TexMode_TA, bool MaskEval_TA>
+int32_t PS_GPU::DrawTriangleRows(const tri_rows &t, int32_t y_first, int32_t y_end)
+{
+   const int32_t y_middle = std::min<int32_t>(std::max<int32_t>(t.y_middle, y_first), y_end);
+   int64_t base_coord = t.base_coord + t.base_step * (y_first - t.y_start);
+   int64_t bound_coord_ul = t.bound_coord_ul + t.bound_coord_us * (y_first - t.y_start);
+   int64_t bound_coord_ll = t.bound_coord_ll + t.bound_coord_ls * (y_middle - t.y_middle);
+   int32_t draw_time = 0;
+
+   if(t.right_facing)
+   {
+      for(int32_t y = y_first; y < y_middle; y++)
+      {
+         draw_time += DrawSpan<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(y, t.clut, GetPolyXFP_Int(base_coord), GetPolyXFP_Int(bound_coord_ul), t.ig, t.idl);
+         base_coord += t.base_step;
+         bound_coord_ul += t.bound_coord_us;
+      }
+
+      for(int32_t y = y_middle; y < y_end; y++)
+      {
+         draw_time += DrawSpan<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(y, t.clut, GetPolyXFP_Int(base_coord), GetPolyXFP_Int(bound_coord_ll), t.ig, t.idl);
+         base_coord += t.base_step;
+         bound_coord_ll += t.bound_coord_ls;
+      }
+   }
+   else
+   {
+      for(int32_t y = y_first; y < y_middle; y++)
+      {
+         draw_time += DrawSpan<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(y, t.clut, GetPolyXFP_Int(bound_coord_ul), GetPolyXFP_Int(base_coord), t.ig, t.idl);
+         base_coord += t.base_step;
+         bound_coord_ul += t.bound_coord_us;
+      }
+
+      for(int32_t y = y_middle; y < y_end; y++)
+      {
+         draw_time += DrawSpan<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(y, t.clut, GetPolyXFP_Int(bound_coord_ll), GetPolyXFP_Int(base_coord), t.ig, t.idl);
+         base_coord += t.base_step;
+         bound_coord_ll += t.bound_coord_ls;
+      }
+   }
+
+   return draw_time;
+}
+
+template<bool goraud, bool textured, int BlendMode, bool TexMult, uint32_t TexMode_TA, bool MaskEval_TA>
+void PS_GPU::DrawTriangleBand(void *arg, unsigned band)
+{
+   tri_band_job *job = (tri_band_job*)arg;
+   const tri_rows &t = *job->rows;
+   const int32_t y_first = t.y_start + (int32_t)band * job->band_height;
+   const int32_t y_end = std::min<int32_t>(y_first + job->band_height, t.y_bound);
+
+   job->draw_time[band] = job->gpu->DrawTriangleRows<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(t, y_first, y_end);
+}
+
+// Whether [a, a + a_count) and [b, b + b_count) intersect, in VRAM lines(which wrap at 512).
+static INLINE bool LinesOverlap(uint32_t a, uint32_t a_count, uint32_t b, uint32_t b_count)
+{
+   return ((b - a) & 511) < a_count || ((a - b) & 511) < b_count;
 }
 
 template<bool goraud, bool textured, int BlendMode, bool TexMult, uint32_t TexMode_TA, bool MaskEval_TA>
@@ -384,38 +977,73 @@ void PS_GPU::DrawTriangle(tri_vertex *vertices, uint32_t clut)
          y_middle = y_bound;
    }
 
-   if(right_facing)
+   if(y_start >= y_bound)
+      return;
+
+   if(textured && TexMode_TA < 2)
+      tex_page_cur = timing_only ? NULL : TexPageCacheLookup(TexMode_TA, clut);
+
+   tri_rows t;
+
+   t.base_coord = base_coord;
+   t.base_step = base_step;
+   t.bound_coord_ul = bound_coord_ul;
+   t.bound_coord_us = bound_coord_us;
+   t.bound_coord_ll = bound_coord_ll;
+   t.bound_coord_ls = bound_coord_ls;
+   t.y_start = y_start;
+   t.y_middle = y_middle;
+   t.y_bound = y_bound;
+   t.right_facing = right_facing;
+   t.clut = clut;
+   t.ig = ig;
+   t.idl = idl;
+
+   //
+   // Large triangles are split into horizontal bands, drawn in parallel.  Every
+   // pixel is still written once, by the same span, so the result only depends
+   // on drawing order if the triangle samples a texture or CLUT it's drawing over.
+   //
+   unsigned bands = 1;
+
+   if(raster_threads > 1 && !timing_only)
    {
-      for(int32_t y = y_start; y < y_middle; y++)
-      {
-         DrawSpan<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(y, clut, GetPolyXFP_Int(base_coord), GetPolyXFP_Int(bound_coord_ul), ig, idl);
-         base_coord += base_step;
-         bound_coord_ul += bound_coord_us;
-      }
+      const int32_t height = y_bound - y_start;
+
+      bands = std::min<int32_t>(raster_threads, height / (RASTER_BAND_MIN_LINES << upscale_shift));
 
-      for(int32_t y = y_middle; y < y_bound; y++)
+      if(bands > 1 && textured)
       {
-         DrawSpan<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(y, clut, GetPolyXFP_Int(base_coord), GetPolyXFP_Int(bound_coord_ll), ig, idl);
-         base_coord += base_step;
-         bound_coord_ll += bound_coord_ls;
+         const uint32_t first_line = y_start >> upscale_shift;
+         const uint32_t line_count = ((y_bound - 1) >> upscale_shift) - first_line + 1;
+
+         // 4bpp and 8bpp textures are also read through the CLUT, which sits on a line of its own.
+         if(LinesOverlap(first_line, line_count, TexPageY, 256) ||
+               (TexMode_TA < 2 && LinesOverlap(first_line, line_count, (clut >> 10) & 0x1FF, 1)))
+            bands = 1;
       }
    }
-   else
+
+   if(bands > 1)
    {
-      for(int32_t y = y_start; y < y_middle; y++)
-      {
-         DrawSpan<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(y, clut, GetPolyXFP_Int(bound_coord_ul), GetPolyXFP_Int(base_coord), ig, idl);
-         base_coord += base_step;
-         bound_coord_ul += bound_coord_us;
-      }
+      tri_band_job job;
 
-      for(int32_t y = y_middle; y < y_bound; y++)
-      {
-         DrawSpan<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(y, clut, GetPolyXFP_Int(bound_coord_ll), GetPolyXFP_Int(base_coord), ig, idl);
-         base_coord += base_step;
-         bound_coord_ll += bound_coord_ls;
-      }
+      job.gpu = this;
+      job.rows = &t;
+      job.band_height = (y_bound - y_start + bands - 1) / bands;
+
+      bands = (y_bound - y_start + job.band_height - 1) / job.band_height;
+
+      if(textured && TexMode_TA < 2 && tex_page_cur)
+         TexPageCacheFill(tex_page_cur);
+
+      RunRasterBands(DrawTriangleBand<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>, &job, bands);
+
+      for(unsigned i = 0; i < bands; i++)
+         DrawTimeAvail -= job.draw_time[i];
    }
+   else
+      DrawTimeAvail -= DrawTriangleRows<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(t, y_start, y_bound);
 
 #if 0
    printf("[GPU] Vertices: %d:%d(r=%d, g=%d, b=%d) -> %d:%d(r=%d, g=%d, b=%d) -> %d:%d(r=%d, g=%d, b=%d)\n\n\n", vertices[0].x, vertices[0].y,
@@ -18,6 +18,9 @@ void PS_GPU::DrawSprite(int32_t x_arg, int32_t y_arg, int32_t w, int32_t h,
 
    //printf("[GPU] Sprite: x=%d, y=%d, w=%d, h=%d\n", x_arg, y_arg, w, h);
 
+   if(textured && TexMode_TA < 2)
+      tex_page_cur = timing_only ? NULL : TexPageCacheLookup(TexMode_TA, clut_offset);
+
    if(textured)
    {
       u = u_arg;
@@ -87,24 +90,27 @@ void PS_GPU::DrawSprite(int32_t x_arg, int32_t y_arg, int32_t w, int32_t h,
             DrawTimeAvail -= suck_time;
          }
 
-         for(int32_t x = x_start; MDFN_LIKELY(x < x_bound); x++)
+         if(!timing_only)
          {
-            if(textured)
+            for(int32_t x = x_start; MDFN_LIKELY(x < x_bound); x++)
             {
-               uint16_t fbw = GetTexel<TexMode_TA>(clut_offset, u_r, v);
-
-               if(fbw)
+               if(textured)
                {
-                  if(TexMult)
-                     fbw = ModTexel(fbw, r, g, b, 3, 2);
-                  PlotNativePixel<BlendMode, MaskEval_TA, true>(x, y, fbw);
+                  uint16_t fbw = GetTexel<TexMode_TA>(clut_offset, u_r, v);
+
+                  if(fbw)
+                  {
+                     if(TexMult)
+                        fbw = ModTexel(fbw, r, g, b, 3, 2);
+                     PlotNativePixel<BlendMode, MaskEval_TA, true>(x, y, fbw);
+                  }
                }
-            }
-            else
-               PlotNativePixel<BlendMode, MaskEval_TA, false>(x, y, fill_color);
+               else
+                  PlotNativePixel<BlendMode, MaskEval_TA, false>(x, y, fill_color);
 
-            if(textured)
-               u_r += u_inc;
+               if(textured)
+                  u_r += u_inc;
+            }
          }
       }
       if(textured)
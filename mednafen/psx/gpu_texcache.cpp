@@ -0,0 +1,225 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "psx.h"
+#include "../../libretro.h"
+
+extern retro_log_printf_t log_cb;
+
+/*
+   Decoded texture page cache.
+
+   Sampling a 4bpp or 8bpp texture takes two dependent VRAM reads per texel,
+   one for the index and one for the CLUT entry.  Instead, textured primitives
+   look texels up in a copy of their texture page with the CLUT already
+   applied, decoded a line at a time on first use.  Entries are keyed by the
+   texture page, CLUT and mode; the texture window is applied to the
+   coordinates before the lookup, like with VRAM, so it isn't part of the key.
+
+   Every command that writes to VRAM first drops the entries whose texture
+   page or CLUT it may write to(for primitives, anything in the drawing area),
+   and primitives sampling a page they may draw over don't use the cache at
+   all, so cached texels are always what a VRAM read would return.
+*/
+
+enum
+{
+   TEXPAGE_CACHE_ENTRIES = 8,
+   TEXPAGE_CACHE_UNUSED = ~0U
+};
+
+struct TexPageCache
+{
+   TexPageCacheEntry *entries[TEXPAGE_CACHE_ENTRIES];	// Allocated on first use.
+   uint32 clock;	// For LRU replacement.
+
+   // Statistics, logged when the cache is freed.
+   uint32 hits;
+   uint32 misses;
+   uint32 bypasses;
+   uint32 lines_decoded;
+   uint32 invalidations;
+};
+
+static INLINE bool SpanOverlap(uint32 a, uint32 a_len, uint32 b, uint32 b_len, uint32 wrap_mask)
+{
+   return ((b - a) & wrap_mask) < a_len || ((a - b) & wrap_mask) < b_len;
+}
+
+static INLINE bool RectOverlap(uint32 ax, uint32 ay, uint32 aw, uint32 ah, uint32 bx, uint32 by, uint32 bw, uint32 bh)
+{
+   return SpanOverlap(ax, aw, bx, bw, 1023) && SpanOverlap(ay, ah, by, bh, 511);
+}
+
+// Whether a VRAM write to the rectangle could change a page's decoded texels.
+static bool SourceOverlap(uint32 mode, uint32 page_x, uint32 page_y, uint32 clut, uint32 x, uint32 y, uint32 w, uint32 h)
+{
+   return RectOverlap(page_x, page_y, 64 << mode, 256, x, y, w, h) ||
+      RectOverlap(clut & 1023, (clut >> 10) & 511, mode ? 256 : 16, 1, x, y, w, h);
+}
+
+void PS_GPU::TexPageCacheInit(void)
+{
+   TexPageCache *tc = new TexPageCache;
+
+   memset(tc, 0, sizeof(*tc));
+
+   tex_page_cache = tc;
+   tex_page_cur = NULL;
+}
+
+void PS_GPU::TexPageCacheFree(void)
+{
+   TexPageCache *tc = tex_page_cache;
+
+   if(!tc)
+      return;
+
+   if(tc->hits || tc->misses)
+   {
+      log_cb(RETRO_LOG_INFO, "[GPU] Texture page cache: %u hits, %u misses, %u bypassed, %u lines decoded, %u invalidated.\n",
+            tc->hits, tc->misses, tc->bypasses, tc->lines_decoded, tc->invalidations);
+   }
+
+   for(unsigned i = 0; i < TEXPAGE_CACHE_ENTRIES; i++)
+      delete tc->entries[i];
+
+   delete tc;
+
+   tex_page_cache = NULL;
+   tex_page_cur = NULL;
+}
+
+// Returns the cache entry for the current texture page with a CLUT, or NULL
+// if the primitive about to be drawn has to read VRAM directly.
+TexPageCacheEntry *PS_GPU::TexPageCacheLookup(uint32 mode, uint32 clut)
+{
+   TexPageCache *tc = tex_page_cache;
+   const uint32 key = (clut >> 4) | ((TexPageX >> 6) << 15) | ((TexPageY >> 8) << 19) | (mode << 20);
+   TexPageCacheEntry *victim = NULL;
+   uint32 victim_age = 0;
+
+   if(ClipX1 >= ClipX0 && ClipY1 >= ClipY0 &&
+         SourceOverlap(mode, TexPageX, TexPageY, clut, ClipX0, ClipY0, ClipX1 - ClipX0 + 1, std::min<int32>(ClipY1 - ClipY0 + 1, 512)))
+   {
+      tc->bypasses++;
+      return NULL;
+   }
+
+   tc->clock++;
+
+   for(unsigned i = 0; i < TEXPAGE_CACHE_ENTRIES; i++)
+   {
+      TexPageCacheEntry *e = tc->entries[i];
+
+      if(!e)
+      {
+         e = tc->entries[i] = new TexPageCacheEntry;
+         e->key = TEXPAGE_CACHE_UNUSED;
+         e->last_use = 0;
+      }
+
+      if(e->key == key)
+      {
+         tc->hits++;
+         e->last_use = tc->clock;
+         return e;
+      }
+
+      const uint32 age = (e->key == TEXPAGE_CACHE_UNUSED) ? 0 : e->last_use;
+
+      if(!victim || age < victim_age)
+      {
+         victim = e;
+         victim_age = age;
+      }
+   }
+
+   tc->misses++;
+
+   victim->key = key;
+   victim->last_use = tc->clock;
+   victim->mode = mode;
+   victim->page_x = TexPageX;
+   victim->page_y = TexPageY;
+   victim->clut = clut;
+   memset(victim->line_valid, 0, sizeof(victim->line_valid));
+
+   return victim;
+}
+
+void PS_GPU::TexPageCacheDecodeLine(TexPageCacheEntry *e, uint32 v)
+{
+   const uint32 y = e->page_y + v;
+   const uint32 clut_x = e->clut & 1023;
+   const uint32 clut_y = (e->clut >> 10) & 511;
+   uint16 *texels = e->texels[v];
+
+   if(e->mode == 0)
+   {
+      for(uint32 u = 0; u < 256; u++)
+      {
+         const uint16 fbw = texel_fetch((e->page_x + (u >> 2)) & 1023, y);
+
+         texels[u] = texel_fetch((clut_x + ((fbw >> ((u & 3) * 4)) & 0xF)) & 1023, clut_y);
+      }
+   }
+   else
+   {
+      for(uint32 u = 0; u < 256; u++)
+      {
+         const uint16 fbw = texel_fetch((e->page_x + (u >> 1)) & 1023, y);
+
+         texels[u] = texel_fetch((clut_x + ((fbw >> ((u & 1) * 8)) & 0xFF)) & 1023, clut_y);
+      }
+   }
+
+   e->line_valid[v] = true;
+   tex_page_cache->lines_decoded++;
+}
+
+// Decodes the whole page, so that other threads can sample it.
+void PS_GPU::TexPageCacheFill(TexPageCacheEntry *e)
+{
+   for(uint32 v = 0; v < 256; v++)
+   {
+      if(!e->line_valid[v])
+         TexPageCacheDecodeLine(e, v);
+   }
+}
+
+// Drops entries that a VRAM write to the rectangle could make stale.
+void PS_GPU::TexPageCacheInvalidate(uint32 x, uint32 y, uint32 w, uint32 h)
+{
+   TexPageCache *tc = tex_page_cache;
+
+   for(unsigned i = 0; i < TEXPAGE_CACHE_ENTRIES; i++)
+   {
+      TexPageCacheEntry *e = tc->entries[i];
+
+      if(e && e->key != TEXPAGE_CACHE_UNUSED && SourceOverlap(e->mode, e->page_x, e->page_y, e->clut, x & 1023, y & 511, w, h))
+      {
+         e->key = TEXPAGE_CACHE_UNUSED;
+         tc->invalidations++;
+      }
+   }
+}
+
+void PS_GPU::TexPageCacheInvalidateAll(void)
+{
+   TexPageCacheInvalidate(0, 0, 1024, 512);
+}
@@ -0,0 +1,552 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "psx.h"
+#include "../../libretro.h"
+
+#include <rthreads/rthreads.h>
+
+extern retro_log_printf_t log_cb;
+
+/*
+   Software rendering thread.
+
+   The emulation thread keeps executing every GP0 command itself, but with
+   timing_only set: the rasterizers walk the same spans and charge the same
+   DrawTimeAvail, they just don't touch VRAM.  Everything the game can observe
+   (GPU status, IRQs, DMA pacing) is therefore computed exactly as without the
+   thread.  The commands are also queued, together with the few bits of
+   emulation thread state that drawing depends on, to a copy of the PS_GPU
+   that runs them for real on the render thread and shares the VRAM with the
+   original.
+
+   The emulation thread only waits for the render thread when it needs VRAM:
+   FBRead, savestates, resets, and scanout, the latter only when the line
+   being displayed has a queued write still pending.  Pending writes are
+   tracked per VRAM line using conservative ranges(the drawing area for
+   primitives), so a game drawing into its back buffer is never waited for.
+*/
+
+enum
+{
+   RENDER_QUEUE_SIZE = 4096	// Must be a power of 2
+};
+
+enum
+{
+   RENDER_COMMAND,
+   RENDER_FBWRITE
+};
+
+struct GPURenderCommand
+{
+   uint8 type;
+   uint8 cc;
+   uint8 len;	// Words in cb
+   uint8 continuation;
+
+   // Emulation thread state the command was run with.
+   uint8 InCmd;
+   uint8 TexDisableAllowChange;
+   uint8 field_ram_readout;
+   uint32 DisplayMode;
+   uint32 DisplayFB_YStart;
+
+   // A polygon's vertices from the subpixel vertex cache, which the GTE
+   // keeps writing to on the emulation thread.
+   uint8 subpixel_count;
+   subpixel_vertex subpixel[3];
+
+   uint32 cb[0x10];
+};
+
+struct GPURenderThread
+{
+   PS_GPU *gpu;	// Our copy, drawing into the original's VRAM.
+
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *work_cond;	// Signalled when commands are queued.
+   scond_t *done_cond;	// Signalled when a command has been run.
+
+   // Free-running sequence numbers, protected by lock.
+   uint32 write_pos;
+   uint32 read_pos;
+   bool quit;
+
+   //
+   // Emulation-thread-only:
+   //
+   uint32 done_pos;	// Last read_pos seen.
+   bool fbwrite_open;	// An RENDER_FBWRITE entry at write_pos is being filled.
+
+   // Sequence number the render thread has to reach for each VRAM
+   // line(at 1x) to be up to date.
+   uint32 line_pos[512];
+
+   GPURenderCommand queue[RENDER_QUEUE_SIZE];
+};
+
+static void RenderThreadRun(GPURenderThread *rt, const GPURenderCommand *c)
+{
+   PS_GPU *g = rt->gpu;
+
+   if(c->type == RENDER_FBWRITE)
+   {
+      for(unsigned i = 0; i < c->len; i++)
+      {
+         if(g->InCmd == INCMD_FBWRITE)
+            g->WriteFBWord(c->cb[i]);
+      }
+      return;
+   }
+
+   g->InCmd = c->InCmd;
+   g->TexDisableAllowChange = c->TexDisableAllowChange;
+   g->field_ram_readout = c->field_ram_readout;
+   g->DisplayMode = c->DisplayMode;
+   g->DisplayFB_YStart = c->DisplayFB_YStart;
+
+   // Not used for anything here, just keep it from overflowing.
+   g->DrawTimeAvail = 0;
+
+   g->SubpixelVertexQueued = c->subpixel_count ? c->subpixel : NULL;
+   g->ExecuteCommand(c->cc, c->cb, c->continuation);
+   g->SubpixelVertexQueued = NULL;
+}
+
+static void RenderThreadMain(void *arg)
+{
+   GPURenderThread *rt = (GPURenderThread*)arg;
+
+   slock_lock(rt->lock);
+
+   for(;;)
+   {
+      while(rt->read_pos == rt->write_pos && !rt->quit)
+         scond_wait(rt->work_cond, rt->lock);
+
+      if(rt->read_pos == rt->write_pos)
+         break;
+
+      // Entries below write_pos are not touched by the emulation thread.
+      const GPURenderCommand *c = &rt->queue[rt->read_pos & (RENDER_QUEUE_SIZE - 1)];
+
+      slock_unlock(rt->lock);
+
+      RenderThreadRun(rt, c);
+
+      slock_lock(rt->lock);
+
+      rt->read_pos++;
+      scond_signal(rt->done_cond);
+   }
+
+   slock_unlock(rt->lock);
+}
+
+void PS_GPU::SetRenderThread(bool enable)
+{
+   GPURenderThread *rt = render_thread;
+
+   if(enable == (rt != NULL))
+      return;
+
+   if(enable)
+   {
+      rt = new GPURenderThread;
+
+      rt->gpu = new (new char[sizeof(PS_GPU)]) PS_GPU(*this, rt);
+      rt->lock = slock_new();
+      rt->work_cond = scond_new();
+      rt->done_cond = scond_new();
+      rt->write_pos = 0;
+      rt->read_pos = 0;
+      rt->quit = false;
+      rt->done_pos = 0;
+      rt->fbwrite_open = false;
+      memset(rt->line_pos, 0, sizeof(rt->line_pos));
+
+      render_thread = rt;
+      timing_only = true;
+
+      rt->thread = sthread_create(RenderThreadMain, rt);
+
+      if(!rt->thread)
+      {
+         log_cb(RETRO_LOG_WARN, "[GPU] Couldn't start the rendering thread.\n");
+         SetRenderThread(false);
+      }
+   }
+   else
+   {
+      if(rt->thread)
+      {
+         SyncRenderThread();
+
+         slock_lock(rt->lock);
+         rt->quit = true;
+         scond_signal(rt->work_cond);
+         slock_unlock(rt->lock);
+
+         sthread_join(rt->thread);
+      }
+
+      scond_free(rt->done_cond);
+      scond_free(rt->work_cond);
+      slock_free(rt->lock);
+      rt->gpu->~PS_GPU();
+      delete [] (char*)rt->gpu;
+      delete rt;
+
+      render_thread = NULL;
+      timing_only = false;
+   }
+}
+
+static void PublishRenderCommand(GPURenderThread *rt)
+{
+   slock_lock(rt->lock);
+   rt->write_pos++;
+   scond_signal(rt->work_cond);
+   slock_unlock(rt->lock);
+
+   rt->fbwrite_open = false;
+}
+
+// Returns the entry at write_pos, once the render thread is done with it.
+static GPURenderCommand *GetRenderCommand(GPURenderThread *rt)
+{
+   if((rt->write_pos - rt->done_pos) >= RENDER_QUEUE_SIZE)
+   {
+      slock_lock(rt->lock);
+      while((rt->write_pos - rt->read_pos) >= RENDER_QUEUE_SIZE)
+         scond_wait(rt->done_cond, rt->lock);
+      rt->done_pos = rt->read_pos;
+      slock_unlock(rt->lock);
+   }
+
+   return &rt->queue[rt->write_pos & (RENDER_QUEUE_SIZE - 1)];
+}
+
+static void MarkRenderLines(GPURenderThread *rt, uint32 first, uint32 count)
+{
+   // The entry being filled will be done once read_pos goes past it.
+   const uint32 pos = rt->write_pos + 1;
+
+   if(count > 512)
+      count = 512;
+
+   for(uint32 i = 0; i < count; i++)
+      rt->line_pos[(first + i) & 511] = pos;
+}
+
+void PS_GPU::QueueRenderCommand(uint32 cc, const uint32 *CB, unsigned len, bool continuation)
+{
+   GPURenderThread *rt = render_thread;
+
+   // Only what draws or changes drawing state; IRQs in particular must
+   // stay on this thread, and FBRead has nothing to do over there.
+   if(!(cc == 0x02 || (cc >= 0x20 && cc <= 0xBF) || (cc >= 0xE1 && cc <= 0xE6)))
+      return;
+
+   if(rt->fbwrite_open)
+      PublishRenderCommand(rt);
+
+   GPURenderCommand *c = GetRenderCommand(rt);
+
+   c->type = RENDER_COMMAND;
+   c->cc = cc;
+   c->len = len;
+   c->continuation = continuation;
+   c->InCmd = InCmd;
+   c->TexDisableAllowChange = TexDisableAllowChange;
+   c->field_ram_readout = field_ram_readout;
+   c->DisplayMode = DisplayMode;
+   c->DisplayFB_YStart = DisplayFB_YStart;
+   memcpy(c->cb, CB, len * sizeof(uint32));
+
+   // Look the vertices up the way Command_DrawPolygon() will.
+   c->subpixel_count = 0;
+
+   if(SubpixelVertexCache && cc >= 0x20 && cc <= 0x3F)
+   {
+      const bool goraud = cc & 0x10;
+      const bool textured = cc & 0x04;
+      const uint32 *cb = CB;
+
+      for(unsigned v = ((cc & 0x08) && InCmd == INCMD_QUAD) ? 2 : 0; v < 3; v++)
+      {
+         if(v == 0 || goraud)
+            cb++;
+
+         c->subpixel[c->subpixel_count++] = *GetSubpixelVertex(sign_x_to_s32(11, (int16_t)(*cb & 0xFFFF)),
+               sign_x_to_s32(11, (int16_t)(*cb >> 16)));
+         cb++;
+
+         if(textured)
+            cb++;
+      }
+   }
+
+   if(cc >= 0x20 && cc <= 0x7F)
+   {
+      if(ClipY1 >= ClipY0)
+         MarkRenderLines(rt, ClipY0, ClipY1 - ClipY0 + 1);
+   }
+   else if(cc == 0x02)
+      MarkRenderLines(rt, (CB[1] >> 16) & 0x3FF, (CB[2] >> 16) & 0x1FF);
+   else if(cc >= 0x80 && cc <= 0x9F)
+   {
+      const uint32 height = (CB[3] >> 16) & 0x1FF;
+
+      MarkRenderLines(rt, (CB[2] >> 16) & 0x3FF, height ? height : 0x200);
+   }
+
+   PublishRenderCommand(rt);
+}
+
+void PS_GPU::QueueRenderFBWrite(uint32 InData, uint32 first_line, uint32 last_line)
+{
+   GPURenderThread *rt = render_thread;
+   GPURenderCommand *c = GetRenderCommand(rt);
+
+   if(!rt->fbwrite_open)
+   {
+      c->type = RENDER_FBWRITE;
+      c->len = 0;
+      rt->fbwrite_open = true;
+   }
+
+   c->cb[c->len++] = InData;
+
+   MarkRenderLines(rt, first_line, 1);
+   MarkRenderLines(rt, last_line, 1);
+
+   // Keep the render thread busy during long transfers.
+   if(c->len == 0x10 || InCmd != INCMD_FBWRITE)
+      PublishRenderCommand(rt);
+}
+
+// Waits until the render thread has caught up with everything queued.
+void PS_GPU::SyncRenderThread(void)
+{
+   GPURenderThread *rt = render_thread;
+
+   if(rt->fbwrite_open)
+      PublishRenderCommand(rt);
+
+   if(rt->done_pos == rt->write_pos)
+      return;
+
+   slock_lock(rt->lock);
+   while(rt->read_pos != rt->write_pos)
+      scond_wait(rt->done_cond, rt->lock);
+   rt->done_pos = rt->read_pos;
+   slock_unlock(rt->lock);
+}
+
+// Waits until a VRAM line(at 1x) is up to date, for scanout.
+void PS_GPU::SyncRenderLine(uint32 line)
+{
+   GPURenderThread *rt = render_thread;
+   const uint32 pos = rt->line_pos[line & 511];
+
+   if((int32)(pos - rt->done_pos) <= 0)
+      return;
+
+   if(rt->fbwrite_open && pos == rt->write_pos + 1)
+      PublishRenderCommand(rt);
+
+   slock_lock(rt->lock);
+   while((int32)(pos - rt->read_pos) > 0)
+      scond_wait(rt->done_cond, rt->lock);
+   rt->done_pos = rt->read_pos;
+   slock_unlock(rt->lock);
+}
+
+// Brings the render thread's copy of the GPU up to date, after changes to the
+// drawing state that don't go through the command queue(resets, savestates).
+void PS_GPU::ReloadRenderThread(void)
+{
+   GPURenderThread *rt = render_thread;
+
+   SyncRenderThread();
+
+   rt->gpu->~PS_GPU();
+   new (rt->gpu) PS_GPU(*this, rt);
+}
+
+/*
+   Band-parallel rasterization.
+
+   DrawTriangle() splits large triangles into horizontal bands and hands them
+   to RunRasterBands(), which draws them on a pool of worker threads, the
+   calling thread included, and returns once they're all done.
+*/
+
+struct GPURasterPool
+{
+   unsigned count;	// Worker threads
+   sthread_t *threads[GPU_RASTER_THREADS_MAX];
+
+   slock_t *lock;
+   scond_t *work_cond;	// Signalled when a job is posted.
+   scond_t *done_cond;	// Signalled when the last band of a job is done.
+
+   // Current job, protected by lock.
+   void (*func)(void *arg, unsigned band);
+   void *arg;
+   unsigned bands;
+   unsigned next_band;
+   unsigned pending;	// Bands not done yet.
+   bool quit;
+};
+
+static void RasterThreadMain(void *arg)
+{
+   GPURasterPool *pool = (GPURasterPool*)arg;
+
+   slock_lock(pool->lock);
+
+   for(;;)
+   {
+      while(pool->next_band >= pool->bands && !pool->quit)
+         scond_wait(pool->work_cond, pool->lock);
+
+      if(pool->quit)
+         break;
+
+      const unsigned band = pool->next_band++;
+
+      slock_unlock(pool->lock);
+
+      pool->func(pool->arg, band);
+
+      slock_lock(pool->lock);
+
+      if(!--pool->pending)
+         scond_signal(pool->done_cond);
+   }
+
+   slock_unlock(pool->lock);
+}
+
+void PS_GPU::SetRasterThreads(unsigned count)
+{
+   GPURasterPool *pool = raster_pool;
+
+   if(count > GPU_RASTER_THREADS_MAX)
+      count = GPU_RASTER_THREADS_MAX;
+
+   if(count < 2)
+      count = 0;
+
+   if(count == raster_threads)
+      return;
+
+   // The render thread's copy may be using the pool.
+   if(render_thread)
+      SyncRenderThread();
+
+   if(pool)
+   {
+      slock_lock(pool->lock);
+      pool->quit = true;
+      scond_broadcast(pool->work_cond);
+      slock_unlock(pool->lock);
+
+      for(unsigned i = 0; i < pool->count; i++)
+         sthread_join(pool->threads[i]);
+
+      scond_free(pool->done_cond);
+      scond_free(pool->work_cond);
+      slock_free(pool->lock);
+      delete pool;
+
+      raster_pool = NULL;
+      raster_threads = 0;
+   }
+
+   if(count)
+   {
+      pool = new GPURasterPool;
+
+      pool->count = 0;
+      pool->lock = slock_new();
+      pool->work_cond = scond_new();
+      pool->done_cond = scond_new();
+      pool->func = NULL;
+      pool->arg = NULL;
+      pool->bands = 0;
+      pool->next_band = 0;
+      pool->pending = 0;
+      pool->quit = false;
+
+      while(pool->count < count - 1)
+      {
+         sthread_t *thread = sthread_create(RasterThreadMain, pool);
+
+         if(!thread)
+            break;
+
+         pool->threads[pool->count++] = thread;
+      }
+
+      if(pool->count < count - 1)
+         log_cb(RETRO_LOG_WARN, "[GPU] Only started %u of %u rasterizer threads.\n", pool->count, count - 1);
+
+      raster_pool = pool;
+      raster_threads = pool->count + 1;
+   }
+
+   if(render_thread)
+      ReloadRenderThread();
+}
+
+void PS_GPU::RunRasterBands(void (*func)(void *arg, unsigned band), void *arg, unsigned bands)
+{
+   GPURasterPool *pool = raster_pool;
+
+   slock_lock(pool->lock);
+
+   pool->func = func;
+   pool->arg = arg;
+   pool->bands = bands;
+   pool->next_band = 0;
+   pool->pending = bands;
+   scond_broadcast(pool->work_cond);
+
+   // Help out rather than just wait.
+   while(pool->next_band < pool->bands)
+   {
+      const unsigned band = pool->next_band++;
+
+      slock_unlock(pool->lock);
+
+      func(arg, band);
+
+      slock_lock(pool->lock);
+
+      pool->pending--;
+   }
+
+   while(pool->pending)
+      scond_wait(pool->done_cond, pool->lock);
+
+   slock_unlock(pool->lock);
+}
@@ -136,6 +136,98 @@ static uint32_t LZCR;
 static uint32_t Reg23;
 // end DR
 
+//
+// FLAG for the instructions with a fast path below isn't worked out when they're run, but only if
+// the game reads it before the next instruction, by running the instruction again the normal way.
+// None of them have an output register that's also an input, so until a register is written the
+// inputs are still there; on the first write, they're copied aside.  Games that read FLAG after an
+// instruction tend to do so every time(e.g. after each RTPT), so a 2-bit counter per opcode tracks
+// that, and when it's expected to be read the instruction just goes the normal way.
+//
+typedef struct
+{
+   Matrices_t Matrices;
+   int32_t CRVectors[4][4];
+   int32_t OFX, OFY;
+   uint16_t H;
+   int16_t DQA;
+   int32_t DQB;
+   int16_t ZSF3, ZSF4;
+
+   int16_t Vectors[3][4];
+   gtergb RGB;
+   uint16_t OTZ;
+   int16_t IR[4];
+   gtexy XY_FIFO[4];
+   uint16_t Z_FIFO[4];
+   gtergb RGB_FIFO[3];
+   int32_t MAC[4];
+} gteregs;
+
+static bool FlagsPending;	// CR[31] is stale, FlagsInstr has to be run again for it.
+static uint32_t FlagsInstr;
+static bool FlagsSaved;		// FlagsRegs has the inputs, they've since been written.
+static gteregs FlagsRegs;
+static bool ResolvingFlags;
+static bool FlagsRead;			// Since the last instruction.
+static unsigned FlagsLastCode;
+static uint8_t FlagsReadCounter[0x40];
+
+static void SaveRegs(gteregs *r)
+{
+   r->Matrices = Matrices;
+   memcpy(r->CRVectors, CRVectors.All, sizeof(r->CRVectors));
+   r->OFX = OFX;
+   r->OFY = OFY;
+   r->H = H;
+   r->DQA = DQA;
+   r->DQB = DQB;
+   r->ZSF3 = ZSF3;
+   r->ZSF4 = ZSF4;
+
+   memcpy(r->Vectors, Vectors, sizeof(r->Vectors));
+   r->RGB = RGB;
+   r->OTZ = OTZ;
+   memcpy(r->IR, IR, sizeof(r->IR));
+   memcpy(r->XY_FIFO, XY_FIFO, sizeof(r->XY_FIFO));
+   memcpy(r->Z_FIFO, Z_FIFO, sizeof(r->Z_FIFO));
+   memcpy(r->RGB_FIFO, RGB_FIFO, sizeof(r->RGB_FIFO));
+   memcpy(r->MAC, MAC, sizeof(r->MAC));
+}
+
+static void LoadRegs(const gteregs *r)
+{
+   Matrices = r->Matrices;
+   memcpy(CRVectors.All, r->CRVectors, sizeof(r->CRVectors));
+   OFX = r->OFX;
+   OFY = r->OFY;
+   H = r->H;
+   DQA = r->DQA;
+   DQB = r->DQB;
+   ZSF3 = r->ZSF3;
+   ZSF4 = r->ZSF4;
+
+   memcpy(Vectors, r->Vectors, sizeof(r->Vectors));
+   RGB = r->RGB;
+   OTZ = r->OTZ;
+   memcpy(IR, r->IR, sizeof(r->IR));
+   memcpy(XY_FIFO, r->XY_FIFO, sizeof(r->XY_FIFO));
+   memcpy(Z_FIFO, r->Z_FIFO, sizeof(r->Z_FIFO));
+   memcpy(RGB_FIFO, r->RGB_FIFO, sizeof(r->RGB_FIFO));
+   memcpy(MAC, r->MAC, sizeof(r->MAC));
+}
+
+static void ResolveFlags(void);
+
+static INLINE void PrepareRegWrite(void)
+{
+   if(MDFN_UNLIKELY(FlagsPending) && !FlagsSaved)
+   {
+      SaveRegs(&FlagsRegs);
+      FlagsSaved = true;
+   }
+}
+
 extern "C" unsigned char widescreen_hack;
 
 static INLINE uint8_t Sat5(int16_t cc)
@@ -213,11 +305,16 @@ void GTE_Power(void)
    LZCR = 0;
 
    Reg23 = 0;
+
+   FlagsPending = false;
 }
 
 // TODO: Don't save redundant state, regarding CR cache variables
 int GTE_StateAction(StateMem *sm, int load, int data_only)
 {
+   if(FlagsPending)
+      ResolveFlags();
+
    SFORMAT StateRegs[] =
    {
       { CR, (uint32_t)(32 * sizeof(uint32_t)), MDFNSTATE_RLSB32 | 0, "CR" },
@@ -292,6 +389,11 @@ void GTE_WriteCR(unsigned int which, uint32_t value)
 
    //PSX_WARNING("[GTE] Write CR %d, 0x%08x", which, value);
 
+   if(which == 31)
+      FlagsPending = false;
+   else
+      PrepareRegWrite();
+
    value &= mask_table[which];
 
    CR[which] = value | (CR[which] & ~mask_table[which]);
@@ -391,6 +493,9 @@ uint32_t GTE_ReadCR(unsigned int which)
          break;
 
       case 31:
+         if(MDFN_UNLIKELY(FlagsPending))
+            ResolveFlags();
+         FlagsRead = true;
          ret = CR[31];
          break;
    }
@@ -400,6 +505,8 @@ uint32_t GTE_ReadCR(unsigned int which)
 
 void GTE_WriteDR(unsigned int which, uint32_t value)
 {
+   PrepareRegWrite();
+
    switch(which & 0x1F)
    {
       case 0:
@@ -1066,7 +1173,8 @@ static INLINE void TransformXY(int64_t h_div_sz, float precise_h_div_sz, int16 z
    float precise_x = fofx + ((float)IR1 * precise_h_div_sz);
    float precise_y = fofy + ((float)IR2 * precise_h_div_sz);
 
-   GPU->AddSubpixelVertex(XY_FIFO[3].X, XY_FIFO[3].Y,
+   if(!ResolvingFlags)
+      GPU->AddSubpixelVertex(XY_FIFO[3].X, XY_FIFO[3].Y,
 			  precise_x, precise_y, z);
 
    XY_FIFO[0] = XY_FIFO[1];
@@ -1438,6 +1546,276 @@ static int32_t GPL(uint32_t instr)
    return(5);
 }
 
+//
+// Fast paths for the instructions games use per polygon, with sf and lm made constant and FLAG left
+// to be worked out later(see ResolveFlags()).  The 44-bit MAC1-3 accumulation can only wrap when the
+// added vector's magnitude is 2^30 or more; that's left to the normal code.
+//
+static INLINE bool InRange30(const int32_t *crv)
+{
+   return ((((uint32_t)crv[0] + 0x40000000) | ((uint32_t)crv[1] + 0x40000000) | ((uint32_t)crv[2] + 0x40000000)) < 0x80000000);
+}
+
+template<bool lm>
+static INLINE int16_t Sat_B(int32_t value)
+{
+   const int32_t min = lm ? 0 : -32768;
+
+   if(value < min)
+      value = min;
+
+   if(value > 32767)
+      value = 32767;
+
+   return(value);
+}
+
+static INLINE int32_t Sat(int32_t value, int32_t min, int32_t max)
+{
+   if(value < min)
+      value = min;
+
+   if(value > max)
+      value = max;
+
+   return(value);
+}
+
+// MultiplyMatrixByVector() and MAC_to_IR() for the Rot, Light and Color matrices.
+template<uint32_t sf, bool lm>
+static INLINE void MulMatVec_Fast(const gtematrix *matrix, const int16_t *v, const int32_t *crv, int64_t *tmp)
+{
+   for(unsigned i = 0; i < 3; i++)
+   {
+      tmp[i] = (int64_t)((uint64_t)(int64_t)crv[i] << 12) + (matrix->MX[i][0] * v[0]) + (matrix->MX[i][1] * v[1]) + (matrix->MX[i][2] * v[2]);
+      MAC[1 + i] = tmp[i] >> sf;
+   }
+
+   IR1 = Sat_B<lm>(MAC[1]);
+   IR2 = Sat_B<lm>(MAC[2]);
+   IR3 = Sat_B<lm>(MAC[3]);
+}
+
+static INLINE void MAC_to_RGB_FIFO_Fast(void)
+{
+   RGB_FIFO[0] = RGB_FIFO[1];
+   RGB_FIFO[1] = RGB_FIFO[2];
+   RGB_FIFO[2].R = Sat(MAC[1] >> 4, 0, 255);
+   RGB_FIFO[2].G = Sat(MAC[2] >> 4, 0, 255);
+   RGB_FIFO[2].B = Sat(MAC[3] >> 4, 0, 255);
+   RGB_FIFO[2].CD = RGB.CD;
+}
+
+template<uint32_t sf, bool lm>
+static INLINE void RTP_Fast(const int16_t *v, bool dq)
+{
+   int64_t tmp[3];
+   int64_t h_div_sz;
+
+   MulMatVec_Fast<sf, lm>(&Matrices.Rot, v, CRVectors.T, tmp);
+
+   Z_FIFO[0] = Z_FIFO[1];
+   Z_FIFO[1] = Z_FIFO[2];
+   Z_FIFO[2] = Z_FIFO[3];
+   Z_FIFO[3] = Sat(tmp[2] >> 12, 0, 65535);
+
+   // Divide() only touches FLAG when it overflows.
+   h_div_sz = ((Z_FIFO[3] * 2) > H) ? Divide(H, Z_FIFO[3]) : 0x1FFFF;
+
+   float precise_h_div_sz = (float)H / (float)Z_FIFO[3];
+   float fofx = ((float)OFX / (float)(1 << 16));
+   float fofy = ((float)OFY / (float)(1 << 16));
+
+   MAC[0] = (int64_t)((int64_t)OFX + IR1 * h_div_sz * ((widescreen_hack) ? 0.75 : 1.00)) >> 16;
+   XY_FIFO[3].X = Sat(MAC[0], -1024, 1023);
+
+   MAC[0] = ((int64_t)OFY + IR2 * h_div_sz) >> 16;
+   XY_FIFO[3].Y = Sat(MAC[0], -1024, 1023);
+
+   float precise_x = fofx + ((float)IR1 * precise_h_div_sz);
+   float precise_y = fofy + ((float)IR2 * precise_h_div_sz);
+
+   GPU->AddSubpixelVertex(XY_FIFO[3].X, XY_FIFO[3].Y,
+         precise_x, precise_y, Z_FIFO[3]);
+
+   XY_FIFO[0] = XY_FIFO[1];
+   XY_FIFO[1] = XY_FIFO[2];
+   XY_FIFO[2] = XY_FIFO[3];
+
+   if(dq)
+   {
+      MAC[0] = (int64_t)DQB + DQA * h_div_sz;
+      IR0 = Sat(((int64_t)DQB + DQA * h_div_sz) >> 12, 0, 4096);
+   }
+}
+
+template<uint32_t sf, bool lm>
+static int32_t RTPS_Fast(void)
+{
+   RTP_Fast<sf, lm>(Vectors[0], true);
+
+   return(15);
+}
+
+template<uint32_t sf, bool lm>
+static int32_t RTPT_Fast(void)
+{
+   RTP_Fast<sf, lm>(Vectors[0], false);
+   RTP_Fast<sf, lm>(Vectors[1], false);
+   RTP_Fast<sf, lm>(Vectors[2], true);
+
+   return(23);
+}
+
+template<uint32_t sf, bool lm, bool dq>
+static INLINE void NormColor_Fast(const int16_t *v)
+{
+   int64_t tmp[3];
+   int16_t tmp_vector[3];
+
+   MulMatVec_Fast<sf, lm>(&Matrices.Light, v, CRVectors.Null, tmp);
+
+   tmp_vector[0] = IR1; tmp_vector[1] = IR2; tmp_vector[2] = IR3;
+   MulMatVec_Fast<sf, lm>(&Matrices.Color, tmp_vector, CRVectors.B, tmp);
+
+   if(dq)
+   {
+      const int32_t RGB_temp[3] = { RGB.R << 4, RGB.G << 4, RGB.B << 4 };
+      const int32_t IR_temp[3] = { IR1, IR2, IR3 };
+
+      for(unsigned i = 0; i < 3; i++)
+      {
+         MAC[1 + i] = ((int64_t)((uint64_t)(int64_t)CRVectors.FC[i] << 12) - RGB_temp[i] * IR_temp[i]) >> sf;
+         MAC[1 + i] = (int64_t)(RGB_temp[i] * IR_temp[i] + IR0 * Sat_B<false>(MAC[1 + i])) >> sf;
+      }
+
+      IR1 = Sat_B<lm>(MAC[1]);
+      IR2 = Sat_B<lm>(MAC[2]);
+      IR3 = Sat_B<lm>(MAC[3]);
+   }
+
+   MAC_to_RGB_FIFO_Fast();
+}
+
+template<uint32_t sf, bool lm>
+static int32_t NCS_Fast(void)
+{
+   NormColor_Fast<sf, lm, false>(Vectors[0]);
+
+   return(14);
+}
+
+template<uint32_t sf, bool lm>
+static int32_t NCT_Fast(void)
+{
+   NormColor_Fast<sf, lm, false>(Vectors[0]);
+   NormColor_Fast<sf, lm, false>(Vectors[1]);
+   NormColor_Fast<sf, lm, false>(Vectors[2]);
+
+   return(30);
+}
+
+template<uint32_t sf, bool lm>
+static int32_t NCDS_Fast(void)
+{
+   NormColor_Fast<sf, lm, true>(Vectors[0]);
+
+   return(19);
+}
+
+template<uint32_t sf, bool lm>
+static int32_t NCDT_Fast(void)
+{
+   NormColor_Fast<sf, lm, true>(Vectors[0]);
+   NormColor_Fast<sf, lm, true>(Vectors[1]);
+   NormColor_Fast<sf, lm, true>(Vectors[2]);
+
+   return(44);
+}
+
+static int32_t NCLIP_Fast(void)
+{
+   MAC[0] = (int64_t)(XY_FIFO[0].X * (XY_FIFO[1].Y - XY_FIFO[2].Y)) + (XY_FIFO[1].X * (XY_FIFO[2].Y - XY_FIFO[0].Y)) + (XY_FIFO[2].X * (XY_FIFO[0].Y - XY_FIFO[1].Y));
+
+   return(8);
+}
+
+static INLINE void AVSZ_Fast(int64_t value)
+{
+   MAC[0] = value;
+
+   if(value < -2147483648LL)
+      OTZ = 0;
+   else if(value > 2147483647LL)
+      OTZ = 0xFFFF;
+   else
+      OTZ = Sat(MAC[0] >> 12, 0, 65535);
+}
+
+typedef int32_t (*fastop_t)(void);
+
+#define FASTOP_SFLM(op) { op<0, false>, op<0, true>, op<12, false>, op<12, true> }
+static const fastop_t RTPS_Fast_Tab[4] = FASTOP_SFLM(RTPS_Fast);
+static const fastop_t RTPT_Fast_Tab[4] = FASTOP_SFLM(RTPT_Fast);
+static const fastop_t NCS_Fast_Tab[4] = FASTOP_SFLM(NCS_Fast);
+static const fastop_t NCT_Fast_Tab[4] = FASTOP_SFLM(NCT_Fast);
+static const fastop_t NCDS_Fast_Tab[4] = FASTOP_SFLM(NCDS_Fast);
+static const fastop_t NCDT_Fast_Tab[4] = FASTOP_SFLM(NCDT_Fast);
+#undef FASTOP_SFLM
+
+// Returns 0 if the instruction has to go through Instruction().
+static INLINE int32_t InstructionFast(uint32_t instr)
+{
+   const unsigned sflm = ((instr >> 18) & 0x2) | ((instr >> 10) & 0x1);
+
+   switch(instr & 0x3F)
+   {
+      case 0x00:
+      case 0x01:
+         if(InRange30(CRVectors.T))
+            return RTPS_Fast_Tab[sflm]();
+         break;
+
+      case 0x30:
+         if(InRange30(CRVectors.T))
+            return RTPT_Fast_Tab[sflm]();
+         break;
+
+      case 0x1E:
+         if(InRange30(CRVectors.B))
+            return NCS_Fast_Tab[sflm]();
+         break;
+
+      case 0x20:
+         if(InRange30(CRVectors.B))
+            return NCT_Fast_Tab[sflm]();
+         break;
+
+      case 0x13:
+         if(InRange30(CRVectors.B) && InRange30(CRVectors.FC))
+            return NCDS_Fast_Tab[sflm]();
+         break;
+
+      case 0x16:
+         if(InRange30(CRVectors.B) && InRange30(CRVectors.FC))
+            return NCDT_Fast_Tab[sflm]();
+         break;
+
+      case 0x06:
+         return NCLIP_Fast();
+
+      case 0x2D:
+         AVSZ_Fast((int64_t)ZSF3 * (Z_FIFO[1] + Z_FIFO[2] + Z_FIFO[3]));
+         return(5);
+
+      case 0x2E:
+         AVSZ_Fast((int64_t)ZSF4 * (Z_FIFO[0] + Z_FIFO[1] + Z_FIFO[2] + Z_FIFO[3]));
+         return(5);
+   }
+
+   return(0);
+}
+
 /*
 
 ---------------------------------------------------------------------------------------------
@@ -1464,13 +1842,11 @@ static int32_t GPL(uint32_t instr)
  opcode = operation code 
 */
 
-int32_t GTE_Instruction(uint32_t instr)
+static int32_t Instruction(uint32_t instr)
 {
    const unsigned code = instr & 0x3F;
    int32_t ret = 1;
 
-   FLAGS = 0;
-
    switch(code)
    {
       default: 
@@ -1712,14 +2088,74 @@ int32_t GTE_Instruction(uint32_t instr)
          break;
    }
 
-   // Overclock: force all GTE instruction to have 1 cycle latency
-   if (psx_cpu_overclock)
-      ret = 1;
+   return(ret);
+}
+
+static void ResolveFlags(void)
+{
+   gteregs cur;
+
+   FlagsPending = false;
+
+   SaveRegs(&cur);
+   if(FlagsSaved)
+      LoadRegs(&FlagsRegs);
+
+   FLAGS = 0;
+   ResolvingFlags = true;
+   Instruction(FlagsInstr);
+   ResolvingFlags = false;
+
+   LoadRegs(&cur);
 
    if(FLAGS & 0x7f87e000)
       FLAGS |= 1 << 31;
 
    CR[31] = FLAGS;
+}
+
+int32_t GTE_Instruction(uint32_t instr)
+{
+   const unsigned code = instr & 0x3F;
+   uint8_t *counter = &FlagsReadCounter[FlagsLastCode];
+   int32_t ret = 0;
+
+   if(FlagsRead)
+   {
+      if(*counter < 3)
+         (*counter)++;
+   }
+   else if(*counter)
+      (*counter)--;
+
+   FlagsRead = false;
+   FlagsLastCode = code;
+   FlagsPending = false;
+
+   if(FlagsReadCounter[code] < 2)
+      ret = InstructionFast(instr);
+
+   if(ret)
+   {
+      FlagsPending = true;
+      FlagsInstr = instr;
+      FlagsSaved = false;
+   }
+   else
+   {
+      FLAGS = 0;
+
+      ret = Instruction(instr);
+
+      if(FLAGS & 0x7f87e000)
+         FLAGS |= 1 << 31;
+
+      CR[31] = FLAGS;
+   }
+
+   // Overclock: force all GTE instruction to have 1 cycle latency
+   if (psx_cpu_overclock)
+      ret = 1;
 
    return(ret - 1);
 }
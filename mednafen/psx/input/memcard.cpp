@@ -189,14 +189,18 @@ int InputDevice_Memcard::StateAction(StateMem* sm, int load, int data_only, cons
    if(MDFNSS_StateAction(sm, load, data_only, StateRegs, section_name) != 0)
    {
       //printf("%s data_used=%d\n", section_name, data_used);
-      if(data_used)
+      // Raw snapshots always carry the card contents, so a first write made
+      // during frames that get rolled back is undone along with them.
+      if(data_used || data_only)
       {
          std::string tmp_name = std::string(section_name) + "_DT";
 
          ret &= MDFNSS_StateAction(sm, load, data_only, CD_StateRegs, tmp_name.c_str());
       }
 
-      if(load)
+      // Raw snapshots only rewind frames that were emulated ahead, don't make
+      // that look like a memory card write.
+      if(load && !data_only)
       {
          if(data_used)
             dirty_count++;
@@ -55,16 +55,28 @@
 
 #include "psx.h"
 #include "mdec.h"
+#include "../../libretro.h"
 
 #include "../masmem.h"
 #include "FastFIFO.h"
 #include <math.h>
 
+#include <rthreads/rthreads.h>
+
 #if defined(__SSE2__)
 #include <xmmintrin.h>
 #include <emmintrin.h>
 #endif
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if (defined(__ARM_NEON__) || defined(__ARM_NEON)) && !defined(MSB_FIRST)
+#include <arm_neon.h>
+#define MDEC_NEON
+#endif
+
 #if defined(ARCH_POWERPC_ALTIVEC) && defined(HAVE_ALTIVEC_H)
  #include <altivec.h>
 #endif
@@ -85,21 +97,33 @@ static bool InCommand;
 static uint8 QMatrix[2][64];
 static uint32 QMIndex;
 
-static int16 IDCTMatrix[64] MDFN_ALIGN(16);
+static int16 IDCTMatrix[64] MDFN_ALIGN(16);	// [x][u], x being the output, u the input
 static uint32 IDCTMIndex;
 
+// IDCTMatrix rearranged for the SIMD IDCTs, so each input coefficient's entries for all 8
+// outputs are together:
+#if defined(__SSE2__)
+// [u >> 1][x >> 2][((x & 3) << 1) | (u & 1)], for _mm_madd_epi16() on pairs of inputs.
+static int16 IDCTMatrixPairs[4][2][8] MDFN_ALIGN(32);
+#elif defined(MDEC_NEON)
+// [u][x]
+static int16 IDCTMatrixT[8][8] MDFN_ALIGN(16);
+#endif
+
 static uint8 QScale;
 
 static int16 Coeff[64] MDFN_ALIGN(16);
 static uint32 CoeffIndex;
 static uint32 DecodeWB;
 
-static union
+union MDECPixelBuffer
 {
  uint32 pix32[48];
  uint16 pix16[96];
  uint8   pix8[192];
-} PixelBuffer;
+};
+
+static MDECPixelBuffer PixelBuffer;
 static uint32 PixelBufferReadOffset;
 static uint32 PixelBufferCount32;
 
@@ -109,6 +133,138 @@ static uint8 RAMOffsetY;
 static uint8 RAMOffsetCounter;
 static uint8 RAMOffsetWWS;
 
+extern retro_log_printf_t log_cb;
+
+/*
+   Decoding thread.
+
+   The emulation thread keeps reading the input FIFO, undoing the run-length
+   coding and quantization, and charging the same cycles per block as without
+   the thread, so InFIFO/OutFIFO levels, the status register and DMA pacing
+   are exactly what they would be.  Only the IDCT and the conversion to the
+   output pixel format, which is most of the work, are queued to the thread
+   as soon as the last coefficient of a block has been read; the result isn't
+   needed until the cycles the block costs have passed, and is then copied to
+   PixelBuffer.
+
+   Blocks are decoded in order, one at a time, since a luma block's colour
+   comes from the chroma blocks before it.  When the emulation thread needs a
+   block that the thread hasn't started on yet, it decodes it itself rather
+   than wait.  It also finishes everything queued before savestates, resets,
+   and IDCT matrix changes, so block_y/cb/cr and PixelBuffer are always as
+   they would be without the thread when anything else looks at them.
+*/
+
+// Ordering for the decode queue positions, which both threads update without taking a lock.
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define DQ_LOAD_ACQUIRE(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define DQ_STORE_RELEASE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define DQ_FENCE_FULL()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define DQ_CAS(p, o, n)		__sync_bool_compare_and_swap((p), (o), (n))
+#elif defined(__GNUC__)
+#define DQ_LOAD_ACQUIRE(p)	({ __typeof__(*(p)) dq_tmp = *(volatile __typeof__(*(p)) *)(p); __sync_synchronize(); dq_tmp; })
+#define DQ_STORE_RELEASE(p, v)	do { __sync_synchronize(); *(volatile __typeof__(*(p)) *)(p) = (v); } while(0)
+#define DQ_FENCE_FULL()		__sync_synchronize()
+#define DQ_CAS(p, o, n)		__sync_bool_compare_and_swap((p), (o), (n))
+#elif defined(_MSC_VER)
+#include <windows.h>
+#define DQ_LOAD_ACQUIRE(p)	(MemoryBarrier(), *(volatile long *)(p))
+#define DQ_STORE_RELEASE(p, v)	do { MemoryBarrier(); *(volatile long *)(p) = (v); } while(0)
+#define DQ_FENCE_FULL()		MemoryBarrier()
+#define DQ_CAS(p, o, n)		(InterlockedCompareExchange((volatile long *)(p), (n), (o)) == (long)(o))
+#else
+#error "No memory barriers for this compiler."
+#endif
+
+#if defined(__SSE2__)
+#define DQ_PAUSE()		_mm_pause()
+#else
+#define DQ_PAUSE()
+#endif
+
+enum
+{
+   DECODE_QUEUE_SIZE = 64,	// Must be a power of 2
+
+   // Times a thread checks for something to do before sleeping.  The decoding
+   // thread only waits like this for the rest of a macroblock it's been woken
+   // for; between macroblocks it sleeps straight away.
+   DECODE_THREAD_SPIN = 1024,
+   DECODE_WAIT_SPIN = 1024
+};
+
+struct MDECDecodeJob
+{
+   int16 Coeff[64] MDFN_ALIGN(16);
+   uint32 Command;
+   uint32 WB;
+
+   MDECPixelBuffer Pixels;	// Output, for luma blocks.
+};
+
+struct MDECDecodeThread
+{
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *work_cond;	// Signalled when a job is queued, if thread_sleeping.
+   scond_t *done_cond;	// Signalled when a job has been decoded, if emu_waiting.
+
+   // Free-running sequence numbers.  The job at take_pos can be taken, by
+   // either thread, once read_pos has caught up with it; blocks have to be
+   // decoded in order.
+   uint32 write_pos;
+   uint32 take_pos;
+   uint32 read_pos;
+
+   uint32 thread_sleeping;
+   uint32 emu_waiting;
+   uint32 quit;
+
+   //
+   // Emulation-thread-only:
+   //
+   bool output_pending;	// Job output_pos - 1 has pixels for PixelBuffer.
+   uint32 output_pos;
+
+   MDECDecodeJob queue[DECODE_QUEUE_SIZE];
+};
+
+static MDECDecodeThread *decode_thread = NULL;
+
+// Color macroblocks are Cr, Cb, Y0-Y3; monochrome ones are a single Y block.
+static INLINE bool MacroblockStart(uint32 command, uint32 wb)
+{
+   return wb == (((command >> 27) & 2) ? 0 : 2);
+}
+
+static INLINE bool MacroblockEnd(uint32 command, uint32 wb)
+{
+   return wb == (((command >> 27) & 2) ? 5 : 2);
+}
+
+static void SyncDecodeThread(void);
+
+static INLINE void SetIDCTMatrix(unsigned x, unsigned u, int16 v)
+{
+   IDCTMatrix[(x << 3) | u] = v;
+
+#if defined(__SSE2__)
+   IDCTMatrixPairs[u >> 1][x >> 2][((x & 3) << 1) | (u & 1)] = v;
+#elif defined(MDEC_NEON)
+   IDCTMatrixT[u][x] = v;
+#endif
+}
+
+// Brings the rearranged copies up to date after IDCTMatrix has been written directly.
+static void ReloadIDCTMatrix(void)
+{
+   for(unsigned x = 0; x < 8; x++)
+   {
+      for(unsigned u = 0; u < 8; u++)
+         SetIDCTMatrix(x, u, IDCTMatrix[(x << 3) | u]);
+   }
+}
+
 static const uint8 ZigZag[64] =
 {
  0x00, 0x08, 0x01, 0x02, 0x09, 0x10, 0x18, 0x11, 
@@ -123,6 +279,8 @@ static const uint8 ZigZag[64] =
 
 void MDEC_Power(void)
 {
+   SyncDecodeThread();
+
    ClockCounter = 0;
    MDRPhase = 0;
 
@@ -141,6 +299,7 @@ void MDEC_Power(void)
    QMIndex = 0;
 
    memset(IDCTMatrix, 0, sizeof(IDCTMatrix));
+   ReloadIDCTMatrix();
    IDCTMIndex = 0;
 
    QScale = 0;
@@ -162,6 +321,8 @@ void MDEC_Power(void)
 
 int MDEC_StateAction(StateMem *sm, int load, int data_only)
 {
+   SyncDecodeThread();
+
    SFORMAT StateRegs[] =
    {
       SFVAR(ClockCounter),
@@ -215,6 +376,7 @@ int MDEC_StateAction(StateMem *sm, int load, int data_only)
    {
       InFIFO.SaveStatePostLoad();
       OutFIFO.SaveStatePostLoad();
+      ReloadIDCTMatrix();
    }
 
    return(ret);
@@ -233,37 +395,173 @@ static INLINE int8 Mask9ClampS8(int32 v)
    return v;
 }
 
-template<typename T>
-static void IDCT_1D_Multi(int16 *in_coeff, T *out_coeff)
-{
+//
+// The IDCT is two passes of multiplying by the matrix the game uploaded, which needn't be
+// a DCT one, so there's no butterfly; each pass, a row of the block at a time is
+// multiplied with all 8 of its outputs in a vector, and the result transposed for the next.
+// Nothing here can overflow with the coefficients clamped to 15 bits and the matrix
+// entries to 13, so this comes out the same as the scalar version.
+//
 #if defined(__SSE2__)
+static INLINE __m128i IDCT_Row(__m128i row)
 {
- for(unsigned col = 0; col < 8; col++)
- {
-  __m128i c =  _mm_load_si128((__m128i *)&in_coeff[(col * 8)]);
+#if defined(__AVX2__)
+   const __m256i rr = _mm256_broadcastsi128_si256(row);
+   __m256i sum;
 
-  for(unsigned x = 0; x < 8; x++)
-  {
-   __m128i sum;
-   __m128i m;
-   int32 tmp[4] MDFN_ALIGN(16);
+   sum = _mm256_madd_epi16(_mm256_shuffle_epi32(rr, 0x00), _mm256_load_si256((__m256i*)IDCTMatrixPairs[0]));
+   sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_shuffle_epi32(rr, 0x55), _mm256_load_si256((__m256i*)IDCTMatrixPairs[1])));
+   sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_shuffle_epi32(rr, 0xAA), _mm256_load_si256((__m256i*)IDCTMatrixPairs[2])));
+   sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_shuffle_epi32(rr, 0xFF), _mm256_load_si256((__m256i*)IDCTMatrixPairs[3])));
+   sum = _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(0x4000)), 15);
 
-   m = _mm_load_si128((__m128i *)&IDCTMatrix[(x * 8)]);
-   sum = _mm_madd_epi16(m, c);
-   sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, (3 << 0) | (2 << 2) | (1 << 4) | (0 << 6)));
-   sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, (1 << 0) | (0 << 2)));
+   return _mm_packs_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+#else
+   __m128i sum_lo, sum_hi;
+   __m128i c;
 
-   //_mm_store_ss((float *)&tmp[0], (__m128)sum);
-   _mm_store_si128((__m128i*)tmp, sum);
+   c = _mm_shuffle_epi32(row, 0x00);
+   sum_lo = _mm_madd_epi16(c, _mm_load_si128((__m128i*)IDCTMatrixPairs[0][0]));
+   sum_hi = _mm_madd_epi16(c, _mm_load_si128((__m128i*)IDCTMatrixPairs[0][1]));
 
-   if(sizeof(T) == 1)
-    out_coeff[(col * 8) + x] = Mask9ClampS8((tmp[0] + 0x4000) >> 15);
-   else
-    out_coeff[(x * 8) + col] = (tmp[0] + 0x4000) >> 15;
-  }
- }
+   c = _mm_shuffle_epi32(row, 0x55);
+   sum_lo = _mm_add_epi32(sum_lo, _mm_madd_epi16(c, _mm_load_si128((__m128i*)IDCTMatrixPairs[1][0])));
+   sum_hi = _mm_add_epi32(sum_hi, _mm_madd_epi16(c, _mm_load_si128((__m128i*)IDCTMatrixPairs[1][1])));
+
+   c = _mm_shuffle_epi32(row, 0xAA);
+   sum_lo = _mm_add_epi32(sum_lo, _mm_madd_epi16(c, _mm_load_si128((__m128i*)IDCTMatrixPairs[2][0])));
+   sum_hi = _mm_add_epi32(sum_hi, _mm_madd_epi16(c, _mm_load_si128((__m128i*)IDCTMatrixPairs[2][1])));
+
+   c = _mm_shuffle_epi32(row, 0xFF);
+   sum_lo = _mm_add_epi32(sum_lo, _mm_madd_epi16(c, _mm_load_si128((__m128i*)IDCTMatrixPairs[3][0])));
+   sum_hi = _mm_add_epi32(sum_hi, _mm_madd_epi16(c, _mm_load_si128((__m128i*)IDCTMatrixPairs[3][1])));
+
+   sum_lo = _mm_srai_epi32(_mm_add_epi32(sum_lo, _mm_set1_epi32(0x4000)), 15);
+   sum_hi = _mm_srai_epi32(_mm_add_epi32(sum_hi, _mm_set1_epi32(0x4000)), 15);
+
+   return _mm_packs_epi32(sum_lo, sum_hi);
+#endif
+}
+
+static INLINE void Transpose8x8(__m128i *r)
+{
+   const __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+   const __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+   const __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+   const __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+   const __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+   const __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+   const __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+   const __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+   const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+   const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+   const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+   const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+   const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+   const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+   const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+   const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+   r[0] = _mm_unpacklo_epi64(b0, b4);
+   r[1] = _mm_unpackhi_epi64(b0, b4);
+   r[2] = _mm_unpacklo_epi64(b1, b5);
+   r[3] = _mm_unpackhi_epi64(b1, b5);
+   r[4] = _mm_unpacklo_epi64(b2, b6);
+   r[5] = _mm_unpackhi_epi64(b2, b6);
+   r[6] = _mm_unpacklo_epi64(b3, b7);
+   r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+static void IDCT(int16 *in_coeff, int8 *out_coeff)
+{
+   __m128i r[8];
+
+   for(unsigned i = 0; i < 8; i++)
+      r[i] = IDCT_Row(_mm_load_si128((__m128i*)&in_coeff[i * 8]));
+
+   Transpose8x8(r);
+
+   for(unsigned i = 0; i < 8; i += 2)
+   {
+      // Mask9ClampS8(), the clamping done by the signed saturation when packing.
+      const __m128i a = _mm_srai_epi16(_mm_slli_epi16(IDCT_Row(r[i + 0]), 7), 7);
+      const __m128i b = _mm_srai_epi16(_mm_slli_epi16(IDCT_Row(r[i + 1]), 7), 7);
+
+      _mm_storeu_si128((__m128i*)&out_coeff[i * 8], _mm_packs_epi16(a, b));
+   }
+}
+#elif defined(MDEC_NEON)
+static INLINE int16x8_t IDCT_Row(int16x8_t row)
+{
+   const int16x4_t lo = vget_low_s16(row);
+   const int16x4_t hi = vget_high_s16(row);
+   int32x4_t sum_lo, sum_hi;
+
+#define IDCT_MAC(u, v, lane) \
+   sum_lo = vmlal_lane_s16(sum_lo, vld1_s16(&IDCTMatrixT[u][0]), v, lane); \
+   sum_hi = vmlal_lane_s16(sum_hi, vld1_s16(&IDCTMatrixT[u][4]), v, lane);
+
+   sum_lo = vmull_lane_s16(vld1_s16(&IDCTMatrixT[0][0]), lo, 0);
+   sum_hi = vmull_lane_s16(vld1_s16(&IDCTMatrixT[0][4]), lo, 0);
+   IDCT_MAC(1, lo, 1)
+   IDCT_MAC(2, lo, 2)
+   IDCT_MAC(3, lo, 3)
+   IDCT_MAC(4, hi, 0)
+   IDCT_MAC(5, hi, 1)
+   IDCT_MAC(6, hi, 2)
+   IDCT_MAC(7, hi, 3)
+#undef IDCT_MAC
+
+   // (sum + 0x4000) >> 15
+   return vcombine_s16(vrshrn_n_s32(sum_lo, 15), vrshrn_n_s32(sum_hi, 15));
+}
+
+static INLINE void Transpose8x8(int16x8_t *r)
+{
+   const int16x8x2_t a01 = vtrnq_s16(r[0], r[1]);
+   const int16x8x2_t a23 = vtrnq_s16(r[2], r[3]);
+   const int16x8x2_t a45 = vtrnq_s16(r[4], r[5]);
+   const int16x8x2_t a67 = vtrnq_s16(r[6], r[7]);
+
+   const int32x4x2_t b02 = vtrnq_s32(vreinterpretq_s32_s16(a01.val[0]), vreinterpretq_s32_s16(a23.val[0]));
+   const int32x4x2_t b13 = vtrnq_s32(vreinterpretq_s32_s16(a01.val[1]), vreinterpretq_s32_s16(a23.val[1]));
+   const int32x4x2_t b46 = vtrnq_s32(vreinterpretq_s32_s16(a45.val[0]), vreinterpretq_s32_s16(a67.val[0]));
+   const int32x4x2_t b57 = vtrnq_s32(vreinterpretq_s32_s16(a45.val[1]), vreinterpretq_s32_s16(a67.val[1]));
+
+#define TRANSPOSE_JOIN(d, e, part) vcombine_s16(part(vreinterpretq_s16_s32(d)), part(vreinterpretq_s16_s32(e)))
+   r[0] = TRANSPOSE_JOIN(b02.val[0], b46.val[0], vget_low_s16);
+   r[1] = TRANSPOSE_JOIN(b13.val[0], b57.val[0], vget_low_s16);
+   r[2] = TRANSPOSE_JOIN(b02.val[1], b46.val[1], vget_low_s16);
+   r[3] = TRANSPOSE_JOIN(b13.val[1], b57.val[1], vget_low_s16);
+   r[4] = TRANSPOSE_JOIN(b02.val[0], b46.val[0], vget_high_s16);
+   r[5] = TRANSPOSE_JOIN(b13.val[0], b57.val[0], vget_high_s16);
+   r[6] = TRANSPOSE_JOIN(b02.val[1], b46.val[1], vget_high_s16);
+   r[7] = TRANSPOSE_JOIN(b13.val[1], b57.val[1], vget_high_s16);
+#undef TRANSPOSE_JOIN
+}
+
+static void IDCT(int16 *in_coeff, int8 *out_coeff)
+{
+   int16x8_t r[8];
+
+   for(unsigned i = 0; i < 8; i++)
+      r[i] = IDCT_Row(vld1q_s16(&in_coeff[i * 8]));
+
+   Transpose8x8(r);
+
+   for(unsigned i = 0; i < 8; i++)
+   {
+      // Mask9ClampS8()
+      const int16x8_t v = vshrq_n_s16(vshlq_n_s16(IDCT_Row(r[i]), 7), 7);
+
+      vst1_s8(&out_coeff[i * 8], vqmovn_s16(v));
+   }
 }
 #else
+template<typename T>
+static void IDCT_1D_Multi(int16 *in_coeff, T *out_coeff)
+{
  for(unsigned col = 0; col < 8; col++)
  {
   for(unsigned x = 0; x < 8; x++)
@@ -281,7 +579,6 @@ static void IDCT_1D_Multi(int16 *in_coeff, T *out_coeff)
     out_coeff[(x * 8) + col] = (sum + 0x4000) >> 15;
   }
  }
-#endif
 }
 
 static void IDCT(int16 *in_coeff, int8 *out_coeff)
@@ -291,6 +588,7 @@ static void IDCT(int16 *in_coeff, int8 *out_coeff)
    IDCT_1D_Multi<int16>(in_coeff, tmpbuf);
    IDCT_1D_Multi<int8>(tmpbuf, out_coeff);
 }
+#endif
 
 static INLINE void YCbCr_to_RGB(const int8 y, const int8 cb, const int8 cr, int &r, int &g, int &b)
 {
@@ -323,18 +621,124 @@ static INLINE uint16 RGB_to_RGB555(uint8 r, uint8 g, uint8 b)
    return((r << 0) | (g << 5) | (b << 10));
 }
 
-static void EncodeImage(const unsigned ybn)
+//
+// YCbCr_to_RGB() for 8 pixels(or 16, two lines sharing the same chroma, with AVX2), giving
+// r, g and b as 0-255 in 16-bit lanes(bytes with NEON); "cb" and "cr" point to the start of
+// the chroma line, "x" says which half of it.  The multiplies are split into a shift and a
+// multiply that fits in 16 bits; e.g. (359 * cr + 0x80) >> 8 is cr + ((103 * cr + 0x80) >> 8),
+// and the same goes for the green's masking since the part taken out is a multiple of 256.
+//
+#if defined(__AVX2__)
+enum { YCC_LINES = 2 };
+
+static INLINE void YCbCr_to_RGB_Lines(const int8 *by, const int8 *cb, const int8 *cr, const unsigned x, __m256i &r, __m256i &g, __m256i &b)
 {
-   //printf("ENCODE, %d\n", (Command & 0x08000000) ? 256 : 384);
+   const __m256i y = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)by));
+   __m128i cb8 = _mm_loadl_epi64((const __m128i*)cb);
+   __m128i cr8 = _mm_loadl_epi64((const __m128i*)cr);
 
-   PixelBufferCount32 = 0;
+   if(x)
+   {
+      cb8 = _mm_srli_si128(cb8, 4);
+      cr8 = _mm_srli_si128(cr8, 4);
+   }
+
+   const __m256i cbw = _mm256_broadcastsi128_si256(_mm_cvtepi8_epi16(_mm_unpacklo_epi8(cb8, cb8)));
+   const __m256i crw = _mm256_broadcastsi128_si256(_mm_cvtepi8_epi16(_mm_unpacklo_epi8(cr8, cr8)));
+   const __m256i round = _mm256_set1_epi16(0x80);
+   __m256i rt, gt, bt;
+
+   rt = _mm256_add_epi16(crw, _mm256_srai_epi16(_mm256_add_epi16(_mm256_mullo_epi16(crw, _mm256_set1_epi16(103)), round), 8));
+   gt = _mm256_add_epi16(_mm256_and_si256(_mm256_mullo_epi16(cbw, _mm256_set1_epi16(-88)), _mm256_set1_epi16(~0x1F)),
+                         _mm256_and_si256(_mm256_mullo_epi16(crw, _mm256_set1_epi16(73)), _mm256_set1_epi16(~0x07)));
+   gt = _mm256_sub_epi16(_mm256_srai_epi16(_mm256_add_epi16(gt, round), 8), crw);
+   bt = _mm256_add_epi16(cbw, _mm256_srai_epi16(_mm256_add_epi16(_mm256_mullo_epi16(cbw, _mm256_set1_epi16(198)), round), 8));
+
+#define YCC_FINISH(v) _mm256_add_epi16(_mm256_max_epi16(_mm256_min_epi16(_mm256_srai_epi16(_mm256_slli_epi16(_mm256_add_epi16(y, v), 7), 7), \
+                                       _mm256_set1_epi16(127)), _mm256_set1_epi16(-128)), round)
+   r = YCC_FINISH(rt);
+   g = YCC_FINISH(gt);
+   b = YCC_FINISH(bt);
+#undef YCC_FINISH
+}
+#elif defined(__SSE2__)
+enum { YCC_LINES = 1 };
+
+static INLINE void YCbCr_to_RGB_Lines(const int8 *by, const int8 *cb, const int8 *cr, const unsigned x, __m128i &r, __m128i &g, __m128i &b)
+{
+   const __m128i y8 = _mm_loadl_epi64((const __m128i*)by);
+   const __m128i y = _mm_srai_epi16(_mm_unpacklo_epi8(y8, y8), 8);
+   __m128i cb8 = _mm_loadl_epi64((const __m128i*)cb);
+   __m128i cr8 = _mm_loadl_epi64((const __m128i*)cr);
+
+   if(x)
+   {
+      cb8 = _mm_srli_si128(cb8, 4);
+      cr8 = _mm_srli_si128(cr8, 4);
+   }
+
+   // Each chroma sample for two pixels, sign-extended.
+   cb8 = _mm_unpacklo_epi8(cb8, cb8);
+   cr8 = _mm_unpacklo_epi8(cr8, cr8);
+
+   const __m128i cbw = _mm_srai_epi16(_mm_unpacklo_epi8(cb8, cb8), 8);
+   const __m128i crw = _mm_srai_epi16(_mm_unpacklo_epi8(cr8, cr8), 8);
+   const __m128i round = _mm_set1_epi16(0x80);
+   __m128i rt, gt, bt;
+
+   rt = _mm_add_epi16(crw, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(crw, _mm_set1_epi16(103)), round), 8));
+   gt = _mm_add_epi16(_mm_and_si128(_mm_mullo_epi16(cbw, _mm_set1_epi16(-88)), _mm_set1_epi16(~0x1F)),
+                      _mm_and_si128(_mm_mullo_epi16(crw, _mm_set1_epi16(73)), _mm_set1_epi16(~0x07)));
+   gt = _mm_sub_epi16(_mm_srai_epi16(_mm_add_epi16(gt, round), 8), crw);
+   bt = _mm_add_epi16(cbw, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(cbw, _mm_set1_epi16(198)), round), 8));
+
+#define YCC_FINISH(v) _mm_add_epi16(_mm_max_epi16(_mm_min_epi16(_mm_srai_epi16(_mm_slli_epi16(_mm_add_epi16(y, v), 7), 7), \
+                                    _mm_set1_epi16(127)), _mm_set1_epi16(-128)), round)
+   r = YCC_FINISH(rt);
+   g = YCC_FINISH(gt);
+   b = YCC_FINISH(bt);
+#undef YCC_FINISH
+}
+#elif defined(MDEC_NEON)
+static INLINE void YCbCr_to_RGB_Lines(const int8 *by, const int8 *cb, const int8 *cr, const unsigned x, uint8x8_t &r, uint8x8_t &g, uint8x8_t &b)
+{
+   const int16x8_t y = vmovl_s8(vld1_s8(by));
+   int8x8_t cb8 = vld1_s8(cb);
+   int8x8_t cr8 = vld1_s8(cr);
+
+   if(x)
+   {
+      cb8 = vext_s8(cb8, cb8, 4);
+      cr8 = vext_s8(cr8, cr8, 4);
+   }
+
+   const int16x8_t cbw = vmovl_s8(vzip_s8(cb8, cb8).val[0]);
+   const int16x8_t crw = vmovl_s8(vzip_s8(cr8, cr8).val[0]);
+   int16x8_t rt, gt, bt;
+
+   rt = vaddq_s16(crw, vshrq_n_s16(vaddq_s16(vmulq_n_s16(crw, 103), vdupq_n_s16(0x80)), 8));
+   gt = vaddq_s16(vandq_s16(vmulq_n_s16(cbw, -88), vdupq_n_s16(~0x1F)), vandq_s16(vmulq_n_s16(crw, 73), vdupq_n_s16(~0x07)));
+   gt = vsubq_s16(vshrq_n_s16(vaddq_s16(gt, vdupq_n_s16(0x80)), 8), crw);
+   bt = vaddq_s16(cbw, vshrq_n_s16(vaddq_s16(vmulq_n_s16(cbw, 198), vdupq_n_s16(0x80)), 8));
+
+#define YCC_FINISH(v) veor_u8(vreinterpret_u8_s8(vqmovn_s16(vshrq_n_s16(vshlq_n_s16(vaddq_s16(y, v), 7), 7))), vdup_n_u8(0x80))
+   r = YCC_FINISH(rt);
+   g = YCC_FINISH(gt);
+   b = YCC_FINISH(bt);
+#undef YCC_FINISH
+}
+#endif
+
+static void EncodeImage(const uint32 Command, const unsigned ybn, MDECPixelBuffer *out)
+{
+   //printf("ENCODE, %d\n", (Command & 0x08000000) ? 256 : 384);
 
    switch((Command >> 27) & 0x3)
    {
       case 0:	// 4bpp
          {
             const uint8 us_xor = (Command & (1U << 26)) ? 0x00 : 0x88;
-            uint8* pix_out = PixelBuffer.pix8;
+            uint8* pix_out = out->pix8;
 
             for(int y = 0; y < 8; y++)
             {
@@ -347,7 +751,6 @@ static void EncodeImage(const unsigned ybn)
                   pix_out++;
                }
             }
-            PixelBufferCount32 = 8;
          }
          break;
 
@@ -355,7 +758,7 @@ static void EncodeImage(const unsigned ybn)
       case 1:	// 8bpp
          {
             const uint8 us_xor = (Command & (1U << 26)) ? 0x00 : 0x80;
-            uint8* pix_out = PixelBuffer.pix8;
+            uint8* pix_out = out->pix8;
 
             for(int y = 0; y < 8; y++)
             {
@@ -365,15 +768,58 @@ static void EncodeImage(const unsigned ybn)
                   pix_out++;
                }
             }
-            PixelBufferCount32 = 16;
          }
          break;
 
       case 2:	// 24bpp
          {
             const uint8 rgb_xor = (Command & (1U << 26)) ? 0x80 : 0x00;
-            uint8* pix_out = PixelBuffer.pix8;
+            uint8* pix_out = out->pix8;
 
+#if defined(__SSE2__)
+            for(int y = 0; y < 8; y += YCC_LINES)
+            {
+               const int8* cb = &block_cb[(y >> 1) | ((ybn & 2) << 1)][0];
+               const int8* cr = &block_cr[(y >> 1) | ((ybn & 2) << 1)][0];
+               uint8 rgb[3][8 * YCC_LINES] MDFN_ALIGN(16);
+#if defined(__AVX2__)
+               __m256i r, g, b;
+
+               YCbCr_to_RGB_Lines(&block_y[y][0], cb, cr, ybn & 1, r, g, b);
+               _mm_store_si128((__m128i*)rgb[0], _mm_packus_epi16(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1)));
+               _mm_store_si128((__m128i*)rgb[1], _mm_packus_epi16(_mm256_castsi256_si128(g), _mm256_extracti128_si256(g, 1)));
+               _mm_store_si128((__m128i*)rgb[2], _mm_packus_epi16(_mm256_castsi256_si128(b), _mm256_extracti128_si256(b, 1)));
+#else
+               __m128i r, g, b;
+
+               YCbCr_to_RGB_Lines(&block_y[y][0], cb, cr, ybn & 1, r, g, b);
+               _mm_storel_epi64((__m128i*)rgb[0], _mm_packus_epi16(r, r));
+               _mm_storel_epi64((__m128i*)rgb[1], _mm_packus_epi16(g, g));
+               _mm_storel_epi64((__m128i*)rgb[2], _mm_packus_epi16(b, b));
+#endif
+               for(int x = 0; x < 8 * YCC_LINES; x++)
+               {
+                  pix_out[0] = rgb[0][x] ^ rgb_xor;
+                  pix_out[1] = rgb[1][x] ^ rgb_xor;
+                  pix_out[2] = rgb[2][x] ^ rgb_xor;
+                  pix_out += 3;
+               }
+            }
+#elif defined(MDEC_NEON)
+            for(int y = 0; y < 8; y++)
+            {
+               const int8* cb = &block_cb[(y >> 1) | ((ybn & 2) << 1)][0];
+               const int8* cr = &block_cr[(y >> 1) | ((ybn & 2) << 1)][0];
+               uint8x8x3_t rgb;
+
+               YCbCr_to_RGB_Lines(&block_y[y][0], cb, cr, ybn & 1, rgb.val[0], rgb.val[1], rgb.val[2]);
+               rgb.val[0] = veor_u8(rgb.val[0], vdup_n_u8(rgb_xor));
+               rgb.val[1] = veor_u8(rgb.val[1], vdup_n_u8(rgb_xor));
+               rgb.val[2] = veor_u8(rgb.val[2], vdup_n_u8(rgb_xor));
+               vst3_u8(pix_out, rgb);
+               pix_out += 24;
+            }
+#else
             for(int y = 0; y < 8; y++)
             {
                const int8* by = &block_y[y][0];
@@ -392,15 +838,67 @@ static void EncodeImage(const unsigned ybn)
                   pix_out += 3;
                }
             }
-            PixelBufferCount32 = 48;
+#endif
          }
          break;
 
       case 3:	// 16bpp
          {
             uint16 pixel_xor = ((Command & 0x02000000) ? 0x8000 : 0x0000) | ((Command & (1U << 26)) ? 0x4210 : 0x0000);
-            uint16* pix_out = PixelBuffer.pix16;
+            uint16* pix_out = out->pix16;
 
+#if defined(__SSE2__)
+            for(int y = 0; y < 8; y += YCC_LINES)
+            {
+               const int8* cb = &block_cb[(y >> 1) | ((ybn & 2) << 1)][0];
+               const int8* cr = &block_cr[(y >> 1) | ((ybn & 2) << 1)][0];
+#if defined(__AVX2__)
+               const __m256i four = _mm256_set1_epi16(4);
+               const __m256i max = _mm256_set1_epi16(0x1F);
+               __m256i r, g, b;
+
+               // RGB_to_RGB555()
+               YCbCr_to_RGB_Lines(&block_y[y][0], cb, cr, ybn & 1, r, g, b);
+               r = _mm256_min_epi16(_mm256_srli_epi16(_mm256_add_epi16(r, four), 3), max);
+               g = _mm256_min_epi16(_mm256_srli_epi16(_mm256_add_epi16(g, four), 3), max);
+               b = _mm256_min_epi16(_mm256_srli_epi16(_mm256_add_epi16(b, four), 3), max);
+
+               _mm256_storeu_si256((__m256i*)pix_out, _mm256_xor_si256(_mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi16(g, 5)), _mm256_slli_epi16(b, 10)),
+                                                                     _mm256_set1_epi16(pixel_xor)));
+#else
+               const __m128i four = _mm_set1_epi16(4);
+               const __m128i max = _mm_set1_epi16(0x1F);
+               __m128i r, g, b;
+
+               // RGB_to_RGB555()
+               YCbCr_to_RGB_Lines(&block_y[y][0], cb, cr, ybn & 1, r, g, b);
+               r = _mm_min_epi16(_mm_srli_epi16(_mm_add_epi16(r, four), 3), max);
+               g = _mm_min_epi16(_mm_srli_epi16(_mm_add_epi16(g, four), 3), max);
+               b = _mm_min_epi16(_mm_srli_epi16(_mm_add_epi16(b, four), 3), max);
+
+               _mm_storeu_si128((__m128i*)pix_out, _mm_xor_si128(_mm_or_si128(_mm_or_si128(r, _mm_slli_epi16(g, 5)), _mm_slli_epi16(b, 10)),
+                                                               _mm_set1_epi16(pixel_xor)));
+#endif
+               pix_out += 8 * YCC_LINES;
+            }
+#elif defined(MDEC_NEON)
+            for(int y = 0; y < 8; y++)
+            {
+               const int8* cb = &block_cb[(y >> 1) | ((ybn & 2) << 1)][0];
+               const int8* cr = &block_cr[(y >> 1) | ((ybn & 2) << 1)][0];
+               uint8x8_t r8, g8, b8;
+               uint16x8_t r, g, b;
+
+               // RGB_to_RGB555()
+               YCbCr_to_RGB_Lines(&block_y[y][0], cb, cr, ybn & 1, r8, g8, b8);
+               r = vminq_u16(vshrq_n_u16(vaddl_u8(r8, vdup_n_u8(4)), 3), vdupq_n_u16(0x1F));
+               g = vminq_u16(vshrq_n_u16(vaddl_u8(g8, vdup_n_u8(4)), 3), vdupq_n_u16(0x1F));
+               b = vminq_u16(vshrq_n_u16(vaddl_u8(b8, vdup_n_u8(4)), 3), vdupq_n_u16(0x1F));
+
+               vst1q_u16(pix_out, veorq_u16(vorrq_u16(vorrq_u16(r, vshlq_n_u16(g, 5)), vshlq_n_u16(b, 10)), vdupq_n_u16(pixel_xor)));
+               pix_out += 8;
+            }
+#else
             for(int y = 0; y < 8; y++)
             {
                const int8* by = &block_y[y][0];
@@ -417,13 +915,247 @@ static void EncodeImage(const unsigned ybn)
                   pix_out++;
                }
             }
-            PixelBufferCount32 = 32;
+#endif
          }
          break;
 
    }
 }
 
+// IDCTs a finished block into block_cr, block_cb or block_y, the latter then
+// converted to pixels in "out".
+static void DecodeBlock(int16 *coeff, const uint32 command, const uint32 wb, MDECPixelBuffer *out)
+{
+   switch(wb)
+   {
+      case 0:
+         IDCT(coeff, &block_cr[0][0]);
+         break;
+      case 1:
+         IDCT(coeff, &block_cb[0][0]);
+         break;
+      case 2:
+      case 3:
+      case 4:
+      case 5:
+         IDCT(coeff, &block_y[0][0]);
+         break;
+   }
+
+   if(wb >= 2)
+      EncodeImage(command, (wb + 4) % 6, out);
+}
+
+// Takes and decodes the job at take_pos, if it's been queued and nobody's
+// decoding the one before it.  *mb_end is set if it was the last block of its
+// macroblock.
+static bool DecodeThreadRunJob(MDECDecodeThread *dt, bool *mb_end = NULL)
+{
+   const uint32 pos = DQ_LOAD_ACQUIRE(&dt->read_pos);
+
+   if(pos == DQ_LOAD_ACQUIRE(&dt->write_pos) || DQ_LOAD_ACQUIRE(&dt->take_pos) != pos)
+      return false;
+
+   if(!DQ_CAS(&dt->take_pos, pos, pos + 1))
+      return false;
+
+   MDECDecodeJob *j = &dt->queue[pos & (DECODE_QUEUE_SIZE - 1)];
+
+   DecodeBlock(j->Coeff, j->Command, j->WB, &j->Pixels);
+
+   if(mb_end)
+      *mb_end = MacroblockEnd(j->Command, j->WB);
+
+   DQ_STORE_RELEASE(&dt->read_pos, pos + 1);
+
+   return true;
+}
+
+static void DecodeThreadWake(MDECDecodeThread *dt, uint32 *sleeping, scond_t *cond)
+{
+   // Pairs with the one in the sleeping thread, so that either it sees the
+   // new position or this sees it sleeping.
+   DQ_FENCE_FULL();
+
+   if(DQ_LOAD_ACQUIRE(sleeping))
+   {
+      slock_lock(dt->lock);
+      scond_signal(cond);
+      slock_unlock(dt->lock);
+   }
+}
+
+static void DecodeThreadMain(void *arg)
+{
+   MDECDecodeThread *dt = (MDECDecodeThread*)arg;
+   unsigned spins = 0;
+   bool mb_end = true;
+
+   while(!DQ_LOAD_ACQUIRE(&dt->quit))
+   {
+      if(DecodeThreadRunJob(dt, &mb_end))
+      {
+         DecodeThreadWake(dt, &dt->emu_waiting, dt->done_cond);
+         spins = 0;
+      }
+      else if(!mb_end && ++spins < DECODE_THREAD_SPIN)
+         DQ_PAUSE();
+      else
+      {
+         slock_lock(dt->lock);
+         DQ_STORE_RELEASE(&dt->thread_sleeping, 1);
+         DQ_FENCE_FULL();
+
+         if(DQ_LOAD_ACQUIRE(&dt->write_pos) == DQ_LOAD_ACQUIRE(&dt->take_pos) && !DQ_LOAD_ACQUIRE(&dt->quit))
+            scond_wait(dt->work_cond, dt->lock);
+
+         DQ_STORE_RELEASE(&dt->thread_sleeping, 0);
+         slock_unlock(dt->lock);
+         spins = 0;
+         mb_end = false;
+      }
+   }
+}
+
+// Until job "pos" - 1 and everything before it is decoded, helping out.
+static void WaitDecodeThread(MDECDecodeThread *dt, uint32 pos)
+{
+   unsigned spins = 0;
+
+   while((int32)(pos - DQ_LOAD_ACQUIRE(&dt->read_pos)) > 0)
+   {
+      if(DecodeThreadRunJob(dt))
+         spins = 0;
+      else if(++spins < DECODE_WAIT_SPIN)
+         DQ_PAUSE();
+      else
+      {
+         // The decoding thread has the job, but isn't getting to finish it.
+         slock_lock(dt->lock);
+         DQ_STORE_RELEASE(&dt->emu_waiting, 1);
+         DQ_FENCE_FULL();
+
+         const uint32 read_pos = DQ_LOAD_ACQUIRE(&dt->read_pos);
+
+         if((int32)(pos - read_pos) > 0 && DQ_LOAD_ACQUIRE(&dt->take_pos) != read_pos)
+            scond_wait(dt->done_cond, dt->lock);
+
+         DQ_STORE_RELEASE(&dt->emu_waiting, 0);
+         slock_unlock(dt->lock);
+         spins = 0;
+      }
+   }
+
+   // Anything after it is left to the decoding thread, which might've gone
+   // to sleep waiting for this one.
+   if(DQ_LOAD_ACQUIRE(&dt->take_pos) != dt->write_pos)
+      DecodeThreadWake(dt, &dt->thread_sleeping, dt->work_cond);
+}
+
+static void QueueDecodeJob(MDECDecodeThread *dt)
+{
+   if((dt->write_pos - DQ_LOAD_ACQUIRE(&dt->read_pos)) >= DECODE_QUEUE_SIZE)
+      WaitDecodeThread(dt, dt->write_pos - DECODE_QUEUE_SIZE + 1);
+
+   MDECDecodeJob *j = &dt->queue[dt->write_pos & (DECODE_QUEUE_SIZE - 1)];
+
+   memcpy(j->Coeff, Coeff, sizeof(j->Coeff));
+   j->Command = Command;
+   j->WB = DecodeWB;
+
+   DQ_STORE_RELEASE(&dt->write_pos, dt->write_pos + 1);
+
+   // The thread is handed a macroblock at a time; if it gave up waiting for
+   // the rest of one, whatever's left gets decoded here as it's needed.
+   if(MacroblockStart(Command, DecodeWB))
+      DecodeThreadWake(dt, &dt->thread_sleeping, dt->work_cond);
+
+   if(DecodeWB >= 2)
+   {
+      dt->output_pending = true;
+      dt->output_pos = dt->write_pos;
+   }
+}
+
+// Copies the pixels of the last luma block queued to PixelBuffer, once decoded.
+static void TakeDecodeOutput(MDECDecodeThread *dt)
+{
+   WaitDecodeThread(dt, dt->output_pos);
+
+   memcpy(&PixelBuffer, &dt->queue[(dt->output_pos - 1) & (DECODE_QUEUE_SIZE - 1)].Pixels, sizeof(PixelBuffer));
+   dt->output_pending = false;
+}
+
+// Brings block_y/cb/cr and PixelBuffer up to date.
+static void SyncDecodeThread(void)
+{
+   MDECDecodeThread *dt = decode_thread;
+
+   if(!dt)
+      return;
+
+   WaitDecodeThread(dt, dt->write_pos);
+
+   if(dt->output_pending)
+      TakeDecodeOutput(dt);
+}
+
+void MDEC_SetDecodeThread(bool enable)
+{
+   MDECDecodeThread *dt = decode_thread;
+
+   if(enable == (dt != NULL))
+      return;
+
+   if(enable)
+   {
+      dt = new MDECDecodeThread;
+
+      dt->lock = slock_new();
+      dt->work_cond = scond_new();
+      dt->done_cond = scond_new();
+      dt->write_pos = 0;
+      dt->take_pos = 0;
+      dt->read_pos = 0;
+      dt->thread_sleeping = 0;
+      dt->emu_waiting = 0;
+      dt->quit = 0;
+      dt->output_pending = false;
+      dt->output_pos = 0;
+
+      decode_thread = dt;
+
+      dt->thread = sthread_create(DecodeThreadMain, dt);
+
+      if(!dt->thread)
+      {
+         log_cb(RETRO_LOG_WARN, "[MDEC] Couldn't start the decoding thread.\n");
+         MDEC_SetDecodeThread(false);
+      }
+   }
+   else
+   {
+      SyncDecodeThread();
+
+      if(dt->thread)
+      {
+         slock_lock(dt->lock);
+         DQ_STORE_RELEASE(&dt->quit, 1);
+         scond_signal(dt->work_cond);
+         slock_unlock(dt->lock);
+
+         sthread_join(dt->thread);
+      }
+
+      scond_free(dt->done_cond);
+      scond_free(dt->work_cond);
+      slock_free(dt->lock);
+      delete dt;
+
+      decode_thread = NULL;
+   }
+}
+
 static INLINE void WriteImageData(uint16 V, int32* eat_cycles)
 {
    const uint32 qmw = (bool)(DecodeWB < 2);
@@ -496,21 +1228,10 @@ static INLINE void WriteImageData(uint16 V, int32* eat_cycles)
 
       //printf("Block %d finished\n", DecodeWB);
 
-      switch(DecodeWB)
-      {
-         case 0:
-            IDCT(Coeff, &block_cr[0][0]);
-            break;
-         case 1:
-            IDCT(Coeff, &block_cb[0][0]);
-            break;
-         case 2:
-         case 3:
-         case 4:
-         case 5:
-            IDCT(Coeff, &block_y[0][0]);
-            break;
-      }   
+      if(decode_thread)
+         QueueDecodeJob(decode_thread);
+      else
+         DecodeBlock(Coeff, Command, DecodeWB, &PixelBuffer);
 
       // Timing in the actual PS1 MDEC is complex due to (apparent) pipelining, but the average when decoding a large number of blocks is
       // about 512.  We'll go with a lower value here to be conservative due to timing granularity and other timing deficiencies in Mednafen.  BUT, don't
@@ -519,7 +1240,11 @@ static INLINE void WriteImageData(uint16 V, int32* eat_cycles)
       *eat_cycles += 474;
 
       if(DecodeWB >= 2)
-         EncodeImage((DecodeWB + 4) % 6);
+      {
+         static const uint8 count32[4] = { 8, 16, 48, 32 };
+
+         PixelBufferCount32 = count32[(Command >> 27) & 0x3];
+      }
 
       DecodeWB++;
       if(DecodeWB == (((Command >> 27) & 2) ? 6 : 3))
@@ -598,6 +1323,9 @@ void MDEC_Run(int32 clocks)
 
                { ClockCounter -= (need_eat); { case 7: if(!(ClockCounter > 0)) { MDRPhase = 8 - MDRPhaseBias - 1; return; } }; };
 
+               if(decode_thread && decode_thread->output_pending)
+                  TakeDecodeOutput(decode_thread);
+
                PixelBufferReadOffset = 0;
                while(PixelBufferReadOffset != PixelBufferCount32)
                {
@@ -639,6 +1367,9 @@ void MDEC_Run(int32 clocks)
             IDCTMIndex = 0;
             InCounter = 0x20;
 
+            // Blocks still being decoded use the old matrix.
+            SyncDecodeThread();
+
             InCounter--;
             do
             {
@@ -649,7 +1380,7 @@ void MDEC_Run(int32 clocks)
 
                for(unsigned i = 0; i < 2; i++)
                {
-                  IDCTMatrix[((IDCTMIndex & 0x7) << 3) | ((IDCTMIndex >> 3) & 0x7)] = (int16)(tfr & 0xFFFF) >> 3;
+                  SetIDCTMatrix(IDCTMIndex & 0x7, (IDCTMIndex >> 3) & 0x7, (int16)(tfr & 0xFFFF) >> 3);
                   IDCTMIndex = (IDCTMIndex + 1) & 0x3F;
 
                   tfr >>= 16;
@@ -720,6 +1451,8 @@ void MDEC_Write(const int32_t timestamp, uint32 A, uint32 V)
    {
       if(V & 0x80000000) // Reset?
       {
+         SyncDecodeThread();
+
          MDRPhase = 0;
          InCounter = 0;
          Command = 0;
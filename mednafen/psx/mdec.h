@@ -16,4 +16,7 @@ void MDEC_Run(int32 clocks);
 
 int MDEC_StateAction(StateMem *sm, int load, int data_only);
 
+// Moves the IDCT and pixel conversion of decoded blocks to a thread of its own.
+void MDEC_SetDecodeThread(bool enable);
+
 #endif
@@ -8,6 +8,7 @@
 #include "../cdrom/cdromif.h"
 #include "../general.h"
 #include "../FileStream.h"
+#include "../rewind.h"
 
 // Comment out these 2 defines for extra speeeeed.
 #define PSX_DBGPRINT_ENABLE    1
@@ -99,5 +100,6 @@ extern PS_GPU *GPU;
 extern PS_CDC *CDC;
 extern PS_SPU *SPU;
 extern MultiAccessSizeMem<2048 * 1024, uint32_t, false> MainRAM;
+extern uint8 MainRAMDirty[(2048 * 1024) >> REWIND_PAGE_SHIFT];
 
 #endif
@@ -64,6 +64,11 @@
 /*
  Update() isn't called on Read and Writes for performance reasons, it's called with sufficient granularity from the event
  system, though this will obviously need to change if we ever emulate the SPU with better precision than per-sample(pair).
+
+ The samples the event system clocks aren't necessarily run right then, though; unless the IRQ is enabled, they're left
+ to pile up and then run a block at a time, so that the voice loop stays in the cache rather than having the rest of the
+ emulation run in between.  Everything that could tell the difference(SPU register and DMA access, the CDC changing the
+ CD audio fed in, the end of the frame, save states) runs the ones due first, so the output is exactly the same.
 */
 
 #include "psx.h"
@@ -71,6 +76,10 @@
 #include "spu.h"
 #include "../../libretro.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 uint32_t IntermediateBufferPos;
 int16_t IntermediateBuffer[4096][2];
 
@@ -80,16 +89,152 @@ static INLINE void SPUIRQ_DBG(const char *fmt, ...)
 {
 }
 
+enum
+{
+   SPU_BLOCK_SAMPLES = 64	// Most samples to put off running.
+};
+
 static const int16 FIR_Table[256][4] =
 {
 #include "spu_fir_table.inc"
 };
 
+// What's needed to work out the output of the voices for a sample, laid out voice by
+// voice so that it can be done for several voices at once.
+struct SPU_MixInput
+{
+   int16 fir_in[24][4];		// Decoded samples to interpolate,
+   int16 fir_coef[24][4];	// and their FIR_Table[] weights.
+   int16 params[24][4];		// MIX_* below.
+};
+
+enum
+{
+   MIX_ENV = 0,
+   MIX_VOL_L,
+   MIX_VOL_R,
+   MIX_RVB_MASK			// ~0 if reverb is on for the voice.
+};
+
+// Interpolated and enveloped output of a voice.
+static INLINE int32 MixVoice(const SPU_MixInput &mix, unsigned v)
+{
+   const int16 *in = mix.fir_in[v];
+   const int16 *coef = mix.fir_coef[v];
+   const int32 pvs = ((in[0] * coef[0]) + (in[1] * coef[1]) + (in[2] * coef[2]) + (in[3] * coef[3])) >> 15;
+
+   return (pvs * mix.params[v][MIX_ENV]) >> 15;
+}
+
+// Output of all the voices, before L/R volume, to pvs[], and their sum after L/R volume
+// added to accum[], and to accum_fv[] for those with reverb on.
+static void MixVoices(const SPU_MixInput &mix, int32 *pvs, int32 *accum, int32 *accum_fv)
+{
+   for(unsigned v = 0; v < 24; v++)
+   {
+      pvs[v] = MixVoice(mix, v);
+
+      for(unsigned lr = 0; lr < 2; lr++)
+      {
+         const int32 s = (pvs[v] * mix.params[v][MIX_VOL_L + lr]) >> 15;
+
+         accum[lr] += s;
+         accum_fv[lr] += s & mix.params[v][MIX_RVB_MASK];
+      }
+   }
+}
+
+#if defined(__SSE2__)
+//
+// MixVoices() for 8 voices at a time.  The FIR_Table[] rows' weights add up to less than
+// 0x8000, so the interpolated samples fit in 16 bits, and all the rest does too, save for
+// an envelope level of -32768 (only ever written by the game) times a noise sample of
+// -32768; MixVoices() is used for those.
+//
+
+// SPU_MixInput is filled in just before it's used, voice by voice, so it's loaded the same
+// size it was stored, for the loads to be forwarded from the stores instead of waiting for
+// them.
+static INLINE __m128i Load2x64_SSE2(const int16 *a, const int16 *b)
+{
+   return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)a), _mm_loadl_epi64((const __m128i *)b));
+}
+
+// 4 voices' 4-tap interpolation, in 32-bit lanes.
+static INLINE __m128i FIR4_SSE2(const SPU_MixInput &mix, unsigned v)
+{
+   // Two voices each, their first and last two products summed.
+   const __m128i fir01 = _mm_madd_epi16(Load2x64_SSE2(mix.fir_in[v + 0], mix.fir_in[v + 1]), Load2x64_SSE2(mix.fir_coef[v + 0], mix.fir_coef[v + 1]));
+   const __m128i fir23 = _mm_madd_epi16(Load2x64_SSE2(mix.fir_in[v + 2], mix.fir_in[v + 3]), Load2x64_SSE2(mix.fir_coef[v + 2], mix.fir_coef[v + 3]));
+   const __m128i fir_lo = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(fir01), _mm_castsi128_ps(fir23), _MM_SHUFFLE(2, 0, 2, 0)));
+   const __m128i fir_hi = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(fir01), _mm_castsi128_ps(fir23), _MM_SHUFFLE(3, 1, 3, 1)));
+
+   return _mm_srai_epi32(_mm_add_epi32(fir_lo, fir_hi), 15);
+}
+
+// (a * b) >> 15, for results that fit in 16 bits.
+static INLINE __m128i MulShift15_SSE2(__m128i a, __m128i b)
+{
+   return _mm_or_si128(_mm_slli_epi16(_mm_mulhi_epi16(a, b), 1), _mm_srli_epi16(_mm_mullo_epi16(a, b), 15));
+}
+
+static void MixVoices_SSE2(const SPU_MixInput &mix, int32 *pvs, int32 *accum, int32 *accum_fv)
+{
+   const __m128i ones = _mm_set1_epi16(1);
+   __m128i sum[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+   __m128i sum_fv[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+
+   for(unsigned v = 0; v < 24; v += 8)
+   {
+      // params[] of 8 voices, each of them for all 8.
+      const __m128i p01 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)mix.params[v + 0]), _mm_loadl_epi64((const __m128i *)mix.params[v + 1]));
+      const __m128i p23 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)mix.params[v + 2]), _mm_loadl_epi64((const __m128i *)mix.params[v + 3]));
+      const __m128i p45 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)mix.params[v + 4]), _mm_loadl_epi64((const __m128i *)mix.params[v + 5]));
+      const __m128i p67 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)mix.params[v + 6]), _mm_loadl_epi64((const __m128i *)mix.params[v + 7]));
+      const __m128i el03 = _mm_unpacklo_epi32(p01, p23);
+      const __m128i rm03 = _mm_unpackhi_epi32(p01, p23);
+      const __m128i el47 = _mm_unpacklo_epi32(p45, p67);
+      const __m128i rm47 = _mm_unpackhi_epi32(p45, p67);
+      const __m128i env = _mm_unpacklo_epi64(el03, el47);
+      const __m128i vol[2] = { _mm_unpackhi_epi64(el03, el47), _mm_unpacklo_epi64(rm03, rm47) };
+      const __m128i rvb_mask = _mm_unpackhi_epi64(rm03, rm47);
+
+      const __m128i fir = _mm_packs_epi32(FIR4_SSE2(mix, v), FIR4_SSE2(mix, v + 4));
+      const __m128i out = MulShift15_SSE2(fir, env);
+      const __m128i sign = _mm_srai_epi16(out, 15);
+
+      _mm_storeu_si128((__m128i *)&pvs[v + 0], _mm_unpacklo_epi16(out, sign));
+      _mm_storeu_si128((__m128i *)&pvs[v + 4], _mm_unpackhi_epi16(out, sign));
+
+      for(unsigned lr = 0; lr < 2; lr++)
+      {
+         const __m128i s = MulShift15_SSE2(out, vol[lr]);
+
+         sum[lr] = _mm_add_epi32(sum[lr], _mm_madd_epi16(s, ones));
+         sum_fv[lr] = _mm_add_epi32(sum_fv[lr], _mm_madd_epi16(_mm_and_si128(s, rvb_mask), ones));
+      }
+   }
+
+   for(unsigned lr = 0; lr < 2; lr++)
+   {
+      int32 tmp[4], tmp_fv[4];
+
+      _mm_storeu_si128((__m128i *)tmp, sum[lr]);
+      _mm_storeu_si128((__m128i *)tmp_fv, sum_fv[lr]);
+
+      accum[lr] += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+      accum_fv[lr] += tmp_fv[0] + tmp_fv[1] + tmp_fv[2] + tmp_fv[3];
+   }
+}
+#endif
+
 PS_SPU::PS_SPU()
 {
    IntermediateBufferPos = 0;
    memset(IntermediateBuffer, 0, sizeof(IntermediateBuffer));
 
+   DeferredSamples = 0;
+   BlockRender = true;
 }
 
 PS_SPU::~PS_SPU()
@@ -99,6 +244,7 @@ PS_SPU::~PS_SPU()
 void PS_SPU::Power(void)
 {
    clock_divider = 768;
+   DeferredSamples = 0;
 
    memset(SPURAM, 0, sizeof(SPURAM));
 
@@ -239,58 +385,61 @@ INLINE int16 SPU_Sweep::ReadVolume(void)
    return((int16)Current);
 }
 
-void SPU_Sweep::Clock(void)
+// The rest of Clock(), with the sweep enabled.
+void SPU_Sweep::ClockSweep(void)
 {
-   if(!(Control & 0x8000))
+   const bool log_mode = (bool)(Control & 0x4000);
+   const bool dec_mode = (bool)(Control & 0x2000);
+   const bool inv_mode = (bool)(Control & 0x1000);
+   const bool inv_increment = (dec_mode ^ inv_mode) | (dec_mode & log_mode);
+   const uint16 vc_cv_xor = (inv_mode & !(dec_mode & log_mode)) ? 0xFFFF : 0x0000;
+   const uint16 TestInvert = inv_mode ? 0xFFFF : 0x0000;
+   int increment;
+   int divinco;
+
+   CalcVCDelta(0x7F, Control & 0x7F, log_mode, dec_mode, inv_increment, (int16)(Current ^ vc_cv_xor), increment, divinco);
+   //printf("%d %d\n", divinco, increment);
+
+   if((dec_mode & !(inv_mode & log_mode)) && ((Current & 0x8000) == (inv_mode ? 0x0000 : 0x8000) || (Current == 0)))
    {
-      Current = (Control & 0x7FFF) << 1;
-      return;
+      //
+      // Not sure if this condition should stop the Divider adding or force the increment value to 0.
+      //
+      Current = 0;
    }
-
-   if(Control & 0x8000) 	// Sweep enabled
+   else
    {
-      const bool log_mode = (bool)(Control & 0x4000);
-      const bool dec_mode = (bool)(Control & 0x2000);
-      const bool inv_mode = (bool)(Control & 0x1000);
-      const bool inv_increment = (dec_mode ^ inv_mode) | (dec_mode & log_mode);
-      const uint16 vc_cv_xor = (inv_mode & !(dec_mode & log_mode)) ? 0xFFFF : 0x0000;
-      const uint16 TestInvert = inv_mode ? 0xFFFF : 0x0000;
-      int increment;
-      int divinco;
-
-      CalcVCDelta(0x7F, Control & 0x7F, log_mode, dec_mode, inv_increment, (int16)(Current ^ vc_cv_xor), increment, divinco);
-      //printf("%d %d\n", divinco, increment);
-
-      if((dec_mode & !(inv_mode & log_mode)) && ((Current & 0x8000) == (inv_mode ? 0x0000 : 0x8000) || (Current == 0)))
-      {
-         //
-         // Not sure if this condition should stop the Divider adding or force the increment value to 0.
-         //
-         Current = 0;
-      }
-      else
+      Divider += divinco;
+
+      if(Divider & 0x8000)
       {
-         Divider += divinco;
+         Divider = 0;
 
-         if(Divider & 0x8000)
+         if(dec_mode || ((Current ^ TestInvert) != 0x7FFF))
          {
-            Divider = 0;
+            uint16 PrevCurrent = Current;
+            Current = Current + increment;
 
-            if(dec_mode || ((Current ^ TestInvert) != 0x7FFF))
-            {
-               uint16 PrevCurrent = Current;
-               Current = Current + increment;
+            //printf("%04x %04x\n", PrevCurrent, Current);
 
-               //printf("%04x %04x\n", PrevCurrent, Current);
-
-               if(!dec_mode && ((Current ^ PrevCurrent) & 0x8000) && ((Current ^ TestInvert) & 0x8000))
-                  Current = 0x7FFF ^ TestInvert;
-            }
+            if(!dec_mode && ((Current ^ PrevCurrent) & 0x8000) && ((Current ^ TestInvert) & 0x8000))
+               Current = 0x7FFF ^ TestInvert;
          }
       }
    }
 }
 
+INLINE void SPU_Sweep::Clock(void)
+{
+   if(!(Control & 0x8000))
+   {
+      Current = (Control & 0x7FFF) << 1;
+      return;
+   }
+
+   ClockSweep();
+}
+
 INLINE void SPU_Sweep::WriteVolume(int16 value)
 {
    Current = value;
@@ -561,6 +710,7 @@ INLINE void PS_SPU::WriteSPURAM(uint32 addr, uint16 value)
    CheckIRQAddr(addr);
 
    SPURAM[addr] = value;
+   SPURAMDirty[(addr << 1) >> REWIND_PAGE_SHIFT] = 1;
 }
 
 INLINE uint16 PS_SPU::ReadSPURAM(uint32 addr)
@@ -645,6 +795,56 @@ static INLINE int32 Reverb2244(const int16 *src)
    return out;
 }
 
+#if defined(__SSE2__)
+// ResampTable[] spread out over the samples Reverb4422() takes every other one of, with the middle
+// one in between.
+static const int16 ResampTable4422[40] =
+{
+ -1, 0, 2, 0, -10, 0, 35, 0, -103, 0, 266, 0, -616, 0, 1332, 0, -2960, 0, 10246, 0x4000,
+ 10246, 0, -2960, 0, 1332, 0, -616, 0, 266, 0, -103, 0, 35, 0, -10, 0, 2, 0, -1, 0
+};
+
+// And padded out to a multiple of 8 for Reverb2244().
+static const int16 ResampTable2244[24] =
+{
+ -1, 2, -10, 35, -103, 266, -616, 1332, -2960, 10246, 10246, -2960, 1332, -616, 266, -103, 35, -10, 2, -1,
+ 0, 0, 0, 0
+};
+
+static INLINE int32 ResampDot_SSE2(const int16 *src, const int16 *table, unsigned count)
+{
+   __m128i sum = _mm_setzero_si128();
+
+   for(unsigned i = 0; i < count; i += 8)
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)&src[i]), _mm_loadu_si128((const __m128i *)&table[i])));
+
+   sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+   sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+   return _mm_cvtsi128_si32(sum);
+}
+
+// Same as Reverb4422() and Reverb2244(); they read a few samples past the end of the ones used, which
+// RDSB[] and RUSB[] have room for.
+static INLINE int32 Reverb4422_SSE2(const int16 *src)
+{
+   int32 out = ResampDot_SSE2(src, ResampTable4422, 40) >> 15;
+
+   clamp(&out, -32768, 32767);
+
+   return(out);
+}
+
+static INLINE int32 Reverb2244_SSE2(const int16 *src)
+{
+   int32 out = ResampDot_SSE2(src, ResampTable2244, 24) >> 14;
+
+   clamp(&out, -32768, 32767);
+
+   return(out);
+}
+#endif
+
 static int32 IIASM(const int16 IIR_ALPHA, const int16 insamp)
 {
    if(MDFN_UNLIKELY(IIR_ALPHA == -32768))
@@ -750,6 +950,271 @@ void PS_SPU::RunReverb(const int32* in, int32* out)
 }
 
 
+//
+// What RunReverb() reads and writes of the reverb work area, as offsets from ReverbCur.
+//
+enum
+{
+   RVB_IIR_SRC_A0 = 0,
+   RVB_IIR_SRC_A1,
+   RVB_IIR_SRC_B0,
+   RVB_IIR_SRC_B1,
+
+   RVB_IIR_PREV_A0,	// IIR_DEST_xx - 1
+   RVB_IIR_PREV_A1,
+   RVB_IIR_PREV_B0,
+   RVB_IIR_PREV_B1,
+
+   RVB_IIR_DEST_A0,
+   RVB_IIR_DEST_A1,
+   RVB_IIR_DEST_B0,
+   RVB_IIR_DEST_B1,
+
+   RVB_ACC_SRC_A0,
+   RVB_ACC_SRC_A1,
+   RVB_ACC_SRC_B0,
+   RVB_ACC_SRC_B1,
+   RVB_ACC_SRC_C0,
+   RVB_ACC_SRC_C1,
+   RVB_ACC_SRC_D0,
+   RVB_ACC_SRC_D1,
+
+   RVB_FB_A0,		// MIX_DEST_xx - FB_SRC_x
+   RVB_FB_A1,
+   RVB_FB_B0,
+   RVB_FB_B1,
+
+   RVB_MIX_DEST_A0,
+   RVB_MIX_DEST_A1,
+   RVB_MIX_DEST_B0,
+   RVB_MIX_DEST_B1,
+
+   RVB_TAP_COUNT
+};
+
+static INLINE uint32 ReverbTapOffset(uint16 raw_offs, int32 extra_offs = 0)
+{
+   return ((raw_offs << 2) + extra_offs) & 0x3FFFF;
+}
+
+void PS_SPU::GetReverbTapOffsets(uint32 *offs)
+{
+   const uint16 iir_src[4] = { IIR_SRC_A0, IIR_SRC_A1, IIR_SRC_B0, IIR_SRC_B1 };
+   const uint16 iir_dest[4] = { IIR_DEST_A0, IIR_DEST_A1, IIR_DEST_B0, IIR_DEST_B1 };
+   const uint16 acc_src[8] = { ACC_SRC_A0, ACC_SRC_A1, ACC_SRC_B0, ACC_SRC_B1, ACC_SRC_C0, ACC_SRC_C1, ACC_SRC_D0, ACC_SRC_D1 };
+   const uint16 mix_dest[4] = { MIX_DEST_A0, MIX_DEST_A1, MIX_DEST_B0, MIX_DEST_B1 };
+   const uint16 fb_src[4] = { FB_SRC_A, FB_SRC_A, FB_SRC_B, FB_SRC_B };
+
+   for(unsigned i = 0; i < 4; i++)
+   {
+      offs[RVB_IIR_SRC_A0 + i] = ReverbTapOffset(iir_src[i]);
+      offs[RVB_IIR_PREV_A0 + i] = ReverbTapOffset(iir_dest[i], -1);
+      offs[RVB_IIR_DEST_A0 + i] = ReverbTapOffset(iir_dest[i]);
+      offs[RVB_FB_A0 + i] = ReverbTapOffset(mix_dest[i] - fb_src[i]);
+      offs[RVB_MIX_DEST_A0 + i] = ReverbTapOffset(mix_dest[i]);
+   }
+
+   for(unsigned i = 0; i < 8; i++)
+      offs[RVB_ACC_SRC_A0 + i] = ReverbTapOffset(acc_src[i]);
+}
+
+//
+// Whether the voices can be run for the next "count" samples before the reverb is for any of them, with the
+// same result as running it all sample by sample.  That's so as long as none of what the reverb reads and
+// writes in the meantime(a run of consecutive addresses for each offset) is where CD audio and voices 1 and 3
+// are written to SPU RAM, and none of what it writes is anything the voices could read(a voice reads at most
+// 2 words per sample; from where it is, where it loops to, or where it starts from if it's being keyed on).
+//
+bool PS_SPU::CanRunReverbAfter(unsigned count)
+{
+   const uint32 steps = (count + (RvbResPos & 1)) >> 1;
+   const uint32 voice_span = count * 2;
+   uint32 offs[RVB_TAP_COUNT];
+   uint32 voice_addrs[24 * 3];
+   unsigned voice_addr_count = 0;
+
+   if(SPUControl & 0x40)
+      return false;
+
+   if(ReverbCur + steps > 0x40000)
+      return false;
+
+   if(SPUControl & 0x80)
+   {
+      for(unsigned i = 0; i < 24; i++)
+      {
+         voice_addrs[voice_addr_count++] = Voices[i].CurAddr;
+         voice_addrs[voice_addr_count++] = Voices[i].LoopAddr & ~0x7;
+
+         if(VoiceOn & (1U << i))
+            voice_addrs[voice_addr_count++] = Voices[i].StartAddr & ~0x7;
+      }
+
+      for(unsigned i = 0; i < voice_addr_count; i++)
+      {
+         if(voice_addrs[i] + voice_span > 0x40000)
+            return false;
+      }
+   }
+
+   GetReverbTapOffsets(offs);
+
+   for(unsigned t = 0; t < RVB_TAP_COUNT; t++)
+   {
+      const uint32 addr = Get_Reverb_Offset(offs[t]);
+
+      if(addr < 0x800 || addr + steps > 0x40000)
+         return false;
+
+      if((t >= RVB_IIR_DEST_A0 && t <= RVB_IIR_DEST_B1) || t >= RVB_MIX_DEST_A0)
+      {
+         for(unsigned i = 0; i < voice_addr_count; i++)
+         {
+            if(addr < voice_addrs[i] + voice_span && voice_addrs[i] < addr + steps)
+               return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+INLINE void PS_SPU::WriteReverbRAM(uint32 addr, uint16 value)
+{
+   SPURAM[addr] = value;
+   SPURAMDirty[(addr << 1) >> REWIND_PAGE_SHIFT] = 1;
+}
+
+//
+// RunReverb() for a block of samples, the IRQ not being enabled.  Rather than working out each address in the work
+// area on its own, it does so once per run of steps in which none of them wraps around(from where ReverbCur is, the
+// same as the one before plus one, up to the end of SPU RAM), and the resampling is done with SIMD where there is.
+//
+void PS_SPU::RunReverbBlock(const int32 (*in)[2], int32 (*out)[2], unsigned count)
+{
+   uint32 offs[RVB_TAP_COUNT];
+   uint32 taps[RVB_TAP_COUNT];
+   uint32 run = 0;	// Steps left until a tap address wraps around, from taps[] + step.
+   uint32 step = 0;
+
+   GetReverbTapOffsets(offs);
+
+   for(unsigned i = 0; i < count; i++)
+   {
+      int32 upsampled[2];
+
+      for(unsigned lr = 0; lr < 2; lr++)
+      {
+         RDSB[lr][RvbResPos | 0x00] = in[i][lr];
+         RDSB[lr][RvbResPos | 0x40] = in[i][lr];
+      }
+
+      if(RvbResPos & 1)
+      {
+         int32 downsampled[2];
+
+         for(unsigned lr = 0; lr < 2; lr++)
+         {
+#if defined(__SSE2__)
+            downsampled[lr] = Reverb4422_SSE2(&RDSB[lr][(RvbResPos - 39) & 0x3F]);
+#else
+            downsampled[lr] = Reverb4422(&RDSB[lr][(RvbResPos - 39) & 0x3F]);
+#endif
+         }
+
+         if(!run)
+         {
+            run = 0x40000 - ReverbCur;
+
+            for(unsigned t = 0; t < RVB_TAP_COUNT; t++)
+            {
+               taps[t] = Get_Reverb_Offset(offs[t]);
+               run = std::min<uint32>(run, 0x40000 - taps[t]);
+            }
+
+            step = 0;
+         }
+
+#define RVB(t) ((int16)SPURAM[taps[RVB_##t] + step])
+#define WR_RVB_TAP(t, sample) WriteReverbRAM(taps[RVB_##t] + step, (sample))
+
+         if(SPUControl & 0x80)
+         {
+            int16 ACC0, ACC1;
+            int16 FB_A0, FB_A1, FB_B0, FB_B1;
+
+            int16 IIR_INPUT_A0 = ReverbSat(((RVB(IIR_SRC_A0) * IIR_COEF) >> 15) + ((downsampled[0] * IN_COEF_L) >> 15));
+            int16 IIR_INPUT_A1 = ReverbSat(((RVB(IIR_SRC_A1) * IIR_COEF) >> 15) + ((downsampled[1] * IN_COEF_R) >> 15));
+            int16 IIR_INPUT_B0 = ReverbSat(((RVB(IIR_SRC_B0) * IIR_COEF) >> 15) + ((downsampled[0] * IN_COEF_L) >> 15));
+            int16 IIR_INPUT_B1 = ReverbSat(((RVB(IIR_SRC_B1) * IIR_COEF) >> 15) + ((downsampled[1] * IN_COEF_R) >> 15));
+
+            int16 IIR_A0 = ReverbSat((((IIR_INPUT_A0 * IIR_ALPHA) >> 14) + (IIASM(IIR_ALPHA, RVB(IIR_PREV_A0)) >> 14)) >> 1);
+            int16 IIR_A1 = ReverbSat((((IIR_INPUT_A1 * IIR_ALPHA) >> 14) + (IIASM(IIR_ALPHA, RVB(IIR_PREV_A1)) >> 14)) >> 1);
+            int16 IIR_B0 = ReverbSat((((IIR_INPUT_B0 * IIR_ALPHA) >> 14) + (IIASM(IIR_ALPHA, RVB(IIR_PREV_B0)) >> 14)) >> 1);
+            int16 IIR_B1 = ReverbSat((((IIR_INPUT_B1 * IIR_ALPHA) >> 14) + (IIASM(IIR_ALPHA, RVB(IIR_PREV_B1)) >> 14)) >> 1);
+
+            WR_RVB_TAP(IIR_DEST_A0, IIR_A0);
+            WR_RVB_TAP(IIR_DEST_A1, IIR_A1);
+            WR_RVB_TAP(IIR_DEST_B0, IIR_B0);
+            WR_RVB_TAP(IIR_DEST_B1, IIR_B1);
+
+            ACC0 = ReverbSat((((RVB(ACC_SRC_A0) * ACC_COEF_A) >> 14) +
+                     ((RVB(ACC_SRC_B0) * ACC_COEF_B) >> 14) +
+                     ((RVB(ACC_SRC_C0) * ACC_COEF_C) >> 14) +
+                     ((RVB(ACC_SRC_D0) * ACC_COEF_D) >> 14)) >> 1);
+
+            ACC1 = ReverbSat((((RVB(ACC_SRC_A1) * ACC_COEF_A) >> 14) +
+                     ((RVB(ACC_SRC_B1) * ACC_COEF_B) >> 14) +
+                     ((RVB(ACC_SRC_C1) * ACC_COEF_C) >> 14) +
+                     ((RVB(ACC_SRC_D1) * ACC_COEF_D) >> 14)) >> 1);
+
+            FB_A0 = RVB(FB_A0);
+            FB_A1 = RVB(FB_A1);
+            FB_B0 = RVB(FB_B0);
+            FB_B1 = RVB(FB_B1);
+
+            WR_RVB_TAP(MIX_DEST_A0, ReverbSat(ACC0 - ((FB_A0 * FB_ALPHA) >> 15)));
+            WR_RVB_TAP(MIX_DEST_A1, ReverbSat(ACC1 - ((FB_A1 * FB_ALPHA) >> 15)));
+
+            WR_RVB_TAP(MIX_DEST_B0, ReverbSat(((FB_ALPHA * ACC0) >> 15) - ((FB_A0 * (int16)(0x8000 ^ FB_ALPHA)) >> 15) - ((FB_B0 * FB_X) >> 15)));
+            WR_RVB_TAP(MIX_DEST_B1, ReverbSat(((FB_ALPHA * ACC1) >> 15) - ((FB_A1 * (int16)(0x8000 ^ FB_ALPHA)) >> 15) - ((FB_B1 * FB_X) >> 15)));
+         }
+
+         RUSB[0][(RvbResPos >> 1) | 0x20] = RUSB[0][RvbResPos >> 1] = (RVB(MIX_DEST_A0) + RVB(MIX_DEST_B0)) >> 1;
+         RUSB[1][(RvbResPos >> 1) | 0x20] = RUSB[1][RvbResPos >> 1] = (RVB(MIX_DEST_A1) + RVB(MIX_DEST_B1)) >> 1;
+
+#undef WR_RVB_TAP
+#undef RVB
+
+         step++;
+         run--;
+
+         ReverbCur = (ReverbCur + 1) & 0x3FFFF;
+         if(!ReverbCur)
+            ReverbCur = ReverbWA;
+
+         for(unsigned lr = 0; lr < 2; lr++)
+            upsampled[lr] = RUSB[lr][(((RvbResPos - 39) & 0x3F) >> 1) + 9];
+      }
+      else
+      {
+         for(unsigned lr = 0; lr < 2; lr++)
+         {
+#if defined(__SSE2__)
+            upsampled[lr] = Reverb2244_SSE2(&RUSB[lr][((RvbResPos - 39) & 0x3F) >> 1]);
+#else
+            upsampled[lr] = Reverb2244(&RUSB[lr][((RvbResPos - 39) & 0x3F) >> 1]);
+#endif
+         }
+      }
+
+      RvbResPos = (RvbResPos + 1) & 0x3F;
+
+      for(unsigned lr = 0; lr < 2; lr++)
+         out[i][lr] = upsampled[lr];
+   }
+}
+
 INLINE void PS_SPU::RunNoise(void)
 {
    const unsigned rf = ((SPUControl >> 8) & 0x3F);
@@ -778,281 +1243,365 @@ INLINE void PS_SPU::RunNoise(void)
    }
 }
 
-int32 PS_SPU::UpdateFromCDC(int32 clocks)
+// Runs the voices and CD audio for a sample; "accum" gets the sound output and "accum_fv" the
+// reverb input(xxx[0] = left, xxx[1] = right).
+INLINE void PS_SPU::MixSample(int32 *accum, int32 *accum_fv)
 {
-   //int32 clocks = timestamp - lastts;
-   int32 sample_clocks = 0;
-   //lastts = timestamp;
-
-   clock_divider -= clocks;
-
-   while(clock_divider <= 0)
-   {
-      clock_divider += 768;
-      sample_clocks++;
-   }
-
-   while(sample_clocks > 0)
+   accum[0] = accum[1] = 0;
+   accum_fv[0] = accum_fv[1] = 0;
+
+   const uint32 PhaseModCache = FM_Mode & ~ 1;
+   /*
+    **
+    ** 0x1F801DAE Notes and Conjecture:
+    **   -------------------------------------------------------------------------------------
+    **   |   15   14 | 13 | 12 | 11 | 10  | 9  | 8 |  7 |  6  | 5    4    3    2    1    0   |
+    **   |      ?    | *13| ?  | ba | *10 | wrr|rdr| df |  is |      c                       |
+    **   -------------------------------------------------------------------------------------
+    **
+    **	c - Appears to be delayed copy of lower 6 bits from 0x1F801DAA.
+    **
+    **     is - Interrupt asserted out status. (apparently not instantaneous status though...)
+    **
+    **     df - Related to (c & 0x30) == 0x20 or (c & 0x30) == 0x30, at least.
+    **          0 = DMA busy(FIFO not empty when in DMA write mode?)?
+    **	    1 = DMA ready?  Something to do with the FIFO?
+    **
+    **     rdr - Read(DMA read?) Ready?
+    **
+    **     wrr - Write(DMA write?) Ready?
+    **
+    **     *10 - Unknown.  Some sort of (FIFO?) busy status?(BIOS tests for this bit in places)
+    **
+    **     ba - Alternates between 0 and 1, even when SPUControl bit15 is 0; might be related to CD audio and voice 1 and 3 writing to SPU RAM.
+    **
+    **     *13 - Unknown, was set to 1 when testing with an SPU delay system reg value of 0x200921E1(test result might not be reliable, re-run).
+    */
+   SPUStatus = SPUControl & 0x3F;
+   SPUStatus |= IRQAsserted ? 0x40 : 0x00;
+
+   if(Regs[0xD6] == 0x4)	// TODO: Investigate more(case 0x2C in global regs r/w handler)
+      SPUStatus |= (CWA & 0x100) ? 0x800 : 0x000;
+
+   //
+   // The voices' output is worked out for all of them at once, between running their
+   // decoders and clocking the rest of their state.  Nothing a voice does in between
+   // depends on the voices after it, save for voice 1 and 3's output being written to
+   // SPU RAM before the decoders of the voices after them run; that is done as before.
+   //
+   SPU_MixInput mix;
+   int32 voice_pvs[24];
+   bool active = false;
+   bool wide = false;
+
+   for(int voice_num = 0; voice_num < 24; voice_num++)
    {
-      // xxx[0] = left, xxx[1] = right
-
-      // Accumulated sound output.
-      int32 accum[2] = { 0, 0 };
-
-      // Accumulated sound output for reverb input
-      int32 accum_fv[2] = { 0, 0 };
-
-      // Output of reverb processing.
-      int32 reverb[2] = { 0, 0 };
-
-      // Final output.
-      int32 output[2] = { 0, 0 };
-
-      const uint32 PhaseModCache = FM_Mode & ~ 1;
-      /*
-       **
-       ** 0x1F801DAE Notes and Conjecture:
-       **   -------------------------------------------------------------------------------------
-       **   |   15   14 | 13 | 12 | 11 | 10  | 9  | 8 |  7 |  6  | 5    4    3    2    1    0   |
-       **   |      ?    | *13| ?  | ba | *10 | wrr|rdr| df |  is |      c                       |
-       **   -------------------------------------------------------------------------------------
-       **
-       **	c - Appears to be delayed copy of lower 6 bits from 0x1F801DAA.
-       **
-       **     is - Interrupt asserted out status. (apparently not instantaneous status though...)
-       **
-       **     df - Related to (c & 0x30) == 0x20 or (c & 0x30) == 0x30, at least.
-       **          0 = DMA busy(FIFO not empty when in DMA write mode?)?
-       **	    1 = DMA ready?  Something to do with the FIFO?
-       **
-       **     rdr - Read(DMA read?) Ready?
-       **
-       **     wrr - Write(DMA write?) Ready?
-       **
-       **     *10 - Unknown.  Some sort of (FIFO?) busy status?(BIOS tests for this bit in places)
-       **
-       **     ba - Alternates between 0 and 1, even when SPUControl bit15 is 0; might be related to CD audio and voice 1 and 3 writing to SPU RAM.
-       **
-       **     *13 - Unknown, was set to 1 when testing with an SPU delay system reg value of 0x200921E1(test result might not be reliable, re-run).
-       */
-      SPUStatus = SPUControl & 0x3F;
-      SPUStatus |= IRQAsserted ? 0x40 : 0x00;
-
-      if(Regs[0xD6] == 0x4)	// TODO: Investigate more(case 0x2C in global regs r/w handler)
-         SPUStatus |= (CWA & 0x100) ? 0x800 : 0x000;
-
-      for(int voice_num = 0; voice_num < 24; voice_num++)
-      {
-         SPU_Voice *voice = &Voices[voice_num];
-         int32 voice_pvs;
-
-         voice->PreLRSample = 0;
+      SPU_Voice *voice = &Voices[voice_num];
+      int16 fir_in[4] = { 0, 0, 0, 0 };
+      int16 fir_coef[4] = { 0, 0, 0, 0 };
+      int16 params[4];
 
-         //PSX_WARNING("[SPU] Voice %d CurPhase=%08x, pitch=%04x, CurAddr=%08x", voice_num, voice->CurPhase, voice->Pitch, voice->CurAddr);
+      //PSX_WARNING("[SPU] Voice %d CurPhase=%08x, pitch=%04x, CurAddr=%08x", voice_num, voice->CurPhase, voice->Pitch, voice->CurAddr);
 
-         //
-         // Decode new samples if necessary.
-         //
+      //
+      // Decode new samples if necessary.
+      //
+      if(voice->DecodeAvail < 11 || (SPUControl & 0x40))
          RunDecoder(voice);
 
+      params[MIX_ENV] = voice->ADSR.EnvLevel;
+      params[MIX_VOL_L] = voice->Sweep[0].ReadVolume();
+      params[MIX_VOL_R] = voice->Sweep[1].ReadVolume();
+      params[MIX_RVB_MASK] = (Reverb_Mode & (1 << voice_num)) ? ~0 : 0;
 
-         //
-         //
-         //
-         int l, r;
-
+      // Nothing to interpolate if the envelope has it silent.
+      if(params[MIX_ENV])
+      {
          if(Noise_Mode & (1 << voice_num))
-            voice_pvs = (int16)LFSR;
+         {
+            // (LFSR * 0x4000 * 2) >> 15, the noise sample as is.
+            fir_in[0] = fir_in[1] = LFSR;
+            fir_coef[0] = fir_coef[1] = 0x4000;
+         }
          else
          {
             const int si = voice->DecodeReadPos;
             const int pi = ((voice->CurPhase & 0xFFF) >> 4);
 
-            voice_pvs = ((voice->DecodeBuffer[(si + 0) & 0x1F] * FIR_Table[pi][0]) +
-                  (voice->DecodeBuffer[(si + 1) & 0x1F] * FIR_Table[pi][1]) +
-                  (voice->DecodeBuffer[(si + 2) & 0x1F] * FIR_Table[pi][2]) +   
-                  (voice->DecodeBuffer[(si + 3) & 0x1F] * FIR_Table[pi][3])) >> 15;
-         }
-
-         voice_pvs = (voice_pvs * (int16)voice->ADSR.EnvLevel) >> 15;
-         voice->PreLRSample = voice_pvs;
-
-         if(voice_num == 1 || voice_num == 3)
-         {
-            int index = voice_num >> 1;
-
-            WriteSPURAM(0x400 | (index * 0x200) | CWA, voice_pvs);
+            if(si <= 0x1C)
+               memcpy(fir_in, &voice->DecodeBuffer[si], sizeof(fir_in));
+            else
+            {
+               for(int i = 0; i < 4; i++)
+                  fir_in[i] = voice->DecodeBuffer[(si + i) & 0x1F];
+            }
+            memcpy(fir_coef, FIR_Table[pi], sizeof(fir_coef));
          }
 
+         active = true;
+         wide |= (params[MIX_ENV] == -32768);
+      }
 
-         l = (voice_pvs * voice->Sweep[0].ReadVolume()) >> 15;
-         r = (voice_pvs * voice->Sweep[1].ReadVolume()) >> 15;
+      memcpy(mix.fir_in[voice_num], fir_in, sizeof(fir_in));
+      memcpy(mix.fir_coef[voice_num], fir_coef, sizeof(fir_coef));
+      memcpy(mix.params[voice_num], params, sizeof(params));
 
-         accum[0] += l;
-         accum[1] += r;
+      if(voice_num == 1 || voice_num == 3)
+      {
+         int index = voice_num >> 1;
 
-         if(Reverb_Mode & (1 << voice_num))
-         {
-            accum_fv[0] += l;
-            accum_fv[1] += r;
-         }
+         WriteSPURAM(0x400 | (index * 0x200) | CWA, MixVoice(mix, voice_num));
+      }
+   }
 
-         // Run sweep
-         for(int lr = 0; lr < 2; lr++)
-            voice->Sweep[lr].Clock();
+   if(!active)
+      memset(voice_pvs, 0, sizeof(voice_pvs));
+#if defined(__SSE2__)
+   else if(!wide)
+      MixVoices_SSE2(mix, voice_pvs, accum, accum_fv);
+#endif
+   else
+      MixVoices(mix, voice_pvs, accum, accum_fv);
 
-         // Increment stuff
-         if(!voice->DecodePlayDelay)
-         {
-            unsigned phase_inc;
+   for(int voice_num = 0; voice_num < 24; voice_num++)
+   {
+      SPU_Voice *voice = &Voices[voice_num];
 
-            // Run enveloping
-            RunEnvelope(voice);
+      voice->PreLRSample = voice_pvs[voice_num];
 
-            if(PhaseModCache & (1 << voice_num))
-            {
-               // This old formula: phase_inc = (voice->Pitch * ((voice - 1)->PreLRSample + 0x8000)) >> 15;
-               // is incorrect, as it does not handle carrier pitches >= 0x8000 properly.
-               phase_inc = voice->Pitch + (((int16)voice->Pitch * ((voice - 1)->PreLRSample)) >> 15);
-            }
-            else
-               phase_inc = voice->Pitch;
+      // Run sweep
+      for(int lr = 0; lr < 2; lr++)
+         voice->Sweep[lr].Clock();
 
-            if(phase_inc > 0x3FFF)
-               phase_inc = 0x3FFF;
+      // Increment stuff
+      if(!voice->DecodePlayDelay)
+      {
+         unsigned phase_inc;
 
-            {
-               const uint32 tmp_phase = voice->CurPhase + phase_inc;
-               const unsigned used = tmp_phase >> 12;
+         // Run enveloping
+         RunEnvelope(voice);
 
-               voice->CurPhase = tmp_phase & 0xFFF;
-               voice->DecodeAvail -= used;
-               voice->DecodeReadPos = (voice->DecodeReadPos + used) & 0x1F;
-            }
+         if(PhaseModCache & (1 << voice_num))
+         {
+            // This old formula: phase_inc = (voice->Pitch * ((voice - 1)->PreLRSample + 0x8000)) >> 15;
+            // is incorrect, as it does not handle carrier pitches >= 0x8000 properly.
+            phase_inc = voice->Pitch + (((int16)voice->Pitch * ((voice - 1)->PreLRSample)) >> 15);
          }
          else
-            voice->DecodePlayDelay--;
+            phase_inc = voice->Pitch;
+
+         if(phase_inc > 0x3FFF)
+            phase_inc = 0x3FFF;
 
-         if(VoiceOff & (1U << voice_num))
          {
-            if(voice->ADSR.Phase != ADSR_RELEASE)
-            {
-               ReleaseEnvelope(voice);
-            }
+            const uint32 tmp_phase = voice->CurPhase + phase_inc;
+            const unsigned used = tmp_phase >> 12;
+
+            voice->CurPhase = tmp_phase & 0xFFF;
+            voice->DecodeAvail -= used;
+            voice->DecodeReadPos = (voice->DecodeReadPos + used) & 0x1F;
          }
+      }
+      else
+         voice->DecodePlayDelay--;
 
-         if(VoiceOn & (1U << voice_num))
+      if(VoiceOff & (1U << voice_num))
+      {
+         if(voice->ADSR.Phase != ADSR_RELEASE)
          {
-            //printf("Voice On: %u\n", voice_num);
+            ReleaseEnvelope(voice);
+         }
+      }
 
-            ResetEnvelope(voice);
+      if(VoiceOn & (1U << voice_num))
+      {
+         //printf("Voice On: %u\n", voice_num);
 
-            voice->DecodeFlags = 0;
-            voice->DecodeWritePos = 0;
-            voice->DecodeReadPos = 0;
-            voice->DecodeAvail = 0;
-            voice->DecodePlayDelay = 4;
+         ResetEnvelope(voice);
 
-            BlockEnd &= ~(1 << voice_num);
+         voice->DecodeFlags = 0;
+         voice->DecodeWritePos = 0;
+         voice->DecodeReadPos = 0;
+         voice->DecodeAvail = 0;
+         voice->DecodePlayDelay = 4;
 
-            //
-            // Weight/filter previous value initialization:
-            //
-            voice->DecodeM2 = 0;
-            voice->DecodeM1 = 0;
+         BlockEnd &= ~(1 << voice_num);
 
-            voice->CurPhase = 0;
-            voice->CurAddr = voice->StartAddr & ~0x7;
-            voice->IgnoreSampLA = false;
-         }
+         //
+         // Weight/filter previous value initialization:
+         //
+         voice->DecodeM2 = 0;
+         voice->DecodeM1 = 0;
 
-         if(!(SPUControl & 0x8000))
-         {
-            voice->ADSR.Phase = ADSR_RELEASE;
-            voice->ADSR.EnvLevel = 0;
-         }
+         voice->CurPhase = 0;
+         voice->CurAddr = voice->StartAddr & ~0x7;
+         voice->IgnoreSampLA = false;
       }
 
-      VoiceOff = 0;
-      VoiceOn = 0; 
-
-      // "Mute" control doesn't seem to affect CD audio(though CD audio reverb wasn't tested...)
-      // TODO: If we add sub-sample timing accuracy, see if it's checked for every channel at different times, or just once.
-      if(!(SPUControl & 0x4000))
+      if(!(SPUControl & 0x8000))
       {
-         accum[0] = 0;
-         accum[1] = 0;
-         accum_fv[0] = 0;
-         accum_fv[1] = 0;
+         voice->ADSR.Phase = ADSR_RELEASE;
+         voice->ADSR.EnvLevel = 0;
       }
+   }
 
-      // Get CD-DA
-      {
-         int32 cda_raw[2];
-         int32 cdav[2];
+   VoiceOff = 0;
+   VoiceOn = 0; 
 
-         CDC->GetCDAudio(cda_raw);	// PS_CDC::GetCDAudio() guarantees the variables passed by reference will be set to 0,
-         // and that their range shall be -32768 through 32767.
+   // "Mute" control doesn't seem to affect CD audio(though CD audio reverb wasn't tested...)
+   // TODO: If we add sub-sample timing accuracy, see if it's checked for every channel at different times, or just once.
+   if(!(SPUControl & 0x4000))
+   {
+      accum[0] = 0;
+      accum[1] = 0;
+      accum_fv[0] = 0;
+      accum_fv[1] = 0;
+   }
 
-         WriteSPURAM(CWA | 0x000, cda_raw[0]);
-         WriteSPURAM(CWA | 0x200, cda_raw[1]);
+   // Get CD-DA
+   {
+      int32 cda_raw[2];
+      int32 cdav[2];
 
-         for(unsigned i = 0; i < 2; i++)
-            cdav[i] = (cda_raw[i] * CDVol[i]) >> 15;
+      CDC->GetCDAudio(cda_raw);	// PS_CDC::GetCDAudio() guarantees the variables passed by reference will be set to 0,
+      // and that their range shall be -32768 through 32767.
 
-         if(SPUControl & 0x0001)
-         {
-            accum[0] += cdav[0];
-            accum[1] += cdav[1];
+      WriteSPURAM(CWA | 0x000, cda_raw[0]);
+      WriteSPURAM(CWA | 0x200, cda_raw[1]);
 
-            if(SPUControl & 0x0004)	// TODO: Test this bit(and see if it is really dependent on bit0)
-            {
-               accum_fv[0] += cdav[0];
-               accum_fv[1] += cdav[1];
-            }
+      for(unsigned i = 0; i < 2; i++)
+         cdav[i] = (cda_raw[i] * CDVol[i]) >> 15;
+
+      if(SPUControl & 0x0001)
+      {
+         accum[0] += cdav[0];
+         accum[1] += cdav[1];
+
+         if(SPUControl & 0x0004)	// TODO: Test this bit(and see if it is really dependent on bit0)
+         {
+            accum_fv[0] += cdav[0];
+            accum_fv[1] += cdav[1];
          }
       }
+   }
 
-      CWA = (CWA + 1) & 0x1FF;
+   CWA = (CWA + 1) & 0x1FF;
 
-      RunNoise();
+   RunNoise();
 
-      for (unsigned lr = 0; lr < 2; lr++)
-         clamp(&accum_fv[lr], -32768, 32767);
+   for (unsigned lr = 0; lr < 2; lr++)
+      clamp(&accum_fv[lr], -32768, 32767);
+}
+
+// Adds the output of reverb processing to MixSample()'s, for the final output.
+INLINE void PS_SPU::OutputSample(int32 *accum, const int32 *reverb)
+{
+   int32 output[2];
 
-      RunReverb(accum_fv, reverb);
+   for(unsigned lr = 0; lr < 2; lr++)
+   {
+      accum[lr] += ((reverb[lr] * ReverbVol[lr]) >> 15);
+      clamp(&accum[lr],  -32768, 32767);
+      output[lr] = (accum[lr] * GlobalSweep[lr].ReadVolume()) >> 15;
+      clamp(&output[lr], -32768, 32767);
+   }
 
+   if(IntermediateBufferPos < 4096)	// Overflow might occur in some debugger use cases.
+   {
+      // 75%, for some (resampling) headroom.
       for(unsigned lr = 0; lr < 2; lr++)
-      {
-         accum[lr] += ((reverb[lr] * ReverbVol[lr]) >> 15);
-         clamp(&accum[lr],  -32768, 32767);
-         output[lr] = (accum[lr] * GlobalSweep[lr].ReadVolume()) >> 15;
-         clamp(&output[lr], -32768, 32767);
-      }
+         IntermediateBuffer[IntermediateBufferPos][lr] = (output[lr] * 3 + 2) >> 2;
 
-      if(IntermediateBufferPos < 4096)	// Overflow might occur in some debugger use cases.
-      {
-         // 75%, for some (resampling) headroom.
-         for(unsigned lr = 0; lr < 2; lr++)
-            IntermediateBuffer[IntermediateBufferPos][lr] = (output[lr] * 3 + 2) >> 2;
+      IntermediateBufferPos++;
+   }
 
-         IntermediateBufferPos++;
-      }
+   // Clock global sweep
+   for(unsigned lr = 0; lr < 2; lr++)
+      GlobalSweep[lr].Clock();
+}
 
-      sample_clocks--;
+INLINE void PS_SPU::RunSample(void)
+{
+   int32 accum[2];
+   int32 accum_fv[2];
+   int32 reverb[2];
 
-      // Clock global sweep
-      for(unsigned lr = 0; lr < 2; lr++)
-         GlobalSweep[lr].Clock();
+   MixSample(accum, accum_fv);
+   RunReverb(accum_fv, reverb);
+   OutputSample(accum, reverb);
+}
+
+int32 PS_SPU::UpdateFromCDC(int32 clocks)
+{
+   //int32 clocks = timestamp - lastts;
+   //lastts = timestamp;
+
+   clock_divider -= clocks;
+
+   while(clock_divider <= 0)
+   {
+      clock_divider += 768;
+      DeferredSamples++;
    }
 
+   // A sample that may raise the IRQ has to be run when it's due; otherwise they're left to pile up into
+   // a block, unless something that depends on them comes first(see RenderDeferred()).
+   if(DeferredSamples && (!BlockRender || (SPUControl & 0x40) || DeferredSamples >= SPU_BLOCK_SAMPLES))
+      RenderDeferred();
+
    //assert(clock_divider < 768);
 
    return clock_divider;
 }
 
+// Runs the voices for "count" samples, then the reverb for all of them; see CanRunReverbAfter().
+void PS_SPU::RunBlock(unsigned count)
+{
+   int32 accum[SPU_BLOCK_SAMPLES][2];
+   int32 accum_fv[SPU_BLOCK_SAMPLES][2];
+   int32 reverb[SPU_BLOCK_SAMPLES][2];
+
+   for(unsigned i = 0; i < count; i++)
+      MixSample(accum[i], accum_fv[i]);
+
+   RunReverbBlock(accum_fv, reverb, count);
+
+   for(unsigned i = 0; i < count; i++)
+      OutputSample(accum[i], reverb[i]);
+}
+
+void PS_SPU::RenderDeferred(void)
+{
+   while(DeferredSamples)
+   {
+      if(!BlockRender || (SPUControl & 0x40))
+      {
+         RunSample();
+         DeferredSamples--;
+      }
+      else
+      {
+         unsigned count = std::min<uint32>(DeferredSamples, SPU_BLOCK_SAMPLES);
+
+         if(!CanRunReverbAfter(count))
+            count = 1;
+
+         RunBlock(count);
+         DeferredSamples -= count;
+      }
+   }
+}
+
+void PS_SPU::SetBlockRender(bool enabled)
+{
+   RenderDeferred();
+   BlockRender = enabled;
+}
+
 void PS_SPU::WriteDMA(uint32 V)
 {
+   RenderDeferred();
+
    //SPUIRQ_DBG("DMA Write, RWAddr after=0x%06x", RWAddr);
    WriteSPURAM(RWAddr, V);
    RWAddr = (RWAddr + 1) & 0x3FFFF;
@@ -1066,6 +1615,8 @@ void PS_SPU::WriteDMA(uint32 V)
 
 uint32 PS_SPU::ReadDMA(void)
 {
+   RenderDeferred();
+
    uint32 ret = (uint16)ReadSPURAM(RWAddr);
    RWAddr = (RWAddr + 1) & 0x3FFFF;
 
@@ -1084,6 +1635,8 @@ void PS_SPU::Write(int32_t timestamp, uint32 A, uint16 V)
    //if((A & 0x3FF) < 0x180)
    // PSX_WARNING("[SPU] Write: %08x %04x", A, V);
 
+   RenderDeferred();
+
    A &= 0x3FF;
 
    if(A >= 0x200)
@@ -1267,6 +1820,8 @@ void PS_SPU::Write(int32_t timestamp, uint32 A, uint16 V)
 
 uint16 PS_SPU::Read(int32_t timestamp, uint32 A)
 {
+   RenderDeferred();
+
    A &= 0x3FF;
 
    PSX_DBGINFO("[SPU] Read: %08x", A);
@@ -1456,7 +2011,7 @@ int PS_SPU::StateAction(StateMem *sm, int load, int data_only)
 
       SFVAR(clock_divider),
 
-      SFARRAY16(SPURAM, 524288 / sizeof(uint16)),
+      { SPURAM, 524288, MDFNSTATE_RLSB16 | MDFNSTATE_REWIND_TRACKED, "SPURAM" },
       SFEND
    };
 #undef SFSWEEP
@@ -1466,6 +2021,8 @@ int PS_SPU::StateAction(StateMem *sm, int load, int data_only)
 
    if(load)
    {
+      DeferredSamples = 0;
+
       for(unsigned i = 0; i < 24; i++)
       {
          Voices[i].DecodeReadPos &= 0x1F;
@@ -1488,6 +2045,12 @@ uint16 PS_SPU::PeekSPURAM(uint32 address)
 void PS_SPU::PokeSPURAM(uint32 address, uint16 value)
 {
    SPURAM[address & 0x3FFFF] = value;
+   SPURAMDirty[((address & 0x3FFFF) << 1) >> REWIND_PAGE_SHIFT] = 1;
+}
+
+void PS_SPU::RewindAddRegions(void)
+{
+   MDFN_RewindAddRegion(SPURAM, sizeof(SPURAM), SPURAMDirty);
 }
 
 uint32 PS_SPU::GetRegister(unsigned int which, char *special, const uint32 special_len)
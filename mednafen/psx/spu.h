@@ -54,6 +54,8 @@ class SPU_Sweep
    void Clock(void);
 
    private:
+   void ClockSweep(void);
+
    uint16_t Control;
    uint16_t Current;
    uint32_t Divider;
@@ -112,8 +114,20 @@ class PS_SPU
 
       int32_t UpdateFromCDC(int32_t clocks);
 
+      // Runs the samples UpdateFromCDC() has put off; needed before anything that depends on
+      // them, on or outside of the SPU(other than Read(), Write() and the DMA functions, which
+      // do it themselves).
+      void RenderDeferred(void);
+
+      void SetBlockRender(bool enabled);
+
    private:
 
+      void MixSample(int32 *accum, int32 *accum_fv);
+      void OutputSample(int32 *accum, const int32 *reverb);
+      void RunSample(void);
+      void RunBlock(unsigned count);
+
       void CheckIRQAddr(uint32_t addr);
       void WriteSPURAM(uint32_t addr, uint16_t value);
       uint16_t ReadSPURAM(uint32_t addr);
@@ -127,6 +141,10 @@ class PS_SPU
 
 
       void RunReverb(const int32* in, int32* out);
+      void RunReverbBlock(const int32 (*in)[2], int32 (*out)[2], unsigned count);
+      void GetReverbTapOffsets(uint32 *offs);
+      bool CanRunReverbAfter(unsigned count);
+      void WriteReverbRAM(uint32 addr, uint16 value);
       void RunNoise(void);
       bool GetCDAudio(int32_t &l, int32_t &r);
 
@@ -237,7 +255,11 @@ class PS_SPU
 
       int32_t clock_divider;
 
+      uint32_t DeferredSamples;	// Due but not run yet; always 0 between frames.
+      bool BlockRender;
+
       uint16_t SPURAM[524288 / sizeof(uint16)];
+      uint8_t SPURAMDirty[524288 >> REWIND_PAGE_SHIFT];
 
       int last_rate;
       uint32_t last_quality;
@@ -326,6 +348,8 @@ class PS_SPU
 
       uint16_t PeekSPURAM(uint32_t address);
       void PokeSPURAM(uint32_t address, uint16_t value);
+
+      void RewindAddRegions(void);
 };
 
 #endif
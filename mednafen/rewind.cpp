@@ -0,0 +1,440 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <string.h>
+
+#include <deque>
+#include <vector>
+
+#include "mednafen.h"
+#include "state.h"
+#include "rewind.h"
+#include "../libretro.h"
+
+extern retro_log_printf_t log_cb;
+
+/*
+   In-core rewinding.
+
+   Each frame is recorded as its difference from the frame before: the raw
+   state(without the regions) XORed with the previous one, and the XOR of
+   every region page that was written to in between.  Those are mostly zeros,
+   so they're stored as runs of zero words and literal words.
+
+   The last recorded frame is kept in full as the baseline, with a shadow
+   copy of every region.  Going back a frame first undoes whatever was
+   emulated since, by copying the pages dirtied since back from the shadow,
+   then XORs the newest record into the baseline and loads it.
+*/
+
+struct RewindRegion
+{
+   uint8_t *mem;
+   uint32_t size;
+   uint8_t *dirty;
+   uint8_t *shadow;	// Contents at the baseline.
+};
+
+struct RewindRecord
+{
+   uint32_t offset;
+   uint32_t size;
+};
+
+enum
+{
+   REWIND_END_OF_RECORD = ~0U
+};
+
+static std::vector<RewindRegion> Regions;
+
+static uint8_t *Ring;	// Records, the oldest ones make room for new ones.
+static uint32_t RingSize;
+static uint32_t RingHead;
+static std::deque<RewindRecord> Records;
+
+static StateMem Baseline;	// Raw state of the last recorded frame, less the regions.
+static StateMem Current;
+static bool BaselineValid;
+
+static uint8_t *Scratch;	// The record being put together.
+static uint32_t ScratchSize;
+static uint32_t ScratchPos;
+
+// Statistics, logged when rewinding is turned off.
+static uint64_t frames_recorded;
+static uint64_t bytes_recorded;
+
+static void ScratchReserve(uint32_t n)
+{
+   if(ScratchPos + n <= ScratchSize)
+      return;
+
+   while(ScratchPos + n > ScratchSize)
+      ScratchSize = ScratchSize ? ScratchSize * 2 : 65536;
+
+   Scratch = (uint8_t *)realloc(Scratch, ScratchSize);
+}
+
+static INLINE void ScratchPut32(uint32_t v)
+{
+   memcpy(Scratch + ScratchPos, &v, 4);
+   ScratchPos += 4;
+}
+
+// Appends a XOR b as runs, each a 16-bit count of zero words and a 16-bit count of literal
+// words followed by the literals.  Appends nothing and returns false if they're equal.
+static bool EncodeDelta(const uint32_t *a, const uint32_t *b, uint32_t words)
+{
+   const uint32_t start = ScratchPos;
+   bool changed = false;
+   uint32_t i = 0;
+
+   ScratchReserve(words * 8 + 8);
+
+   while(i < words)
+   {
+      uint32_t zeros = 0;
+      uint32_t literals = 0;
+      uint32_t header_pos;
+
+      while(i < words && zeros < 0xFFFF && a[i] == b[i])
+      {
+         zeros++;
+         i++;
+      }
+
+      header_pos = ScratchPos;
+      ScratchPos += 4;
+
+      while(i < words && literals < 0xFFFF && a[i] != b[i])
+      {
+         ScratchPut32(a[i] ^ b[i]);
+         literals++;
+         i++;
+      }
+
+      const uint32_t header = zeros | (literals << 16);
+      memcpy(Scratch + header_pos, &header, 4);
+
+      changed |= (literals != 0);
+   }
+
+   if(!changed)
+      ScratchPos = start;
+
+   return(changed);
+}
+
+// XORs a delta made by EncodeDelta() into dst, returns the end of the delta.
+static const uint8_t *ApplyDelta(const uint8_t *p, uint32_t *dst, uint32_t words)
+{
+   uint32_t i = 0;
+
+   while(i < words)
+   {
+      uint32_t header;
+
+      memcpy(&header, p, 4);
+      p += 4;
+
+      i += header & 0xFFFF;
+
+      for(uint32_t n = header >> 16; n; n--)
+      {
+         uint32_t v;
+
+         memcpy(&v, p, 4);
+         p += 4;
+
+         dst[i++] ^= v;
+      }
+   }
+
+   return(p);
+}
+
+static bool SaveSmall(StateMem *st)
+{
+   static uint8_t zero[4] = { 0 };
+
+   st->loc = 0;
+   st->len = 0;
+   st->skip_rewind_tracked = true;
+
+   if(!MDFNSS_SaveSM(st, 0, 1, NULL, NULL, NULL))
+      return(false);
+
+   // Pad to whole words for EncodeDelta().
+   smem_write(st, zero, (4 - (st->len & 3)) & 3);
+
+   return(true);
+}
+
+static void TakeBaseline(void)
+{
+   const StateMem tmp = Baseline;
+
+   Baseline = Current;
+   Current = tmp;
+
+   for(size_t r = 0; r < Regions.size(); r++)
+   {
+      memcpy(Regions[r].shadow, Regions[r].mem, Regions[r].size);
+      memset(Regions[r].dirty, 0, Regions[r].size >> REWIND_PAGE_SHIFT);
+   }
+
+   Records.clear();
+   RingHead = 0;
+   BaselineValid = true;
+}
+
+static void StoreRecord(void)
+{
+   const uint32_t size = ScratchPos;
+   RewindRecord rec;
+
+   if(size > RingSize)
+   {
+      // Going back past this frame won't be possible.
+      Records.clear();
+      RingHead = 0;
+      return;
+   }
+
+   if(RingHead + size > RingSize)
+      RingHead = 0;
+
+   while(!Records.empty() && Records.front().offset < (RingHead + size) && RingHead < (Records.front().offset + Records.front().size))
+      Records.pop_front();
+
+   memcpy(Ring + RingHead, Scratch, size);
+
+   rec.offset = RingHead;
+   rec.size = size;
+   Records.push_back(rec);
+
+   RingHead += size;
+
+   frames_recorded++;
+   bytes_recorded += size;
+}
+
+void MDFN_RewindInit(uint32_t buffer_size)
+{
+   MDFN_RewindKill();
+
+   if(!buffer_size)
+      return;
+
+   Ring = (uint8_t *)malloc(buffer_size);
+
+   if(Ring)
+      RingSize = buffer_size;
+}
+
+void MDFN_RewindKill(void)
+{
+   if(frames_recorded)
+   {
+      log_cb(RETRO_LOG_INFO, "[Mednafen]: Rewind: %llu frames recorded, %llu bytes per frame on average, %u frames kept.\n",
+            (unsigned long long)frames_recorded, (unsigned long long)(bytes_recorded / frames_recorded), (unsigned)Records.size());
+   }
+
+   for(size_t r = 0; r < Regions.size(); r++)
+      free(Regions[r].shadow);
+
+   Regions.clear();
+   Records.clear();
+
+   free(Ring);
+   Ring = NULL;
+   RingSize = 0;
+   RingHead = 0;
+
+   free(Baseline.data);
+   free(Current.data);
+   memset(&Baseline, 0, sizeof(Baseline));
+   memset(&Current, 0, sizeof(Current));
+   BaselineValid = false;
+
+   free(Scratch);
+   Scratch = NULL;
+   ScratchSize = 0;
+   ScratchPos = 0;
+
+   frames_recorded = 0;
+   bytes_recorded = 0;
+}
+
+bool MDFN_RewindEnabled(void)
+{
+   return(RingSize != 0);
+}
+
+void MDFN_RewindAddRegion(void *mem, uint32_t size, uint8_t *dirty)
+{
+   RewindRegion r;
+
+   if(!RingSize)
+      return;
+
+   r.mem = (uint8_t *)mem;
+   r.size = size;
+   r.dirty = dirty;
+   r.shadow = (uint8_t *)malloc(size);
+
+   Regions.push_back(r);
+
+   BaselineValid = false;
+}
+
+void MDFN_RewindDirtyAll(void)
+{
+   for(size_t r = 0; r < Regions.size(); r++)
+      memset(Regions[r].dirty, 1, Regions[r].size >> REWIND_PAGE_SHIFT);
+}
+
+void MDFN_RewindMarkPtr(const void *ptr)
+{
+   for(size_t r = 0; r < Regions.size(); r++)
+   {
+      const uint8_t *p = (const uint8_t *)ptr;
+
+      if(p >= Regions[r].mem && p < (Regions[r].mem + Regions[r].size))
+         Regions[r].dirty[(p - Regions[r].mem) >> REWIND_PAGE_SHIFT] = 1;
+   }
+}
+
+void MDFN_RewindPush(void)
+{
+   if(!RingSize || !SaveSmall(&Current))
+      return;
+
+   if(!BaselineValid || Current.len != Baseline.len)
+   {
+      TakeBaseline();
+      return;
+   }
+
+   ScratchPos = 0;
+   ScratchReserve(4);
+   ScratchPut32(0);
+
+   if(EncodeDelta((const uint32_t *)Current.data, (const uint32_t *)Baseline.data, Baseline.len >> 2))
+      memcpy(Scratch, "\x01\x00\x00\x00", 4);
+
+   {
+      const StateMem tmp = Baseline;
+
+      Baseline = Current;
+      Current = tmp;
+   }
+
+   for(size_t r = 0; r < Regions.size(); r++)
+   {
+      RewindRegion *reg = &Regions[r];
+      const uint32_t pages = reg->size >> REWIND_PAGE_SHIFT;
+
+      for(uint32_t page = 0; page < pages; page++)
+      {
+         if(!reg->dirty[page])
+            continue;
+
+         const uint32_t offs = page << REWIND_PAGE_SHIFT;
+         const uint32_t record_pos = ScratchPos;
+
+         reg->dirty[page] = 0;
+
+         ScratchReserve(4);
+         ScratchPut32((r << 24) | page);
+
+         if(EncodeDelta((const uint32_t *)(reg->mem + offs), (const uint32_t *)(reg->shadow + offs), REWIND_PAGE_SIZE >> 2))
+            memcpy(reg->shadow + offs, reg->mem + offs, REWIND_PAGE_SIZE);
+         else
+            ScratchPos = record_pos;
+      }
+   }
+
+   ScratchReserve(4);
+   ScratchPut32(REWIND_END_OF_RECORD);
+
+   StoreRecord();
+}
+
+bool MDFN_RewindPop(void)
+{
+   bool ret = false;
+
+   if(!RingSize || !BaselineValid)
+      return(false);
+
+   // Undo what was emulated after the baseline.
+   for(size_t r = 0; r < Regions.size(); r++)
+   {
+      RewindRegion *reg = &Regions[r];
+      const uint32_t pages = reg->size >> REWIND_PAGE_SHIFT;
+
+      for(uint32_t page = 0; page < pages; page++)
+      {
+         if(reg->dirty[page])
+         {
+            const uint32_t offs = page << REWIND_PAGE_SHIFT;
+
+            memcpy(reg->mem + offs, reg->shadow + offs, REWIND_PAGE_SIZE);
+            reg->dirty[page] = 0;
+         }
+      }
+   }
+
+   if(!Records.empty())
+   {
+      const RewindRecord rec = Records.back();
+      const uint8_t *p = Ring + rec.offset;
+      uint32_t tmp;
+
+      memcpy(&tmp, p, 4);
+      p += 4;
+
+      if(tmp)
+         p = ApplyDelta(p, (uint32_t *)Baseline.data, Baseline.len >> 2);
+
+      for(;;)
+      {
+         memcpy(&tmp, p, 4);
+         p += 4;
+
+         if(tmp == REWIND_END_OF_RECORD)
+            break;
+
+         RewindRegion *reg = &Regions[tmp >> 24];
+         const uint32_t offs = (tmp & 0xFFFFFF) << REWIND_PAGE_SHIFT;
+
+         p = ApplyDelta(p, (uint32_t *)(reg->shadow + offs), REWIND_PAGE_SIZE >> 2);
+         memcpy(reg->mem + offs, reg->shadow + offs, REWIND_PAGE_SIZE);
+      }
+
+      RingHead = rec.offset;
+      Records.pop_back();
+      ret = true;
+   }
+
+   Baseline.loc = 0;
+   MDFNSS_LoadSM(&Baseline, 0, 1);
+
+   return(ret);
+}
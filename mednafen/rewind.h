@@ -0,0 +1,31 @@
+#ifndef __MDFN_REWIND_H
+#define __MDFN_REWIND_H
+
+#include <stdint.h>
+
+// Large memories(main RAM, VRAM, SPU RAM) are registered as regions, and
+// their owners set a byte in the region's dirty map for every page they
+// write to.  Everything else is saved as a raw state each frame.
+#define REWIND_PAGE_SHIFT	12
+#define REWIND_PAGE_SIZE	(1 << REWIND_PAGE_SHIFT)
+
+// Starts over with an empty history and no regions; a buffer_size of 0
+// turns rewinding off.
+void MDFN_RewindInit(uint32_t buffer_size);
+void MDFN_RewindKill(void);
+bool MDFN_RewindEnabled(void);
+
+// "size" is a multiple of REWIND_PAGE_SIZE, "dirty" has a byte per page.
+void MDFN_RewindAddRegion(void *mem, uint32_t size, uint8_t *dirty);
+
+// For writes that don't go through the dirty maps, like loading a state.
+void MDFN_RewindDirtyAll(void);
+void MDFN_RewindMarkPtr(const void *ptr);
+
+// Call once a frame to record it; MDFN_RewindPop() then goes back one
+// recorded frame, dropping anything emulated since.  Returns false once
+// the history is exhausted.
+void MDFN_RewindPush(void);
+bool MDFN_RewindPop(void);
+
+#endif
@@ -33,6 +33,10 @@ uint32_t setting_psx_multitap_port_1 = 0;
 uint32_t setting_psx_multitap_port_2 = 0;
 uint32_t setting_psx_analog_toggle = 0;
 uint32_t setting_psx_fastboot = 1;
+uint32_t setting_cd_pbp_cache_size = 8 << 20;
+uint32_t setting_cd_image_preload = 0;
+uint32_t setting_cd_audio_cache_size = 8 << 20;
+uint32_t setting_spu_resamp_quality = 4;
 
 extern char retro_cd_base_name[4096];
 extern char retro_save_directory[4096];
@@ -45,8 +49,12 @@ bool MDFN_SaveSettings(const char *path)
 
 uint64_t MDFN_GetSettingUI(const char *name)
 {
-   if (!strcmp("psx.spu.resamp_quality", name)) /* make configurable */
-      return 4;
+   if (!strcmp("psx.spu.resamp_quality", name))
+      return setting_spu_resamp_quality;
+   if (!strcmp("cdrom.pbp_cache_size", name))
+      return setting_cd_pbp_cache_size;
+   if (!strcmp("cdrom.audio_cache_size", name))
+      return setting_cd_audio_cache_size;
 
    fprintf(stderr, "unhandled setting UI: %s\n", name);
    return 0;
@@ -113,6 +121,8 @@ bool MDFN_GetSettingB(const char *name)
    /* CDROM */
    if (!strcmp("cdrom.lec_eval", name))
       return 1;
+   if (!strcmp("cdrom.image_preload", name))
+      return setting_cd_image_preload;
    /* FILESYS */
    if (!strcmp("filesys.untrusted_fip_check", name))
       return 0;
@@ -0,0 +1,247 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "PolyphaseResampler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+enum
+{
+   RESAMP_MAX_TAPS = 56,	// At quality 10.
+   RESAMP_MAX_PHASES = 512,
+   RESAMP_CHUNK = 4096	// Input samples taken into Buf at a time.
+};
+
+static uint32_t GCD(uint32_t a, uint32_t b)
+{
+   while(b)
+   {
+      const uint32_t t = a % b;
+
+      a = b;
+      b = t;
+   }
+
+   return a;
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window.
+static double BesselI0(double x)
+{
+   double sum = 1.0;
+   double term = 1.0;
+
+   for(unsigned k = 1; k < 64 && term > sum * 1e-12; k++)
+   {
+      term *= (x / (2 * k)) * (x / (2 * k));
+      sum += term;
+   }
+
+   return sum;
+}
+
+PolyphaseResampler::PolyphaseResampler(uint32_t input_rate, uint32_t output_rate, unsigned quality)
+{
+   const uint32_t div = GCD(input_rate, output_rate);
+
+   InRate = input_rate / div;
+   OutRate = output_rate / div;
+
+   quality = std::min(quality, 10U);
+
+   TapCount = 8 + 8 * ((quality + 1) / 2);
+   PhaseCount = std::min<uint32_t>(OutRate, RESAMP_MAX_PHASES);
+   Coeffs = new int16_t[PhaseCount * TapCount];
+
+   BufSize = TapCount + RESAMP_CHUNK;
+   Buf[0] = new int16_t[BufSize];
+   Buf[1] = new int16_t[BufSize];
+
+   InitFilter(quality);
+   Reset();
+}
+
+PolyphaseResampler::~PolyphaseResampler()
+{
+   delete[] Buf[1];
+   delete[] Buf[0];
+   delete[] Coeffs;
+}
+
+void PolyphaseResampler::InitFilter(unsigned quality)
+{
+   // Lower qualities have fewer taps, so a wider transition band; start it lower to keep
+   // the aliasing down.  When downsampling, the cutoff is the output's Nyquist frequency.
+   const double cutoff = (0.82 + 0.012 * quality) * std::min(1.0, (double)OutRate / InRate);
+   const double beta = 4.0 + 0.5 * quality;
+   const double half = TapCount / 2;
+   const double i0_beta = BesselI0(beta);
+
+   for(uint32_t phase = 0; phase < PhaseCount; phase++)
+   {
+      int16_t *c = &Coeffs[phase * TapCount];
+      double h[RESAMP_MAX_TAPS];
+      double sum = 0;
+      int32_t isum = 0;
+      uint32_t peak = 0;
+
+      for(uint32_t j = 0; j < TapCount; j++)
+      {
+         // Distance, in input samples, from the point this phase is for.
+         const double x = j - (half - 1) - (double)phase / PhaseCount;
+         const double u = x / half;
+         const double w = (u >= 1.0) ? 0.0 : BesselI0(beta * sqrt(1.0 - u * u)) / i0_beta;
+         const double s = (x == 0) ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+
+         h[j] = cutoff * s * w;
+         sum += h[j];
+      }
+
+      // Scale to a gain of exactly 1.0 in 1.15 fixed point, the rounding error going to the
+      // largest coefficient.
+      for(uint32_t j = 0; j < TapCount; j++)
+      {
+         c[j] = (int16_t)floor(h[j] * 32768 / sum + 0.5);
+         isum += c[j];
+
+         if(abs(c[j]) > abs(c[peak]))
+            peak = j;
+      }
+
+      c[peak] += 32768 - isum;
+   }
+}
+
+void PolyphaseResampler::Reset(void)
+{
+   // Input before the first sample being silence, so the first output sample is at its time.
+   BufCount = TapCount / 2 - 1;
+   memset(Buf[0], 0, BufCount * sizeof(int16_t));
+   memset(Buf[1], 0, BufCount * sizeof(int16_t));
+
+   Pos = 0;
+   Frac = 0;
+}
+
+uint32_t PolyphaseResampler::MaxOutput(uint32_t in_count) const
+{
+   return ((uint64_t)(in_count + TapCount) * OutRate + InRate - 1) / InRate + 1;
+}
+
+static inline int16_t ResampClamp(int32_t v)
+{
+   v = (v + 0x4000) >> 15;
+
+   if(v < -32768)
+      v = -32768;
+
+   if(v > 32767)
+      v = 32767;
+
+   return v;
+}
+
+uint32_t PolyphaseResampler::Resample(const int16_t (*in)[2], uint32_t in_count, int16_t (*out)[2], uint32_t out_max)
+{
+   uint32_t written = 0;
+
+   while(in_count)
+   {
+      const uint32_t n = std::min(in_count, BufSize - BufCount);
+
+      for(uint32_t i = 0; i < n; i++)
+      {
+         Buf[0][BufCount + i] = in[i][0];
+         Buf[1][BufCount + i] = in[i][1];
+      }
+
+      BufCount += n;
+      in += n;
+      in_count -= n;
+
+      while(Pos + TapCount <= BufCount)
+      {
+         const uint32_t phase = (PhaseCount == OutRate) ? Frac : (uint32_t)((uint64_t)Frac * PhaseCount / OutRate);
+         const int16_t *c = &Coeffs[phase * TapCount];
+         const int16_t *l = &Buf[0][Pos];
+         const int16_t *r = &Buf[1][Pos];
+         int32_t sum_l, sum_r;
+
+#if defined(__SSE2__)
+         __m128i acc_l = _mm_setzero_si128();
+         __m128i acc_r = _mm_setzero_si128();
+
+         for(uint32_t j = 0; j < TapCount; j += 8)
+         {
+            const __m128i cv = _mm_loadu_si128((const __m128i *)&c[j]);
+
+            acc_l = _mm_add_epi32(acc_l, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)&l[j]), cv));
+            acc_r = _mm_add_epi32(acc_r, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)&r[j]), cv));
+         }
+
+         // Left and right summed across at the same time, ending up in the low two lanes.
+         __m128i acc = _mm_add_epi32(_mm_unpacklo_epi32(acc_l, acc_r), _mm_unpackhi_epi32(acc_l, acc_r));
+         acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+
+         sum_l = _mm_cvtsi128_si32(acc);
+         sum_r = _mm_cvtsi128_si32(_mm_srli_si128(acc, 4));
+#else
+         sum_l = 0;
+         sum_r = 0;
+
+         for(uint32_t j = 0; j < TapCount; j++)
+         {
+            sum_l += l[j] * c[j];
+            sum_r += r[j] * c[j];
+         }
+#endif
+
+         if(written < out_max)
+         {
+            out[written][0] = ResampClamp(sum_l);
+            out[written][1] = ResampClamp(sum_r);
+            written++;
+         }
+
+         Frac += InRate;
+         Pos += Frac / OutRate;
+         Frac %= OutRate;
+      }
+
+      // Keep only what later output samples still need; when downsampling by a lot, the next
+      // one can start past the end of what's been passed in so far.
+      const uint32_t used = std::min(Pos, BufCount);
+
+      BufCount -= used;
+      memmove(Buf[0], &Buf[0][used], BufCount * sizeof(int16_t));
+      memmove(Buf[1], &Buf[1][used], BufCount * sizeof(int16_t));
+      Pos -= used;
+   }
+
+   return written;
+}
@@ -0,0 +1,66 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MDFN_SOUND_POLYPHASERESAMPLER_H
+#define __MDFN_SOUND_POLYPHASERESAMPLER_H
+
+#include <stdint.h>
+
+// Converts 16-bit stereo sound from one sampling rate to another with a windowed sinc filter,
+// its coefficients worked out ahead of time for each of the fractional positions(phases) an
+// output sample can fall at between two input ones.  The output is written straight to a buffer
+// the caller provides, and what's left of the input over is kept for the next call, so sound
+// passed in a frame at a time comes out continuous.
+class PolyphaseResampler
+{
+ public:
+
+ // "quality" is 0 to 10, as psx.spu.resamp_quality; higher takes more taps per output sample.
+ PolyphaseResampler(uint32_t input_rate, uint32_t output_rate, unsigned quality);
+ ~PolyphaseResampler();
+
+ // The most Resample() can write for "in_count" input samples.
+ uint32_t MaxOutput(uint32_t in_count) const;
+
+ // Resamples "in_count" samples from "in" into "out", which has room for "out_max" of them, and
+ // returns how many it wrote.  Output that doesn't fit is dropped.
+ uint32_t Resample(const int16_t (*in)[2], uint32_t in_count, int16_t (*out)[2], uint32_t out_max);
+
+ // Forgets the input kept from before, as if it had been silence.
+ void Reset(void);
+
+ private:
+
+ void InitFilter(unsigned quality);
+
+ uint32_t InRate;	// Reduced by their greatest common divisor.
+ uint32_t OutRate;
+
+ uint32_t TapCount;	// Per phase, a multiple of 8.
+ uint32_t PhaseCount;	// OutRate, or fewer with the nearest one used when that's too many.
+ int16_t *Coeffs;	// [PhaseCount][TapCount]
+
+ // Input waiting to be used; planar, so a phase's coefficients line up with one channel's samples.
+ int16_t *Buf[2];
+ uint32_t BufSize;
+ uint32_t BufCount;
+
+ uint32_t Pos;		// Of the first input sample the next output sample is made from, in Buf.
+ uint32_t Frac;		// And how far past it, in 1/OutRate input samples.
+};
+
+#endif
@@ -18,6 +18,8 @@
 #include <string.h>
 
 #include <map>
+#include <string>
+#include <vector>
 
 #include "mednafen.h"
 #include "driver.h"
@@ -41,6 +43,17 @@ int32_t smem_read(StateMem *st, void *buffer, uint32_t len)
 
 int32_t smem_write(StateMem *st, void *buffer, uint32_t len)
 {
+   if ((len + st->loc) > st->malloced && st->fixed)
+   {
+      // Out of room, only keep track of the size the state needs.
+      st->loc += len;
+
+      if (st->loc > st->len)
+         st->len = st->loc;
+
+      return(0);
+   }
+
    if ((len + st->loc) > st->malloced)
    {
       uint32_t newsize = (st->malloced >= 32768) ? st->malloced : (st->initial_malloc ? st->initial_malloc : 32768);
@@ -236,6 +249,37 @@ static int WriteStateChunk(StateMem *st, const char *sname, SFORMAT *sf)
    return(end_pos - data_start_pos);
 }
 
+// Raw chunk writer, the counterpart of DOReadChunk(): no names or sizes, and no byte order
+// conversion, so it's only good for snapshots loaded back into the same running instance.
+static void DOWriteChunk(StateMem *st, SFORMAT *sf)
+{
+   while(sf->size || sf->name)       // Size can sometimes be zero, so also check for the text name.
+      // These two should both be zero only at the end of a struct.
+   {
+      if(!sf->size || !sf->v || (st->skip_rewind_tracked && (sf->flags & MDFNSTATE_REWIND_TRACKED)))
+      {
+         sf++;
+         continue;
+      }
+
+      if(sf->size == (uint32_t) ~0) // Link to another SFORMAT struct
+      {
+         DOWriteChunk(st, (SFORMAT *)sf->v);
+         sf++;
+         continue;
+      }
+
+      int32_t bytesize = sf->size;
+
+      // Saving raw data, bool types are stored as they appear in memory.
+      if(sf->flags & MDFNSTATE_BOOL)
+         bytesize *= sizeof(bool);
+
+      smem_write(st, (uint8_t *)sf->v, bytesize);
+      sf++;
+   }
+}
+
 struct compare_cstr
 {
    bool operator()(const char *s1, const char *s2) const
@@ -244,9 +288,24 @@ struct compare_cstr
    }
 };
 
-typedef std::map<const char *, SFORMAT *, compare_cstr> SFMap_t;
+typedef std::map<const char *, uint32_t, compare_cstr> SFMap_t;
+
+// Name map of one save state section, built the first time the section is loaded.
+struct SFMapCache
+{
+   std::vector<std::string> names;	// Variable names in SFORMAT order, the map keys point into these.
+   SFMap_t sfmap;			// Name -> index into "names".
+};
+
+typedef std::map<std::string, SFMapCache> SFMapCacheMap_t;
+
+static SFMapCacheMap_t SFMapCaches;
 
-static void MakeSFMap(SFORMAT *sf, SFMap_t &sfmap)
+// Scratch buffers for ReadStateChunk(), kept around so loading doesn't allocate.
+static std::vector<SFORMAT *> SFFlat;
+static std::vector<uint8_t> SFFound;
+
+static void FlattenSF(SFORMAT *sf, std::vector<SFORMAT *> &flat)
 {
    while(sf->size || sf->name) // Size can sometimes be zero, so also check for the text name.  These two should both be zero only at the end of a struct.
    {
@@ -257,28 +316,56 @@ static void MakeSFMap(SFORMAT *sf, SFMap_t &sfmap)
       }
 
       if(sf->size == (uint32_t)~0)            /* Link to another SFORMAT structure. */
-         MakeSFMap((SFORMAT *)sf->v, sfmap);
+         FlattenSF((SFORMAT *)sf->v, flat);
       else
       {
          assert(sf->name);
-
-         if(sfmap.find(sf->name) != sfmap.end())
-            printf("Duplicate save state variable in internal emulator structures(CLUB THE PROGRAMMERS WITH BREADSTICKS): %s\n", sf->name);
-
-         sfmap[sf->name] = sf;
+         flat.push_back(sf);
       }
 
       sf++;
    }
 }
 
+// Returns the name map for a section whose variables are "flat", reusing the one made by an
+// earlier load as long as the section still has the same variables.
+static SFMapCache &MakeSFMap(const char *sname, const std::vector<SFORMAT *> &flat)
+{
+   SFMapCache &cache = SFMapCaches[sname];
+   bool match = (cache.names.size() == flat.size());
+
+   for(size_t i = 0; match && i < flat.size(); i++)
+      match = !strcmp(cache.names[i].c_str(), flat[i]->name);
+
+   if(match)
+      return(cache);
+
+   cache.sfmap.clear();
+   cache.names.resize(flat.size());
+
+   for(size_t i = 0; i < flat.size(); i++)
+      cache.names[i] = flat[i]->name;
+
+   for(size_t i = 0; i < flat.size(); i++)
+   {
+      const char *name = cache.names[i].c_str();
+
+      if(cache.sfmap.find(name) != cache.sfmap.end())
+         printf("Duplicate save state variable in internal emulator structures(CLUB THE PROGRAMMERS WITH BREADSTICKS): %s\n", name);
+
+      cache.sfmap[name] = i;
+   }
+
+   return(cache);
+}
+
 // Fast raw chunk reader
 static void DOReadChunk(StateMem *st, SFORMAT *sf)
 {
    while(sf->size || sf->name)       // Size can sometimes be zero, so also check for the text name.  
       // These two should both be zero only at the end of a struct.
    {
-      if(!sf->size || !sf->v)
+      if(!sf->size || !sf->v || (st->skip_rewind_tracked && (sf->flags & MDFNSTATE_REWIND_TRACKED)))
       {
          sf++;
          continue;
@@ -304,21 +391,25 @@ static void DOReadChunk(StateMem *st, SFORMAT *sf)
    }
 }
 
-static int ReadStateChunk(StateMem *st, SFORMAT *sf, int size)
+static int ReadStateChunk(StateMem *st, const char *sname, SFORMAT *sf, int size)
 {
    int temp;
 
    {
-      SFMap_t sfmap;
-      SFMap_t sfmap_found;	// Used for identifying variables that are missing in the save state.
+      SFFlat.clear();
+      FlattenSF(sf, SFFlat);
+
+      SFMapCache &cache = MakeSFMap(sname, SFFlat);
+      uint32_t next = 0;	// Variables are usually stored in SFORMAT order, so try the one after the last first.
 
-      MakeSFMap(sf, sfmap);
+      SFFound.assign(SFFlat.size(), 0);	// Used for identifying variables that are missing in the save state.
 
       temp = smem_tell(st);
       while(smem_tell(st) < (temp + size))
       {
          uint32_t recorded_size;	// In bytes
          uint8_t toa[1 + 256];	// Don't change to char unless cast toa[0] to unsigned to smem_read() and other places.
+         uint32_t index;
 
          if(smem_read(st, toa, 1) != 1)
          {
@@ -336,15 +427,22 @@ static int ReadStateChunk(StateMem *st, SFORMAT *sf, int size)
 
          smem_read32le(st, &recorded_size);
 
-         SFMap_t::iterator sfmit;
+         if(next < SFFlat.size() && !strcmp(cache.names[next].c_str(), (char *)toa + 1))
+            index = next;
+         else
+         {
+            SFMap_t::iterator sfmit = cache.sfmap.find((char *)toa + 1);
 
-         sfmit = sfmap.find((char *)toa + 1);
+            index = (sfmit != cache.sfmap.end()) ? sfmit->second : SFFlat.size();
+         }
 
-         if(sfmit != sfmap.end())
+         if(index < SFFlat.size())
          {
-            SFORMAT *tmp = sfmit->second;
+            SFORMAT *tmp = SFFlat[index];
             uint32_t expected_size = tmp->size;	// In bytes
 
+            next = index + 1;
+
             if(recorded_size != expected_size)
             {
                printf("Variable in save state wrong size: %s.  Need: %d, got: %d\n", toa + 1, expected_size, recorded_size);
@@ -356,7 +454,7 @@ static int ReadStateChunk(StateMem *st, SFORMAT *sf, int size)
             }
             else
             {
-               sfmap_found[tmp->name] = tmp;
+               SFFound[index] = 1;
 
                smem_read(st, (uint8_t *)tmp->v, expected_size);
 
@@ -391,11 +489,11 @@ static int ReadStateChunk(StateMem *st, SFORMAT *sf, int size)
          }
       } // while(...)
 
-      for(SFMap_t::const_iterator it = sfmap.begin(); it != sfmap.end(); it++)
+      for(size_t i = 0; i < SFFlat.size(); i++)
       {
-         if(sfmap_found.find(it->second->name) == sfmap_found.end())
+         if(!SFFound[i])
          {
-            printf("Variable missing from save state: %s\n", it->second->name);
+            printf("Variable missing from save state: %s\n", SFFlat[i]->name);
          }
       }
 
@@ -412,7 +510,17 @@ int MDFNSS_StateAction(void *st_p, int load, int data_only, std::vector <SSDescr
    StateMem *st = (StateMem*)st_p;
    std::vector<SSDescriptor>::iterator section;
 
-   if(load)
+   if(data_only)
+   {
+      for(section = sections.begin(); section != sections.end(); section++)
+      {
+         if(load)
+            DOReadChunk(st, section->sf);
+         else
+            DOWriteChunk(st, section->sf);
+      }
+   }
+   else if(load)
    {
       {
          char sname[32];
@@ -433,7 +541,7 @@ int MDFNSS_StateAction(void *st_p, int load, int data_only, std::vector <SSDescr
                // Yay, we found the section
                if(!strncmp(sname, section->name, 32))
                {
-                  if(!ReadStateChunk(st, section->sf, tmp_size))
+                  if(!ReadStateChunk(st, section->name, section->sf, tmp_size))
                   {
                      printf("Error reading chunk: %s\n", section->name);
                      return(0);
@@ -481,16 +589,19 @@ int MDFNSS_StateAction(void *st_p, int load, int data_only, SFORMAT *sf, const c
    std::vector <SSDescriptor> love;
 
    love.push_back(SSDescriptor(sf, name, optional));
-   return(MDFNSS_StateAction(st, load, 0, love));
+   return(MDFNSS_StateAction(st, load, data_only, love));
 }
 
-int MDFNSS_SaveSM(void *st_p, int, int, const void*, const void*, const void*)
+int MDFNSS_SaveSM(void *st_p, int, int data_only, const void*, const void*, const void*)
 {
    uint8_t header[32];
    StateMem *st = (StateMem*)st_p;
    static const char *header_magic = "MDFNSVST";
    int neowidth = 0, neoheight = 0;
 
+   if(data_only)
+      return(MDFNGameInfo->StateAction(st, 0, data_only));
+
    memset(header, 0, sizeof(header));
    memcpy(header, header_magic, 8);
 
@@ -509,12 +620,15 @@ int MDFNSS_SaveSM(void *st_p, int, int, const void*, const void*, const void*)
    return(1);
 }
 
-int MDFNSS_LoadSM(void *st_p, int, int)
+int MDFNSS_LoadSM(void *st_p, int, int data_only)
 {
    uint8_t header[32];
    uint32_t stateversion;
    StateMem *st = (StateMem*)st_p;
 
+   if(data_only)
+      return(MDFNGameInfo->StateAction(st, MEDNAFEN_VERSION_NUMERIC, data_only));
+
    smem_read(st, header, 32);
 
    if(memcmp(header, "MEDNAFENSVESTATE", 16) && memcmp(header, "MDFNSVST", 8))
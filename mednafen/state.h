@@ -8,6 +8,9 @@ typedef struct
    uint32_t len;
    uint32_t malloced;
    uint32_t initial_malloc; // A setting!
+   bool fixed;              // "data" is a caller-owned buffer of "malloced" bytes that is never realloc()'d;
+                            // writes past its end are dropped but still counted in "len".
+   bool skip_rewind_tracked; // Raw(data_only) states leave out the MDFNSTATE_REWIND_TRACKED variables.
 } StateMem;
 
 // Eh, we abuse the smem_* in-memory stream code
@@ -20,8 +23,10 @@ int32_t smem_seek(StateMem *st, uint32_t offset, int whence);
 int smem_write32le(StateMem *st, uint32_t b);
 int smem_read32le(StateMem *st, uint32_t *b);
 
-int MDFNSS_SaveSM(void *st, int, int, const void*, const void*, const void*);
-int MDFNSS_LoadSM(void *st, int, int);
+// With data_only set, the state is just the raw contents of every variable, without the
+// header and names, for fast snapshots that are only loaded back into the same session.
+int MDFNSS_SaveSM(void *st, int wantpreview, int data_only, const void*, const void*, const void*);
+int MDFNSS_LoadSM(void *st, int haspreview, int data_only);
 
 // Flag for a single, >= 1 byte native-endian variable
 #define MDFNSTATE_RLSB            0x80000000
@@ -37,6 +42,9 @@ int MDFNSS_LoadSM(void *st, int, int);
 
 #define MDFNSTATE_BOOL		  0x08000000
 
+// Memory the rewind code keeps its own copy of, see rewind.h
+#define MDFNSTATE_REWIND_TRACKED  0x04000000
+
 typedef struct {
    void *v;		// Pointer to the variable/array
    uint32_t size;		// Length, in bytes, of the data to be saved EXCEPT:
@@ -8,7 +8,7 @@
 #define MEDNAFEN_CORE_NAME_MODULE "psx"
 #define MEDNAFEN_CORE_NAME "Mednafen PSX"
 #define MEDNAFEN_CORE_VERSION "v0.9.38.6"
-#define MEDNAFEN_CORE_EXTENSIONS "cue|toc|ccd|m3u|pbp"
+#define MEDNAFEN_CORE_EXTENSIONS "cue|toc|ccd|m3u|pbp|chd"
 #define MEDNAFEN_CORE_GEOMETRY_BASE_W 320
 #define MEDNAFEN_CORE_GEOMETRY_BASE_H 240
 #define MEDNAFEN_CORE_GEOMETRY_MAX_W 700